@@ -10,59 +10,169 @@
 #include <zephyr/bluetooth/audio/vcp.h>
 #include <zephyr/bluetooth/audio/csip.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/sys/byteorder.h>
 
 #include "webusb.h"
 #include "message.h"
+#include "message_evt.h"
+#include "scan_ad.h"
+#include "stats.h"
 #include "broadcast_assistant.h"
+#include "scan_cache.h"
+#include "source_registry.h"
+#include "pa_sync_sched.h"
+#include "sink_op.h"
+#include "scan_batch.h"
+#include "device_store.h"
+#include "sink_discovery.h"
+#include "scan_sched.h"
+#include "scan_filter.h"
+#include "state_snapshot.h"
 
 LOG_MODULE_REGISTER(broadcast_assistant, LOG_LEVEL_INF);
 
-#define BT_NAME_LEN 30
-#define INVALID_BROADCAST_ID 0xFFFFFFFFU
 #define BIG_SYNC_FAILED 0xFFFFFFFFU
 
-#define PA_SYNC_SKIP                      5
-#define PA_SYNC_INTERVAL_TO_TIMEOUT_RATIO 20 /* Set the timeout relative to interval */
-
-#define MAX_NUMBER_OF_SOURCES 50
-
 typedef struct add_broadcast_code_data {
 	uint8_t src_id;
 	uint8_t broadcast_code[BT_AUDIO_BROADCAST_CODE_SIZE];
 } add_broadcast_code_data_t;
-typedef struct source_data {
-	bt_addr_le_t addr;
-	bool pa_recv;
-} source_data_t;
-typedef struct source_data_list {
-	uint8_t num;
-	source_data_t data[MAX_NUMBER_OF_SOURCES];
-} source_data_list_t;
-
-source_data_list_t source_data_list;
-struct scan_recv_data {
-	char bt_name[BT_NAME_LEN];
-	uint8_t bt_name_type;
-	char broadcast_name[BT_NAME_LEN];
-	uint32_t broadcast_id;
-	bool set_member;
-	bool has_bass;
-	bool has_pacs;
-	bool has_csis;
-};
 
 static bt_addr_le_t csis_members[CONFIG_BT_MAX_CONN];
 static uint8_t csis_members_cnt;
 static uint8_t csis_set_size;
 static uint8_t csis_sirk[BT_CSIP_SIRK_SIZE];
 
-static struct k_mutex source_data_list_mutex;
-static struct bt_le_per_adv_sync *pa_sync;
-static volatile bool pa_syncing;
+/* Parameters of the current sink operations, kept for sinks issued late */
+static struct bt_bap_bass_subgroup add_src_subgroups[CONFIG_BT_BAP_BASS_MAX_SUBGROUPS];
+static struct bt_bap_broadcast_assistant_add_src_param add_src_param;
+static struct bt_bap_bass_subgroup mod_src_subgroups[CONFIG_BT_BAP_BASS_MAX_SUBGROUPS];
+static struct bt_bap_broadcast_assistant_mod_src_param mod_src_param;
+static add_broadcast_code_data_t add_broadcast_code_data;
+static uint8_t rem_src_source_id;
+
+static int add_src_write(struct bt_conn *conn,
+			 const struct bt_bap_broadcast_assistant_add_src_param *param, uint32_t start);
+static int add_src_issue(struct bt_conn *conn);
+static int rem_src_issue(struct bt_conn *conn);
+static int bcode_issue(struct bt_conn *conn);
+
+static struct sink_op add_src_op = {
+	.sub_type = MESSAGE_SUBTYPE_ADD_SOURCE,
+	.issue = add_src_issue,
+};
+static struct sink_op rem_src_op = {
+	.sub_type = MESSAGE_SUBTYPE_REMOVE_SOURCE,
+	.issue = rem_src_issue,
+};
+static struct sink_op bcode_op = {
+	.sub_type = MESSAGE_SUBTYPE_BIG_BCODE,
+	.issue = bcode_issue,
+};
+
+/*
+ * SWITCH_SOURCE, the sinks are moved to the source of switch_src. The RES is
+ * sent when the BASS writes are done, the receive state changes they cause
+ * are summed up in one SOURCE_SWITCHED event once every sink has settled.
+ */
+static int switch_src_issue(struct bt_conn *conn);
+static bool switch_src_filter(struct bt_conn *conn);
+
+static struct sink_op switch_src_op = {
+	.sub_type = MESSAGE_SUBTYPE_SWITCH_SOURCE,
+	.issue = switch_src_issue,
+	.filter = switch_src_filter,
+};
+
+enum switch_src_step {
+	SWITCH_SRC_IDLE,
+	SWITCH_SRC_MODIFY, /* Same broadcast source, Modify Source to the new BIS sync */
+	SWITCH_SRC_STOP,   /* Modify Source to stop syncing to the old source */
+	SWITCH_SRC_REMOVE,
+	SWITCH_SRC_ADD,
+	SWITCH_SRC_ABORTED, /* Write in flight when the switch was dropped by RESET */
+};
+
+/* BT_DATA_SINK_STATUS and BT_DATA_SOURCE_ID of a sink in SOURCE_SWITCHED */
+#define SWITCH_SRC_RECORD_LEN (MESSAGE_EVT_FIELD_SINK_STATUS + MESSAGE_EVT_FIELD_U8)
+
+static struct {
+	/* Kept apart from add_src_param, which a later ADD_SOURCE overwrites */
+	struct bt_bap_broadcast_assistant_add_src_param add_param;
+	struct bt_bap_bass_subgroup subgroups[CONFIG_BT_BAP_BASS_MAX_SUBGROUPS];
+	uint32_t start; /* For STATS_LATENCY_ADD_SOURCE */
+	uint32_t broadcast_id;
+	uint8_t num_subgroups;
+	uint32_t bis_sync[CONFIG_BT_BAP_BASS_MAX_SUBGROUPS];
+	bool has_bcode;
+	uint8_t bcode[BT_AUDIO_BROADCAST_CODE_SIZE];
+	uint8_t settling; /* Sinks without a result yet */
+	struct bt_bap_bass_subgroup stop_subgroups[CONFIG_BT_BAP_BASS_MAX_SUBGROUPS];
+	struct bt_bap_broadcast_assistant_mod_src_param mod_param;
+	/* Result of each settled sink */
+	uint8_t ltv[CONFIG_BT_MAX_CONN * SWITCH_SRC_RECORD_LEN];
+	uint16_t ltv_len;
+} switch_src;
+static K_MUTEX_DEFINE(switch_src_mutex);
+
+static void switch_src_timeout_work_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(switch_src_timeout_work, switch_src_timeout_work_handler);
+
+/* Volume of a coordinated set, one operation runs at a time as they share the set lock */
+static int set_volume_issue(struct bt_conn *conn);
+static int set_mute_issue(struct bt_conn *conn);
+static int step_volume_issue(struct bt_conn *conn);
+static bool set_volume_filter(struct bt_conn *conn);
+static void set_volume_complete(struct sink_op *op, int32_t rc, const uint8_t *ltv,
+				uint16_t ltv_len);
+
+static struct sink_op set_volume_op = {
+	.sub_type = MESSAGE_SUBTYPE_SET_SET_VOLUME,
+	.issue = set_volume_issue,
+	.filter = set_volume_filter,
+	.complete = set_volume_complete,
+};
+static struct sink_op set_mute_op = {
+	.sub_type = MESSAGE_SUBTYPE_SET_SET_MUTE,
+	.issue = set_mute_issue,
+	.filter = set_volume_filter,
+	.complete = set_volume_complete,
+};
+static struct sink_op step_volume_op = {
+	.sub_type = MESSAGE_SUBTYPE_STEP_SET_VOLUME,
+	.issue = step_volume_issue,
+	.filter = set_volume_filter,
+	.complete = set_volume_complete,
+};
+
+enum set_volume_state {
+	SET_VOLUME_IDLE,
+	SET_VOLUME_LOCKING,
+	SET_VOLUME_WRITING,
+	SET_VOLUME_RELEASING,
+};
 
-static K_SEM_DEFINE(sem_rem_source, 1U, 1U);
-static K_SEM_DEFINE(sem_add_source, 1U, 1U);
+static struct {
+	enum set_volume_state state;
+	struct sink_op *op;
+	struct bt_conn *conn; /* Sink the command was sent for, the set if it is a member */
+	bool has_sirk;
+	uint8_t sirk[BT_CSIP_SIRK_SIZE];
+	int16_t value; /* Volume, mute state or step, depending on the operation */
+	/* Members locked while writing, empty when the set is not locked */
+	const struct bt_csip_set_coordinator_set_member *members[CONFIG_BT_MAX_CONN];
+	const struct bt_csip_set_coordinator_set_info *set_info;
+	uint8_t members_cnt;
+	/* Result kept while the set is released */
+	int32_t rc;
+	uint8_t ltv[CONFIG_BT_MAX_CONN * MESSAGE_EVT_FIELD_SINK_STATUS];
+	uint16_t ltv_len;
+} set_vol;
+
+static void set_volume_timeout_work_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(set_volume_timeout_work, set_volume_timeout_work_handler);
 
 static void broadcast_assistant_discover_cb(struct bt_conn *conn, int err,
 					    uint8_t recv_state_count);
@@ -72,6 +182,7 @@ static void broadcast_assistant_recv_state_removed_cb(struct bt_conn *conn, uint
 static void broadcast_assistant_add_src_cb(struct bt_conn *conn, int err);
 static void broadcast_assistant_mod_src_cb(struct bt_conn *conn, int err);
 static void broadcast_assistant_rem_src_cb(struct bt_conn *conn, int err);
+static void broadcast_assistant_broadcast_code_cb(struct bt_conn *conn, int err);
 static void connected_cb(struct bt_conn *conn, uint8_t err);
 static void disconnected_cb(struct bt_conn *conn, uint8_t reason);
 static void security_changed_cb(struct bt_conn *conn, bt_security_t level,
@@ -80,11 +191,10 @@ static void identity_resolved_cb(struct bt_conn *conn,
 				 const bt_addr_le_t *rpa,
 				 const bt_addr_le_t *identity);
 static void restart_scanning_if_needed(void);
-static bool device_found(struct bt_data *data, void *user_data);
-static bool scan_for_source(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad,
-			    struct scan_recv_data *sr_data);
-static bool scan_for_sink(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad,
-			  struct scan_recv_data *sr_data);
+static bool scan_for_source(const struct bt_le_scan_recv_info *info,
+			    const struct scan_ad_info *ad_info);
+static bool scan_for_sink(const struct bt_le_scan_recv_info *info,
+			  const struct scan_ad_info *ad_info);
 static void scan_recv_cb(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad);
 static void scan_timeout_cb(void);
 
@@ -93,7 +203,6 @@ static void vcs_discover_cb(struct bt_vcp_vol_ctlr *vol_ctlr, int err, uint8_t v
 static void vcs_write_cb(struct bt_vcp_vol_ctlr *vol_ctlr, int err);
 static void vcs_state_cb(struct bt_vcp_vol_ctlr *vol_ctlr, int err, uint8_t volume, uint8_t mute);
 static void vcs_flags_cb(struct bt_vcp_vol_ctlr *vol_ctlr, int err, uint8_t flags);
-static void vcs_discover_work_handler(struct k_work *work);
 
 /* CSIS */
 static void csip_lock_set_cb(int err);
@@ -103,11 +212,7 @@ static void csip_discover_cb(struct bt_conn *conn,
 			     size_t set_count);
 static void csip_ordered_access_cb(const struct bt_csip_set_coordinator_set_info *set_info, int err,
 				  bool locked, struct bt_csip_set_coordinator_set_member *member);
-static void csis_discover_work_handler(struct k_work *work);
 
-static void pa_sync_delete_work_handler(struct k_work *work);
-static void pa_sync_create_timeout_work_handler(struct k_work *work);
-static void pa_sync_create_timer_handler(struct k_timer *dummy);
 static void reset_csis_data(uint8_t set_size, uint8_t sirk[BT_CSIP_SIRK_SIZE]);
 
 static struct bt_le_scan_cb scan_callbacks = {
@@ -122,6 +227,7 @@ static struct bt_bap_broadcast_assistant_cb broadcast_assistant_callbacks = {
 	.add_src = broadcast_assistant_add_src_cb,
 	.mod_src = broadcast_assistant_mod_src_cb,
 	.rem_src = broadcast_assistant_rem_src_cb,
+	.broadcast_code = broadcast_assistant_broadcast_code_cb,
 };
 
 BT_CONN_CB_DEFINE(conn_callbacks) = {
@@ -151,150 +257,419 @@ static struct bt_csip_set_coordinator_cb csip_callbacks = {
 	.ordered_access = csip_ordered_access_cb,
 };
 
+static int sink_discovery_issue(struct bt_conn *conn, enum sink_discovery_step step);
+
+static const struct sink_discovery_cb discovery_callbacks = {
+	.issue = sink_discovery_issue,
+};
+
 static uint8_t ba_scan_mode;
-static uint32_t ba_source_broadcast_id;
-static uint8_t ba_source_id; /* Source ID of the receive state */
-static struct bt_bap_scan_delegator_recv_state ba_recv_state[CONFIG_BT_MAX_CONN] = {0};
-static struct bt_vcp_vol_ctlr *vcs_ctlr;
-static struct bt_conn *vcs_conn;
-static struct bt_conn *csis_conn;
 
+/* Per sink state, indexed by bt_conn_index() */
+struct ba_sink {
+	struct bt_conn *conn; /* NULL when the slot is unused */
+	bool bass_found;      /* SINK_CONNECTED sent */
+	struct bt_bap_scan_delegator_recv_state recv_state;
+	struct bt_vcp_vol_ctlr *vol_ctlr;
+	uint32_t source_broadcast_id; /* Broadcast ID of the source added to the sink */
+	uint8_t source_id;            /* Source ID the sink assigned to it */
+	bool has_source_id;
+	/* Set membership, discovered or from the device store (then csip_member is NULL) */
+	const struct bt_csip_set_coordinator_set_member *csip_member;
+	uint8_t sirk[BT_CSIP_SIRK_SIZE];
+	uint8_t set_rank;
+	uint8_t set_size;
+	bool has_sirk;
+	uint8_t volume; /* Last reported volume and mute */
+	uint8_t mute;
+	bool has_volume;
+	bool past_pending; /* SyncInfo requested before we were synced to the source */
+	bool past_monitor; /* Holds the PA_MONITOR_PAST monitor of past_addr */
+	bt_addr_le_t past_addr;
+	bool add_src_timing; /* BIS sync after ADD_SOURCE not measured yet */
+	uint32_t add_src_start;
+	enum switch_src_step switch_step; /* BASS write of SWITCH_SOURCE in flight */
+	bool switch_settling;             /* SWITCH_SOURCE result not known yet */
+	bool switch_bcode_req;            /* Broadcast code requested, not written yet */
+	uint8_t switch_bcode_src_id;
+	bool repairing; /* Known sink that lost its bond, being paired again */
+};
+
+static struct ba_sink ba_sinks[CONFIG_BT_MAX_CONN];
+/* Held while a sink is (dis)connected, for readers outside the Bluetooth thread */
+static K_MUTEX_DEFINE(ba_sinks_mutex);
+
+/* ADD_SOURCE waits for a PA sync of its own, so that the sinks can be sent PAST */
+static uint32_t add_src_start;
+static atomic_t add_src_waiting;
+
+static void add_src_start_work_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(add_src_start_work, add_src_start_work_handler);
 
-K_WORK_DEFINE(vcs_discover_work, vcs_discover_work_handler);
-K_WORK_DEFINE(csis_discover_work, csis_discover_work_handler);
-K_WORK_DEFINE(pa_sync_create_timeout_work, pa_sync_create_timeout_work_handler);
-K_WORK_DEFINE(pa_sync_delete_work, pa_sync_delete_work_handler);
+/*
+ * Known sinks being connected by CONNECT_KNOWN, one connection is created at a
+ * time. Run on the command workqueue, which also writes the list and may block.
+ */
+static bt_addr_le_t connect_known_addrs[DEVICE_STORE_SIZE];
+static size_t connect_known_cnt;
+static size_t connect_known_next;
 
-K_TIMER_DEFINE(pa_sync_create_timer, pa_sync_create_timer_handler, NULL);
+static void connect_known_work_handler(struct k_work *work);
+K_WORK_DEFINE(connect_known_work, connect_known_work_handler);
 
 /*
  * Private functions
  */
-static void pa_sync_create_timeout_work_handler(struct k_work *work)
+static struct ba_sink *ba_sink_get(struct bt_conn *conn)
+{
+	return &ba_sinks[bt_conn_index(conn)];
+}
+
+static struct ba_sink *ba_sink_lookup(const bt_addr_le_t *bt_addr_le)
 {
-	LOG_WRN("PA sync create timeout");
-	if (pa_syncing) {
-		k_work_submit(&pa_sync_delete_work);
-		pa_syncing = false;
+	for (int i = 0; i < ARRAY_SIZE(ba_sinks); i++) {
+		if (ba_sinks[i].conn && bt_addr_le_eq(bt_conn_get_dst(ba_sinks[i].conn), bt_addr_le)) {
+			return &ba_sinks[i];
+		}
 	}
+
+	return NULL;
 }
 
-static void pa_sync_delete_work_handler(struct k_work *work)
+static struct ba_sink *ba_sink_lookup_vol_ctlr(const struct bt_vcp_vol_ctlr *vol_ctlr)
 {
-	int err;
+	for (int i = 0; i < ARRAY_SIZE(ba_sinks); i++) {
+		if (ba_sinks[i].conn && ba_sinks[i].vol_ctlr == vol_ctlr) {
+			return &ba_sinks[i];
+		}
+	}
 
-	LOG_INF("pa_sync_delete");
+	return NULL;
+}
 
-	err = bt_le_per_adv_sync_delete(pa_sync);
-	if (err) {
-		LOG_INF("bt_le_per_adv_sync_delete failed (%d)", err);
+static const struct bt_csip_set_coordinator_set_info *
+csip_set_info_get(const struct bt_csip_set_coordinator_set_member *member,
+		  const uint8_t sirk[BT_CSIP_SIRK_SIZE])
+{
+	for (size_t i = 0; i < ARRAY_SIZE(member->insts); i++) {
+		if (memcmp(member->insts[i].info.sirk, sirk, BT_CSIP_SIRK_SIZE) == 0) {
+			return &member->insts[i].info;
+		}
 	}
+
+	return NULL;
 }
 
-static void vcs_discover_work_handler(struct k_work *work)
+static bool set_volume_filter(struct bt_conn *conn)
 {
-	int err;
+	const struct ba_sink *sink = ba_sink_get(conn);
 
-	LOG_INF("VCS discover...");
-	err = bt_vcp_vol_ctlr_discover(vcs_conn, &vcs_ctlr);
-	if (err != 0) {
-		LOG_ERR("Failed to discover vcs (err %d)", err);
-		vcs_conn = NULL;
+	if (sink->vol_ctlr == NULL) {
+		return false;
 	}
+
+	if (!set_vol.has_sirk) {
+		/* Not a set member, only the sink itself */
+		return conn == set_vol.conn;
+	}
+
+	return sink->has_sirk && memcmp(sink->sirk, set_vol.sirk, BT_CSIP_SIRK_SIZE) == 0;
 }
 
-static void csis_discover_work_handler(struct k_work *work)
+static int set_volume_issue(struct bt_conn *conn)
 {
-	int err;
+	return bt_vcp_vol_ctlr_set_vol(ba_sink_get(conn)->vol_ctlr, set_vol.value);
+}
 
-	LOG_INF("CSIS discover...");
-	err = bt_csip_set_coordinator_discover(csis_conn);
-	if (err != 0) {
-		LOG_ERR("bt_csip_set_coordinator_discover failed (err %d)", err);
-		csis_conn = NULL;
+static int set_mute_issue(struct bt_conn *conn)
+{
+	struct bt_vcp_vol_ctlr *vol_ctlr = ba_sink_get(conn)->vol_ctlr;
+
+	return (set_vol.value == BT_VCP_STATE_UNMUTED) ? bt_vcp_vol_ctlr_unmute(vol_ctlr)
+						      : bt_vcp_vol_ctlr_mute(vol_ctlr);
+}
+
+static int step_volume_issue(struct bt_conn *conn)
+{
+	const struct ba_sink *sink = ba_sink_get(conn);
+
+	if (!sink->has_volume) {
+		return -ENODATA;
 	}
+
+	/* Relative to the volume of each member, the balance between them is kept */
+	return bt_vcp_vol_ctlr_set_vol(sink->vol_ctlr,
+				       CLAMP(sink->volume + set_vol.value, 0, UINT8_MAX));
 }
 
-static void pa_sync_create_timer_handler(struct k_timer *dummy)
+static void set_volume_finish(int32_t rc, const uint8_t *ltv, uint16_t ltv_len)
 {
-    k_work_submit(&pa_sync_create_timeout_work);
+	struct sink_op *op = set_vol.op;
+
+	(void)k_work_cancel_delayable(&set_volume_timeout_work);
+	set_vol.op = NULL;
+	set_vol.members_cnt = 0;
+	set_vol.state = SET_VOLUME_IDLE;
+
+	if (op) {
+		message_cmd_complete_ltv(op->sub_type, rc, ltv, ltv_len);
+	}
 }
 
-static void reset_source_data(void)
+/*
+ * Answers the running operation with rc. A lock that is held, or still being
+ * taken, is released first and new operations are busy until then. Called
+ * again (e.g. by the timeout) while releasing, it gives up on the set.
+ */
+static void set_volume_abort(int32_t rc)
 {
-	k_mutex_lock(&source_data_list_mutex, K_FOREVER);
-	for (int i = 0; i < MAX_NUMBER_OF_SOURCES; i++) {
-		bt_addr_le_copy(&source_data_list.data[i].addr, BT_ADDR_LE_NONE);
-		source_data_list.data[i].pa_recv = false;
+	struct sink_op *op = set_vol.op;
+	bool releasing;
+
+	if (set_vol.state == SET_VOLUME_IDLE) {
+		return;
+	}
+
+	if (op == NULL) {
+		LOG_WRN("Set not released, left alone");
+		set_volume_finish(0, NULL, 0);
+		return;
+	}
 
+	switch (set_vol.state) {
+	case SET_VOLUME_LOCKING:
+		/* Released by csip_lock_set_cb() */
+	case SET_VOLUME_RELEASING:
+		releasing = true;
+		break;
+	case SET_VOLUME_WRITING:
+		releasing = set_vol.members_cnt > 0 &&
+			    bt_csip_set_coordinator_release(set_vol.members, set_vol.members_cnt,
+							    set_vol.set_info) == 0;
+		break;
+	default:
+		releasing = false;
+		break;
+	}
+
+	if (!releasing) {
+		set_volume_finish(rc, NULL, 0);
+		return;
 	}
-	source_data_list.num = 0;
-	k_mutex_unlock(&source_data_list_mutex);
+
+	set_vol.op = NULL;
+	set_vol.state = SET_VOLUME_RELEASING;
+	k_work_reschedule(&set_volume_timeout_work, K_MSEC(CONFIG_CMD_TIMEOUT_MS));
+
+	message_cmd_complete(op->sub_type, rc);
 }
 
-static void source_data_add(const bt_addr_le_t *addr)
+static void set_volume_timeout_work_handler(struct k_work *work)
 {
-	int i;
-	bool new_source = true;
-	char addr_str[BT_ADDR_LE_STR_LEN];
+	LOG_WRN("Set volume timed out (state %d)", set_vol.state);
+	set_volume_abort(-ETIMEDOUT);
+}
 
-	bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
+/* A member leaving the locked set drops the operation, the others are released */
+static void set_volume_disconnected(struct bt_conn *conn)
+{
+	const struct bt_csip_set_coordinator_set_member *member = ba_sink_get(conn)->csip_member;
 
-	k_mutex_lock(&source_data_list_mutex, K_FOREVER);
-	for (i = 0; i < source_data_list.num; i++) {
-		if (bt_addr_le_cmp(addr, &source_data_list.data[i].addr) == 0) {
-			LOG_DBG("Source already added (%s)", addr_str);
-			new_source = false;
+	for (int i = 0; i < set_vol.members_cnt; i++) {
+		if (set_vol.members[i] == member) {
+			set_vol.members[i] = set_vol.members[--set_vol.members_cnt];
+			set_volume_abort(-ENOTCONN);
 			break;
 		}
 	}
+}
+
+static void set_volume_complete(struct sink_op *op, int32_t rc, const uint8_t *ltv,
+				uint16_t ltv_len)
+{
+	int err;
+
+	if (set_vol.state != SET_VOLUME_WRITING || op != set_vol.op) {
+		/* Aborted while writing */
+		return;
+	}
+
+	if (set_vol.members_cnt > 0) {
+		set_vol.rc = rc;
+		set_vol.ltv_len = MIN(ltv_len, sizeof(set_vol.ltv));
+		memcpy(set_vol.ltv, ltv, set_vol.ltv_len);
+		set_vol.state = SET_VOLUME_RELEASING;
+
+		err = bt_csip_set_coordinator_release(set_vol.members, set_vol.members_cnt,
+						      set_vol.set_info);
+		if (err == 0) {
+			/* RES is sent when the set has been released */
+			return;
+		}
 
-	if (new_source && i < MAX_NUMBER_OF_SOURCES) {
-		bt_addr_le_copy(&source_data_list.data[i].addr, addr);
-		source_data_list.data[i].pa_recv = false;
-		source_data_list.num++;
-		LOG_INF("Source added (%s), (%u)", addr_str, source_data_list.num);
+		LOG_ERR("Failed to release set (err %d)", err);
 	}
 
-	k_mutex_unlock(&source_data_list_mutex);
+	set_volume_finish(rc, ltv, ltv_len);
 }
 
-static bool source_data_get_pa_recv(const bt_addr_le_t *addr)
+static int set_volume_start(struct sink_op *op, const bt_addr_le_t *bt_addr_le, int16_t value)
 {
-	bool pa_recv = false;
+	const struct ba_sink *sink;
+	bool lockable;
+	uint8_t cnt = 0;
+	int err;
 
-	k_mutex_lock(&source_data_list_mutex, K_FOREVER);
-	for (int i = 0; i < source_data_list.num; i++) {
-		if (bt_addr_le_cmp(addr, &source_data_list.data[i].addr) == 0 &&
-		    source_data_list.data[i].pa_recv) {
-			pa_recv = true;
-			break;
+	if (set_vol.state != SET_VOLUME_IDLE) {
+		LOG_WRN("Set volume busy");
+
+		return -EBUSY;
+	}
+
+	sink = ba_sink_lookup(bt_addr_le);
+	if (!sink) {
+		LOG_ERR("Failed to lookup connection");
+
+		return -EINVAL;
+	}
+
+	set_vol.conn = sink->conn;
+	set_vol.value = value;
+	set_vol.has_sirk = sink->has_sirk;
+	memcpy(set_vol.sirk, sink->sirk, BT_CSIP_SIRK_SIZE);
+	set_vol.members_cnt = 0;
+	set_vol.set_info = NULL;
+
+	/* The set is locked when every member taking part has been discovered by CSIP */
+	lockable = set_vol.has_sirk;
+	for (int i = 0; i < ARRAY_SIZE(ba_sinks); i++) {
+		if (!ba_sinks[i].conn || !set_volume_filter(ba_sinks[i].conn)) {
+			continue;
+		}
+
+		cnt++;
+		if (ba_sinks[i].csip_member == NULL) {
+			lockable = false;
+		} else {
+			set_vol.members[set_vol.members_cnt++] = ba_sinks[i].csip_member;
+		}
+	}
+
+	if (cnt == 0) {
+		LOG_ERR("No volume control for this set");
+
+		return -EINVAL;
+	}
+
+	if (lockable) {
+		set_vol.set_info = csip_set_info_get(set_vol.members[0], set_vol.sirk);
+		lockable = set_vol.set_info != NULL && set_vol.set_info->lockable;
+	}
+
+	set_vol.op = op;
+	k_work_reschedule(&set_volume_timeout_work, K_MSEC(CONFIG_CMD_TIMEOUT_MS));
+
+	if (lockable) {
+		set_vol.state = SET_VOLUME_LOCKING;
+		err = bt_csip_set_coordinator_lock(set_vol.members, set_vol.members_cnt,
+						   set_vol.set_info);
+		if (err == 0) {
+			/* Written when the set has been locked */
+			return 0;
 		}
+
+		LOG_WRN("Failed to lock set (err %d), writing unlocked", err);
 	}
-	k_mutex_unlock(&source_data_list_mutex);
 
-	return pa_recv;
+	set_vol.members_cnt = 0;
+	set_vol.state = SET_VOLUME_WRITING;
+	sink_op_start(op);
+
+	return 0;
 }
 
-static void source_data_set_pa_recv(const bt_addr_le_t *addr)
+static int sink_discovery_issue(struct bt_conn *conn, enum sink_discovery_step step)
 {
-	k_mutex_lock(&source_data_list_mutex, K_FOREVER);
-	for (int i = 0; i < source_data_list.num; i++) {
-		if (bt_addr_le_cmp(addr, &source_data_list.data[i].addr) == 0) {
-			source_data_list.data[i].pa_recv = true;
-			break;
+	int err;
+
+	switch (step) {
+	case SINK_DISCOVERY_BASS:
+		LOG_INF("Broadcast assistant discover...");
+		err = bt_bap_broadcast_assistant_discover(conn);
+		if (err && err != -EBUSY && err != -ENOMEM) {
+			LOG_ERR("Failed to broadcast assistant discover (err %d)", err);
+			err = bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+			if (err) {
+				LOG_ERR("Failed to disconnect (err %d)", err);
+			}
+			restart_scanning_if_needed();
+
+			return -EIO;
 		}
+
+		return err;
+	case SINK_DISCOVERY_VCS:
+		LOG_INF("VCS discover...");
+		return bt_vcp_vol_ctlr_discover(conn, &ba_sink_get(conn)->vol_ctlr);
+	case SINK_DISCOVERY_CSIS:
+		LOG_INF("CSIS discover...");
+		return bt_csip_set_coordinator_discover(conn);
+	default:
+		return -EINVAL;
+	}
+}
+
+static void send_sink_connected(const bt_addr_le_t *bt_addr_le, int err)
+{
+	struct net_buf *evt_msg;
+
+	evt_msg = MESSAGE_EVT_ALLOC(SINK_CONNECTED, 0);
+	if (evt_msg) {
+		message_evt_add_addr(evt_msg, bt_addr_le);
+		message_evt_add_err(evt_msg, err);
+		message_send_net_buf_event(MESSAGE_SUBTYPE_SINK_CONNECTED, evt_msg);
+	}
+}
+
+static void send_set_identifier_found(const bt_addr_le_t *bt_addr_le, uint8_t rank,
+				      uint8_t set_size, const uint8_t sirk[BT_CSIP_SIRK_SIZE])
+{
+	struct net_buf *evt_msg;
+
+	evt_msg = MESSAGE_EVT_ALLOC(SET_IDENTIFIER_FOUND, 0);
+	if (evt_msg) {
+		message_evt_add_addr(evt_msg, bt_addr_le);
+		message_evt_add_u8(evt_msg, BT_DATA_SET_RANK, rank);
+		message_evt_add_u8(evt_msg, BT_DATA_SET_SIZE, set_size);
+		message_evt_add_mem(evt_msg, BT_DATA_SIRK, sirk, BT_CSIP_SIRK_SIZE);
+		message_send_net_buf_event(MESSAGE_SUBTYPE_SET_IDENTIFIER_FOUND, evt_msg);
+	}
+}
+
+static void connect_known_work_handler(struct k_work *work)
+{
+	while (connect_known_next < connect_known_cnt) {
+		bt_addr_le_t *addr = &connect_known_addrs[connect_known_next++];
+		int err;
+
+		err = broadcast_assistant_connect_to_sink(addr);
+		if (err == 0) {
+			/* The next sink is connected from connected_cb */
+			return;
+		}
+
+		send_sink_connected(addr, err);
 	}
-	k_mutex_unlock(&source_data_list_mutex);
 }
 
 static void broadcast_assistant_discover_cb(struct bt_conn *conn, int err, uint8_t recv_state_count)
 {
+	struct device_store_sink known;
 	const bt_addr_le_t *bt_addr_le;
 	char addr_str[BT_ADDR_LE_STR_LEN];
-	struct net_buf *evt_msg;
 
 	LOG_INF("Broadcast assistant discover callback (%p, %d, %u)", (void *)conn, err, recv_state_count);
+	sink_discovery_done(conn, SINK_DISCOVERY_BASS);
 	if (err) {
 		err = bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
 		if (err) {
@@ -308,34 +683,23 @@ static void broadcast_assistant_discover_cb(struct bt_conn *conn, int err, uint8
 	bt_conn_unref(conn); /* TODO: Why is this needed? */
 
 	/* Succesful connected to sink */
-	evt_msg = message_alloc_tx();
 	bt_addr_le = bt_conn_get_dst(conn);
 	bt_addr_le_to_str(bt_addr_le, addr_str, sizeof(addr_str));
 	LOG_DBG("Connected to %s", addr_str);
 
-	/* Bluetooth LE Device Address */
-	net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-	net_buf_add_u8(evt_msg, bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-	net_buf_add_u8(evt_msg, bt_addr_le->type);
-	net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
+	send_sink_connected(bt_addr_le, 0 /* OK */);
+	ba_sink_get(conn)->bass_found = true;
 
-	/* error code */
-	net_buf_add_u8(evt_msg, 1 /* len of BT_DATA type */ + sizeof(int32_t));
-	net_buf_add_u8(evt_msg, BT_DATA_ERROR_CODE);
-	net_buf_add_le32(evt_msg, 0 /* OK */);
+	/* VCS and CSIS are discovered in parallel, see security_changed_cb */
+	if (device_store_get(bt_addr_le, &known) && (known.flags & DEVICE_STORE_HAS_CSIS)) {
+		/* Set info does not change, report the stored one instead of discovering it */
+		LOG_INF("Known set member (rank %u, size %u)", known.set_rank, known.set_size);
+		send_set_identifier_found(bt_addr_le, known.set_rank, known.set_size, known.sirk);
 
-	message_send_net_buf_event(MESSAGE_SUBTYPE_SINK_CONNECTED, evt_msg);
-
-	/* Discover VCS */
-	if (vcs_conn == NULL) {
-		vcs_conn = conn;
-		k_work_submit(&vcs_discover_work);
-	}
-
-	/* Discover CSIS */
-	if (csis_conn == NULL) {
-		csis_conn = conn;
-		k_work_submit(&csis_discover_work);
+		memcpy(ba_sink_get(conn)->sirk, known.sirk, BT_CSIP_SIRK_SIZE);
+		ba_sink_get(conn)->set_rank = known.set_rank;
+		ba_sink_get(conn)->set_size = known.set_size;
+		ba_sink_get(conn)->has_sirk = true;
 	}
 
 	restart_scanning_if_needed();
@@ -347,18 +711,27 @@ static void vcs_discover_cb(struct bt_vcp_vol_ctlr *vol_ctlr, int err, uint8_t v
 	const bt_addr_le_t *bt_addr_le;
 	char addr_str[BT_ADDR_LE_STR_LEN];
 	struct net_buf *evt_msg;
+	struct ba_sink *sink;
 	struct bt_conn *conn;
 
-	if (err != 0) {
-		LOG_WRN("Volume control service could not be discovered (%d)", err);
-		vcs_conn = NULL;
+	if (bt_vcp_vol_ctlr_conn_get(vol_ctlr, &conn) != 0) {
+		LOG_ERR("Volume control conn error\n");
+
+		/* The discovery step is still completed, without volume control */
+		sink = ba_sink_lookup_vol_ctlr(vol_ctlr);
+		if (sink) {
+			sink->vol_ctlr = NULL;
+			sink_discovery_done(sink->conn, SINK_DISCOVERY_VCS);
+		}
 
 		return;
 	}
 
-	if (bt_vcp_vol_ctlr_conn_get(vol_ctlr, &conn) != 0) {
-		LOG_ERR("Volume control conn error\n");
-		vcs_conn = NULL;
+	sink_discovery_done(conn, SINK_DISCOVERY_VCS);
+
+	if (err != 0) {
+		LOG_WRN("Volume control service could not be discovered (%d)", err);
+		ba_sink_get(conn)->vol_ctlr = NULL;
 
 		return;
 	}
@@ -366,28 +739,30 @@ static void vcs_discover_cb(struct bt_vcp_vol_ctlr *vol_ctlr, int err, uint8_t v
 	LOG_INF("Volume control discover callback (vocs:%u, aics:%u)", vocs_count, aics_count);
 
 	/* Send volume control status message */
-	evt_msg = message_alloc_tx();
 	bt_addr_le = bt_conn_get_dst(conn);
 	bt_addr_le_to_str(bt_addr_le, addr_str, sizeof(addr_str));
 	LOG_DBG("Volume discover %s", addr_str);
 
-	/* Bluetooth LE Device Address */
-	net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-	net_buf_add_u8(evt_msg,
-		       bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-	net_buf_add_u8(evt_msg, bt_addr_le->type);
-	net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
-
-	message_send_net_buf_event(MESSAGE_SUBTYPE_VOLUME_CONTROL_FOUND, evt_msg);
-
-	vcs_conn = NULL;
+	evt_msg = MESSAGE_EVT_ALLOC(VOLUME_CONTROL_FOUND, 0);
+	if (evt_msg) {
+		message_evt_add_addr(evt_msg, bt_addr_le);
+		message_send_net_buf_event(MESSAGE_SUBTYPE_VOLUME_CONTROL_FOUND, evt_msg);
+	}
+	device_store_set_vcs(bt_addr_le);
 }
 
 static void vcs_write_cb(struct bt_vcp_vol_ctlr *vol_ctlr, int err)
 {
+	struct bt_conn *conn;
+
 	if (err != 0) {
 		LOG_WRN("VCP: Write failed (%d)\n", err);
-		return;
+	}
+
+	if (bt_vcp_vol_ctlr_conn_get(vol_ctlr, &conn) == 0) {
+		sink_op_done(&set_volume_op, conn, err);
+		sink_op_done(&set_mute_op, conn, err);
+		sink_op_done(&step_volume_op, conn, err);
 	}
 }
 
@@ -406,33 +781,26 @@ static void vcs_state_cb(struct bt_vcp_vol_ctlr *vol_ctlr, int err, uint8_t volu
 		return;
 	}
 
+	if (err == 0) {
+		ba_sink_get(conn)->volume = volume;
+		ba_sink_get(conn)->mute = mute;
+		ba_sink_get(conn)->has_volume = true;
+	}
+
 	/* Send volume control status message */
-	evt_msg = message_alloc_tx();
 	bt_addr_le = bt_conn_get_dst(conn);
 	bt_addr_le_to_str(bt_addr_le, addr_str, sizeof(addr_str));
 	LOG_DBG("Volume status from %s", addr_str);
 
-	/* Bluetooth LE Device Address */
-	net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-	net_buf_add_u8(evt_msg,
-		       bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-	net_buf_add_u8(evt_msg, bt_addr_le->type);
-	net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
-
-	/* volume */
-	net_buf_add_u8(evt_msg, 2);
-	net_buf_add_u8(evt_msg, BT_DATA_VOLUME);
-	net_buf_add_u8(evt_msg, volume);
-
-	/* mute */
-	net_buf_add_u8(evt_msg, 2);
-	net_buf_add_u8(evt_msg, BT_DATA_MUTE);
-	net_buf_add_u8(evt_msg, mute);
+	evt_msg = MESSAGE_EVT_ALLOC(VOLUME_STATE, 0);
+	if (!evt_msg) {
+		return;
+	}
 
-	/* error code */
-	net_buf_add_u8(evt_msg, 1 /* len of BT_DATA type */ + sizeof(int32_t));
-	net_buf_add_u8(evt_msg, BT_DATA_ERROR_CODE);
-	net_buf_add_le32(evt_msg, err);
+	message_evt_add_addr(evt_msg, bt_addr_le);
+	message_evt_add_u8(evt_msg, BT_DATA_VOLUME, volume);
+	message_evt_add_u8(evt_msg, BT_DATA_MUTE, mute);
+	message_evt_add_err(evt_msg, err);
 
 	message_send_net_buf_event(MESSAGE_SUBTYPE_VOLUME_STATE, evt_msg);
 }
@@ -459,116 +827,490 @@ static bool csis_member_is_discovered(const bt_addr_le_t *addr)
 	return false;
 }
 
-static bool csis_member_found(struct bt_data *data, void *user_data)
+static void csip_lock_set_cb(int err)
 {
-	if (bt_csip_set_coordinator_is_set_member(csis_sirk, data)) {
-		struct scan_recv_data *sr_data = (struct scan_recv_data *)user_data;
-
-		sr_data->set_member = true;
-
-		return false; /* Stop parsing */
+	if (set_vol.state == SET_VOLUME_RELEASING && set_vol.op == NULL) {
+		/* Aborted while locking, the lock is given back straight away */
+		if (err != 0 || set_vol.members_cnt == 0 ||
+		    bt_csip_set_coordinator_release(set_vol.members, set_vol.members_cnt,
+						    set_vol.set_info) != 0) {
+			set_volume_finish(0, NULL, 0);
+		}
+		return;
 	}
 
-	return true; /* Continue parsing */
-}
+	if (set_vol.state != SET_VOLUME_LOCKING) {
+		return;
+	}
 
-static void csip_lock_set_cb(int err)
-{
 	if (err != 0) {
+		/* E.g. locked by another client, which is then left alone */
 		LOG_ERR("Lock sets failed (%d)", err);
+		set_volume_finish(err, NULL, 0);
 		return;
 	}
 
 	LOG_INF("Set locked");
+
+	/* Written to all members back to back */
+	set_vol.state = SET_VOLUME_WRITING;
+	sink_op_start(set_vol.op);
 }
 
 static void csip_release_set_cb(int err)
 {
 	if (err != 0) {
-		LOG_ERR("Lock sets failed (%d)", err);
-		return;
+		LOG_ERR("Release sets failed (%d)", err);
+	} else {
+		LOG_INF("Set released");
 	}
 
-	LOG_INF("Set released");
+	if (set_vol.state == SET_VOLUME_RELEASING) {
+		set_volume_finish(set_vol.rc, set_vol.ltv, set_vol.ltv_len);
+	}
 }
 
 static void csip_discover_cb(struct bt_conn *conn,
 			     const struct bt_csip_set_coordinator_set_member *member,
 			     int err, size_t set_count)
 {
-	struct net_buf *evt_msg;
 	char addr_str[BT_ADDR_LE_STR_LEN];
 	const bt_addr_le_t *bt_addr_le;
 
-	if (err != 0) {
-		LOG_ERR("Coordinated Set Identification could not be discovered (%d)", err);
-		csis_conn = NULL;
+	sink_discovery_done(conn, SINK_DISCOVERY_CSIS);
+
+	if (err != 0) {
+		LOG_ERR("Coordinated Set Identification could not be discovered (%d)", err);
+
+		return;
+	}
+
+	if (set_count == 0) {
+		LOG_WRN("Device has no sets");
+
+		return;
+	}
+
+	LOG_INF("Found %zu sets on member[%u]", set_count, bt_conn_index(conn));
+
+	for (size_t i = 0U; i < set_count; i++) {
+		LOG_INF("CSIS[%zu]: %p", i, &member->insts[i]);
+		LOG_INF("Rank: %u", member->insts[i].info.rank);
+		LOG_INF("Set Size: %u", member->insts[i].info.set_size);
+		LOG_INF("Lockable: %u", member->insts[i].info.lockable);
+		LOG_HEXDUMP_INF(member->insts[i].info.sirk, BT_CSIP_SIRK_SIZE, "Sirk: ");
+	}
+
+	/* Send send set identifier found message */
+	bt_addr_le = bt_conn_get_dst(conn);
+	bt_addr_le_to_str(bt_addr_le, addr_str, sizeof(addr_str));
+	LOG_DBG("Set identifier identifier from %s, rank %u, size %u",
+		addr_str, member->insts[0].info.rank, member->insts[0].info.set_size);
+
+	send_set_identifier_found(bt_addr_le, member->insts[0].info.rank,
+				  member->insts[0].info.set_size, member->insts[0].info.sirk);
+
+	ba_sink_get(conn)->csip_member = member;
+	memcpy(ba_sink_get(conn)->sirk, member->insts[0].info.sirk, BT_CSIP_SIRK_SIZE);
+	ba_sink_get(conn)->set_rank = member->insts[0].info.rank;
+	ba_sink_get(conn)->set_size = member->insts[0].info.set_size;
+	ba_sink_get(conn)->has_sirk = true;
+	device_store_set_csis(bt_addr_le, member->insts[0].info.rank,
+			      member->insts[0].info.set_size, member->insts[0].info.sirk);
+}
+
+static void csip_ordered_access_cb(
+	const struct bt_csip_set_coordinator_set_info *set_info, int err,
+	bool locked, struct bt_csip_set_coordinator_set_member *member)
+{
+	if (err) {
+		LOG_ERR("Ordered access failed with err %d", err);
+	} else if (locked) {
+		LOG_WRN("Cannot do ordered access as member %p is locked", member);
+	} else {
+		LOG_INF("Ordered access procedure finished");
+	}
+}
+
+/* BASS ServiceData of PAST: both AdvA match (bits 0 and 1 clear), Source_ID in bits 8-15 */
+#define PAST_SERVICE_DATA(src_id) ((uint16_t)((src_id) << 8))
+
+static void past_send(struct bt_conn *conn, struct bt_le_per_adv_sync *sync, uint8_t src_id)
+{
+	int err;
+
+	err = bt_le_per_adv_sync_transfer(sync, conn, PAST_SERVICE_DATA(src_id));
+	if (err) {
+		/* The sink reports the PA sync as failed, or syncs on its own */
+		LOG_WRN("PAST to %p failed (err %d)", (void *)conn, err);
+	} else {
+		LOG_INF("PAST sent to %p (src_id %u)", (void *)conn, src_id);
+	}
+}
+
+/* Stops the PA_MONITOR_PAST monitor unless a sink or a waiting ADD_SOURCE still needs it */
+static void past_monitor_release(const bt_addr_le_t *addr)
+{
+	int err;
+
+	for (int i = 0; i < ARRAY_SIZE(ba_sinks); i++) {
+		if (ba_sinks[i].conn && ba_sinks[i].past_monitor &&
+		    bt_addr_le_eq(&ba_sinks[i].past_addr, addr)) {
+			return;
+		}
+	}
+
+	if (atomic_get(&add_src_waiting) && bt_addr_le_eq(&add_src_param.addr, addr)) {
+		return;
+	}
+
+	err = pa_sync_sched_monitor_stop(addr, PA_MONITOR_PAST);
+	if (err == 0) {
+		LOG_INF("PA sync for PAST no longer needed");
+	}
+}
+
+/* The sink may ask for PAST of the source, our sync to it is kept until it no longer can */
+static int past_monitor_get(struct ba_sink *sink, const bt_addr_le_t *addr, uint8_t sid,
+			    uint16_t pa_interval)
+{
+	int err;
+
+	if (!IS_ENABLED(CONFIG_BT_PER_ADV_SYNC_TRANSFER_SENDER)) {
+		return 0;
+	}
+
+	if (sink->past_monitor && !bt_addr_le_eq(&sink->past_addr, addr)) {
+		sink->past_monitor = false;
+		past_monitor_release(&sink->past_addr);
+	}
+
+	err = pa_sync_sched_monitor_start(addr, sid, pa_interval, PA_MONITOR_PAST);
+	if (err) {
+		LOG_WRN("No PA sync of our own for PAST, the sink syncs on its own (err %d)", err);
+		return err;
+	}
+
+	sink->past_monitor = true;
+	bt_addr_le_copy(&sink->past_addr, addr);
+
+	return 0;
+}
+
+static void past_monitor_put(struct ba_sink *sink)
+{
+	if (!sink->past_monitor) {
+		return;
+	}
+
+	sink->past_monitor = false;
+	past_monitor_release(&sink->past_addr);
+}
+
+static void past_info_req(struct bt_conn *conn,
+			  const struct bt_bap_scan_delegator_recv_state *state)
+{
+	struct ba_sink *sink = ba_sink_get(conn);
+	struct bt_le_per_adv_sync *sync;
+	uint16_t pa_interval = BT_BAP_PA_INTERVAL_UNKNOWN;
+
+	sync = pa_sync_sched_get_synced(&state->addr, state->adv_sid);
+	if (sync) {
+		sink->past_pending = false;
+		past_send(conn, sync, state->src_id);
+		return;
+	}
+
+	if (bt_addr_le_eq(&state->addr, &add_src_param.addr)) {
+		pa_interval = add_src_param.pa_interval;
+	} else if (bt_addr_le_eq(&state->addr, &switch_src.add_param.addr)) {
+		pa_interval = switch_src.add_param.pa_interval;
+	}
+
+	/* Sent from pa_synced_cb, the sink times out on its own if that takes too long */
+	LOG_INF("PAST requested before synced to the source");
+	if (past_monitor_get(sink, &state->addr, state->adv_sid, pa_interval) == 0) {
+		sink->past_pending = true;
+	}
+}
+
+static void past_synced(struct bt_le_per_adv_sync *sync,
+			const struct bt_le_per_adv_sync_synced_info *info)
+{
+	if (atomic_get(&add_src_waiting) && bt_addr_le_eq(info->addr, &add_src_param.addr) &&
+	    info->sid == add_src_param.adv_sid) {
+		k_work_reschedule_for_queue(message_cmd_workqueue_get(), &add_src_start_work,
+					    K_NO_WAIT);
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(ba_sinks); i++) {
+		struct ba_sink *sink = &ba_sinks[i];
+
+		if (sink->conn && sink->past_pending &&
+		    bt_addr_le_eq(&sink->recv_state.addr, info->addr) &&
+		    sink->recv_state.adv_sid == info->sid) {
+			sink->past_pending = false;
+			past_send(sink->conn, sync, sink->recv_state.src_id);
+		}
+	}
+}
+
+/* Called with switch_src_mutex held */
+static void switch_src_send_locked(void)
+{
+	struct net_buf *evt_msg;
+
+	(void)k_work_cancel_delayable(&switch_src_timeout_work);
+
+	evt_msg = MESSAGE_EVT_ALLOC(SOURCE_SWITCHED, 0);
+	if (!evt_msg) {
+		return;
+	}
+
+	message_evt_add_le32(evt_msg, BT_DATA_BROADCAST_ID, switch_src.broadcast_id);
+	net_buf_add_mem(evt_msg, switch_src.ltv, switch_src.ltv_len);
+
+	message_send_net_buf_event(MESSAGE_SUBTYPE_SOURCE_SWITCHED, evt_msg);
+}
+
+/* Records the result of a sink, SOURCE_SWITCHED is sent when it is the last one */
+static void switch_src_settle(struct bt_conn *conn, int err)
+{
+	struct ba_sink *sink = ba_sink_get(conn);
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
+	uint8_t *ltv;
+	uint16_t len = 0;
+
+	k_mutex_lock(&switch_src_mutex, K_FOREVER);
+
+	if (!sink->switch_settling) {
+		k_mutex_unlock(&switch_src_mutex);
+		return;
+	}
+
+	LOG_INF("Source switch of this conn %p settled (err %d)", (void *)conn, err);
+
+	sink->switch_settling = false;
+	sink->switch_bcode_req = false;
+
+	ltv = &switch_src.ltv[switch_src.ltv_len];
+	ltv[len++] = MESSAGE_EVT_FIELD_SINK_STATUS - 1;
+	ltv[len++] = BT_DATA_SINK_STATUS;
+	ltv[len++] = addr->type;
+	memcpy(&ltv[len], &addr->a, sizeof(bt_addr_t));
+	len += sizeof(bt_addr_t);
+	sys_put_le32(err, &ltv[len]);
+	len += sizeof(int32_t);
+
+	if (sink->has_source_id) {
+		ltv[len++] = MESSAGE_EVT_FIELD_U8 - 1;
+		ltv[len++] = BT_DATA_SOURCE_ID;
+		ltv[len++] = sink->source_id;
+	}
+
+	switch_src.ltv_len += len;
+
+	if (--switch_src.settling == 0) {
+		switch_src_send_locked();
+	}
+
+	k_mutex_unlock(&switch_src_mutex);
+}
+
+/* Drops a switch in progress without SOURCE_SWITCHED, for RESET */
+static void switch_src_abort(void)
+{
+	k_mutex_lock(&switch_src_mutex, K_FOREVER);
+
+	(void)k_work_cancel_delayable(&switch_src_timeout_work);
+
+	for (int i = 0; i < ARRAY_SIZE(ba_sinks); i++) {
+		struct ba_sink *sink = &ba_sinks[i];
+
+		sink->switch_settling = false;
+		sink->switch_bcode_req = false;
+		if (sink->switch_step != SWITCH_SRC_IDLE) {
+			sink->switch_step = SWITCH_SRC_ABORTED;
+		}
+	}
+
+	memset(&switch_src, 0, sizeof(switch_src));
+
+	k_mutex_unlock(&switch_src_mutex);
+}
+
+static void switch_src_timeout_work_handler(struct k_work *work)
+{
+	for (int i = 0; i < ARRAY_SIZE(ba_sinks); i++) {
+		if (ba_sinks[i].conn && ba_sinks[i].switch_settling) {
+			LOG_WRN("Source switch of this conn %p timed out", (void *)ba_sinks[i].conn);
+			switch_src_settle(ba_sinks[i].conn, -ETIMEDOUT);
+		}
+	}
+}
+
+/* Sinks requesting the broadcast code are sent it, -EBUSY is retried on the next write */
+static void switch_src_write_bcodes(void)
+{
+	int err;
+
+	for (int i = 0; i < ARRAY_SIZE(ba_sinks); i++) {
+		struct ba_sink *sink = &ba_sinks[i];
+
+		if (!sink->conn || !sink->switch_bcode_req) {
+			continue;
+		}
+
+		err = bt_bap_broadcast_assistant_set_broadcast_code(
+			sink->conn, sink->switch_bcode_src_id, switch_src.bcode);
+		if (err == -EBUSY) {
+			continue;
+		}
+
+		sink->switch_bcode_req = false;
+
+		if (err) {
+			LOG_ERR("Broadcast code not written (err %d)", err);
+			switch_src_settle(sink->conn, err);
+		}
+	}
+}
+
+/* 0 once the sink is synced as requested, -EAGAIN while on its way there */
+static int switch_src_result(const struct bt_bap_scan_delegator_recv_state *state)
+{
+	bool wants_bis = false;
+	bool bis_synced = false;
+
+	if (state->pa_sync_state == BT_BAP_PA_STATE_FAILED ||
+	    state->pa_sync_state == BT_BAP_PA_STATE_NO_PAST) {
+		return -EIO;
+	}
+
+	if (state->encrypt_state == BT_BAP_BIG_ENC_STATE_BAD_CODE) {
+		return -EACCES;
+	}
+
+	for (int i = 0; i < state->num_subgroups; i++) {
+		if (state->subgroups[i].bis_sync == BIG_SYNC_FAILED) {
+			return -EIO;
+		}
+		bis_synced = bis_synced || state->subgroups[i].bis_sync != 0;
+	}
+
+	for (int i = 0; i < switch_src.num_subgroups; i++) {
+		uint32_t bis_sync = i < state->num_subgroups ? state->subgroups[i].bis_sync : 0;
+
+		if (switch_src.bis_sync[i] == BT_BAP_BIS_SYNC_NO_PREF) {
+			/* Any BIS the sink picks */
+			wants_bis = true;
+			continue;
+		}
+
+		if (bis_sync != switch_src.bis_sync[i]) {
+			return -EAGAIN;
+		}
+		wants_bis = wants_bis || bis_sync != 0;
+	}
+
+	return (bis_synced || !wants_bis) ? 0 : -EAGAIN;
+}
+
+/*
+ * Returns true if the receive state change is summed up in SOURCE_SWITCHED
+ * instead of being sent as events of its own.
+ */
+static bool switch_src_recv_state(struct bt_conn *conn,
+				  const struct bt_bap_scan_delegator_recv_state *state)
+{
+	struct ba_sink *sink = ba_sink_get(conn);
+	int err;
+
+	if (!sink->switch_settling) {
+		return false;
+	}
 
-		return;
+	if (state->broadcast_id != switch_src.broadcast_id) {
+		/* The old source going away */
+		return true;
 	}
 
-	if (set_count == 0) {
-		LOG_WRN("Device has no sets");
-		csis_conn = NULL;
+	sink->source_id = state->src_id;
+	sink->has_source_id = true;
 
-		return;
-	}
+	if (state->encrypt_state == BT_BAP_BIG_ENC_STATE_BCODE_REQ) {
+		if (!switch_src.has_bcode) {
+			/* The host is asked for the code as usual */
+			switch_src_settle(conn, -EACCES);
+			return false;
+		}
 
-	LOG_INF("Found %zu sets on member[%u]", set_count, bt_conn_index(conn));
+		if (sink->recv_state.encrypt_state != BT_BAP_BIG_ENC_STATE_BCODE_REQ) {
+			/* Written as soon as requested, not once the host has seen it */
+			sink->switch_bcode_req = true;
+			sink->switch_bcode_src_id = state->src_id;
+			switch_src_write_bcodes();
+		}
 
-	for (size_t i = 0U; i < set_count; i++) {
-		LOG_INF("CSIS[%zu]: %p", i, &member->insts[i]);
-		LOG_INF("Rank: %u", member->insts[i].info.rank);
-		LOG_INF("Set Size: %u", member->insts[i].info.set_size);
-		LOG_INF("Lockable: %u", member->insts[i].info.lockable);
-		LOG_HEXDUMP_INF(member->insts[i].info.sirk, BT_CSIP_SIRK_SIZE, "Sirk: ");
+		return true;
 	}
 
-	/* Send send set identifier found message */
-	evt_msg = message_alloc_tx();
-	bt_addr_le = bt_conn_get_dst(conn);
-	bt_addr_le_to_str(bt_addr_le, addr_str, sizeof(addr_str));
-	LOG_DBG("Set identifier identifier from %s, rank %u, size %u",
-		addr_str, member->insts[0].info.rank, member->insts[0].info.set_size);
+	if (sink->switch_step != SWITCH_SRC_IDLE) {
+		return true;
+	}
 
-	/* Bluetooth LE Device Address */
-	net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-	net_buf_add_u8(evt_msg,
-		       bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-	net_buf_add_u8(evt_msg, bt_addr_le->type);
-	net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
+	err = switch_src_result(state);
+	if (err != -EAGAIN) {
+		switch_src_settle(conn, err);
+		/* A bad code is also left to the host */
+		return err != -EACCES;
+	}
 
-	/* rank */
-	net_buf_add_u8(evt_msg, 2);
-	net_buf_add_u8(evt_msg, BT_DATA_SET_RANK);
-	net_buf_add_u8(evt_msg, member->insts[0].info.rank);
+	return true;
+}
 
-	/* set_size */
-	net_buf_add_u8(evt_msg, 2);
-	net_buf_add_u8(evt_msg, BT_DATA_SET_SIZE);
-	net_buf_add_u8(evt_msg, member->insts[0].info.set_size);
+/* A BASS write of SWITCH_SOURCE completed, the next one is issued if there is one */
+static void switch_src_step_done(struct bt_conn *conn, int err)
+{
+	struct ba_sink *sink = ba_sink_get(conn);
+	enum switch_src_step step = sink->switch_step;
 
-	/* sirk */
-	net_buf_add_u8(evt_msg, 1 + BT_CSIP_SIRK_SIZE);
-	net_buf_add_u8(evt_msg, BT_DATA_SIRK);
-	net_buf_add_mem(evt_msg, member->insts[0].info.sirk, BT_CSIP_SIRK_SIZE);
+	sink->switch_step = SWITCH_SRC_IDLE;
 
-	message_send_net_buf_event(MESSAGE_SUBTYPE_SET_IDENTIFIER_FOUND, evt_msg);
+	if (step == SWITCH_SRC_ABORTED) {
+		/* The next steps are not written */
+		return;
+	}
 
-	csis_conn = NULL;
-}
+	if (err == 0 && step == SWITCH_SRC_STOP) {
+		LOG_INF("Source switch, removing source %u", sink->source_id);
+		err = bt_bap_broadcast_assistant_rem_src(conn, sink->source_id);
+		if (err == 0) {
+			sink->switch_step = SWITCH_SRC_REMOVE;
+			return;
+		}
+	} else if (err == 0 && step == SWITCH_SRC_REMOVE) {
+		err = add_src_write(conn, &switch_src.add_param, switch_src.start);
+		if (err == 0) {
+			sink->switch_step = SWITCH_SRC_ADD;
+			return;
+		}
+	}
 
-static void csip_ordered_access_cb(
-	const struct bt_csip_set_coordinator_set_info *set_info, int err,
-	bool locked, struct bt_csip_set_coordinator_set_member *member)
-{
 	if (err) {
-		LOG_ERR("Ordered access failed with err %d", err);
-	} else if (locked) {
-		LOG_WRN("Cannot do ordered access as member %p is locked", member);
-	} else {
-		LOG_INF("Ordered access procedure finished");
+		LOG_ERR("Source switch failed (step %d, err %d)", step, err);
+		switch_src_settle(conn, err);
+	} else if (sink->recv_state.broadcast_id == switch_src.broadcast_id) {
+		/* The notifications may have come first, or nothing changes */
+		err = switch_src_result(&sink->recv_state);
+		if (err != -EAGAIN) {
+			switch_src_settle(conn, err);
+		}
+		err = 0;
 	}
+
+	sink_op_done(&switch_src_op, conn, err);
+	switch_src_write_bcodes();
 }
 
 static void broadcast_assistant_recv_state_cb(struct bt_conn *conn, int err,
@@ -576,18 +1318,20 @@ static void broadcast_assistant_recv_state_cb(struct bt_conn *conn, int err,
 {
 	struct net_buf *evt_msg;
 	enum message_sub_type evt_msg_sub_type;
-	const bt_addr_le_t *bt_addr_le;
 	bool bis_synced;
 	bool bis_sync_changed;
-
-	uint8_t conn_index = bt_conn_index(conn);
+	bool notify;
+	struct ba_sink *sink = ba_sink_get(conn);
+	struct bt_bap_scan_delegator_recv_state *prev = &sink->recv_state;
 
 	LOG_INF("Broadcast assistant recv_state callback (%p (%u), %d, %u)", (void *)conn,
-		conn_index, err, state->src_id);
+		bt_conn_index(conn), err, state->src_id);
 
-	if (state->encrypt_state != ba_recv_state[conn_index].encrypt_state) {
+	notify = !switch_src_recv_state(conn, state);
+
+	if (state->encrypt_state != prev->encrypt_state) {
 		LOG_INF("Going from encrypt state %u to %u",
-			ba_recv_state[conn_index].encrypt_state, state->encrypt_state);
+			prev->encrypt_state, state->encrypt_state);
 
 		switch (state->encrypt_state) {
 		case BT_BAP_BIG_ENC_STATE_NO_ENC:
@@ -613,25 +1357,16 @@ static void broadcast_assistant_recv_state_cb(struct bt_conn *conn, int err,
 			return;
 		}
 
-		evt_msg = message_alloc_tx();
-
-		/* Bluetooth LE Device Address */
-		bt_addr_le = bt_conn_get_dst(conn);
-		net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-		net_buf_add_u8(evt_msg, bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-		net_buf_add_u8(evt_msg, bt_addr_le->type);
-		net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
-
-		/* source id */
-		net_buf_add_u8(evt_msg, 2);
-		net_buf_add_u8(evt_msg, BT_DATA_SOURCE_ID);
-		net_buf_add_u8(evt_msg, state->src_id);
-
-		message_send_net_buf_event(evt_msg_sub_type, evt_msg);
+		evt_msg = notify ? MESSAGE_EVT_ALLOC(ENC_STATE, 0) : NULL;
+		if (evt_msg) {
+			message_evt_add_addr(evt_msg, bt_conn_get_dst(conn));
+			message_evt_add_u8(evt_msg, BT_DATA_SOURCE_ID, state->src_id);
+			message_send_net_buf_event(evt_msg_sub_type, evt_msg);
+		}
 	}
 
-	if (state->pa_sync_state != ba_recv_state[conn_index].pa_sync_state) {
-		LOG_INF("Going from PA state %u to %u", ba_recv_state[conn_index].pa_sync_state,
+	if (state->pa_sync_state != prev->pa_sync_state) {
+		LOG_INF("Going from PA state %u to %u", prev->pa_sync_state,
 			state->pa_sync_state);
 
 		switch (state->pa_sync_state) {
@@ -642,6 +1377,9 @@ static void broadcast_assistant_recv_state_cb(struct bt_conn *conn, int err,
 		case BT_BAP_PA_STATE_INFO_REQ:
 			LOG_INF("BT_BAP_PA_STATE_INFO_REQ");
 			evt_msg_sub_type = MESSAGE_SUBTYPE_NEW_PA_STATE_INFO_REQ;
+			if (IS_ENABLED(CONFIG_BT_PER_ADV_SYNC_TRANSFER_SENDER)) {
+				past_info_req(conn, state);
+			}
 			break;
 		case BT_BAP_PA_STATE_SYNCED:
 			LOG_INF("BT_BAP_PA_STATE_SYNCED (src_id = %u)", state->src_id);
@@ -660,31 +1398,28 @@ static void broadcast_assistant_recv_state_cb(struct bt_conn *conn, int err,
 			return;
 		}
 
-		evt_msg = message_alloc_tx();
-
-		/* Bluetooth LE Device Address */
-		bt_addr_le = bt_conn_get_dst(conn);
-		net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-		net_buf_add_u8(evt_msg, bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-		net_buf_add_u8(evt_msg, bt_addr_le->type);
-		net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
-
-		/* broadcast id */
-		net_buf_add_u8(evt_msg, 5);
-		net_buf_add_u8(evt_msg, BT_DATA_BROADCAST_ID);
-		net_buf_add_le32(evt_msg, state->broadcast_id);
+		if (state->pa_sync_state != BT_BAP_PA_STATE_INFO_REQ) {
+			sink->past_pending = false;
+		}
 
-		/* source id */
-		net_buf_add_u8(evt_msg, 2);
-		net_buf_add_u8(evt_msg, BT_DATA_SOURCE_ID);
-		net_buf_add_u8(evt_msg, state->src_id);
+		if (state->pa_sync_state != BT_BAP_PA_STATE_INFO_REQ &&
+		    state->pa_sync_state != BT_BAP_PA_STATE_NOT_SYNCED) {
+			/* Synced, or given up until it asks again */
+			past_monitor_put(sink);
+		}
 
-		message_send_net_buf_event(evt_msg_sub_type, evt_msg);
+		evt_msg = notify ? MESSAGE_EVT_ALLOC(PA_STATE, 0) : NULL;
+		if (evt_msg) {
+			message_evt_add_addr(evt_msg, bt_conn_get_dst(conn));
+			message_evt_add_le32(evt_msg, BT_DATA_BROADCAST_ID, state->broadcast_id);
+			message_evt_add_u8(evt_msg, BT_DATA_SOURCE_ID, state->src_id);
+			message_send_net_buf_event(evt_msg_sub_type, evt_msg);
+		}
 	}
 
 	for (int i = 0; i < state->num_subgroups; i++) {
 		LOG_INF("bis_sync[%d]: %x -> %x", i,
-			ba_recv_state[conn_index].subgroups[i].bis_sync,
+			prev->subgroups[i].bis_sync,
 			state->subgroups[i].bis_sync);
 	}
 
@@ -693,7 +1428,7 @@ static void broadcast_assistant_recv_state_cb(struct bt_conn *conn, int err,
 	bis_synced = false;
 	for (int i = 0; i < state->num_subgroups; i++) {
 		if (state->subgroups[i].bis_sync !=
-		    ba_recv_state[conn_index].subgroups[i].bis_sync) {
+		    prev->subgroups[i].bis_sync) {
 			/* bis sync changed */
 			bis_sync_changed = true;
 			if (state->subgroups[i].bis_sync == BIG_SYNC_FAILED) {
@@ -714,41 +1449,62 @@ static void broadcast_assistant_recv_state_cb(struct bt_conn *conn, int err,
 		/* BIS sync changed */
 		evt_msg_sub_type = bis_synced ? MESSAGE_SUBTYPE_BIS_SYNCED : MESSAGE_SUBTYPE_BIS_NOT_SYNCED;
 
+		if (bis_synced && sink->add_src_timing) {
+			stats_latency_end(STATS_LATENCY_ADD_SOURCE, sink->add_src_start);
+			sink->add_src_timing = false;
+		}
+
 		LOG_INF("%s", evt_msg_sub_type == MESSAGE_SUBTYPE_BIS_SYNCED
 				      ? "MESSAGE_SUBTYPE_BIS_SYNCED"
 				      : "MESSAGE_SUBTYPE_BIS_NOT_SYNCED");
 
-		evt_msg = message_alloc_tx();
-
-		/* Bluetooth LE Device Address */
-		bt_addr_le = bt_conn_get_dst(conn);
-		net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-		net_buf_add_u8(evt_msg,
-			       bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-		net_buf_add_u8(evt_msg, bt_addr_le->type);
-		net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
-
-		/* broadcast id */
-		net_buf_add_u8(evt_msg, 5);
-		net_buf_add_u8(evt_msg, BT_DATA_BROADCAST_ID);
-		net_buf_add_le32(evt_msg, state->broadcast_id);
-
-		/* source id */
-		net_buf_add_u8(evt_msg, 2);
-		net_buf_add_u8(evt_msg, BT_DATA_SOURCE_ID);
-		net_buf_add_u8(evt_msg, state->src_id);
+		evt_msg = notify ? MESSAGE_EVT_ALLOC(BIS_SYNC, 0) : NULL;
+		if (evt_msg) {
+			message_evt_add_addr(evt_msg, bt_conn_get_dst(conn));
+			message_evt_add_le32(evt_msg, BT_DATA_BROADCAST_ID, state->broadcast_id);
+			message_evt_add_u8(evt_msg, BT_DATA_SOURCE_ID, state->src_id);
+			message_send_net_buf_event(evt_msg_sub_type, evt_msg);
+		}
+	}
 
-		message_send_net_buf_event(evt_msg_sub_type, evt_msg);
+	if (state->broadcast_id == sink->source_broadcast_id) {
+		/* Each sink assigns its own source ID */
+		sink->source_id = state->src_id;
+		sink->has_source_id = true;
 	}
 
 	/* Store latest recv_state */
-	memcpy(&ba_recv_state[conn_index], state, sizeof(struct bt_bap_scan_delegator_recv_state));
+	memcpy(prev, state, sizeof(struct bt_bap_scan_delegator_recv_state));
 }
 
 static void broadcast_assistant_recv_state_removed_cb(struct bt_conn *conn, uint8_t src_id)
 {
+	struct ba_sink *sink = ba_sink_get(conn);
+	struct net_buf *evt_msg;
+
 	LOG_INF("Broadcast assistant recv_state_removed callback (%p, %u)", (void *)conn, src_id);
-	message_send_return_code(MESSAGE_TYPE_EVT, MESSAGE_SUBTYPE_SOURCE_REMOVED, 0, 0);
+
+	if (sink->has_source_id && sink->source_id == src_id) {
+		sink->has_source_id = false;
+	}
+
+	if (sink->recv_state.src_id == src_id && sink->past_monitor &&
+	    bt_addr_le_eq(&sink->past_addr, &sink->recv_state.addr)) {
+		past_monitor_put(sink);
+	}
+
+	if (sink->switch_settling) {
+		/* Part of SWITCH_SOURCE */
+		return;
+	}
+
+	evt_msg = MESSAGE_EVT_ALLOC(SOURCE_REMOVED, 0);
+	if (evt_msg) {
+		message_evt_add_addr(evt_msg, bt_conn_get_dst(conn));
+		message_evt_add_u8(evt_msg, BT_DATA_SOURCE_ID, src_id);
+		message_evt_add_err(evt_msg, 0 /* OK */);
+		message_send_net_buf_event(MESSAGE_SUBTYPE_SOURCE_REMOVED, evt_msg);
+	}
 }
 
 static void broadcast_assistant_add_src_cb(struct bt_conn *conn, int err)
@@ -763,44 +1519,52 @@ static void broadcast_assistant_add_src_cb(struct bt_conn *conn, int err)
 		LOG_INF("Broadcast assistant add_src callback (%p, %d)", (void *)conn, err);
 	}
 
-	k_sem_give(&sem_add_source);
+	if (ba_sink_get(conn)->switch_step != SWITCH_SRC_IDLE) {
+		/* Reported in SOURCE_SWITCHED instead of SOURCE_ADDED */
+		switch_src_step_done(conn, err);
+		return;
+	}
+
+	sink_op_done(&add_src_op, conn, err);
 
-	evt_msg = message_alloc_tx();
 	bt_addr_le = bt_conn_get_dst(conn); /* sink addr */
 	bt_addr_le_to_str(bt_addr_le, addr_str, sizeof(addr_str));
 	LOG_DBG("Source added for %s", addr_str);
 
-	/* Bluetooth LE Device Address */
-	net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-	net_buf_add_u8(evt_msg, bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-	net_buf_add_u8(evt_msg, bt_addr_le->type);
-	net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
-
-	/* broadcast id */
-	net_buf_add_u8(evt_msg, 5);
-	net_buf_add_u8(evt_msg, BT_DATA_BROADCAST_ID);
-	net_buf_add_le32(evt_msg, ba_source_broadcast_id);
-	/* error code */
-	net_buf_add_u8(evt_msg, 1 /* len of BT_DATA type */ + sizeof(int32_t));
-	net_buf_add_u8(evt_msg, BT_DATA_ERROR_CODE);
-	net_buf_add_le32(evt_msg, err);
+	evt_msg = MESSAGE_EVT_ALLOC(SOURCE_ADDED, 0);
+	if (!evt_msg) {
+		return;
+	}
+
+	message_evt_add_addr(evt_msg, bt_addr_le);
+	message_evt_add_le32(evt_msg, BT_DATA_BROADCAST_ID, ba_sink_get(conn)->source_broadcast_id);
+	message_evt_add_err(evt_msg, err);
 
 	message_send_net_buf_event(MESSAGE_SUBTYPE_SOURCE_ADDED, evt_msg);
 }
 
 static void broadcast_assistant_mod_src_cb(struct bt_conn *conn, int err)
 {
+	const uint8_t source_id = ba_sink_get(conn)->source_id;
+
+	if (ba_sink_get(conn)->switch_step != SWITCH_SRC_IDLE) {
+		switch_src_step_done(conn, err);
+		return;
+	}
+
 	if (err) {
 		LOG_ERR("BASS modify source (err: %d)", err);
+		sink_op_done(&rem_src_op, conn, err);
 		return;
 	}
 
 	LOG_INF("BASS modify source (bis_sync = 0, pa_sync = false) ok -> Now remove source (%u)",
-		ba_source_id);
+		source_id);
 
-	err = bt_bap_broadcast_assistant_rem_src(conn, ba_source_id);
+	err = bt_bap_broadcast_assistant_rem_src(conn, source_id);
 	if (err) {
 		LOG_ERR("BASS remove source (err: %d)", err);
+		sink_op_done(&rem_src_op, conn, err);
 	}
 }
 
@@ -812,7 +1576,24 @@ static void broadcast_assistant_rem_src_cb(struct bt_conn *conn, int err)
 		LOG_INF("BASS remove source (err: %d)", err);
 	}
 
-	k_sem_give(&sem_rem_source);
+	if (ba_sink_get(conn)->switch_step != SWITCH_SRC_IDLE) {
+		switch_src_step_done(conn, err);
+		return;
+	}
+
+	sink_op_done(&rem_src_op, conn, err);
+}
+
+static void broadcast_assistant_broadcast_code_cb(struct bt_conn *conn, int err)
+{
+	if (err) {
+		LOG_ERR("BASS set broadcast code (err: %d)", err);
+	} else {
+		LOG_INF("BASS set broadcast code (err: %d)", err);
+	}
+
+	sink_op_done(&bcode_op, conn, err);
+	switch_src_write_bcodes();
 }
 
 static void connected_cb(struct bt_conn *conn, uint8_t err)
@@ -822,31 +1603,46 @@ static void connected_cb(struct bt_conn *conn, uint8_t err)
 	if (err) {
 		LOG_ERR("Connected error (err %d)", err);
 	} else {
-		err = bt_conn_set_security(conn, BT_SECURITY_L2 | BT_SECURITY_FORCE_PAIR);
+		bt_security_t sec = BT_SECURITY_L2;
+		struct ba_sink *sink = ba_sink_get(conn);
+
+		k_mutex_lock(&ba_sinks_mutex, K_FOREVER);
+		memset(sink, 0, sizeof(*sink));
+		sink->conn = conn;
+		k_mutex_unlock(&ba_sinks_mutex);
+
+		/* A known sink is still bonded, encrypting with the stored keys is enough */
+		if (!device_store_get(bt_conn_get_dst(conn), NULL)) {
+			sec |= BT_SECURITY_FORCE_PAIR;
+		}
+
+		err = bt_conn_set_security(conn, sec);
 		if (err) {
 			LOG_ERR("Setting security failed (err %d)", err);
 		}
 	}
 
+	if (connect_known_next < connect_known_cnt) {
+		k_work_submit_to_queue(message_cmd_workqueue_get(), &connect_known_work);
+	} else if (!err) {
+		/* Keep discovering while the sink is paired and discovered */
+		restart_scanning_if_needed();
+	}
+
 	if (err) {
-		const bt_addr_le_t *bt_addr_le;
 		struct net_buf *evt_msg;
 
-		evt_msg = message_alloc_tx();
-		bt_addr_le = bt_conn_get_dst(conn);
-		/* Bluetooth LE Device Address */
-		net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-		net_buf_add_u8(evt_msg, bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-		net_buf_add_u8(evt_msg, bt_addr_le->type);
-		net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
-		/* error code */
-		net_buf_add_u8(evt_msg, 1 /* len of BT_DATA type */ + sizeof(int32_t));
-		net_buf_add_u8(evt_msg, BT_DATA_ERROR_CODE);
-		net_buf_add_le32(evt_msg, err);
+		evt_msg = MESSAGE_EVT_ALLOC(SINK_CONNECTED, 0);
+		if (evt_msg) {
+			message_evt_add_addr(evt_msg, bt_conn_get_dst(conn));
+			message_evt_add_err(evt_msg, err);
+		}
 
 		bt_conn_unref(conn);
 
-		message_send_net_buf_event(MESSAGE_SUBTYPE_SINK_CONNECTED, evt_msg);
+		if (evt_msg) {
+			message_send_net_buf_event(MESSAGE_SUBTYPE_SINK_CONNECTED, evt_msg);
+		}
 		restart_scanning_if_needed();
 	}
 }
@@ -859,20 +1655,60 @@ static void disconnected_cb(struct bt_conn *conn, uint8_t reason)
 	LOG_INF("Broadcast assistant disconnected callback (%p, reason:%d)", (void *)conn, reason);
 
 	bt_addr_le = bt_conn_get_dst(conn);
-	evt_msg = message_alloc_tx();
-	/* Bluetooth LE Device Address */
-	net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-	net_buf_add_u8(evt_msg, bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-	net_buf_add_u8(evt_msg, bt_addr_le->type);
-	net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
-	/* error code */
-	net_buf_add_u8(evt_msg, 1 /* len of BT_DATA type */ + sizeof(int32_t));
-	net_buf_add_u8(evt_msg, BT_DATA_ERROR_CODE);
-	net_buf_add_le32(evt_msg, 0 /* OK */);
-
+	evt_msg = MESSAGE_EVT_ALLOC(SINK_DISCONNECTED, 0);
+	if (evt_msg) {
+		message_evt_add_addr(evt_msg, bt_addr_le);
+		message_evt_add_err(evt_msg, 0 /* OK */);
+	}
+
+	sink_op_disconnected(&add_src_op, conn);
+	sink_op_disconnected(&rem_src_op, conn);
+	sink_op_disconnected(&bcode_op, conn);
+	switch_src_settle(conn, -ENOTCONN);
+	sink_op_disconnected(&switch_src_op, conn);
+	past_monitor_put(ba_sink_get(conn));
+	set_volume_disconnected(conn);
+	sink_op_disconnected(&set_volume_op, conn);
+	sink_op_disconnected(&set_mute_op, conn);
+	sink_op_disconnected(&step_volume_op, conn);
+	sink_discovery_stop(conn);
+
+	k_mutex_lock(&ba_sinks_mutex, K_FOREVER);
+	memset(ba_sink_get(conn), 0, sizeof(struct ba_sink));
 	bt_conn_unref(conn);
+	k_mutex_unlock(&ba_sinks_mutex);
+
+	if (evt_msg) {
+		message_send_net_buf_event(MESSAGE_SUBTYPE_SINK_DISCONNECTED, evt_msg);
+	}
+
+	/* Report the sink again as soon as it advertises */
+	scan_cache_remove(MESSAGE_SUBTYPE_SINK_FOUND, bt_addr_le);
+	scan_cache_remove(SCAN_CACHE_SCAN_RSP(MESSAGE_SUBTYPE_SINK_FOUND), bt_addr_le);
+}
+
+/* A known sink that lost its bond is paired again on the same link, once */
+static bool security_retry_pairing(struct bt_conn *conn, enum bt_security_err err)
+{
+	struct ba_sink *sink = ba_sink_get(conn);
+	int ret;
+
+	if (err != BT_SECURITY_ERR_PIN_OR_KEY_MISSING || sink->repairing ||
+	    !device_store_get(bt_conn_get_dst(conn), NULL)) {
+		return false;
+	}
+
+	LOG_WRN("Sink lost its bond, pairing again");
+	sink->repairing = true;
+
+	ret = bt_conn_set_security(conn, BT_SECURITY_L2 | BT_SECURITY_FORCE_PAIR);
+	if (ret) {
+		LOG_ERR("Failed to pair again (err %d)", ret);
 
-	message_send_net_buf_event(MESSAGE_SUBTYPE_SINK_DISCONNECTED, evt_msg);
+		return false;
+	}
+
+	return true;
 }
 
 static void security_changed_cb(struct bt_conn *conn, bt_security_t level, enum bt_security_err err)
@@ -880,19 +1716,31 @@ static void security_changed_cb(struct bt_conn *conn, bt_security_t level, enum
 	LOG_INF("Broadcast assistant security_changed callback (%p, %d, err:%d)", (void *)conn, level, err);
 
 	if (err == BT_SECURITY_ERR_SUCCESS) {
-		/* Connected and paired. Do BAP broadcast assistant discover */
-		LOG_INF("Broadcast assistant discover...");
-		err = bt_bap_broadcast_assistant_discover(conn);
-		if (err) {
-			LOG_ERR("Failed to broadcast assistant discover (err %d)", err);
-			err = bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
-			if (err) {
-				LOG_ERR("Failed to disconnect (err %d)", err);
-			}
+		struct device_store_sink known;
+		uint8_t steps = BIT(SINK_DISCOVERY_BASS) | BIT(SINK_DISCOVERY_VCS) |
+				BIT(SINK_DISCOVERY_CSIS);
+
+		if (device_store_get(bt_conn_get_dst(conn), &known) &&
+		    (known.flags & DEVICE_STORE_HAS_CSIS)) {
+			/* Reported from the store in broadcast_assistant_discover_cb */
+			steps &= ~BIT(SINK_DISCOVERY_CSIS);
 		}
+
+		device_store_add(bt_conn_get_dst(conn));
+
+		/* Connected and paired. Discover BASS, VCS and CSIS */
+		sink_discovery_start(conn, steps);
+	} else if (security_retry_pairing(conn, err)) {
+		/* Called again with the result */
+		return;
 	} else {
 		LOG_ERR("Failed to change security (err %d)", err);
-		err = bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+		if (ba_sink_get(conn)->repairing) {
+			/* Stale keys are dropped (disconnecting), the next connection pairs anew */
+			err = bt_unpair(BT_ID_DEFAULT, bt_conn_get_dst(conn));
+		} else {
+			err = bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+		}
 		if (err) {
 			LOG_ERR("Failed to disconnect (err %d)", err);
 		}
@@ -916,17 +1764,13 @@ static void identity_resolved_cb(struct bt_conn *conn, const bt_addr_le_t *rpa,
 	struct net_buf *evt_msg;
 
 	evt_msg_sub_type = MESSAGE_SUBTYPE_IDENTITY_RESOLVED;
-	evt_msg = message_alloc_tx();
-
-	net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-	net_buf_add_u8(evt_msg, BT_DATA_RPA);
-	net_buf_add_u8(evt_msg, rpa->type);
-	net_buf_add_mem(evt_msg, &rpa->a, sizeof(bt_addr_t));
+	evt_msg = MESSAGE_EVT_ALLOC(IDENTITY_RESOLVED, 0);
+	if (!evt_msg) {
+		return;
+	}
 
-	net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-	net_buf_add_u8(evt_msg, BT_DATA_IDENTITY);
-	net_buf_add_u8(evt_msg, identity->type);
-	net_buf_add_mem(evt_msg, &identity->a, sizeof(bt_addr_t));
+	message_evt_add_addr_type(evt_msg, BT_DATA_RPA, rpa);
+	message_evt_add_addr_type(evt_msg, BT_DATA_IDENTITY, identity);
 
 	message_send_net_buf_event(evt_msg_sub_type, evt_msg);
 }
@@ -936,102 +1780,14 @@ static void restart_scanning_if_needed(void)
 	int err;
 
 	if (ba_scan_mode) {
-		LOG_INF("Restart scanning");
-		err = bt_le_scan_start(BT_LE_SCAN_PASSIVE, NULL);
+		err = scan_sched_resume();
 		if (err) {
-			LOG_ERR("Scanning failed to start (err %d)", err);
 			ba_scan_mode = BROADCAST_ASSISTANT_SCAN_IDLE;
+			(void)scan_sched_set_modes(ba_scan_mode);
 		}
 	}
 }
 
-static bool device_found(struct bt_data *data, void *user_data)
-{
-	struct scan_recv_data *sr_data = (struct scan_recv_data *)user_data;
-	struct bt_uuid_16 adv_uuid;
-
-	switch (data->type) {
-	case BT_DATA_NAME_SHORTENED:
-	case BT_DATA_NAME_COMPLETE:
-		memcpy(sr_data->bt_name, data->data, MIN(data->data_len, BT_NAME_LEN - 1));
-		sr_data->bt_name_type = data->type == BT_DATA_NAME_SHORTENED
-						? BT_DATA_NAME_SHORTENED
-						: BT_DATA_NAME_COMPLETE;
-		return true;
-	case BT_DATA_BROADCAST_NAME:
-		memcpy(sr_data->broadcast_name, data->data, MIN(data->data_len, BT_NAME_LEN - 1));
-		return true;
-	case BT_DATA_SVC_DATA16:
-		if (data->data_len < BT_UUID_SIZE_16) {
-			return true;
-		}
-		if (!bt_uuid_create(&adv_uuid.uuid, data->data, BT_UUID_SIZE_16)) {
-			return true;
-		}
-		/* Check for BASS */
-		if (bt_uuid_cmp(&adv_uuid.uuid, BT_UUID_BASS) == 0) {
-			sr_data->has_bass = true;
-
-			return true;
-		}
-		/* Check for Broadcast ID */
-		if (bt_uuid_cmp(&adv_uuid.uuid, BT_UUID_BROADCAST_AUDIO) == 0) {
-			if (data->data_len >= BT_UUID_SIZE_16 + BT_AUDIO_BROADCAST_ID_SIZE) {
-				sr_data->broadcast_id = sys_get_le24(data->data + BT_UUID_SIZE_16);
-			}
-
-			return true;
-		}
-
-		return true;
-	case BT_DATA_UUID16_SOME:
-	case BT_DATA_UUID16_ALL:
-		/* NOTE: According to the BAP 1.0.1 Spec,
-		 * Section 3.9.2. Additional Broadcast Audio Scan Service requirements,
-		 * If the Scan Delegator implements a Broadcast Sink, it should also
-		 * advertise a Service Data field containing the Broadcast Audio
-		 * Scan Service (BASS) UUID.
-		 *
-		 * However, it seems that this is not the case with the sinks available
-		 * while developing this sample application.  Therefore, we instead,
-		 * search for the existence of BASS and PACS in the list of service UUIDs,
-		 * which does seem to exist in the sinks available.
-		 */
-
-		/* Check for BASS and PACS */
-		if (data->data_len % sizeof(uint16_t) != 0U) {
-			LOG_ERR("UUID16 AD malformed");
-			return true;
-		}
-
-		for (size_t i = 0; i < data->data_len; i += sizeof(uint16_t)) {
-			const struct bt_uuid *uuid;
-			uint16_t u16;
-
-			memcpy(&u16, &data->data[i], sizeof(u16));
-			uuid = BT_UUID_DECLARE_16(sys_le16_to_cpu(u16));
-
-			if (bt_uuid_cmp(uuid, BT_UUID_BASS) == 0) {
-				sr_data->has_bass = true;
-				continue;
-			}
-
-			if (bt_uuid_cmp(uuid, BT_UUID_PACS) == 0) {
-				sr_data->has_pacs = true;
-				continue;
-			}
-		}
-
-		return true;
-	case BT_DATA_CSIS_RSI:
-		sr_data->has_csis = true;
-
-		return true;
-	default:
-		return true;
-	}
-}
-
 static bool base_search(struct bt_data *data, void *user_data)
 {
 	const struct bt_bap_base *base = bt_bap_base_get_base_from_ad(data);
@@ -1064,7 +1820,11 @@ static void pa_synced_cb(struct bt_le_per_adv_sync *sync,
 {
 	LOG_INF("PA sync %p synced", (void *)sync);
 
-	k_timer_stop(&pa_sync_create_timer);
+	pa_sync_sched_synced(sync);
+
+	if (IS_ENABLED(CONFIG_BT_PER_ADV_SYNC_TRANSFER_SENDER)) {
+		past_synced(sync, info);
+	}
 }
 
 static void pa_recv_cb(struct bt_le_per_adv_sync *sync,
@@ -1074,85 +1834,103 @@ static void pa_recv_cb(struct bt_le_per_adv_sync *sync,
 	char addr_str[BT_ADDR_LE_STR_LEN];
 
 	bt_addr_le_to_str(info->addr, addr_str, sizeof(addr_str));
-	LOG_INF("PA receive %p, %s", (void *)sync, addr_str);
+	LOG_DBG("PA receive %p, %s", (void *)sync, addr_str);
 
-	if (sync != pa_sync) {
+	if (!pa_sync_sched_owns(sync)) {
 		return;
 	}
 
 	bt_data_parse(buf, base_search, (void *)&base_found);
 
-	if (base_found) {
+	/* Monitored sources report their BASE again only when it changes */
+	if (base_found &&
+	    pa_sync_sched_data_changed(sync, PA_SYNC_DATA_BASE, buf->data, buf->len)) {
 		enum message_sub_type evt_msg_sub_type;
 		struct net_buf *evt_msg;
 
 		LOG_INF("BASE found");
-		source_data_set_pa_recv(info->addr);
+		source_registry_set_pa_recv(info->addr, true);
 
 		evt_msg_sub_type = MESSAGE_SUBTYPE_SOURCE_BASE_FOUND;
-		evt_msg = message_alloc_tx();
-
-		net_buf_add_u8(evt_msg, buf->len + 1);
-		net_buf_add_u8(evt_msg, BT_DATA_BASE);
-		net_buf_add_mem(evt_msg, buf->data, buf->len);
-
-		/* Append data from struct bt_le_scan_recv_info (BT addr) */
-		/* Bluetooth LE Device Address */
-		net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-		net_buf_add_u8(evt_msg,
-			       bt_addr_le_is_identity(info->addr) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-		net_buf_add_u8(evt_msg, info->addr->type);
-		net_buf_add_mem(evt_msg, &info->addr->a, sizeof(bt_addr_t));
-
-		message_send_net_buf_event(evt_msg_sub_type, evt_msg);
+		if (buf->len > MESSAGE_EVT_VALUE_MAX_LEN) {
+			LOG_WRN("PA data too large for BASE event (%u)", buf->len);
+			evt_msg = NULL;
+		} else {
+			evt_msg = MESSAGE_EVT_ALLOC_BULK(SOURCE_BASE_FOUND, buf->len);
+			if (!evt_msg) {
+				/* Reported with the next PA data */
+				pa_sync_sched_data_forget(sync, PA_SYNC_DATA_BASE);
+			}
+		}
 
-		if (pa_syncing) {
-			LOG_INF("Delete PA sync");
-			k_timer_stop(&pa_sync_create_timer);
-			k_work_submit(&pa_sync_delete_work);
-			pa_syncing = false;
+		if (evt_msg) {
+			message_evt_add_mem(evt_msg, BT_DATA_BASE, buf->data, buf->len);
+			/* Append data from struct bt_le_scan_recv_info (BT addr) */
+			message_evt_add_addr(evt_msg, info->addr);
+			message_send_net_buf_event(evt_msg_sub_type, evt_msg);
 		}
 	}
+
+	if (base_found) {
+		/* Give the slot to the next source */
+		pa_sync_sched_release(sync);
+	}
 }
 
 static void pa_term_cb(struct bt_le_per_adv_sync *sync,
 		       const struct bt_le_per_adv_sync_term_info *info)
 {
 	LOG_INF("PA terminated %p %u", (void *)sync, info->reason);
+
+	pa_sync_sched_terminated(sync);
 }
 
 static void pa_biginfo_cb(struct bt_le_per_adv_sync *sync, const struct bt_iso_biginfo *biginfo)
 {
+	NET_BUF_SIMPLE_DEFINE(big_info, MESSAGE_EVT_FIELD_BIG_INFO);
 	enum message_sub_type evt_msg_sub_type;
 	struct net_buf *evt_msg;
 
-	LOG_INF("BIGinfo received (num_bis = %u), %s", biginfo->num_bis,
+	LOG_DBG("BIGinfo received (num_bis = %u), %s", biginfo->num_bis,
+		biginfo->encryption ? "encrypted" : "not encrypted");
+
+	if (!pa_sync_sched_owns(sync)) {
+		return;
+	}
+
+	net_buf_simple_add_u8(big_info, MESSAGE_EVT_FIELD_BIG_INFO - 1 /* num_bis .. encryption */);
+	net_buf_simple_add_u8(big_info, BT_DATA_BIG_INFO);
+	net_buf_simple_add_u8(big_info, biginfo->num_bis);
+	net_buf_simple_add_u8(big_info, biginfo->sub_evt_count);
+	net_buf_simple_add_le16(big_info, biginfo->iso_interval);
+	net_buf_simple_add_u8(big_info, biginfo->burst_number);
+	net_buf_simple_add_u8(big_info, biginfo->offset);
+	net_buf_simple_add_u8(big_info, biginfo->rep_count);
+	net_buf_simple_add_le16(big_info, biginfo->max_pdu);
+	net_buf_simple_add_le32(big_info, biginfo->sdu_interval);
+	net_buf_simple_add_le16(big_info, biginfo->max_sdu);
+	net_buf_simple_add_u8(big_info, biginfo->phy);
+	net_buf_simple_add_u8(big_info, biginfo->framing);
+	net_buf_simple_add_u8(big_info, biginfo->encryption ? 1 : 0);
+
+	/* The BIGinfo is received with every PA event, only changes are sent */
+	if (!pa_sync_sched_data_changed(sync, PA_SYNC_DATA_BIG_INFO, big_info->data,
+					big_info->len)) {
+		return;
+	}
+
+	LOG_INF("BIGinfo changed (num_bis = %u), %s", biginfo->num_bis,
 		biginfo->encryption ? "encrypted" : "not encrypted");
 
 	evt_msg_sub_type = MESSAGE_SUBTYPE_SOURCE_BIG_INFO;
-	evt_msg = message_alloc_tx();
-
-	/* Bluetooth LE Device Address */
-	net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-	net_buf_add_u8(evt_msg,
-		       bt_addr_le_is_identity(biginfo->addr) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-	net_buf_add_u8(evt_msg, biginfo->addr->type);
-	net_buf_add_mem(evt_msg, &biginfo->addr->a, sizeof(bt_addr_t));
-
-	net_buf_add_u8(evt_msg, 1 + 18 /* sizeof num_bis .. encryption fields */);
-	net_buf_add_u8(evt_msg, BT_DATA_BIG_INFO);
-	net_buf_add_u8(evt_msg, biginfo->num_bis);
-	net_buf_add_u8(evt_msg, biginfo->sub_evt_count);
-	net_buf_add_le16(evt_msg, biginfo->iso_interval);
-	net_buf_add_u8(evt_msg, biginfo->burst_number);
-	net_buf_add_u8(evt_msg, biginfo->offset);
-	net_buf_add_u8(evt_msg, biginfo->rep_count);
-	net_buf_add_le16(evt_msg, biginfo->max_pdu);
-	net_buf_add_le32(evt_msg, biginfo->sdu_interval);
-	net_buf_add_le16(evt_msg, biginfo->max_sdu);
-	net_buf_add_u8(evt_msg, biginfo->phy);
-	net_buf_add_u8(evt_msg, biginfo->framing);
-	net_buf_add_u8(evt_msg, biginfo->encryption ? 1 : 0);
+	evt_msg = MESSAGE_EVT_ALLOC_BULK(SOURCE_BIG_INFO, 0);
+	if (!evt_msg) {
+		pa_sync_sched_data_forget(sync, PA_SYNC_DATA_BIG_INFO);
+		return;
+	}
+
+	message_evt_add_addr(evt_msg, biginfo->addr);
+	net_buf_add_mem(evt_msg, big_info->data, big_info->len);
 
 	message_send_net_buf_event(evt_msg_sub_type, evt_msg);
 }
@@ -1164,77 +1942,24 @@ static struct bt_le_per_adv_sync_cb pa_synced_callbacks = {
 	.biginfo = pa_biginfo_cb,
 };
 
-static uint16_t interval_to_sync_timeout(uint16_t pa_interval)
-{
-	uint16_t pa_timeout;
-
-	if (pa_interval == BT_BAP_PA_INTERVAL_UNKNOWN) {
-		/* Use maximum value to maximize chance of success */
-		pa_timeout = BT_GAP_PER_ADV_MAX_TIMEOUT;
-	} else {
-		uint32_t interval_ms;
-		uint32_t timeout;
-
-		/* Add retries and convert to unit in 10's of ms */
-		interval_ms = BT_GAP_PER_ADV_INTERVAL_TO_MS(pa_interval);
-		timeout = (interval_ms * PA_SYNC_INTERVAL_TO_TIMEOUT_RATIO) / 10;
-
-		/* Enforce restraints */
-		pa_timeout = CLAMP(timeout, BT_GAP_PER_ADV_MIN_TIMEOUT, BT_GAP_PER_ADV_MAX_TIMEOUT);
-	}
-
-	return pa_timeout;
-}
-
-static int pa_sync_create(const struct bt_le_scan_recv_info *info)
-{
-	struct bt_le_per_adv_sync_param per_adv_sync_param = {0};
-
-	bt_addr_le_copy(&per_adv_sync_param.addr, info->addr);
-	per_adv_sync_param.options = BT_LE_PER_ADV_SYNC_OPT_FILTER_DUPLICATE;
-	per_adv_sync_param.sid = info->sid;
-	per_adv_sync_param.skip = PA_SYNC_SKIP;
-	per_adv_sync_param.timeout = interval_to_sync_timeout(info->interval);
-
-	uint16_t create_timeout_duration_ms;
-
-	create_timeout_duration_ms = per_adv_sync_param.timeout * 10U;
-	LOG_INF("PA sync create timeout set to %u ms", create_timeout_duration_ms);
-	k_timer_start(&pa_sync_create_timer, K_MSEC(create_timeout_duration_ms), K_NO_WAIT);
-
-	return bt_le_per_adv_sync_create(&per_adv_sync_param, &pa_sync);
-}
-
-static bool scan_for_source(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad,
-			    struct scan_recv_data *sr_data)
+static bool scan_for_source(const struct bt_le_scan_recv_info *info,
+			    const struct scan_ad_info *ad_info)
 {
 	/* Scan for Broadcast Source */
 
-	sr_data->broadcast_id = INVALID_BROADCAST_ID;
-
-	/* We are only interested in non-connectable periodic advertisers */
-	if ((info->adv_props & BT_GAP_ADV_PROP_CONNECTABLE) != 0 || info->interval == 0) {
+	if (ad_info->broadcast_id != SCAN_AD_INVALID_BROADCAST_ID) {
+		LOG_DBG("Broadcast Source Found [name, b_name, b_id] = [\"%s\", \"%s\", 0x%06x]",
+			ad_info->bt_name, ad_info->broadcast_name, ad_info->broadcast_id);
 
-		return false;
-	}
+		struct source_record record;
 
-	bt_data_parse(ad, device_found, (void *)sr_data);
+		source_registry_update(info->addr, info->sid, info->interval,
+				       ad_info->broadcast_id, ad_info->broadcast_name, &record);
 
-	if (sr_data->broadcast_id != INVALID_BROADCAST_ID) {
-		LOG_DBG("Broadcast Source Found [name, b_name, b_id] = [\"%s\", \"%s\", 0x%06x]",
-			sr_data->bt_name, sr_data->broadcast_name, sr_data->broadcast_id);
-
-		source_data_add(info->addr);
-
-		if (!pa_syncing && !source_data_get_pa_recv(info->addr)) {
-			LOG_INF("PA sync create (b_id = 0x%06x, \"%s\")", sr_data->broadcast_id,
-				sr_data->broadcast_name);
-			int err = pa_sync_create(info);
-			if (err != 0) {
-				LOG_INF("Could not create Broadcast PA sync: %d", err);
-			} else {
-				pa_syncing = true;
-			}
+		if (!record.pa_recv) {
+			LOG_DBG("PA sync request (b_id = 0x%06x, \"%s\")", ad_info->broadcast_id,
+				ad_info->broadcast_name);
+			pa_sync_sched_request(info->addr, info->sid, info->interval, info->rssi);
 		}
 
 		return true;
@@ -1243,25 +1968,17 @@ static bool scan_for_source(const struct bt_le_scan_recv_info *info, struct net_
 	return false;
 }
 
-static bool scan_for_sink(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad,
-			  struct scan_recv_data *sr_data)
+static bool scan_for_sink(const struct bt_le_scan_recv_info *info,
+			  const struct scan_ad_info *ad_info)
 {
 	/* Scan for Broadcast Sink */
 
-	/* We are only interested in connectable advertisers */
-	if ((info->adv_props & BT_GAP_ADV_PROP_CONNECTABLE) == 0) {
-
-		return false;
-	}
-
-	bt_data_parse(ad, device_found, (void *)sr_data);
-
-	if (sr_data->has_bass) {
+	if (ad_info->has_bass) {
 		char addr_str[BT_ADDR_LE_STR_LEN];
 
 		bt_addr_le_to_str(info->addr, addr_str, sizeof(addr_str));
-		LOG_INF("Broadcast Sink Found: [\"%s\", %s]%s", sr_data->bt_name, addr_str,
-			sr_data->has_csis ? ", CSIS" : "");
+		LOG_INF("Broadcast Sink Found: [\"%s\", %s]%s", ad_info->bt_name, addr_str,
+			ad_info->has_csis ? ", CSIS" : "");
 
 		return true;
 	}
@@ -1269,21 +1986,12 @@ static bool scan_for_sink(const struct bt_le_scan_recv_info *info, struct net_bu
 	return false;
 }
 
-static bool scan_for_csis_member(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad,
-				 struct scan_recv_data *sr_data)
+static bool scan_for_csis_member(const struct bt_le_scan_recv_info *info,
+				 const struct scan_ad_info *ad_info)
 {
 	/* Scan for CSIS member */
 
-	/* We are only interested in connectable advertisers */
-	if ((info->adv_props & BT_GAP_ADV_PROP_CONNECTABLE) == 0) {
-
-		return false;
-	}
-
-	/* Scanning for set members */
-	bt_data_parse(ad, csis_member_found, (void *)sr_data);
-
-	if (sr_data->set_member) {
+	if (ad_info->set_member) {
 		char addr_str[BT_ADDR_LE_STR_LEN];
 
 		bt_addr_le_to_str(info->addr, addr_str, sizeof(addr_str));
@@ -1294,149 +2002,178 @@ static bool scan_for_csis_member(const struct bt_le_scan_recv_info *info, struct
 			return false;
 		}
 
-		bt_addr_le_copy(&csis_members[csis_members_cnt++], info->addr);
-		LOG_INF("Set member found (%u / %u), %s", csis_members_cnt, csis_set_size,
-			addr_str);
+		if (csis_members_cnt == ARRAY_SIZE(csis_members)) {
+			LOG_WRN("No room for set member, %s", addr_str);
+
+			return false;
+		}
+
+		bt_addr_le_copy(&csis_members[csis_members_cnt++], info->addr);
+		LOG_INF("Set member found (%u / %u), %s", csis_members_cnt, csis_set_size,
+			addr_str);
+
+		return true;
+	}
+
+	return false;
+}
+
+static bool scan_rsp_of_sink(const struct bt_le_scan_recv_info *info,
+			     const struct scan_ad_info *ad_info)
+{
+	/* Sinks are scanned actively, the name may only be in the scan response */
+	return (info->adv_props & BT_GAP_ADV_PROP_SCAN_RESPONSE) != 0 &&
+	       ad_info->bt_name[0] != '\0' &&
+	       scan_cache_contains(MESSAGE_SUBTYPE_SINK_FOUND, info->addr);
+}
 
+static bool scan_passes_filter(enum scan_filter_target target,
+			       const struct bt_le_scan_recv_info *info,
+			       const struct scan_ad_info *ad_info)
+{
+	if (scan_filter_match(target, info, ad_info)) {
 		return true;
 	}
 
+	stats_inc(STATS_SCAN_FILTERED);
+
 	return false;
 }
 
 static void scan_recv_cb(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad)
 {
-	if (ba_scan_mode & BROADCAST_ASSISTANT_SCAN_SOURCE) {
-		struct scan_recv_data sr_data = {0};
-		struct net_buf_simple ad_clone;
+	struct scan_ad_info ad_info;
+	uint8_t modes = ba_scan_mode;
+
+	stats_inc(STATS_SCAN_REPORTS);
+
+	/* Sources are non-connectable periodic advertisers, sinks and set members connectable */
+	if ((info->adv_props & BT_GAP_ADV_PROP_CONNECTABLE) != 0 || info->interval == 0) {
+		modes &= ~BROADCAST_ASSISTANT_SCAN_SOURCE;
+	}
+	if ((info->adv_props & BT_GAP_ADV_PROP_CONNECTABLE) == 0) {
+		modes &= ~(BROADCAST_ASSISTANT_SCAN_SINK | BROADCAST_ASSISTANT_SCAN_CSIS);
+	}
+
+	if (modes == BROADCAST_ASSISTANT_SCAN_IDLE) {
+		return;
+	}
 
-		/* Clone needed for the event message because bt_data_parse consumes ad data */
-		net_buf_simple_clone(ad, &ad_clone);
-		if (scan_for_source(info, &ad_clone, &sr_data)) {
+	/* One pass over the advertising data for all active scan modes */
+	scan_ad_classify(ad, modes | (scan_filter_needs_services() ? SCAN_AD_ALL_SERVICES : 0),
+			 csis_sirk, &ad_info);
+
+	/* Host filters are applied before anything is cached or allocated */
+	if (modes & BROADCAST_ASSISTANT_SCAN_SOURCE) {
+		if (scan_for_source(info, &ad_info) &&
+		    scan_passes_filter(SCAN_FILTER_SOURCE, info, &ad_info) &&
+		    scan_cache_should_report(MESSAGE_SUBTYPE_SOURCE_FOUND, info->addr, info->rssi,
+					     ad->data, ad->len)) {
 			enum message_sub_type evt_msg_sub_type;
 			struct net_buf *evt_msg;
 
 			/* broadcast source found */
 			evt_msg_sub_type = MESSAGE_SUBTYPE_SOURCE_FOUND;
-			evt_msg = message_alloc_tx();
-
-			net_buf_add_mem(evt_msg, ad->data, ad->len);
-
-			/* Append data from struct bt_le_scan_recv_info (RSSI, BT addr, ..) */
-			/* RSSI */
-			net_buf_add_u8(evt_msg, 2);
-			net_buf_add_u8(evt_msg, BT_DATA_RSSI);
-			net_buf_add_u8(evt_msg, info->rssi);
-			/* Bluetooth LE Device Address */
-			net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-			net_buf_add_u8(evt_msg, bt_addr_le_is_identity(info->addr) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-			net_buf_add_u8(evt_msg, info->addr->type);
-			net_buf_add_mem(evt_msg, &info->addr->a, sizeof(bt_addr_t));
-			/* BT name */
-			net_buf_add_u8(evt_msg, strlen(sr_data.bt_name) + 1);
-			net_buf_add_u8(evt_msg, sr_data.bt_name_type);
-			net_buf_add_mem(evt_msg, &sr_data.bt_name, strlen(sr_data.bt_name));
-
-			/* sid */
-			net_buf_add_u8(evt_msg, 2);
-			net_buf_add_u8(evt_msg, BT_DATA_SID);
-			net_buf_add_u8(evt_msg, info->sid);
-			/* pa interval */
-			net_buf_add_u8(evt_msg, 3);
-			net_buf_add_u8(evt_msg, BT_DATA_PA_INTERVAL);
-			net_buf_add_le16(evt_msg, info->interval);
-			/* broadcast id */
-			net_buf_add_u8(evt_msg, 5);
-			net_buf_add_u8(evt_msg, BT_DATA_BROADCAST_ID);
-			net_buf_add_le32(evt_msg, sr_data.broadcast_id);
-
-			message_send_net_buf_event(evt_msg_sub_type, evt_msg);
+			evt_msg = SCAN_BATCH_ALLOC(SOURCE_FOUND, ad->len);
+			if (evt_msg) {
+				net_buf_add_mem(evt_msg, ad->data, ad->len);
+
+				/* Append data from struct bt_le_scan_recv_info (RSSI, BT addr, ..) */
+				message_evt_add_u8(evt_msg, BT_DATA_RSSI, info->rssi);
+				message_evt_add_addr(evt_msg, info->addr);
+				message_evt_add_mem(evt_msg, ad_info.bt_name_type, ad_info.bt_name,
+						    strlen(ad_info.bt_name));
+				message_evt_add_u8(evt_msg, BT_DATA_SID, info->sid);
+				message_evt_add_le16(evt_msg, BT_DATA_PA_INTERVAL, info->interval);
+				message_evt_add_le32(evt_msg, BT_DATA_BROADCAST_ID, ad_info.broadcast_id);
+
+				scan_batch_commit(evt_msg_sub_type, evt_msg);
+				stats_inc(STATS_SCAN_FORWARDED);
+			}
 		}
 	}
 
-	if (ba_scan_mode & BROADCAST_ASSISTANT_SCAN_SINK) {
-		struct scan_recv_data sr_data = {0};
-		struct net_buf_simple ad_clone;
+	if (modes & BROADCAST_ASSISTANT_SCAN_SINK) {
+		uint8_t kind = MESSAGE_SUBTYPE_SINK_FOUND;
+		enum scan_filter_target target = SCAN_FILTER_SINK;
+		bool found = scan_for_sink(info, &ad_info);
 
-		/* Clone needed for the event message because bt_data_parse consumes ad data */
-		net_buf_simple_clone(ad, &ad_clone);
-		if (scan_for_sink(info, &ad_clone, &sr_data)) {
+		if (!found && scan_rsp_of_sink(info, &ad_info)) {
+			/* Reported as SINK_FOUND, the host picks up the name */
+			kind = SCAN_CACHE_SCAN_RSP(MESSAGE_SUBTYPE_SINK_FOUND);
+			target = SCAN_FILTER_SINK_SCAN_RSP;
+			found = true;
+		}
+
+		if (found && scan_passes_filter(target, info, &ad_info) &&
+		    scan_cache_should_report(kind, info->addr, info->rssi, ad->data,
+						      ad->len)) {
 			enum message_sub_type evt_msg_sub_type;
 			struct net_buf *evt_msg;
 
 			/* broadcast sink found */
 			evt_msg_sub_type = MESSAGE_SUBTYPE_SINK_FOUND;
-			evt_msg = message_alloc_tx();
-
-			net_buf_add_mem(evt_msg, ad->data, ad->len);
-
-			/* Append data from struct bt_le_scan_recv_info (RSSI, BT addr, ..) */
-			/* RSSI */
-			net_buf_add_u8(evt_msg, 2);
-			net_buf_add_u8(evt_msg, BT_DATA_RSSI);
-			net_buf_add_u8(evt_msg, info->rssi);
-			/* Bluetooth LE Device Address */
-			net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-			net_buf_add_u8(evt_msg, bt_addr_le_is_identity(info->addr) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-			net_buf_add_u8(evt_msg, info->addr->type);
-			net_buf_add_mem(evt_msg, &info->addr->a, sizeof(bt_addr_t));
-			/* BT name */
-			net_buf_add_u8(evt_msg, strlen(sr_data.bt_name) + 1);
-			net_buf_add_u8(evt_msg, sr_data.bt_name_type);
-			net_buf_add_mem(evt_msg, &sr_data.bt_name, strlen(sr_data.bt_name));
-
-			message_send_net_buf_event(evt_msg_sub_type, evt_msg);
+			evt_msg = SCAN_BATCH_ALLOC(SINK_FOUND, ad->len);
+			if (evt_msg) {
+				net_buf_add_mem(evt_msg, ad->data, ad->len);
+
+				/* Append data from struct bt_le_scan_recv_info (RSSI, BT addr, ..) */
+				message_evt_add_u8(evt_msg, BT_DATA_RSSI, info->rssi);
+				message_evt_add_addr(evt_msg, info->addr);
+				message_evt_add_mem(evt_msg, ad_info.bt_name_type, ad_info.bt_name,
+						    strlen(ad_info.bt_name));
+
+				scan_batch_commit(evt_msg_sub_type, evt_msg);
+				stats_inc(STATS_SCAN_FORWARDED);
+			}
 		}
 	}
 
-	if (ba_scan_mode & BROADCAST_ASSISTANT_SCAN_CSIS) {
-		struct scan_recv_data sr_data = {0};
-		struct net_buf_simple ad_clone;
-
-		/* Clone needed for the event message because bt_data_parse consumes ad data */
-		net_buf_simple_clone(ad, &ad_clone);
-		if (scan_for_csis_member(info, &ad_clone, &sr_data)) {
+	if (modes & BROADCAST_ASSISTANT_SCAN_CSIS) {
+		if (scan_for_csis_member(info, &ad_info)) {
 			enum message_sub_type evt_msg_sub_type;
 			struct net_buf *evt_msg;
 
 			/* csis member found */
 			evt_msg_sub_type = MESSAGE_SUBTYPE_SET_MEMBER_FOUND;
-			evt_msg = message_alloc_tx();
-
-			net_buf_add_mem(evt_msg, ad->data, ad->len);
-
-			/* Bluetooth LE Device Address */
-			net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-			net_buf_add_u8(evt_msg, bt_addr_le_is_identity(info->addr) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-			net_buf_add_u8(evt_msg, info->addr->type);
-			net_buf_add_mem(evt_msg, &info->addr->a, sizeof(bt_addr_t));
-
-			message_send_net_buf_event(evt_msg_sub_type, evt_msg);
+			evt_msg = SCAN_BATCH_ALLOC(SET_MEMBER_FOUND, ad->len);
+			if (evt_msg) {
+				net_buf_add_mem(evt_msg, ad->data, ad->len);
+				message_evt_add_addr(evt_msg, info->addr);
+				scan_batch_commit(evt_msg_sub_type, evt_msg);
+				stats_inc(STATS_SCAN_FORWARDED);
+			}
 
 			if (csis_members_cnt == csis_set_size) {
 				LOG_INF("All members found");
 
 				/* Restore previous scan mode */
 				ba_scan_mode = ba_scan_mode & ~BROADCAST_ASSISTANT_SCAN_CSIS;
-				if (ba_scan_mode == BROADCAST_ASSISTANT_SCAN_IDLE) {
-					int err = bt_le_scan_stop();
-					if (err) {
-						LOG_ERR("bt_le_scan_stop failed with %d", err);
-					}
-				}
+				(void)scan_sched_set_modes(ba_scan_mode);
 			}
 		}
 	}
 }
 
+void broadcast_assistant_scan_inject(const struct bt_le_scan_recv_info *info,
+				     struct net_buf_simple *ad)
+{
+	scan_recv_cb(info, ad);
+}
+
 static void scan_timeout_cb(void)
 {
+	struct net_buf *evt_msg;
+
 	LOG_INF("Scan timeout");
 
 	ba_scan_mode = BROADCAST_ASSISTANT_SCAN_IDLE;
 
-	message_send_return_code(MESSAGE_TYPE_EVT, MESSAGE_SUBTYPE_STOP_SCAN, 0, 0);
-
+	evt_msg = MESSAGE_EVT_ALLOC(STOP_SCAN, 0);
+	if (evt_msg) {
+		message_evt_add_err(evt_msg, 0 /* OK */);
+		message_send_net_buf_event(MESSAGE_SUBTYPE_STOP_SCAN, evt_msg);
+	}
 }
 
 static void add_csis_member(struct bt_conn *conn, void *data)
@@ -1479,98 +2216,229 @@ static void disconnect(struct bt_conn *conn, void *data)
 	}
 }
 
-static void add_source_foreach_sink(struct bt_conn *conn, void *data)
+static void disconnect_all(void)
 {
-	int err;
-	struct bt_conn_info info;
-
-	const struct bt_bap_broadcast_assistant_add_src_param *param =
-		(struct bt_bap_broadcast_assistant_add_src_param *)data;
+	LOG_INF("Disconnecting all devices");
 
-	err = bt_conn_get_info(conn, &info);
-	if (err) {
-		LOG_ERR("Failed to get conn info (err %d)", err);
-	}
-
-	if (info.state != BT_CONN_STATE_CONNECTED) {
-		LOG_WRN("Skip adding broadcast source for this conn %p (not connected)",
-			(void *)conn);
-		return;
-	}
+	connect_known_cnt = 0;
+	bt_conn_foreach(BT_CONN_TYPE_LE, disconnect, NULL);
+}
 
+/* Adds the source of param to the sink, for ADD_SOURCE and SWITCH_SOURCE */
+static int add_src_write(struct bt_conn *conn,
+			 const struct bt_bap_broadcast_assistant_add_src_param *param, uint32_t start)
+{
 	LOG_INF("Adding broadcast source for this conn %p ...", (void *)conn);
 
-	err = k_sem_take(&sem_add_source, SYS_TIMEOUT_MS(2000));
-	if (err != 0) {
-		LOG_ERR("sem_rem_source timed out");
-	}
+	struct ba_sink *sink = ba_sink_get(conn);
 
 	/* Clear recv_state */
-	memset(&ba_recv_state[bt_conn_index(conn)], 0,
-	       sizeof(struct bt_bap_scan_delegator_recv_state));
+	memset(&sink->recv_state, 0, sizeof(sink->recv_state));
+	sink->source_broadcast_id = param->broadcast_id;
+	sink->has_source_id = false;
+	sink->past_pending = false;
+	sink->add_src_start = start;
+	sink->add_src_timing = true;
 
-	err = bt_bap_broadcast_assistant_add_src(conn, param);
-	if (err) {
-		LOG_ERR("Failed to add source (err %d)", err);
+	(void)past_monitor_get(sink, &param->addr, param->adv_sid, param->pa_interval);
+
+	return bt_bap_broadcast_assistant_add_src(conn, param);
+}
+
+static int add_src_issue(struct bt_conn *conn)
+{
+	return add_src_write(conn, &add_src_param, add_src_start);
+}
+
+static void add_src_start_work_handler(struct k_work *work)
+{
+	if (!atomic_cas(&add_src_waiting, 1, 0)) {
+		/* Started already */
+		return;
 	}
+
+	if (pa_sync_sched_get_synced(&add_src_param.addr, add_src_param.adv_sid) == NULL) {
+		LOG_INF("Not synced to the source, sinks sync on their own");
+	}
+
+	sink_op_start(&add_src_op);
+	/* Kept by the sinks the source was added to */
+	past_monitor_release(&add_src_param.addr);
 }
 
-static void remove_source_foreach_sink(struct bt_conn *conn, void *data)
+/*
+ * The host stack only asks a sink for PAST if we are synced to the source
+ * when the source is added, and the sink supports it. Otherwise the sink
+ * has to scan and sync on its own.
+ *
+ * Returns true if the sink operation is started once synced.
+ */
+static bool add_src_wait_for_sync(void)
 {
 	int err;
-	struct bt_conn_info info;
 
-	const struct bt_bap_broadcast_assistant_mod_src_param *param =
-		(struct bt_bap_broadcast_assistant_mod_src_param *)data;
-
-	err = bt_conn_get_info(conn, &info);
+	/* Kept for SyncInfo requests, then by each sink until it is synced (past_monitor_get()) */
+	err = pa_sync_sched_monitor_start(&add_src_param.addr, add_src_param.adv_sid,
+					  add_src_param.pa_interval, PA_MONITOR_PAST);
 	if (err) {
-		LOG_ERR("Failed to get conn info (err %d)", err);
+		LOG_WRN("No PA sync of our own for PAST (err %d)", err);
+		return false;
 	}
 
-	if (info.state != BT_CONN_STATE_CONNECTED) {
-		LOG_WRN("Skip removing broadcast source for this conn %p (not connected)",
-			(void *)conn);
-		return;
+	atomic_set(&add_src_waiting, 1);
+
+	if (pa_sync_sched_get_synced(&add_src_param.addr, add_src_param.adv_sid)) {
+		/* Unless pa_synced_cb got there first */
+		return !atomic_cas(&add_src_waiting, 1, 0);
 	}
 
+	/* Run with the commands, RESET cancels it */
+	k_work_reschedule_for_queue(message_cmd_workqueue_get(), &add_src_start_work,
+				    K_MSEC(CONFIG_PAST_SYNC_WAIT_MS));
+
+	return true;
+}
+
+static int rem_src_issue(struct bt_conn *conn)
+{
+	struct ba_sink *sink = ba_sink_get(conn);
+
 	LOG_INF("Removing broadcast source for this conn %p ...", (void *)conn);
 
-	err = k_sem_take(&sem_rem_source, SYS_TIMEOUT_MS(2000));
-	if (err != 0) {
-		LOG_ERR("sem_rem_source timed out");
-	}
-	err = bt_bap_broadcast_assistant_mod_src(conn, param);
-	if (err) {
-		LOG_ERR("Failed to modify source (err %d)", err);
+	/* The parameters are written out before returning, only the source ID differs */
+	if (!sink->has_source_id) {
+		sink->source_id = rem_src_source_id;
 	}
+	mod_src_param.src_id = sink->source_id;
+
+	return bt_bap_broadcast_assistant_mod_src(conn, &mod_src_param);
 }
 
-static void add_broadcast_code_foreach_sink(struct bt_conn *conn, void *data)
+static int bcode_issue(struct bt_conn *conn)
 {
-	int err;
-	struct bt_conn_info info;
+	const struct ba_sink *sink = ba_sink_get(conn);
 
-	add_broadcast_code_data_t *add_broadcast_code_data = (add_broadcast_code_data_t *)data;
+	LOG_INF("Adding broadcast code for this conn %p ...", (void *)conn);
 
-	err = bt_conn_get_info(conn, &info);
-	if (err) {
-		LOG_ERR("Failed to get conn info (err %d)", err);
+	return bt_bap_broadcast_assistant_set_broadcast_code(
+		conn, sink->has_source_id ? sink->source_id : add_broadcast_code_data.src_id,
+		add_broadcast_code_data.broadcast_code);
+}
+
+static bool switch_src_filter(struct bt_conn *conn)
+{
+	/* Marked when the switch was started */
+	return ba_sink_get(conn)->switch_settling;
+}
+
+/*
+ * Modify Source only changes the BIS sync of the same broadcast source, a sink
+ * synced to another one has it stopped and removed before the new one is added.
+ */
+static int switch_src_issue(struct bt_conn *conn)
+{
+	struct ba_sink *sink = ba_sink_get(conn);
+	struct bt_bap_broadcast_assistant_mod_src_param *param = &switch_src.mod_param;
+	const struct bt_bap_broadcast_assistant_add_src_param *add_param = &switch_src.add_param;
+	enum switch_src_step step;
+	int err;
+
+	if (sink->switch_step != SWITCH_SRC_IDLE) {
+		/* Still writing for a previous SWITCH_SOURCE */
+		return -EBUSY;
 	}
 
-	if (info.state != BT_CONN_STATE_CONNECTED) {
-		LOG_WRN("Skip adding broadcast code for this conn %p (not connected)",
+	/* The parameters are written out before returning */
+	if (!sink->has_source_id) {
+		LOG_INF("Source switch, adding source for this conn %p", (void *)conn);
+		step = SWITCH_SRC_ADD;
+		err = add_src_write(conn, add_param, switch_src.start);
+	} else if (sink->source_broadcast_id == add_param->broadcast_id) {
+		LOG_INF("Source switch, modifying source %u for this conn %p", sink->source_id,
 			(void *)conn);
-		return;
+		param->src_id = sink->source_id;
+		param->pa_sync = true;
+		param->pa_interval = add_param->pa_interval;
+		param->num_subgroups = add_param->num_subgroups;
+		param->subgroups = add_param->subgroups;
+		sink->add_src_start = switch_src.start;
+		sink->add_src_timing = true;
+		if (sink->recv_state.pa_sync_state != BT_BAP_PA_STATE_SYNCED) {
+			(void)past_monitor_get(sink, &add_param->addr, add_param->adv_sid,
+					       add_param->pa_interval);
+		}
+		step = SWITCH_SRC_MODIFY;
+		err = bt_bap_broadcast_assistant_mod_src(conn, param);
+	} else {
+		LOG_INF("Source switch, stopping source %u for this conn %p", sink->source_id,
+			(void *)conn);
+		param->src_id = sink->source_id;
+		param->pa_sync = false;
+		param->pa_interval = BT_BAP_PA_INTERVAL_UNKNOWN;
+		param->num_subgroups =
+			CLAMP(sink->recv_state.num_subgroups, 1, CONFIG_BT_BAP_BASS_MAX_SUBGROUPS);
+		param->subgroups = switch_src.stop_subgroups; /* bis_sync = 0 */
+		/* Synced before the new source is added, sinks asking early are sent PAST */
+		(void)past_monitor_get(sink, &add_param->addr, add_param->adv_sid,
+				       add_param->pa_interval);
+		step = SWITCH_SRC_STOP;
+		err = bt_bap_broadcast_assistant_mod_src(conn, param);
 	}
 
-	LOG_INF("Adding broadcast code for this conn %p ...", (void *)conn);
+	if (err == 0) {
+		sink->switch_step = step;
+	}
 
-	err = bt_bap_broadcast_assistant_set_broadcast_code(
-		conn, add_broadcast_code_data->src_id, add_broadcast_code_data->broadcast_code);
-	if (err) {
-		LOG_ERR("Failed to add broadcast code (err %d)", err);
+	return err;
+}
+
+/*
+ * Fills in the source being added, for ADD_SOURCE (add_src_param) and
+ * SWITCH_SOURCE (switch_src). subgroup has CONFIG_BT_BAP_BASS_MAX_SUBGROUPS entries.
+ */
+static void add_src_param_set(struct bt_bap_broadcast_assistant_add_src_param *param,
+			      struct bt_bap_bass_subgroup *subgroup, uint8_t sid,
+			      uint16_t pa_interval, uint32_t broadcast_id, const bt_addr_le_t *addr,
+			      uint8_t num_subgroups, const uint32_t *bis_sync)
+{
+	memset(subgroup, 0, CONFIG_BT_BAP_BASS_MAX_SUBGROUPS * sizeof(*subgroup));
+	memset(param, 0, sizeof(*param));
+
+	num_subgroups = MIN(num_subgroups, CONFIG_BT_BAP_BASS_MAX_SUBGROUPS);
+	for (int i = 0; i < num_subgroups; i++) {
+		subgroup[i].bis_sync = bis_sync[i];
+	}
+
+	if (num_subgroups == 0) {
+		num_subgroups = 1;
+		subgroup[0].bis_sync = BT_BAP_BIS_SYNC_NO_PREF;
+		LOG_WRN("num_subgroups argument is 0. Change to 1 and set bis sync no pref");
+	} else {
+		for (int i = 0; i < num_subgroups; i++) {
+			LOG_INF("bis_sync[%d]: %x", i, subgroup[i].bis_sync);
+		}
 	}
+
+	bt_addr_le_copy(&param->addr, addr);
+	param->adv_sid = sid;
+	param->pa_interval = pa_interval;
+	param->broadcast_id = broadcast_id;
+	param->pa_sync = true;
+
+	struct device_store_source last_source = {
+		.broadcast_id = broadcast_id,
+		.pa_interval = pa_interval,
+		.sid = sid,
+	};
+
+	bt_addr_le_copy(&last_source.addr, addr);
+	device_store_set_last_source(&last_source);
+
+	LOG_INF("adv_sid = %u, pa_interval = %u, broadcast_id = 0x%08x, num_subgroups = %u",
+		param->adv_sid, param->pa_interval, param->broadcast_id, num_subgroups);
+
+	param->num_subgroups = num_subgroups;
+	param->subgroups = subgroup;
 }
 
 /*
@@ -1579,21 +2447,25 @@ static void add_broadcast_code_foreach_sink(struct bt_conn *conn, void *data)
 
 int broadcast_assistant_start_scan(uint8_t mode, uint8_t set_size, uint8_t sirk[BT_CSIP_SIRK_SIZE])
 {
-	/* Scan already ongoing? */
-	if (ba_scan_mode == BROADCAST_ASSISTANT_SCAN_IDLE) {
-		int err = bt_le_scan_start(BT_LE_SCAN_PASSIVE, NULL);
-		if (err) {
-			LOG_ERR("Scanning failed to start (err %d)", err);
-			return err;
-		}
+	/* Starts scanning, or adapts an ongoing scan to the new mode */
+	int err = scan_sched_set_modes(ba_scan_mode | mode);
+
+	if (err) {
+		return err;
 	}
 
 	if (mode == BROADCAST_ASSISTANT_SCAN_SOURCE) {
-		reset_source_data();
+		pa_sync_sched_stop();
+		source_registry_reset();
 	} else if (mode == BROADCAST_ASSISTANT_SCAN_CSIS) {
 		reset_csis_data(set_size, sirk);
 	}
 
+	if (mode & (BROADCAST_ASSISTANT_SCAN_SOURCE | BROADCAST_ASSISTANT_SCAN_SINK)) {
+		/* A new scan reports all advertisers once */
+		scan_cache_reset();
+	}
+
 	ba_scan_mode = ba_scan_mode | mode;
 
 	LOG_INF("Scanning started (mode: 0x%08x)", ba_scan_mode);
@@ -1601,6 +2473,11 @@ int broadcast_assistant_start_scan(uint8_t mode, uint8_t set_size, uint8_t sirk[
 	return 0;
 }
 
+uint8_t broadcast_assistant_scan_mode_get(void)
+{
+	return ba_scan_mode;
+}
+
 int broadcast_assistant_stop_scanning(void)
 {
 	if (ba_scan_mode == BROADCAST_ASSISTANT_SCAN_IDLE) {
@@ -1608,22 +2485,17 @@ int broadcast_assistant_stop_scanning(void)
 		return 0;
 	}
 
-	int err = bt_le_scan_stop();
+	int err = scan_sched_set_modes(BROADCAST_ASSISTANT_SCAN_IDLE);
 	if (err) {
-		LOG_ERR("bt_le_scan_stop failed with %d", err);
 		return err;
 	}
 
 	ba_scan_mode = BROADCAST_ASSISTANT_SCAN_IDLE;
+	scan_batch_flush();
 
 	LOG_INF("Scanning stopped");
 
-	if (pa_syncing) {
-		LOG_INF("Delete PA sync");
-		k_timer_stop(&pa_sync_create_timer);
-		k_work_submit(&pa_sync_delete_work);
-		pa_syncing = false;
-	}
+	pa_sync_sched_stop();
 
 	return 0;
 }
@@ -1634,6 +2506,7 @@ int broadcast_assistant_disconnect_unpair_all(void)
 
 	LOG_INF("Disconnecting and unpairing all devices");
 
+	connect_known_cnt = 0;
 	bt_conn_foreach(BT_CONN_TYPE_LE, disconnect, NULL);
 
 	LOG_INF("Disconnecting complete");
@@ -1642,6 +2515,7 @@ int broadcast_assistant_disconnect_unpair_all(void)
 	if (err) {
 		LOG_ERR("bt_unpair failed with %d", err);
 	}
+	device_store_remove(BT_ADDR_LE_ANY);
 
 	LOG_INF("Unpair complete");
 
@@ -1661,28 +2535,19 @@ int broadcast_assistant_connect_to_sink(bt_addr_le_t *bt_addr_le)
 		.window_coded = 0,
 		.timeout = 1000, /* ms * 10 */
 	};
-	const struct bt_le_conn_param *param =
-		BT_LE_CONN_PARAM(BT_GAP_INIT_CONN_INT_MIN, BT_GAP_INIT_CONN_INT_MAX, 0, 800);
+	/* Relaxed to SINK_CONN_PARAM once the sink has been discovered */
+	const struct bt_le_conn_param *param = SINK_DISCOVERY_CONN_PARAM;
 
 	LOG_INF("Connect to sink...");
 
-	/* Stop scanning if needed */
-	if (ba_scan_mode) {
-		LOG_INF("Stop scanning");
-		err = bt_le_scan_stop();
-		if (err) {
-			LOG_ERR("bt_le_scan_stop failed %d", err);
-			return err;
-		}
+	/* Scanning is paused while initiating, and resumed from connected_cb */
+	err = scan_sched_pause();
+	if (err) {
+		return err;
 	}
 
 	/* Stop PA syncing if needed */
-	if (pa_syncing) {
-		LOG_WRN("Delete PA sync");
-		k_timer_stop(&pa_sync_create_timer);
-		k_work_submit(&pa_sync_delete_work);
-		pa_syncing = false;
-	}
+	pa_sync_sched_stop();
 
 	k_sleep(K_MSEC(100)); /* sleep added to improve robustness */
 
@@ -1720,24 +2585,20 @@ int broadcast_assistant_disconnect_from_sink(bt_addr_le_t *bt_addr_le)
 			struct net_buf *evt_msg;
 
 			LOG_ERR("Failed to disconnect (err %d)", err);
-			evt_msg = message_alloc_tx();
-			/* Bluetooth LE Device Address */
-			net_buf_add_u8(evt_msg, 1 + BT_ADDR_LE_SIZE);
-			net_buf_add_u8(evt_msg, bt_addr_le_is_identity(bt_addr_le) ? BT_DATA_IDENTITY : BT_DATA_RPA);
-			net_buf_add_u8(evt_msg, bt_addr_le->type);
-			net_buf_add_mem(evt_msg, &bt_addr_le->a, sizeof(bt_addr_t));
-			/* error code */
-			net_buf_add_u8(evt_msg, 1 /* len of BT_DATA type */ + sizeof(int32_t));
-			net_buf_add_u8(evt_msg, BT_DATA_ERROR_CODE);
-			net_buf_add_le32(evt_msg, err);
-
-			message_send_net_buf_event(MESSAGE_SUBTYPE_SINK_DISCONNECTED, evt_msg);
+			evt_msg = MESSAGE_EVT_ALLOC(SINK_DISCONNECTED, 0);
+			if (evt_msg) {
+				message_evt_add_addr(evt_msg, bt_addr_le);
+				message_evt_add_err(evt_msg, err);
+				message_send_net_buf_event(MESSAGE_SUBTYPE_SINK_DISCONNECTED,
+							   evt_msg);
+			}
 		}
 
 		err = bt_unpair(BT_ID_DEFAULT, bt_addr_le);
 		if (err) {
 			LOG_ERR("bt_unpair failed with %d", err);
 		}
+		device_store_remove(bt_addr_le);
 	}
 
 	return 0;
@@ -1748,40 +2609,76 @@ int broadcast_assistant_add_source(uint8_t sid, uint16_t pa_interval, uint32_t b
 {
 	LOG_INF("Adding broadcast source (%u)...", broadcast_id);
 
-	struct bt_bap_bass_subgroup subgroup[CONFIG_BT_BAP_BASS_MAX_SUBGROUPS] = {{0}};
-	struct bt_bap_broadcast_assistant_add_src_param param = {0};
+	add_src_start = k_cycle_get_32();
+	add_src_param_set(&add_src_param, add_src_subgroups, sid, pa_interval, broadcast_id, addr,
+			  num_subgroups, bis_sync);
 
-	num_subgroups = MIN(num_subgroups, CONFIG_BT_BAP_BASS_MAX_SUBGROUPS);
-	for (int i = 0; i < num_subgroups; i++) {
-		subgroup[i].bis_sync = bis_sync[i];
+	if (IS_ENABLED(CONFIG_BT_PER_ADV_SYNC_TRANSFER_SENDER) && add_src_wait_for_sync()) {
+		LOG_INF("Waiting for PA sync to the source");
+		return 0;
 	}
 
-	if (num_subgroups == 0) {
-		num_subgroups = 1;
-		subgroup[0].bis_sync = BT_BAP_BIS_SYNC_NO_PREF;
-		LOG_WRN("num_subgroups argument is 0. Change to 1 and set bis sync no pref");
-	} else {
-		for (int i = 0; i < num_subgroups; i++) {
-			LOG_INF("bis_sync[%d]: %x", i, subgroup[i].bis_sync);
-		}
+	sink_op_start(&add_src_op);
+	if (IS_ENABLED(CONFIG_BT_PER_ADV_SYNC_TRANSFER_SENDER)) {
+		past_monitor_release(&add_src_param.addr);
+	}
+
+	return 0;
+}
+
+int broadcast_assistant_switch_source(uint8_t sid, uint16_t pa_interval, uint32_t broadcast_id,
+				      bt_addr_le_t *addr, uint8_t num_subgroups, uint32_t *bis_sync,
+				      const uint8_t *broadcast_code)
+{
+	bool no_sinks;
+
+	LOG_INF("Switching to broadcast source (%u)...", broadcast_id);
+
+	k_mutex_lock(&switch_src_mutex, K_FOREVER);
+
+	if (switch_src.settling > 0) {
+		LOG_WRN("Previous source switch abandoned (%u sinks)", switch_src.settling);
+	}
+
+	switch_src.start = k_cycle_get_32();
+	add_src_param_set(&switch_src.add_param, switch_src.subgroups, sid, pa_interval,
+			  broadcast_id, addr, num_subgroups, bis_sync);
+	switch_src.broadcast_id = broadcast_id;
+	switch_src.num_subgroups = switch_src.add_param.num_subgroups;
+	for (int i = 0; i < switch_src.num_subgroups; i++) {
+		switch_src.bis_sync[i] = switch_src.subgroups[i].bis_sync;
+	}
+	switch_src.has_bcode = broadcast_code != NULL;
+	if (broadcast_code) {
+		memcpy(switch_src.bcode, broadcast_code, BT_AUDIO_BROADCAST_CODE_SIZE);
 	}
+	switch_src.settling = 0;
+	switch_src.ltv_len = 0;
 
-	bt_addr_le_copy(&param.addr, addr);
-	param.adv_sid = sid;
-	param.pa_interval = pa_interval;
-	param.broadcast_id = broadcast_id;
-	param.pa_sync = true;
+	for (int i = 0; i < ARRAY_SIZE(ba_sinks); i++) {
+		struct ba_sink *sink = &ba_sinks[i];
+
+		sink->switch_settling = sink->conn && sink->bass_found;
+		sink->switch_bcode_req = false;
+		if (sink->switch_settling) {
+			switch_src.settling++;
+		}
+	}
 
-	/* keep broadcast_id as global variable (used by source added callback) */
-	ba_source_broadcast_id = broadcast_id;
+	no_sinks = switch_src.settling == 0;
+	if (no_sinks) {
+		switch_src_send_locked();
+	}
 
-	LOG_INF("adv_sid = %u, pa_interval = %u, broadcast_id = 0x%08x, num_subgroups = %u",
-		param.adv_sid, param.pa_interval, param.broadcast_id, num_subgroups);
+	k_mutex_unlock(&switch_src_mutex);
 
-	param.num_subgroups = num_subgroups;
-	param.subgroups = subgroup;
+	if (!no_sinks) {
+		k_work_reschedule(&switch_src_timeout_work,
+				  K_MSEC(CONFIG_SWITCH_SOURCE_TIMEOUT_MS));
+	}
 
-	bt_conn_foreach(BT_CONN_TYPE_LE, add_source_foreach_sink, &param);
+	/* Not waited for, each sink starts the PA sync for PAST (switch_src_issue()) */
+	sink_op_start(&switch_src_op);
 
 	return 0;
 }
@@ -1790,26 +2687,27 @@ int broadcast_assistant_remove_source(uint8_t source_id, uint8_t num_subgroups)
 {
 	LOG_INF("Removing broadcast source (%u, %u)...", source_id, num_subgroups);
 
-	struct bt_bap_bass_subgroup subgroup[CONFIG_BT_BAP_BASS_MAX_SUBGROUPS] = {
-		{0}}; /* bis_sync = 0 */
-	struct bt_bap_broadcast_assistant_mod_src_param param = {0};
+	struct bt_bap_bass_subgroup *subgroup = mod_src_subgroups;
+	struct bt_bap_broadcast_assistant_mod_src_param *param = &mod_src_param;
+
+	memset(mod_src_subgroups, 0, sizeof(mod_src_subgroups)); /* bis_sync = 0 */
+	memset(param, 0, sizeof(*param));
 
 	num_subgroups = MIN(num_subgroups, CONFIG_BT_BAP_BASS_MAX_SUBGROUPS);
 	if (num_subgroups == 0) {
 		num_subgroups = 1;
 		LOG_WRN("num_subgroups argument is 0. Change to 1");
 	}
-	param.src_id = source_id;
-	param.pa_sync = false; /* stop sync to periodic advertisements */
-	param.pa_interval = BT_BAP_PA_INTERVAL_UNKNOWN;
-	param.num_subgroups = num_subgroups;
-	param.subgroups = subgroup;
+	param->src_id = source_id;
+	param->pa_sync = false; /* stop sync to periodic advertisements */
+	param->pa_interval = BT_BAP_PA_INTERVAL_UNKNOWN;
+	param->num_subgroups = num_subgroups;
+	param->subgroups = subgroup;
 
-	/* store source ID globally. Used by broadcast_assistant_mod_src_cb */
-	ba_source_id = source_id;
+	/* Used for sinks that have not reported a source ID of their own */
+	rem_src_source_id = source_id;
 
-	/* FIXME: Incase source id is not the same foreach sink then this will not work */
-	bt_conn_foreach(BT_CONN_TYPE_LE, remove_source_foreach_sink, &param);
+	sink_op_start(&rem_src_op);
 
 	return 0;
 }
@@ -1817,36 +2715,34 @@ int broadcast_assistant_remove_source(uint8_t source_id, uint8_t num_subgroups)
 int broadcast_assistant_add_broadcast_code(
 	uint8_t src_id, const uint8_t broadcast_code[BT_AUDIO_BROADCAST_CODE_SIZE])
 {
-	add_broadcast_code_data_t add_broadcast_code_data;
-
 	LOG_INF("Adding broadcast code for src %u ...", src_id);
 	LOG_HEXDUMP_INF(broadcast_code, BT_AUDIO_BROADCAST_CODE_SIZE, "broadcast code:");
 
 	add_broadcast_code_data.src_id = src_id;
 	memcpy(add_broadcast_code_data.broadcast_code, broadcast_code, BT_AUDIO_BROADCAST_CODE_SIZE);
 
-	/* FIXME: Incase source id is not the same foreach sink then this will not work */
-	bt_conn_foreach(BT_CONN_TYPE_LE, add_broadcast_code_foreach_sink, &add_broadcast_code_data);
+	/* Sinks that reported a source ID of their own get the code for that one */
+	sink_op_start(&bcode_op);
 
 	return 0;
 }
 
 int broadcast_assistant_set_volume(bt_addr_le_t *bt_addr_le, uint8_t volume)
 {
-	struct bt_conn *conn;
+	struct ba_sink *sink;
 	struct bt_vcp_vol_ctlr *vol_ctlr;
 	int err;
 
-	conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, bt_addr_le);
-	if (!conn) {
+	sink = ba_sink_lookup(bt_addr_le);
+	if (!sink) {
 		LOG_ERR("Failed to lookup connection");
 
 		return -EINVAL;
 	}
 
-	vol_ctlr = bt_vcp_vol_ctlr_get_by_conn(conn);
+	vol_ctlr = sink->vol_ctlr;
 	if (vol_ctlr == NULL) {
-		LOG_ERR("No volume control for this conn (%p)", (void *)conn);
+		LOG_ERR("No volume control for this conn (%p)", (void *)sink->conn);
 
 		return -EINVAL;
 	}
@@ -1863,20 +2759,20 @@ int broadcast_assistant_set_volume(bt_addr_le_t *bt_addr_le, uint8_t volume)
 
 int broadcast_assistant_set_mute(bt_addr_le_t *bt_addr_le, uint8_t state)
 {
-	struct bt_conn *conn;
+	struct ba_sink *sink;
 	struct bt_vcp_vol_ctlr *vol_ctlr;
 	int err;
 
-	conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, bt_addr_le);
-	if (!conn) {
+	sink = ba_sink_lookup(bt_addr_le);
+	if (!sink) {
 		LOG_ERR("Failed to lookup connection");
 
 		return -EINVAL;
 	}
 
-	vol_ctlr = bt_vcp_vol_ctlr_get_by_conn(conn);
+	vol_ctlr = sink->vol_ctlr;
 	if (vol_ctlr == NULL) {
-		LOG_ERR("No volume control for this conn (%p)", (void *)conn);
+		LOG_ERR("No volume control for this conn (%p)", (void *)sink->conn);
 
 		return -EINVAL;
 	}
@@ -1892,10 +2788,183 @@ int broadcast_assistant_set_mute(bt_addr_le_t *bt_addr_le, uint8_t state)
 	return 0;
 }
 
+int broadcast_assistant_set_set_volume(bt_addr_le_t *bt_addr_le, uint8_t volume)
+{
+	LOG_INF("Setting set volume (%u)...", volume);
+
+	return set_volume_start(&set_volume_op, bt_addr_le, volume);
+}
+
+int broadcast_assistant_set_set_mute(bt_addr_le_t *bt_addr_le, uint8_t state)
+{
+	LOG_INF("Setting set mute state (%u)...", state);
+
+	return set_volume_start(&set_mute_op, bt_addr_le, state);
+}
+
+int broadcast_assistant_step_set_volume(bt_addr_le_t *bt_addr_le, int8_t step)
+{
+	LOG_INF("Stepping set volume (%d)...", step);
+
+	return set_volume_start(&step_volume_op, bt_addr_le, step);
+}
+
+int broadcast_assistant_connect_known(bt_addr_le_t *addrs, size_t *count)
+{
+	bt_addr_le_t known[DEVICE_STORE_SIZE];
+	size_t known_cnt;
+
+	*count = 0;
+
+	if (connect_known_next < connect_known_cnt) {
+		LOG_WRN("Already connecting known sinks");
+		return -EBUSY;
+	}
+
+	known_cnt = device_store_get_addrs(known);
+	for (size_t i = 0; i < known_cnt; i++) {
+		struct bt_conn *conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, &known[i]);
+
+		if (conn) {
+			/* Already connected */
+			bt_conn_unref(conn);
+			continue;
+		}
+
+		bt_addr_le_copy(&addrs[(*count)++], &known[i]);
+	}
+
+	if (*count == 0) {
+		return known_cnt == 0 ? -ENOENT : 0;
+	}
+
+	LOG_INF("Connecting %zu known sinks", *count);
+
+	memcpy(connect_known_addrs, addrs, *count * sizeof(addrs[0]));
+	connect_known_next = 0;
+	connect_known_cnt = *count;
+	k_work_submit_to_queue(message_cmd_workqueue_get(), &connect_known_work);
+
+	return 0;
+}
+
+static void get_state_source(struct state_snapshot *snap, const struct source_record *record)
+{
+	struct net_buf *buf;
+	uint8_t name_len = strlen(record->broadcast_name);
+
+	buf = state_snapshot_alloc(snap, MESSAGE_EVT_LEN_STATE_SOURCE);
+	if (!buf) {
+		return;
+	}
+
+	message_evt_add_addr(buf, &record->addr);
+	message_evt_add_u8(buf, BT_DATA_SID, record->sid);
+	message_evt_add_le16(buf, BT_DATA_PA_INTERVAL, record->pa_interval);
+	message_evt_add_le32(buf, BT_DATA_BROADCAST_ID, record->broadcast_id);
+	if (name_len > 0) {
+		message_evt_add_mem(buf, BT_DATA_BROADCAST_NAME, record->broadcast_name, name_len);
+	}
+	state_snapshot_commit(snap, MESSAGE_SUBTYPE_SOURCE_FOUND);
+}
+
+static void get_state_sink(struct state_snapshot *snap, const struct ba_sink *sink)
+{
+	const struct bt_bap_scan_delegator_recv_state *state = &sink->recv_state;
+	struct net_buf *buf;
+
+	buf = state_snapshot_alloc(snap, MESSAGE_EVT_LEN_STATE_SINK);
+	if (!buf) {
+		return;
+	}
+
+	message_evt_add_addr(buf, bt_conn_get_dst(sink->conn));
+	message_evt_add_err(buf, 0 /* OK */);
+
+	if (sink->has_volume) {
+		message_evt_add_u8(buf, BT_DATA_VOLUME, sink->volume);
+		message_evt_add_u8(buf, BT_DATA_MUTE, sink->mute);
+	}
+
+	if (sink->has_sirk) {
+		message_evt_add_u8(buf, BT_DATA_SET_RANK, sink->set_rank);
+		message_evt_add_u8(buf, BT_DATA_SET_SIZE, sink->set_size);
+		message_evt_add_mem(buf, BT_DATA_SIRK, sink->sirk, BT_CSIP_SIRK_SIZE);
+	}
+
+	if (sink->has_source_id) {
+		uint8_t num_subgroups = MIN(state->num_subgroups, CONFIG_BT_BAP_BASS_MAX_SUBGROUPS);
+		uint8_t *p;
+
+		message_evt_add_le32(buf, BT_DATA_BROADCAST_ID, state->broadcast_id);
+		message_evt_add_u8(buf, BT_DATA_SOURCE_ID, sink->source_id);
+
+		/* BIS sync state of each subgroup, as in ADD_SOURCE */
+		p = net_buf_add(buf, MESSAGE_EVT_FIELD_LEN(num_subgroups * sizeof(uint32_t)));
+		*p++ = 1 + num_subgroups * sizeof(uint32_t);
+		*p++ = BT_DATA_BIS_SYNC;
+		for (int i = 0; i < num_subgroups; i++, p += sizeof(uint32_t)) {
+			sys_put_le32(state->subgroups[i].bis_sync, p);
+		}
+	}
+	state_snapshot_commit(snap, MESSAGE_SUBTYPE_SINK_CONNECTED);
+}
+
+void broadcast_assistant_get_state(struct state_snapshot *snap)
+{
+	struct source_record record;
+
+	/* Sources first, the sinks refer to them by broadcast ID */
+	for (size_t i = 0; source_registry_get_at(i, &record); i++) {
+		get_state_source(snap, &record);
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(ba_sinks); i++) {
+		struct ba_sink sink;
+
+		/* A copy, with a reference so the sink may disconnect while it is sent */
+		k_mutex_lock(&ba_sinks_mutex, K_FOREVER);
+		sink = ba_sinks[i];
+		if (sink.conn) {
+			sink.conn = bt_conn_ref(sink.conn);
+		}
+		k_mutex_unlock(&ba_sinks_mutex);
+
+		if (!sink.conn) {
+			continue;
+		}
+
+		/* Sinks still being discovered report SINK_CONNECTED when done */
+		if (sink.bass_found) {
+			get_state_sink(snap, &sink);
+		}
+
+		bt_conn_unref(sink.conn);
+	}
+
+	/* BASE and BIGinfo of the monitored sources follow as they are received */
+	pa_sync_sched_data_forget_all();
+}
+
 int broadcast_assistant_reset(void)
 {
 	broadcast_assistant_stop_scanning();
-	broadcast_assistant_disconnect_unpair_all();
+	scan_sched_reset_params();
+	scan_filter_reset();
+
+	/* An ADD_SOURCE waiting for a PA sync is dropped */
+	(void)k_work_cancel_delayable(&add_src_start_work);
+	atomic_clear(&add_src_waiting);
+	(void)pa_sync_sched_monitor_stop(BT_ADDR_LE_ANY, PA_MONITOR_ALL);
+	set_volume_abort(-ECANCELED);
+	switch_src_abort();
+
+	if (IS_ENABLED(CONFIG_DEVICE_STORE)) {
+		/* Known sinks stay bonded for CONNECT_KNOWN, FORGET_KNOWN unpairs them */
+		disconnect_all();
+	} else {
+		broadcast_assistant_disconnect_unpair_all();
+	}
 
 	return 0;
 }
@@ -1911,14 +2980,24 @@ int broadcast_assistant_init(void)
 
 	LOG_INF("Bluetooth initialized");
 
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		/* Bonds and known sinks */
+		err = settings_load();
+		if (err) {
+			LOG_ERR("Failed to load settings (err %d)", err);
+		}
+	}
+
 	bt_le_scan_cb_register(&scan_callbacks);
+	pa_sync_sched_init();
 	bt_le_per_adv_sync_cb_register(&pa_synced_callbacks);
 	bt_bap_broadcast_assistant_register_cb(&broadcast_assistant_callbacks);
 	bt_vcp_vol_ctlr_cb_register(&vcp_callbacks);
 	bt_csip_set_coordinator_register_cb(&csip_callbacks);
+	sink_discovery_register_cb(&discovery_callbacks);
+	scan_sched_reset_params();
 	LOG_INF("Bluetooth scan callback registered");
 
-	k_mutex_init(&source_data_list_mutex);
 	ba_scan_mode = BROADCAST_ASSISTANT_SCAN_IDLE;
 
 	return 0;
@@ -13,6 +13,8 @@
 #include <zephyr/bluetooth/audio/audio.h>
 #include <zephyr/bluetooth/audio/csip.h>
 
+struct state_snapshot;
+
 #define BT_DATA_RSSI         (BT_DATA_MANUFACTURER_DATA - 1)
 #define BT_DATA_SID          (BT_DATA_MANUFACTURER_DATA - 2)
 #define BT_DATA_PA_INTERVAL  (BT_DATA_MANUFACTURER_DATA - 3)
@@ -28,6 +30,21 @@
 #define BT_DATA_SIRK         (BT_DATA_MANUFACTURER_DATA - 13)
 #define BT_DATA_SET_SIZE     (BT_DATA_MANUFACTURER_DATA - 14)
 #define BT_DATA_SET_RANK     (BT_DATA_MANUFACTURER_DATA - 15)
+#define BT_DATA_SINK_STATUS  (BT_DATA_MANUFACTURER_DATA - 16)
+#define BT_DATA_STATS_COUNTER  (BT_DATA_MANUFACTURER_DATA - 17)
+#define BT_DATA_STATS_LATENCY  (BT_DATA_MANUFACTURER_DATA - 18)
+#define BT_DATA_STATS_INTERVAL (BT_DATA_MANUFACTURER_DATA - 19)
+#define BT_DATA_CREDITS        (BT_DATA_MANUFACTURER_DATA - 20)
+#define BT_DATA_SCAN_PARAMS    (BT_DATA_MANUFACTURER_DATA - 21)
+#define BT_DATA_TRACE          (BT_DATA_MANUFACTURER_DATA - 22)
+#define BT_DATA_TRACE_CURSOR   (BT_DATA_MANUFACTURER_DATA - 23)
+#define BT_DATA_VOLUME_STEP    (BT_DATA_MANUFACTURER_DATA - 24)
+#define BT_DATA_SCAN_FILTER    (BT_DATA_MANUFACTURER_DATA - 25)
+#define BT_DATA_STATE_INFO     (BT_DATA_MANUFACTURER_DATA - 26)
+#define BT_DATA_EVT_SEQ        (BT_DATA_MANUFACTURER_DATA - 27)
+#define BT_DATA_HEARTBEAT_INTERVAL (BT_DATA_MANUFACTURER_DATA - 28)
+#define BT_DATA_HEALTH             (BT_DATA_MANUFACTURER_DATA - 29)
+#define BT_DATA_SCAN_MODE          (BT_DATA_MANUFACTURER_DATA - 30)
 
 enum {
 	BROADCAST_ASSISTANT_SCAN_IDLE = 0,
@@ -38,17 +55,82 @@ enum {
 
 int broadcast_assistant_start_scan(uint8_t mode, uint8_t set_size, uint8_t sirk[BT_CSIP_SIRK_SIZE]);
 int broadcast_assistant_stop_scanning(void);
+/* BROADCAST_ASSISTANT_SCAN_* bits of the scans started by the host */
+uint8_t broadcast_assistant_scan_mode_get(void);
 int broadcast_assistant_disconnect_unpair_all(void);
 int broadcast_assistant_connect_to_sink(bt_addr_le_t *bt_addr_le);
 int broadcast_assistant_disconnect_from_sink(bt_addr_le_t *bt_addr_le);
 int broadcast_assistant_add_source(uint8_t sid, uint16_t pa_interval, uint32_t broadcast_id,
 				   bt_addr_le_t *addr, uint8_t num_subgroups, uint32_t *bis_sync);
 int broadcast_assistant_remove_source(uint8_t source_id, uint8_t num_subgroups);
+
+/**
+ * @brief Move all sinks to another broadcast source, or other BISes of the current one
+ *
+ * A sink synced to the same broadcast source is sent Modify Source with the
+ * new BIS sync. A sink synced to another source has it stopped and removed,
+ * then the new source is added. The broadcast code, when given, is written to
+ * each sink as soon as it requests it. The RES of MESSAGE_SUBTYPE_SWITCH_SOURCE
+ * is sent when the writes are done, carrying a BT_DATA_SINK_STATUS per sink.
+ * The receive state changes of the sinks are not sent as events of their own,
+ * one SOURCE_SWITCHED event carries the result of each sink once it is synced,
+ * has failed or SWITCH_SOURCE_TIMEOUT_MS has passed.
+ *
+ * @param broadcast_code  Code of an encrypted source, or NULL to leave it to
+ *                        the host (NEW_ENC_STATE_BCODE_REQ is then sent)
+ *
+ * @return 0 if started, the RES is then sent later
+ */
+int broadcast_assistant_switch_source(uint8_t sid, uint16_t pa_interval, uint32_t broadcast_id,
+				      bt_addr_le_t *addr, uint8_t num_subgroups, uint32_t *bis_sync,
+				      const uint8_t *broadcast_code);
 int broadcast_assistant_add_broadcast_code(
 	uint8_t src_id, const uint8_t broadcast_code[BT_AUDIO_BROADCAST_CODE_SIZE]);
 int broadcast_assistant_set_volume(bt_addr_le_t *bt_addr_le, uint8_t volume);
 int broadcast_assistant_set_mute(bt_addr_le_t *bt_addr_le, uint8_t state);
+
+/**
+ * @brief Set the volume of the coordinated set the sink is a member of
+ *
+ * The set is locked (when lockable and discovered by CSIP), the volume is
+ * written to all connected members back to back and the set is released. The
+ * RES of MESSAGE_SUBTYPE_SET_SET_VOLUME is sent when done, carrying a
+ * BT_DATA_SINK_STATUS per member. A sink that is not a set member is handled
+ * as a set of one.
+ *
+ * @return 0 if started, the RES is then sent later
+ */
+int broadcast_assistant_set_set_volume(bt_addr_le_t *bt_addr_le, uint8_t volume);
+
+/**
+ * @brief Mute or unmute the coordinated set, see broadcast_assistant_set_set_volume()
+ */
+int broadcast_assistant_set_set_mute(bt_addr_le_t *bt_addr_le, uint8_t state);
+
+/**
+ * @brief Change the volume of each set member by step, see broadcast_assistant_set_set_volume()
+ */
+int broadcast_assistant_step_set_volume(bt_addr_le_t *bt_addr_le, int8_t step);
+int broadcast_assistant_connect_known(bt_addr_le_t *addrs, size_t *count);
+
+/**
+ * @brief Add the current state to a snapshot, see MESSAGE_SUBTYPE_GET_STATE
+ *
+ * Each known source is added as a SOURCE_FOUND record, each connected sink as
+ * a SINK_CONNECTED record also carrying its volume, set membership and the
+ * source it is synced to.
+ */
+void broadcast_assistant_get_state(struct state_snapshot *snap);
 int broadcast_assistant_reset(void);
 int broadcast_assistant_init(void);
 
+/**
+ * @brief Handle a scan report as if it was received from the controller
+ *
+ * Used by the load generator (LOADGEN) to feed synthetic advertisers into the
+ * scan path.
+ */
+void broadcast_assistant_scan_inject(const struct bt_le_scan_recv_info *info,
+				     struct net_buf_simple *ad);
+
 #endif /* __BROADCAST_ASSISTANT_H__ */
@@ -27,6 +27,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "cobs.h"
 
 
@@ -42,6 +43,57 @@
 #define TRUE        (!FALSE)
 #endif
 
+/* Non-zero if any byte of the 32-bit word is zero */
+#define COBS_WORD_HAS_ZERO(WORD)    (((WORD) - 0x01010101u) & ~(WORD) & 0x80808080u)
+
+/* The longest run of non-zero bytes in one block */
+#define COBS_BLOCK_MAX_LEN          254u
+
+
+/*****************************************************************************
+ * Local functions
+ ****************************************************************************/
+
+/* Length of the run of non-zero bytes at ptr, at most max_len.
+ *
+ * Once aligned, four bytes are tested at a time, which is where the codec
+ * spends its time on the mostly non-zero message payloads.
+ */
+static size_t cobs_nonzero_len(const uint8_t * ptr, size_t max_len)
+{
+    const uint8_t *     read_ptr            = ptr;
+    const uint8_t *     end_ptr             = ptr + max_len;
+    uint32_t            word;
+
+    while ((read_ptr < end_ptr) && (((uintptr_t) read_ptr & (sizeof(word) - 1u)) != 0u))
+    {
+        if (*read_ptr == 0)
+        {
+            return read_ptr - ptr;
+        }
+        read_ptr++;
+    }
+
+    while ((size_t) (end_ptr - read_ptr) >= sizeof(word))
+    {
+        /* Aligned, compiles to a single load */
+        memcpy(&word, read_ptr, sizeof(word));
+        if (COBS_WORD_HAS_ZERO(word))
+        {
+            break;
+        }
+        read_ptr += sizeof(word);
+    }
+
+    /* Find the zero byte in the last word, or the end of a short tail */
+    while ((read_ptr < end_ptr) && (*read_ptr != 0))
+    {
+        read_ptr++;
+    }
+
+    return read_ptr - ptr;
+}
+
 
 /*****************************************************************************
  * Functions
@@ -68,7 +120,6 @@ cobs_encode_result cobs_encode(void * dst_buf_ptr, size_t dst_buf_len,
     uint8_t *           dst_buf_end_ptr     = (uint8_t*) dst_buf_ptr + dst_buf_len;
     uint8_t *           dst_code_write_ptr  = dst_buf_ptr;
     uint8_t *           dst_write_ptr       = dst_code_write_ptr + 1;
-    uint8_t             src_byte            = 0;
     uint8_t             search_len          = 1;
 
 
@@ -81,45 +132,61 @@ cobs_encode_result cobs_encode(void * dst_buf_ptr, size_t dst_buf_len,
 
     if (src_len != 0)
     {
-        /* Iterate over the source bytes */
+        /* Iterate over the runs of non-zero source bytes */
         for (;;)
         {
+            size_t      src_remaining   = src_end_ptr - src_read_ptr;
+            size_t      run_len;
+
             /* Check for running out of output buffer space */
-            if (dst_write_ptr >= dst_buf_end_ptr)
+            if (dst_write_ptr > dst_buf_end_ptr)
             {
                 result.status |= COBS_ENCODE_OUT_BUFFER_OVERFLOW;
+                dst_write_ptr = dst_buf_end_ptr;
                 break;
             }
 
-            src_byte = *src_read_ptr++;
-            if (src_byte == 0)
+            run_len = cobs_nonzero_len(src_read_ptr,
+                                       (src_remaining < COBS_BLOCK_MAX_LEN) ?
+                                       src_remaining : COBS_BLOCK_MAX_LEN);
+            if (run_len > (size_t) (dst_buf_end_ptr - dst_write_ptr))
             {
-                /* We found a zero byte */
+                result.status |= COBS_ENCODE_OUT_BUFFER_OVERFLOW;
+                dst_write_ptr = dst_buf_end_ptr;
+                break;
+            }
+
+            /* Copy the non-zero bytes, the destination overlaps the source
+             * when encoding in place (see COBS_ENCODE_SRC_OFFSET) */
+            memmove(dst_write_ptr, src_read_ptr, run_len);
+            dst_write_ptr += run_len;
+            src_read_ptr += run_len;
+            search_len = run_len + 1;
+
+            if (src_read_ptr >= src_end_ptr)
+            {
+                break;
+            }
+
+            if (run_len == COBS_BLOCK_MAX_LEN)
+            {
+                /* We have a long string of non-zero bytes, so we need
+                 * to write out a length code of 0xFF. */
                 *dst_code_write_ptr = search_len;
                 dst_code_write_ptr = dst_write_ptr++;
                 search_len = 1;
-                if (src_read_ptr >= src_end_ptr)
-                {
-                    break;
-                }
             }
             else
             {
-                /* Copy the non-zero byte to the destination buffer */
-                *dst_write_ptr++ = src_byte;
-                search_len++;
+                /* We found a zero byte */
+                src_read_ptr++;
+                *dst_code_write_ptr = search_len;
+                dst_code_write_ptr = dst_write_ptr++;
+                search_len = 1;
                 if (src_read_ptr >= src_end_ptr)
                 {
                     break;
                 }
-                if (search_len == 0xFF)
-                {
-                    /* We have a long string of non-zero bytes, so we need
-                     * to write out a length code of 0xFF. */
-                    *dst_code_write_ptr = search_len;
-                    dst_code_write_ptr = dst_write_ptr++;
-                    search_len = 1;
-                }
             }
         }
     }
@@ -168,8 +235,6 @@ cobs_decode_result cobs_decode(void * dst_buf_ptr, size_t dst_buf_len,
     uint8_t *           dst_buf_end_ptr     = (uint8_t*) dst_buf_ptr + dst_buf_len;
     uint8_t *           dst_write_ptr       = dst_buf_ptr;
     size_t              remaining_bytes;
-    uint8_t             src_byte;
-    uint8_t             i;
     uint8_t             len_code;
 
     /* First, do a NULL pointer check and return immediately if it fails. */
@@ -207,15 +272,14 @@ cobs_decode_result cobs_decode(void * dst_buf_ptr, size_t dst_buf_len,
                 len_code = remaining_bytes;
             }
 
-            for (i = len_code; i != 0; i--)
+            if (cobs_nonzero_len(src_read_ptr, len_code) != len_code)
             {
-                src_byte = *src_read_ptr++;
-                if (src_byte == 0)
-                {
-                    result.status |= COBS_DECODE_ZERO_BYTE_IN_INPUT;
-                }
-                *dst_write_ptr++ = src_byte;
+                result.status |= COBS_DECODE_ZERO_BYTE_IN_INPUT;
             }
+            /* The destination overlaps the source when decoding in place */
+            memmove(dst_write_ptr, src_read_ptr, len_code);
+            dst_write_ptr += len_code;
+            src_read_ptr += len_code;
 
             if (src_read_ptr >= src_end_ptr)
             {
@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/addr.h>
+
+#include "device_store.h"
+
+LOG_MODULE_REGISTER(device_store, LOG_LEVEL_INF);
+
+/*
+ * Entries live in RAM and, with DEVICE_STORE, are written to settings as
+ * "ba/sink/<slot>" and "ba/source". Writes are deferred to the system
+ * workqueue as the updates come from Bluetooth callbacks.
+ */
+#define DEVICE_STORE_KEY_SINK   "ba/sink"
+#define DEVICE_STORE_KEY_SOURCE "ba/source"
+#define DEVICE_STORE_KEY_LEN    (sizeof(DEVICE_STORE_KEY_SINK "/") + 3)
+
+/* Dirty bit of the last source, the sink slots use the bits below it */
+#define DEVICE_STORE_DIRTY_SOURCE BIT(DEVICE_STORE_SIZE)
+
+BUILD_ASSERT(DEVICE_STORE_SIZE < ATOMIC_BITS, "Too many sinks for the dirty mask");
+
+struct device_store_slot {
+	bool used;
+	struct device_store_sink sink;
+};
+
+static K_MUTEX_DEFINE(store_mutex);
+static struct device_store_slot slots[DEVICE_STORE_SIZE];
+static struct device_store_source last_source;
+static bool last_source_valid;
+static atomic_t dirty;
+
+static void device_store_save_work_handler(struct k_work *work);
+static K_WORK_DEFINE(save_work, device_store_save_work_handler);
+
+static struct device_store_slot *device_store_find_locked(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].used && bt_addr_le_eq(&slots[i].sink.addr, addr)) {
+			return &slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void device_store_mark_dirty(atomic_val_t mask)
+{
+	if (!IS_ENABLED(CONFIG_DEVICE_STORE)) {
+		return;
+	}
+
+	atomic_or(&dirty, mask);
+	k_work_submit(&save_work);
+}
+
+static void device_store_mark_slot_dirty(const struct device_store_slot *slot)
+{
+	device_store_mark_dirty(BIT(slot - slots));
+}
+
+#if defined(CONFIG_DEVICE_STORE)
+static void device_store_save_work_handler(struct k_work *work)
+{
+	atomic_val_t mask = atomic_clear(&dirty);
+	char key[DEVICE_STORE_KEY_LEN];
+	int err;
+
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		struct device_store_slot slot;
+
+		if (!(mask & BIT(i))) {
+			continue;
+		}
+
+		k_mutex_lock(&store_mutex, K_FOREVER);
+		slot = slots[i];
+		k_mutex_unlock(&store_mutex);
+
+		snprintf(key, sizeof(key), DEVICE_STORE_KEY_SINK "/%d", i);
+		if (slot.used) {
+			err = settings_save_one(key, &slot.sink, sizeof(slot.sink));
+		} else {
+			err = settings_delete(key);
+		}
+		if (err) {
+			LOG_ERR("Failed to save %s (err %d)", key, err);
+		}
+	}
+
+	if (mask & DEVICE_STORE_DIRTY_SOURCE) {
+		struct device_store_source source;
+		bool valid;
+
+		k_mutex_lock(&store_mutex, K_FOREVER);
+		source = last_source;
+		valid = last_source_valid;
+		k_mutex_unlock(&store_mutex);
+
+		if (valid) {
+			err = settings_save_one(DEVICE_STORE_KEY_SOURCE, &source, sizeof(source));
+		} else {
+			err = settings_delete(DEVICE_STORE_KEY_SOURCE);
+		}
+		if (err) {
+			LOG_ERR("Failed to save last source (err %d)", err);
+		}
+	}
+}
+
+static int device_store_settings_set(const char *key, size_t len, settings_read_cb read_cb,
+				     void *cb_arg)
+{
+	const char *next;
+	ssize_t ret;
+
+	if (settings_name_steq(key, "sink", &next) && next) {
+		unsigned long i = strtoul(next, NULL, 10);
+
+		if (i >= ARRAY_SIZE(slots) || len != sizeof(slots[i].sink)) {
+			LOG_WRN("Dropping stored sink %s (len %zu)", next, len);
+			return 0;
+		}
+
+		ret = read_cb(cb_arg, &slots[i].sink, sizeof(slots[i].sink));
+		if (ret < 0) {
+			return ret;
+		}
+
+		slots[i].used = true;
+		return 0;
+	}
+
+	if (settings_name_steq(key, "source", &next) && !next) {
+		if (len != sizeof(last_source)) {
+			return 0;
+		}
+
+		ret = read_cb(cb_arg, &last_source, sizeof(last_source));
+		if (ret < 0) {
+			return ret;
+		}
+
+		last_source_valid = true;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(device_store, "ba", NULL, device_store_settings_set, NULL, NULL);
+#else
+static void device_store_save_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+}
+#endif /* CONFIG_DEVICE_STORE */
+
+/*
+ * Public functions
+ */
+bool device_store_get(const bt_addr_le_t *addr, struct device_store_sink *sink)
+{
+	struct device_store_slot *slot;
+
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	slot = device_store_find_locked(addr);
+	if (slot && sink) {
+		*sink = slot->sink;
+	}
+	k_mutex_unlock(&store_mutex);
+
+	return slot != NULL;
+}
+
+void device_store_add(const bt_addr_le_t *addr)
+{
+	struct device_store_slot *slot;
+
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	slot = device_store_find_locked(addr);
+	if (slot) {
+		k_mutex_unlock(&store_mutex);
+		return;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (!slots[i].used) {
+			slot = &slots[i];
+			break;
+		}
+	}
+
+	if (slot) {
+		memset(slot, 0, sizeof(*slot));
+		slot->used = true;
+		bt_addr_le_copy(&slot->sink.addr, addr);
+		device_store_mark_slot_dirty(slot);
+	}
+	k_mutex_unlock(&store_mutex);
+
+	if (!slot) {
+		/* Bonds are limited to the same number, so unlikely */
+		LOG_WRN("Device store full");
+	}
+}
+
+void device_store_set_vcs(const bt_addr_le_t *addr)
+{
+	struct device_store_slot *slot;
+
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	slot = device_store_find_locked(addr);
+	if (slot && !(slot->sink.flags & DEVICE_STORE_HAS_VCS)) {
+		slot->sink.flags |= DEVICE_STORE_HAS_VCS;
+		device_store_mark_slot_dirty(slot);
+	}
+	k_mutex_unlock(&store_mutex);
+}
+
+void device_store_set_csis(const bt_addr_le_t *addr, uint8_t rank, uint8_t set_size,
+			   const uint8_t sirk[BT_CSIP_SIRK_SIZE])
+{
+	struct device_store_slot *slot;
+
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	slot = device_store_find_locked(addr);
+	if (slot) {
+		slot->sink.flags |= DEVICE_STORE_HAS_CSIS;
+		slot->sink.set_rank = rank;
+		slot->sink.set_size = set_size;
+		memcpy(slot->sink.sirk, sirk, BT_CSIP_SIRK_SIZE);
+		device_store_mark_slot_dirty(slot);
+	}
+	k_mutex_unlock(&store_mutex);
+}
+
+void device_store_remove(const bt_addr_le_t *addr)
+{
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].used && (bt_addr_le_eq(addr, BT_ADDR_LE_ANY) ||
+				      bt_addr_le_eq(&slots[i].sink.addr, addr))) {
+			slots[i].used = false;
+			device_store_mark_slot_dirty(&slots[i]);
+		}
+	}
+
+	if (bt_addr_le_eq(addr, BT_ADDR_LE_ANY) && last_source_valid) {
+		last_source_valid = false;
+		device_store_mark_dirty(DEVICE_STORE_DIRTY_SOURCE);
+	}
+	k_mutex_unlock(&store_mutex);
+}
+
+size_t device_store_get_addrs(bt_addr_le_t addrs[DEVICE_STORE_SIZE])
+{
+	size_t count = 0;
+
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].used) {
+			bt_addr_le_copy(&addrs[count++], &slots[i].sink.addr);
+		}
+	}
+	k_mutex_unlock(&store_mutex);
+
+	return count;
+}
+
+void device_store_set_last_source(const struct device_store_source *source)
+{
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	if (!last_source_valid || memcmp(&last_source, source, sizeof(*source)) != 0) {
+		last_source = *source;
+		last_source_valid = true;
+		device_store_mark_dirty(DEVICE_STORE_DIRTY_SOURCE);
+	}
+	k_mutex_unlock(&store_mutex);
+}
+
+bool device_store_get_last_source(struct device_store_source *source)
+{
+	bool valid;
+
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	valid = last_source_valid;
+	if (valid) {
+		*source = last_source;
+	}
+	k_mutex_unlock(&store_mutex);
+
+	return valid;
+}
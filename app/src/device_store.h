@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DEVICE_STORE_H__
+#define __DEVICE_STORE_H__
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/addr.h>
+#include <zephyr/bluetooth/audio/csip.h>
+
+#define DEVICE_STORE_SIZE CONFIG_BT_MAX_PAIRED
+
+enum {
+	DEVICE_STORE_HAS_VCS = BIT(0),
+	DEVICE_STORE_HAS_CSIS = BIT(1), /* Set info below is valid */
+};
+
+/* What was learned about a bonded sink, kept across power cycles */
+struct device_store_sink {
+	bt_addr_le_t addr;
+	uint8_t flags;
+	uint8_t set_rank;
+	uint8_t set_size;
+	uint8_t sirk[BT_CSIP_SIRK_SIZE];
+};
+
+/* The broadcast source last added to the sinks */
+struct device_store_source {
+	bt_addr_le_t addr;
+	uint32_t broadcast_id;
+	uint16_t pa_interval;
+	uint8_t sid;
+};
+
+/**
+ * @brief Look up a known sink
+ *
+ * @param addr  Identity address of the sink
+ * @param sink  Filled in with the stored data if found, may be NULL
+ *
+ * @return true if the sink is known
+ */
+bool device_store_get(const bt_addr_le_t *addr, struct device_store_sink *sink);
+
+/**
+ * @brief Remember a sink once bonded, known sinks are left unchanged
+ */
+void device_store_add(const bt_addr_le_t *addr);
+
+void device_store_set_vcs(const bt_addr_le_t *addr);
+void device_store_set_csis(const bt_addr_le_t *addr, uint8_t rank, uint8_t set_size,
+			   const uint8_t sirk[BT_CSIP_SIRK_SIZE]);
+
+/**
+ * @brief Forget a sink
+ *
+ * @param addr  Identity address of the sink, or BT_ADDR_LE_ANY to forget all
+ */
+void device_store_remove(const bt_addr_le_t *addr);
+
+/**
+ * @brief Get the addresses of all known sinks
+ *
+ * @param addrs  Array of DEVICE_STORE_SIZE addresses
+ *
+ * @return Number of addresses filled in
+ */
+size_t device_store_get_addrs(bt_addr_le_t addrs[DEVICE_STORE_SIZE]);
+
+void device_store_set_last_source(const struct device_store_source *source);
+bool device_store_get_last_source(struct device_store_source *source);
+
+#endif /* __DEVICE_STORE_H__ */
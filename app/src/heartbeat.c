@@ -5,28 +5,100 @@
  */
 
 #include <zephyr/types.h>
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/net/buf.h>
 
+#include "broadcast_assistant.h"
+#include "heartbeat.h"
 #include "message.h"
+#include "stats.h"
+#include "webusb.h"
+
+LOG_MODULE_REGISTER(heartbeat, LOG_LEVEL_INF);
 
 static bool heartbeat_on;
+static bool heartbeat_timer_running;
 static uint8_t heartbeat_cnt;
+static uint8_t heartbeat_interval = CONFIG_HEARTBEAT_INTERVAL_S;
+/* Seconds without a frame sent, counted from STATS_TX_FRAMES */
+static uint8_t heartbeat_idle;
+static uint32_t heartbeat_tx_frames;
+
+static void heartbeat_work_handler(struct k_work *work);
+K_WORK_DEFINE(heartbeat_work, heartbeat_work_handler);
 
 static void heartbeat_timeout_handler(struct k_timer *dummy_p);
 K_TIMER_DEFINE(heartbeat_timer, heartbeat_timeout_handler, NULL);
 
+static void heartbeat_send(void)
+{
+	uint8_t health[HEARTBEAT_HEALTH_LTV_LEN];
+
+	health[0] = HEARTBEAT_HEALTH_LTV_LEN - 1;
+	health[1] = BT_DATA_HEALTH;
+	sys_put_le32(k_uptime_get() / MSEC_PER_SEC, &health[2]);
+	sys_put_le32(stats_get(STATS_TX_QUEUE_FULL) + stats_get(STATS_TX_ALLOC_FAILED) +
+			     stats_get(STATS_TX_BULK_ALLOC_FAILED),
+		     &health[6]);
+	sys_put_le32(stats_get(STATS_RX_ERRORS), &health[10]);
+	health[14] = MIN(webusb_tx_queued(false), UINT8_MAX);
+	health[15] = MIN(webusb_tx_queued(true), UINT8_MAX);
+
+	message_send_ltv(MESSAGE_TYPE_EVT, MESSAGE_SUBTYPE_HEARTBEAT, heartbeat_cnt++, health,
+			 sizeof(health));
+}
+
+static void heartbeat_work_handler(struct k_work *work)
+{
+	uint32_t tx_frames = stats_get(STATS_TX_FRAMES);
+
+	if (heartbeat_on) {
+		if (tx_frames != heartbeat_tx_frames) {
+			/* Other traffic was sent, the host knows we are alive */
+			heartbeat_tx_frames = tx_frames;
+			heartbeat_idle = 0;
+		} else if (++heartbeat_idle >= heartbeat_interval) {
+			heartbeat_idle = 0;
+			/* Our own frame is not other traffic */
+			heartbeat_tx_frames = tx_frames + 1;
+			heartbeat_send();
+		}
+	}
+
+	/* Periodic STATS events share the timer */
+	stats_tick();
+}
+
 static void heartbeat_timeout_handler(struct k_timer *timer)
 {
-	message_send_no_paylod(MESSAGE_TYPE_EVT, MESSAGE_SUBTYPE_HEARTBEAT, heartbeat_cnt++);
+	/* Timer context, the events are built on the system workqueue */
+	k_work_submit(&heartbeat_work);
+}
+
+void heartbeat_update_timer(void)
+{
+	bool run = heartbeat_on || stats_get_interval() != 0;
+
+	if (run && !heartbeat_timer_running) {
+		// Tick every second
+		k_timer_start(&heartbeat_timer, K_SECONDS(1), K_SECONDS(1));
+	} else if (!run && heartbeat_timer_running) {
+		k_timer_stop(&heartbeat_timer);
+	}
+
+	heartbeat_timer_running = run;
 }
 
 void heartbeat_start(void)
 {
 	if (!heartbeat_on) {
-		// Start generating heartbeats every second
+		// Start generating heartbeats when the link is idle
+		heartbeat_idle = 0;
+		heartbeat_tx_frames = stats_get(STATS_TX_FRAMES);
 		heartbeat_on = true;
-		k_timer_start(&heartbeat_timer, K_SECONDS(1), K_SECONDS(1));
+		heartbeat_update_timer();
 	}
 }
 
@@ -34,7 +106,7 @@ void heartbeat_stop(void)
 {
 	if (heartbeat_on) {
 		heartbeat_on = false;
-		k_timer_stop(&heartbeat_timer);
+		heartbeat_update_timer();
 	}
 }
 
@@ -47,8 +119,28 @@ void heartbeat_toggle(void)
 	}
 }
 
+void heartbeat_set_interval(uint8_t seconds)
+{
+	LOG_INF("Heartbeat interval %u s", seconds);
+
+	if (seconds == 0) {
+		heartbeat_stop();
+		return;
+	}
+
+	heartbeat_interval = seconds;
+	heartbeat_start();
+}
+
+uint8_t heartbeat_get_interval(void)
+{
+	return heartbeat_on ? heartbeat_interval : 0;
+}
+
 void heartbeat_init(void)
 {
 	heartbeat_on = false;
+	heartbeat_timer_running = false;
+	heartbeat_interval = CONFIG_HEARTBEAT_INTERVAL_S;
 	k_timer_init(&heartbeat_timer, heartbeat_timeout_handler, NULL);
 }
@@ -9,9 +9,36 @@
 
 #include <zephyr/types.h>
 
+/*
+ * BT_DATA_HEALTH of the HEARTBEAT event,
+ * [le32 uptime_s][le32 tx_dropped][le32 rx_errors][tx_queued][tx_bulk_queued]
+ */
+#define HEARTBEAT_HEALTH_LEN     14
+/* [len][type][health] */
+#define HEARTBEAT_HEALTH_LTV_LEN (2 + HEARTBEAT_HEALTH_LEN)
+
 void heartbeat_start(void);
 void heartbeat_stop(void);
 void heartbeat_toggle(void);
+
+/**
+ * @brief Set the heartbeat interval
+ *
+ * A HEARTBEAT event is only sent when no other frame was sent for the
+ * interval, any traffic keeps the link alive.
+ *
+ * @param seconds  Interval in seconds, 0 stops the heartbeat
+ */
+void heartbeat_set_interval(uint8_t seconds);
+
+/**
+ * @brief Get the heartbeat interval
+ *
+ * @return Interval in seconds, 0 if the heartbeat is stopped
+ */
+uint8_t heartbeat_get_interval(void);
+
+void heartbeat_update_timer(void);
 void heartbeat_init(void);
 
 #endif /* __HEARTBEAT_H__ */
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/net/buf.h>
+
+#include "io_arena.h"
+#include "stats.h"
+
+LOG_MODULE_REGISTER(io_arena, LOG_LEVEL_INF);
+
+BUILD_ASSERT(CONFIG_IO_ARENA_CONTROL_RESERVE < CONFIG_IO_ARENA_SIZE);
+
+/* Like the Zephyr net_buf heap allocator, a reference count in front of the data */
+#define IO_ARENA_REF_LEN sizeof(void *)
+
+/*
+ * What an allocation takes from the heap: sys_heap puts a chunk header of up
+ * to 8 bytes in front of it and rounds it up to 8 byte chunk units.
+ */
+#define IO_ARENA_CHUNK_UNIT 8
+#define IO_ARENA_FOOTPRINT(size)                                                                   \
+	ROUND_UP(IO_ARENA_CHUNK_UNIT + IO_ARENA_REF_LEN + (size), IO_ARENA_CHUNK_UNIT)
+
+K_HEAP_DEFINE(io_arena_heap, CONFIG_IO_ARENA_SIZE);
+
+static atomic_t arena_used;
+static void (*arena_free_cb)(void);
+
+/* Which limit the allocations of a pool are held to */
+struct io_arena_user {
+	size_t limit;
+};
+
+static const struct io_arena_user control_user = {
+	.limit = CONFIG_IO_ARENA_SIZE,
+};
+
+static const struct io_arena_user bulk_user = {
+	.limit = CONFIG_IO_ARENA_SIZE - CONFIG_IO_ARENA_CONTROL_RESERVE,
+};
+
+static uint8_t *io_arena_data_alloc(struct net_buf *buf, size_t *size, k_timeout_t timeout)
+{
+	const struct net_buf_pool *pool = net_buf_pool_get(buf->pool_id);
+	const struct io_arena_user *user = pool->alloc->alloc_data;
+	size_t len = IO_ARENA_FOOTPRINT(*size);
+	uint8_t *ref_count;
+
+	if ((size_t)atomic_add(&arena_used, len) + len > user->limit) {
+		atomic_sub(&arena_used, len);
+		return NULL;
+	}
+
+	ref_count = k_heap_alloc(&io_arena_heap, IO_ARENA_REF_LEN + *size, timeout);
+	if (ref_count == NULL) {
+		/* Fragmented, or taken by the heap's own bookkeeping */
+		atomic_sub(&arena_used, len);
+		return NULL;
+	}
+
+	*ref_count = 1U;
+	stats_max(STATS_IO_ARENA_PEAK, (uint32_t)atomic_get(&arena_used));
+
+	return ref_count + IO_ARENA_REF_LEN;
+}
+
+static uint8_t *io_arena_data_ref(struct net_buf *buf, uint8_t *data)
+{
+	uint8_t *ref_count = data - IO_ARENA_REF_LEN;
+
+	(*ref_count)++;
+
+	return data;
+}
+
+static void io_arena_data_unref(struct net_buf *buf, uint8_t *data)
+{
+	uint8_t *ref_count = data - IO_ARENA_REF_LEN;
+	void (*cb)(void);
+
+	if (--(*ref_count)) {
+		return;
+	}
+
+	k_heap_free(&io_arena_heap, ref_count);
+	atomic_sub(&arena_used, IO_ARENA_FOOTPRINT(buf->size));
+
+	cb = arena_free_cb;
+	if (cb != NULL) {
+		cb();
+	}
+}
+
+static const struct net_buf_data_cb io_arena_cb = {
+	.alloc = io_arena_data_alloc,
+	.ref = io_arena_data_ref,
+	.unref = io_arena_data_unref,
+};
+
+const struct net_buf_data_alloc io_arena_control_alloc = {
+	.cb = &io_arena_cb,
+	.alloc_data = (void *)&control_user,
+};
+
+const struct net_buf_data_alloc io_arena_bulk_alloc = {
+	.cb = &io_arena_cb,
+	.alloc_data = (void *)&bulk_user,
+};
+
+/*
+ * Public functions
+ */
+void io_arena_register_free_cb(void (*cb)(void))
+{
+	arena_free_cb = cb;
+}
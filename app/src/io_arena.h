@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __IO_ARENA_H__
+#define __IO_ARENA_H__
+
+#include <zephyr/types.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/iterable_sections.h>
+
+/*
+ * With LOW_RAM, the RX and TX message buffers take their data from one
+ * IO_ARENA_SIZE heap instead of each pool having its own fixed size data.
+ * The pools then only bound the number of buffers, which have no user data.
+ * Buffers are allocated with net_buf_alloc_len().
+ */
+extern const struct net_buf_data_alloc io_arena_control_alloc;
+extern const struct net_buf_data_alloc io_arena_bulk_alloc;
+
+#define IO_ARENA_POOL_INITIALIZER(_name, _count, _destroy, _alloc)                                 \
+	static struct net_buf _net_buf_##_name[_count] __noinit;                                   \
+	static STRUCT_SECTION_ITERABLE(net_buf_pool, _name) =                                      \
+		NET_BUF_POOL_INITIALIZER(_name, _alloc, _net_buf_##_name, _count, 0, _destroy)
+
+/* Pool of RX buffers, responses and control events */
+#define IO_ARENA_POOL_DEFINE(_name, _count, _destroy)                                              \
+	IO_ARENA_POOL_INITIALIZER(_name, _count, _destroy, &io_arena_control_alloc)
+
+/*
+ * Pool of bulk events, which fail to allocate rather than leave less than
+ * IO_ARENA_CONTROL_RESERVE of the arena free
+ */
+#define IO_ARENA_BULK_POOL_DEFINE(_name, _count, _destroy)                                         \
+	IO_ARENA_POOL_INITIALIZER(_name, _count, _destroy, &io_arena_bulk_alloc)
+
+/**
+ * @brief Register a callback for when arena memory is freed
+ *
+ * Lets a user whose allocation failed retry, e.g. resume a paused reception.
+ * Called in the context of the net_buf_unref() that freed the memory.
+ *
+ * @param cb  Callback, NULL to unregister
+ */
+void io_arena_register_free_cb(void (*cb)(void));
+
+#endif /* __IO_ARENA_H__ */
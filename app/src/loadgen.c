@@ -0,0 +1,431 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/bluetooth/audio/audio.h>
+
+#include "broadcast_assistant.h"
+#include "cobs.h"
+#include "loadgen.h"
+#include "stats.h"
+
+LOG_MODULE_REGISTER(loadgen, LOG_LEVEL_INF);
+
+/* Reports are injected in bursts, like a controller delivering its backlog */
+#define LOADGEN_TICK_MS     10
+/* Time for the last scan batch to be sent before the counters are read */
+#define LOADGEN_DRAIN_MS    500
+#define LOADGEN_PA_INTERVAL 0x60
+#define LOADGEN_NAME_LEN    16
+#define LOADGEN_REPORT_LEN  1152
+
+#define LOADGEN_COBS_MAX_LEN    1024
+#define LOADGEN_COBS_ITERATIONS 100
+
+struct loadgen_counter {
+	const char *name;
+	enum stats_counter counter;
+};
+
+struct loadgen_latency {
+	const char *name;
+	enum stats_latency latency;
+};
+
+static const struct loadgen_counter loadgen_counters[] = {
+	{"scan_forwarded", STATS_SCAN_FORWARDED},
+	{"scan_batches", STATS_SCAN_BATCHES},
+	{"pa_sync_created", STATS_PA_SYNC_CREATED},
+	{"tx_frames", STATS_TX_FRAMES},
+	{"tx_transfers", STATS_TX_TRANSFERS},
+	{"tx_queue_peak", STATS_TX_QUEUE_PEAK},
+	{"tx_queue_full", STATS_TX_QUEUE_FULL},
+	{"tx_alloc_failed", STATS_TX_ALLOC_FAILED},
+	{"tx_bulk_alloc_failed", STATS_TX_BULK_ALLOC_FAILED},
+	{"tx_errors", STATS_TX_ERRORS},
+	{"io_arena_peak", STATS_IO_ARENA_PEAK},
+};
+
+static const struct loadgen_latency loadgen_latencies[] = {
+	{"scan_recv_us", STATS_LATENCY_SCAN_RECV},
+	{"tx_us", STATS_LATENCY_USB_TX},
+};
+
+struct loadgen_cobs_result {
+	uint32_t encode_ns;
+	uint32_t decode_ns;
+	uint32_t ref_encode_ns;
+	uint32_t ref_decode_ns;
+};
+
+static const uint16_t loadgen_cobs_lens[] = {16, 64, 256, LOADGEN_COBS_MAX_LEN};
+static struct loadgen_cobs_result loadgen_cobs_results[ARRAY_SIZE(loadgen_cobs_lens)];
+static uint8_t loadgen_cobs_src[LOADGEN_COBS_MAX_LEN];
+static uint8_t loadgen_cobs_dst[COBS_ENCODE_DST_BUF_LEN_MAX(LOADGEN_COBS_MAX_LEN)];
+
+NET_BUF_SIMPLE_DEFINE_STATIC(loadgen_ad, BT_GAP_ADV_MAX_ADV_DATA_LEN);
+static char loadgen_report_str[LOADGEN_REPORT_LEN];
+
+/*
+ * The byte-wise COBS codec cobs.c had before the word-at-a-time one, kept as the
+ * reference the new codec is measured against. Same results and status bits.
+ */
+static cobs_encode_result loadgen_cobs_ref_encode(void *dst_buf_ptr, size_t dst_buf_len,
+						  const void *src_ptr, size_t src_len)
+{
+	cobs_encode_result result = {0, COBS_ENCODE_OK};
+	const uint8_t *src_read_ptr = src_ptr;
+	const uint8_t *src_end_ptr = (const uint8_t *)src_ptr + src_len;
+	uint8_t *dst_buf_start_ptr = dst_buf_ptr;
+	uint8_t *dst_buf_end_ptr = (uint8_t *)dst_buf_ptr + dst_buf_len;
+	uint8_t *dst_code_write_ptr = dst_buf_ptr;
+	uint8_t *dst_write_ptr = dst_code_write_ptr + 1;
+	uint8_t search_len = 1;
+
+	if (dst_buf_ptr == NULL || src_ptr == NULL) {
+		result.status = COBS_ENCODE_NULL_POINTER;
+		return result;
+	}
+
+	while (src_len != 0) {
+		uint8_t src_byte;
+
+		if (dst_write_ptr >= dst_buf_end_ptr) {
+			result.status |= COBS_ENCODE_OUT_BUFFER_OVERFLOW;
+			break;
+		}
+
+		src_byte = *src_read_ptr++;
+		if (src_byte == 0) {
+			*dst_code_write_ptr = search_len;
+			dst_code_write_ptr = dst_write_ptr++;
+			search_len = 1;
+			if (src_read_ptr >= src_end_ptr) {
+				break;
+			}
+		} else {
+			*dst_write_ptr++ = src_byte;
+			search_len++;
+			if (src_read_ptr >= src_end_ptr) {
+				break;
+			}
+			if (search_len == 0xFF) {
+				/* Long run of non-zero bytes, split with a 0xFF code */
+				*dst_code_write_ptr = search_len;
+				dst_code_write_ptr = dst_write_ptr++;
+				search_len = 1;
+			}
+		}
+	}
+
+	if (dst_code_write_ptr >= dst_buf_end_ptr) {
+		result.status |= COBS_ENCODE_OUT_BUFFER_OVERFLOW;
+		dst_write_ptr = dst_buf_end_ptr;
+	} else {
+		*dst_code_write_ptr = search_len;
+	}
+
+	result.out_len = dst_write_ptr - dst_buf_start_ptr;
+
+	return result;
+}
+
+static cobs_decode_result loadgen_cobs_ref_decode(void *dst_buf_ptr, size_t dst_buf_len,
+						  const void *src_ptr, size_t src_len)
+{
+	cobs_decode_result result = {0, COBS_DECODE_OK};
+	const uint8_t *src_read_ptr = src_ptr;
+	const uint8_t *src_end_ptr = (const uint8_t *)src_ptr + src_len;
+	uint8_t *dst_buf_start_ptr = dst_buf_ptr;
+	uint8_t *dst_buf_end_ptr = (uint8_t *)dst_buf_ptr + dst_buf_len;
+	uint8_t *dst_write_ptr = dst_buf_ptr;
+
+	if (dst_buf_ptr == NULL || src_ptr == NULL) {
+		result.status = COBS_DECODE_NULL_POINTER;
+		return result;
+	}
+
+	while (src_len != 0) {
+		size_t remaining_bytes;
+		uint8_t len_code;
+
+		len_code = *src_read_ptr++;
+		if (len_code == 0) {
+			result.status |= COBS_DECODE_ZERO_BYTE_IN_INPUT;
+			break;
+		}
+		len_code--;
+
+		remaining_bytes = src_end_ptr - src_read_ptr;
+		if (len_code > remaining_bytes) {
+			result.status |= COBS_DECODE_INPUT_TOO_SHORT;
+			len_code = remaining_bytes;
+		}
+
+		remaining_bytes = dst_buf_end_ptr - dst_write_ptr;
+		if (len_code > remaining_bytes) {
+			result.status |= COBS_DECODE_OUT_BUFFER_OVERFLOW;
+			len_code = remaining_bytes;
+		}
+
+		for (uint8_t i = len_code; i != 0; i--) {
+			uint8_t src_byte = *src_read_ptr++;
+
+			if (src_byte == 0) {
+				result.status |= COBS_DECODE_ZERO_BYTE_IN_INPUT;
+			}
+			*dst_write_ptr++ = src_byte;
+		}
+
+		if (src_read_ptr >= src_end_ptr) {
+			break;
+		}
+
+		/* Every block but a full 0xFF one ends with a zero */
+		if (len_code != 0xFE) {
+			if (dst_write_ptr >= dst_buf_end_ptr) {
+				result.status |= COBS_DECODE_OUT_BUFFER_OVERFLOW;
+				break;
+			}
+			*dst_write_ptr++ = 0;
+		}
+	}
+
+	result.out_len = dst_write_ptr - dst_buf_start_ptr;
+
+	return result;
+}
+
+/*
+ * Time per frame of the COBS codec and of the byte-wise reference, on the same data
+ * and before any load so nothing preempts them
+ */
+static void loadgen_cobs_bench(void)
+{
+	/* Message like data, mostly non-zero with a zero every 32 bytes or so */
+	for (size_t i = 0; i < sizeof(loadgen_cobs_src); i++) {
+		loadgen_cobs_src[i] = (i * 37 + 11) % 32 == 0 ? 0 : (uint8_t)(i * 37 + 11);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(loadgen_cobs_lens); i++) {
+		const uint16_t len = loadgen_cobs_lens[i];
+		cobs_encode_result encoded;
+		uint32_t start;
+		uint32_t cycles;
+
+		start = k_cycle_get_32();
+		for (int n = 0; n < LOADGEN_COBS_ITERATIONS; n++) {
+			encoded = cobs_encode(loadgen_cobs_dst, sizeof(loadgen_cobs_dst),
+					      loadgen_cobs_src, len);
+		}
+		cycles = k_cycle_get_32() - start;
+		loadgen_cobs_results[i].encode_ns =
+			k_cyc_to_ns_floor64(cycles) / LOADGEN_COBS_ITERATIONS;
+
+		/* Back into the source buffer, which keeps the same content */
+		start = k_cycle_get_32();
+		for (int n = 0; n < LOADGEN_COBS_ITERATIONS; n++) {
+			(void)cobs_decode(loadgen_cobs_src, sizeof(loadgen_cobs_src),
+					  loadgen_cobs_dst, encoded.out_len);
+		}
+		cycles = k_cycle_get_32() - start;
+		loadgen_cobs_results[i].decode_ns =
+			k_cyc_to_ns_floor64(cycles) / LOADGEN_COBS_ITERATIONS;
+
+		start = k_cycle_get_32();
+		for (int n = 0; n < LOADGEN_COBS_ITERATIONS; n++) {
+			encoded = loadgen_cobs_ref_encode(loadgen_cobs_dst, sizeof(loadgen_cobs_dst),
+							  loadgen_cobs_src, len);
+		}
+		cycles = k_cycle_get_32() - start;
+		loadgen_cobs_results[i].ref_encode_ns =
+			k_cyc_to_ns_floor64(cycles) / LOADGEN_COBS_ITERATIONS;
+
+		start = k_cycle_get_32();
+		for (int n = 0; n < LOADGEN_COBS_ITERATIONS; n++) {
+			(void)loadgen_cobs_ref_decode(loadgen_cobs_src, sizeof(loadgen_cobs_src),
+						      loadgen_cobs_dst, encoded.out_len);
+		}
+		cycles = k_cycle_get_32() - start;
+		loadgen_cobs_results[i].ref_decode_ns =
+			k_cyc_to_ns_floor64(cycles) / LOADGEN_COBS_ITERATIONS;
+	}
+}
+
+static void loadgen_add_ltv(uint8_t type, const void *data, uint8_t len)
+{
+	net_buf_simple_add_u8(&loadgen_ad, len + 1);
+	net_buf_simple_add_u8(&loadgen_ad, type);
+	net_buf_simple_add_mem(&loadgen_ad, data, len);
+}
+
+/* Report number n, even devices are connectable sinks and odd ones broadcast sources */
+static void loadgen_inject(uint32_t n)
+{
+	const uint16_t device = n % CONFIG_LOADGEN_DEVICES;
+	struct bt_le_scan_recv_info info = {0};
+	char name[LOADGEN_NAME_LEN];
+	bt_addr_le_t addr;
+	uint32_t start;
+
+	/* Random static address C0:00:00:00:<device> */
+	addr.type = BT_ADDR_LE_RANDOM;
+	memset(addr.a.val, 0, sizeof(addr.a.val));
+	sys_put_le16(device, addr.a.val);
+	addr.a.val[5] = 0xC0;
+
+	info.addr = &addr;
+	/* Moves by more than SCAN_CACHE_RSSI_DELTA now and then, so some repeats are reported */
+	info.rssi = -40 - (int8_t)((n / CONFIG_LOADGEN_DEVICES * 7 + device) % 32);
+	info.tx_power = BT_GAP_TX_POWER_INVALID;
+	info.primary_phy = BT_GAP_LE_PHY_1M;
+
+	net_buf_simple_reset(&loadgen_ad);
+
+	if ((device & 1) == 0) {
+		const uint8_t flags = BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR;
+		uint8_t uuids[2 * sizeof(uint16_t)];
+
+		sys_put_le16(BT_UUID_BASS_VAL, &uuids[0]);
+		sys_put_le16(BT_UUID_PACS_VAL, &uuids[sizeof(uint16_t)]);
+		snprintk(name, sizeof(name), "LG sink %u", device);
+
+		loadgen_add_ltv(BT_DATA_FLAGS, &flags, sizeof(flags));
+		loadgen_add_ltv(BT_DATA_UUID16_ALL, uuids, sizeof(uuids));
+		loadgen_add_ltv(BT_DATA_NAME_COMPLETE, name, strlen(name));
+
+		info.adv_type = BT_GAP_ADV_TYPE_ADV_IND;
+		info.adv_props = BT_GAP_ADV_PROP_CONNECTABLE | BT_GAP_ADV_PROP_SCANNABLE;
+	} else {
+		uint8_t svc_data[BT_UUID_SIZE_16 + BT_AUDIO_BROADCAST_ID_SIZE];
+
+		sys_put_le16(BT_UUID_BROADCAST_AUDIO_VAL, svc_data);
+		sys_put_le24(device, &svc_data[BT_UUID_SIZE_16]);
+		snprintk(name, sizeof(name), "LG source %u", device);
+
+		loadgen_add_ltv(BT_DATA_SVC_DATA16, svc_data, sizeof(svc_data));
+		loadgen_add_ltv(BT_DATA_BROADCAST_NAME, name, strlen(name));
+
+		info.adv_type = BT_GAP_ADV_TYPE_EXT_ADV;
+		info.adv_props = BT_GAP_ADV_PROP_EXT_ADV;
+		info.sid = device & 0x0F;
+		info.interval = LOADGEN_PA_INTERVAL;
+		info.secondary_phy = BT_GAP_LE_PHY_2M;
+	}
+
+	start = k_cycle_get_32();
+	broadcast_assistant_scan_inject(&info, &loadgen_ad);
+	stats_latency_end(STATS_LATENCY_SCAN_RECV, start);
+}
+
+static void loadgen_print_report(uint32_t injected, uint32_t elapsed_ms)
+{
+	char *str = loadgen_report_str;
+	size_t left = sizeof(loadgen_report_str);
+	uint32_t dropped;
+	int len;
+
+	dropped = stats_get(STATS_TX_QUEUE_FULL) + stats_get(STATS_TX_ALLOC_FAILED) +
+		  stats_get(STATS_TX_BULK_ALLOC_FAILED);
+
+	len = snprintk(str, left,
+		       "LOADGEN_REPORT {\"devices\":%u,\"rate\":%u,\"duration_ms\":%u,"
+		       "\"injected\":%u,\"reports_per_s\":%u,\"dropped\":%u,\"drop_ppm\":%u",
+		       CONFIG_LOADGEN_DEVICES, CONFIG_LOADGEN_RATE, elapsed_ms, injected,
+		       (uint32_t)((uint64_t)injected * MSEC_PER_SEC / MAX(elapsed_ms, 1)), dropped,
+		       (uint32_t)((uint64_t)dropped * 1000000 /
+				  MAX(stats_get(STATS_TX_FRAMES) + dropped, 1)));
+
+	for (size_t i = 0; i < ARRAY_SIZE(loadgen_counters) && len < left; i++) {
+		len += snprintk(str + len, left - len, ",\"%s\":%u", loadgen_counters[i].name,
+				stats_get(loadgen_counters[i].counter));
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(loadgen_latencies) && len < left; i++) {
+		struct stats_latency_value value;
+
+		stats_latency_get(loadgen_latencies[i].latency, &value);
+		len += snprintk(str + len, left - len,
+				",\"%s\":{\"count\":%u,\"min\":%u,\"max\":%u,\"avg\":%u}",
+				loadgen_latencies[i].name, value.count, value.min, value.max,
+				value.avg);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(loadgen_cobs_lens) && len < left; i++) {
+		len += snprintk(str + len, left - len,
+				"%s{\"len\":%u,\"encode_ns\":%u,\"decode_ns\":%u,"
+				"\"ref_encode_ns\":%u,\"ref_decode_ns\":%u}",
+				i == 0 ? ",\"cobs\":[" : ",", loadgen_cobs_lens[i],
+				loadgen_cobs_results[i].encode_ns, loadgen_cobs_results[i].decode_ns,
+				loadgen_cobs_results[i].ref_encode_ns,
+				loadgen_cobs_results[i].ref_decode_ns);
+	}
+
+	if (len < left) {
+		len += snprintk(str + len, left - len, "]");
+	}
+
+	if (len >= left) {
+		LOG_ERR("Report truncated");
+		return;
+	}
+
+	/* printk, so the line is not interleaved with deferred log output */
+	printk("%s}\n", str);
+}
+
+/*
+ * Public functions
+ */
+void loadgen_run(void)
+{
+	const uint32_t duration_ms = CONFIG_LOADGEN_DURATION_S * MSEC_PER_SEC;
+	uint32_t injected = 0;
+	uint32_t elapsed_ms;
+	int64_t start;
+	int err;
+
+	loadgen_cobs_bench();
+
+	/* The order the web app starts them in */
+	err = broadcast_assistant_start_scan(BROADCAST_ASSISTANT_SCAN_SINK, 0, NULL);
+	if (!err) {
+		err = broadcast_assistant_start_scan(BROADCAST_ASSISTANT_SCAN_SOURCE, 0, NULL);
+	}
+	if (err) {
+		LOG_ERR("Failed to start scanning (err %d)", err);
+		return;
+	}
+
+	LOG_INF("Injecting %u reports/s from %u devices for %u s", CONFIG_LOADGEN_RATE,
+		CONFIG_LOADGEN_DEVICES, CONFIG_LOADGEN_DURATION_S);
+
+	stats_reset();
+	start = k_uptime_get();
+
+	do {
+		elapsed_ms = k_uptime_get() - start;
+
+		/* Catch up with the rate, a slow scan path shows as fewer reports/s */
+		while (injected < (uint64_t)elapsed_ms * CONFIG_LOADGEN_RATE / MSEC_PER_SEC) {
+			loadgen_inject(injected++);
+		}
+
+		k_sleep(K_MSEC(LOADGEN_TICK_MS));
+	} while (elapsed_ms < duration_ms);
+
+	(void)broadcast_assistant_stop_scanning();
+	k_sleep(K_MSEC(LOADGEN_DRAIN_MS));
+
+	loadgen_print_report(injected, elapsed_ms);
+}
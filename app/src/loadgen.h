@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __LOADGEN_H__
+#define __LOADGEN_H__
+
+/**
+ * @brief Run the synthetic advertiser load and print the report
+ *
+ * Starts a sink and source scan, injects scan reports of LOADGEN_DEVICES
+ * advertisers at LOADGEN_RATE reports per second for LOADGEN_DURATION_S
+ * seconds, then prints one "LOADGEN_REPORT {...}" JSON line on the console.
+ * Blocks the caller for the whole run.
+ */
+void loadgen_run(void);
+
+#endif /* __LOADGEN_H__ */
@@ -16,6 +16,7 @@
 #include "broadcast_assistant.h"
 #include "heartbeat.h"
 #include "message.h"
+#include "loadgen.h"
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
 
@@ -26,18 +27,23 @@ int main(void)
 	LOG_INF("web-broadcast-assistants starting");
 
 	/* Initialize WebUSB component */
-	msosv2_init();
+	if (!IS_ENABLED(CONFIG_HOST_PIPE)) {
+		msosv2_init();
+	}
 	webusb_init();
+	message_init();
 
 	/* Set the message handler */
 	webusb_register_message_handler(&message_handler);
 
 	heartbeat_init();
 
-	ret = usb_enable(NULL);
-	if (ret != 0) {
-		LOG_ERR("Failed to enable USB");
-		return ret;
+	if (!IS_ENABLED(CONFIG_HOST_PIPE)) {
+		ret = usb_enable(NULL);
+		if (ret != 0) {
+			LOG_ERR("Failed to enable USB");
+			return ret;
+		}
 	}
 
 	/* Bluetooth initialization */
@@ -47,5 +53,10 @@ int main(void)
 		return ret;
 	}
 
+	if (IS_ENABLED(CONFIG_LOADGEN)) {
+		/* Benchmark builds, see README.md */
+		loadgen_run();
+	}
+
 	return 0;
 }
@@ -17,11 +17,87 @@
 #include "broadcast_assistant.h"
 #include "heartbeat.h"
 #include "message.h"
+#include "message_evt.h"
+#include "stats.h"
+#include "device_store.h"
+#include "scan_sched.h"
+#include "scan_filter.h"
+#include "pa_sync_sched.h"
+#include "trace.h"
+#include "state_snapshot.h"
+#include "io_arena.h"
 
 LOG_MODULE_REGISTER(message_handler, LOG_LEVEL_INF);
 
+#define MESSAGE_TX_BUF_SIZE(payload_len)                                                           \
+	(MESSAGE_TX_COBS_HEADROOM(payload_len) + sizeof(struct webusb_message) + (payload_len))
+
+BUILD_ASSERT(CONFIG_TX_MSG_SMALL_PAYLOAD_LEN <= CONFIG_TX_MSG_MAX_PAYLOAD_LEN);
+BUILD_ASSERT(CONFIG_TX_MSG_MEDIUM_PAYLOAD_LEN <= CONFIG_TX_MSG_MAX_PAYLOAD_LEN);
+
+#if defined(CONFIG_LOW_RAM)
+/* The classes only bound the number of buffers, their data comes from the arena */
+BUILD_ASSERT(MESSAGE_TX_BUF_SIZE(CONFIG_TX_MSG_MAX_PAYLOAD_LEN) + sizeof(void *) <=
+	     CONFIG_IO_ARENA_CONTROL_RESERVE);
+
+IO_ARENA_POOL_DEFINE(command_tx_small_pool, CONFIG_TX_MSG_SMALL_MAX_MESSAGES, NULL);
+IO_ARENA_POOL_DEFINE(command_tx_msg_pool, CONFIG_TX_MSG_MAX_MESSAGES, NULL);
+/* Bulk events leave IO_ARENA_CONTROL_RESERVE for RES and state events */
+IO_ARENA_BULK_POOL_DEFINE(command_tx_bulk_medium_pool, CONFIG_TX_BULK_MSG_MEDIUM_MAX_MESSAGES, NULL);
+IO_ARENA_BULK_POOL_DEFINE(command_tx_bulk_pool, CONFIG_TX_BULK_MSG_MAX_MESSAGES, NULL);
+#else
+NET_BUF_POOL_DEFINE(command_tx_small_pool, CONFIG_TX_MSG_SMALL_MAX_MESSAGES,
+		    MESSAGE_TX_BUF_SIZE(CONFIG_TX_MSG_SMALL_PAYLOAD_LEN), 0, NULL);
 NET_BUF_POOL_DEFINE(command_tx_msg_pool, CONFIG_TX_MSG_MAX_MESSAGES,
-		    sizeof(struct webusb_message) + CONFIG_TX_MSG_MAX_PAYLOAD_LEN, 0, NULL);
+		    MESSAGE_TX_BUF_SIZE(CONFIG_TX_MSG_MAX_PAYLOAD_LEN), 0, NULL);
+/* Scan reports, BASE, BIGinfo and STATS, kept apart so they cannot starve RES and state events */
+NET_BUF_POOL_DEFINE(command_tx_bulk_medium_pool, CONFIG_TX_BULK_MSG_MEDIUM_MAX_MESSAGES,
+		    MESSAGE_TX_BUF_SIZE(CONFIG_TX_MSG_MEDIUM_PAYLOAD_LEN), 0, NULL);
+NET_BUF_POOL_DEFINE(command_tx_bulk_pool, CONFIG_TX_BULK_MSG_MAX_MESSAGES,
+		    MESSAGE_TX_BUF_SIZE(CONFIG_TX_MSG_MAX_PAYLOAD_LEN), 0, NULL);
+#endif /* CONFIG_LOW_RAM */
+
+/* TX buffer size classes, smallest first */
+struct message_tx_class {
+	struct net_buf_pool *pool;
+	uint16_t payload_len;
+};
+
+static const struct message_tx_class tx_classes[] = {
+	{ &command_tx_small_pool, CONFIG_TX_MSG_SMALL_PAYLOAD_LEN },
+	{ &command_tx_msg_pool, CONFIG_TX_MSG_MAX_PAYLOAD_LEN },
+};
+
+static const struct message_tx_class tx_bulk_classes[] = {
+	{ &command_tx_bulk_medium_pool, CONFIG_TX_MSG_MEDIUM_PAYLOAD_LEN },
+	{ &command_tx_bulk_pool, CONFIG_TX_MSG_MAX_PAYLOAD_LEN },
+};
+
+#define MESSAGE_CMD_WORKQUEUE_PRIORITY K_PRIO_PREEMPT(2)
+#define MESSAGE_CMD_MAX_PENDING        4
+
+/*
+ * Commands are executed on their own workqueue, so blocking Bluetooth calls do
+ * not stall the USB workqueue. Received buffers are queued as they are, the
+ * queue is bounded by the RX buffer pool.
+ */
+static struct k_work_q message_cmd_workqueue;
+K_THREAD_STACK_DEFINE(message_cmd_workqueue_stack, CONFIG_CMD_WORKQUEUE_STACK_SIZE);
+K_FIFO_DEFINE(message_cmd_fifo);
+
+static void message_cmd_work_handler(struct k_work *work);
+K_WORK_DEFINE(message_cmd_work, message_cmd_work_handler);
+
+/* Commands whose RES is sent when the Bluetooth operation completes */
+struct message_cmd_pending {
+	uint8_t sub_type;
+	uint8_t seq_no;
+	bool active;
+	struct k_work_delayable timeout_work;
+};
+
+static struct message_cmd_pending cmd_pending[MESSAGE_CMD_MAX_PENDING];
+static K_MUTEX_DEFINE(cmd_pending_mutex);
 
 struct webusb_ltv_data {
 	uint8_t adv_sid;
@@ -30,52 +106,59 @@ struct webusb_ltv_data {
 	bt_addr_le_t addr;
 	uint8_t src_id;
 	uint8_t volume;
+	uint8_t mute;
+	int8_t volume_step;
+	bool has_broadcast_code;
 	uint8_t broadcast_code[BT_AUDIO_BROADCAST_CODE_SIZE];
 	uint8_t num_subgroups;
 	uint32_t bis_sync[CONFIG_BT_BAP_BASS_MAX_SUBGROUPS];
 	uint8_t csis_set_size;
 	uint8_t csis_sirk[BT_CSIP_SIRK_SIZE];
+	bool has_stats_interval;
+	uint8_t stats_interval;
+	uint16_t credits;
+	uint32_t trace_cursor;
+	uint8_t evt_seq;
+	bool has_heartbeat_interval;
+	uint8_t heartbeat_interval;
+	uint8_t scan_params_cnt;
+	uint8_t scan_params[SCAN_SCHED_TARGET_COUNT][SCAN_SCHED_PARAMS_LEN];
+	bool scan_params_invalid; /* Malformed, or more than one per target */
+	/* Rules point into the received message */
+	size_t scan_filter_cnt;
+	struct bt_data scan_filter[SCAN_FILTER_MAX_RULES];
 };
 
 static struct webusb_ltv_data parsed_ltv_data;
 
-static void message_log_ltv(uint8_t *data, uint16_t data_len);
-static void message_prepend_header(struct net_buf *buf, enum message_type mtype,
-				   enum message_sub_type stype, uint8_t seq_no, uint16_t len);
+/* Events are numbered per stream in the header seq_no, see message_send_net_buf_event() */
+enum message_evt_stream {
+	MESSAGE_EVT_STREAM_CONTROL,
+	MESSAGE_EVT_STREAM_BULK,
+	MESSAGE_EVT_STREAM_COUNT,
+};
 
-#define LTV_STR_LEN 1024
+/* A control event kept for RESYNC_FROM, slot seq % EVT_REPLAY_EVENTS */
+struct message_evt_replay {
+	uint8_t seq;
+	uint8_t sub_type;
+	uint8_t len;
+	bool valid; /* False if the event was lost before it could be kept */
+	uint8_t payload[CONFIG_TX_MSG_SMALL_PAYLOAD_LEN];
+};
 
-static void message_log_ltv(uint8_t *data, uint16_t data_len)
-{
-	char ltv_str[LTV_STR_LEN] = {0};
-
-	/* Log message payload (ltv format) */
-	for (int i = 0; i < data_len;) {
-		uint8_t ltv_len = *data++;
-		char *ch_ptr = &ltv_str[0];
-
-		/* length */
-		sprintf(ch_ptr, "[ L:%02x ", ltv_len);
-		ch_ptr += 7;
-		if (ltv_len > 0) {
-			/* type */
-			sprintf(ch_ptr, "T:%02x ", *data++);
-			ch_ptr += 5;
-			if (ltv_len > 1) {
-				/* value */
-				for (int j = 1; j < ltv_len; j++) {
-					sprintf(ch_ptr, "%02x ", *data++);
-					ch_ptr += 3;
-				}
-			}
-		}
-		sprintf(ch_ptr, "]");
-		ch_ptr += 1;
-		i += (ltv_len + 1);
-
-		LOG_DBG("%s", ltv_str);
-	}
-}
+BUILD_ASSERT(CONFIG_TX_MSG_SMALL_PAYLOAD_LEN <= UINT8_MAX);
+/* RESYNC_FROM queues the whole replay at once, followed by its RES */
+BUILD_ASSERT(CONFIG_EVT_REPLAY_EVENTS < MESSAGE_TX_MAX_MESSAGES,
+	     "EVT_REPLAY_EVENTS has to be below the control TX queue and pool depth");
+
+static uint8_t evt_seq[MESSAGE_EVT_STREAM_COUNT];
+static struct message_evt_replay evt_replay[MAX(CONFIG_EVT_REPLAY_EVENTS, 1)];
+/* Numbered events are queued in order */
+static K_MUTEX_DEFINE(evt_seq_mutex);
+
+static void message_prepend_header(struct net_buf *buf, enum message_type mtype,
+				   enum message_sub_type stype, uint8_t seq_no, uint16_t len);
 
 static bool message_ltv_found(struct bt_data *data, void *user_data)
 {
@@ -110,6 +193,7 @@ static bool message_ltv_found(struct bt_data *data, void *user_data)
 		return true;
 	case BT_DATA_BROADCAST_CODE:
 		memcpy(&_parsed->broadcast_code, &data->data[0], BT_AUDIO_BROADCAST_CODE_SIZE);
+		_parsed->has_broadcast_code = true;
 		LOG_HEXDUMP_DBG(_parsed->broadcast_code, BT_AUDIO_BROADCAST_CODE_SIZE,
 				"broadcast code:");
 		return true;
@@ -122,6 +206,14 @@ static bool message_ltv_found(struct bt_data *data, void *user_data)
 		_parsed->volume = data->data[0];
 		LOG_DBG("volume: %u", _parsed->src_id);
 		return true;
+	case BT_DATA_MUTE:
+		_parsed->mute = data->data[0];
+		LOG_DBG("mute: %u", _parsed->mute);
+		return true;
+	case BT_DATA_VOLUME_STEP:
+		_parsed->volume_step = (int8_t)data->data[0];
+		LOG_DBG("volume step: %d", _parsed->volume_step);
+		return true;
 	case BT_DATA_SIRK:
 		memcpy(&_parsed->csis_sirk, &data->data[0], BT_CSIP_SIRK_SIZE);
 		LOG_HEXDUMP_DBG(_parsed->csis_sirk, BT_CSIP_SIRK_SIZE, "sirk:");
@@ -130,6 +222,46 @@ static bool message_ltv_found(struct bt_data *data, void *user_data)
 		_parsed->csis_set_size = data->data[0];
 		LOG_DBG("CSIS set size: %u", _parsed->csis_set_size);
 		return true;
+	case BT_DATA_STATS_INTERVAL:
+		_parsed->has_stats_interval = true;
+		_parsed->stats_interval = data->data[0];
+		LOG_DBG("STATS interval: %u", _parsed->stats_interval);
+		return true;
+	case BT_DATA_CREDITS:
+		_parsed->credits = sys_get_le16(data->data);
+		LOG_DBG("Credits: %u", _parsed->credits);
+		return true;
+	case BT_DATA_EVT_SEQ:
+		_parsed->evt_seq = data->data[0];
+		LOG_DBG("Event seq: %u", _parsed->evt_seq);
+		return true;
+	case BT_DATA_HEARTBEAT_INTERVAL:
+		_parsed->has_heartbeat_interval = true;
+		_parsed->heartbeat_interval = data->data[0];
+		LOG_DBG("Heartbeat interval: %u", _parsed->heartbeat_interval);
+		return true;
+	case BT_DATA_TRACE_CURSOR:
+		_parsed->trace_cursor = sys_get_le32(data->data);
+		LOG_DBG("Trace cursor: %u", _parsed->trace_cursor);
+		return true;
+	case BT_DATA_SCAN_PARAMS:
+		if (data->data_len == SCAN_SCHED_PARAMS_LEN &&
+		    _parsed->scan_params_cnt < SCAN_SCHED_TARGET_COUNT) {
+			memcpy(_parsed->scan_params[_parsed->scan_params_cnt++], data->data,
+			       SCAN_SCHED_PARAMS_LEN);
+		} else {
+			_parsed->scan_params_invalid = true;
+		}
+		LOG_DBG("Scan params (len %u)", data->data_len);
+		return true;
+	case BT_DATA_SCAN_FILTER:
+		/* Counted beyond the array so that an oversized set is rejected */
+		if (_parsed->scan_filter_cnt < ARRAY_SIZE(_parsed->scan_filter)) {
+			_parsed->scan_filter[_parsed->scan_filter_cnt] = *data;
+		}
+		_parsed->scan_filter_cnt++;
+		LOG_DBG("Scan filter (len %u)", data->data_len);
+		return true;
 	default:
 		LOG_DBG("Unknown type");
 	}
@@ -146,88 +278,456 @@ static void message_prepend_header(struct net_buf *buf, enum message_type mtype,
 	net_buf_push_u8(buf, mtype);
 }
 
-struct net_buf* message_alloc_tx(void)
+#define MESSAGE_KNOWN_LTV_LEN                                                                      \
+	(DEVICE_STORE_SIZE * MESSAGE_EVT_FIELD_SINK_STATUS + MESSAGE_EVT_FIELD_ADDR +              \
+	 MESSAGE_EVT_FIELD_U8 + MESSAGE_EVT_FIELD_LE16 + MESSAGE_EVT_FIELD_LE32)
+
+/* The per sink results are never left out of the RES, whatever class it takes */
+BUILD_ASSERT(MESSAGE_EVT_FIELD_ERR + MESSAGE_KNOWN_LTV_LEN <= CONFIG_TX_MSG_MAX_PAYLOAD_LEN,
+	     "CONNECT_KNOWN results do not fit a full size TX buffer");
+
+static void message_get_trace(uint8_t seq_no, uint32_t from)
 {
 	struct net_buf *tx_net_buf;
+	uint32_t next;
+	uint8_t *cursor;
+	int ret;
 
-	tx_net_buf = net_buf_alloc(&command_tx_msg_pool, K_NO_WAIT);
+	/* As many records as fit a full size buffer */
+	tx_net_buf = message_alloc_tx(CONFIG_TX_MSG_MAX_PAYLOAD_LEN);
 	if (!tx_net_buf) {
-		return NULL;
+		LOG_ERR("Failed to allocate net_buf");
+		return;
+	}
+
+	message_evt_add_err(tx_net_buf, 0);
+	/* Where the host continues from, filled in when the records are known */
+	cursor = net_buf_add(tx_net_buf, MESSAGE_EVT_FIELD_LE32);
+	next = trace_encode(&tx_net_buf->b, from);
+	cursor[0] = MESSAGE_EVT_FIELD_LE32 - 1;
+	cursor[1] = BT_DATA_TRACE_CURSOR;
+	sys_put_le32(next, &cursor[2]);
+
+	message_prepend_header(tx_net_buf, MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_GET_TRACE, seq_no,
+			       tx_net_buf->len);
+
+	ret = webusb_transmit(tx_net_buf);
+	if (ret != 0) {
+		LOG_ERR("Failed to send message (err=%d)", ret);
+		net_buf_unref(tx_net_buf);
+	}
+}
+
+static void message_connect_known(uint8_t seq_no)
+{
+	NET_BUF_SIMPLE_DEFINE(known_buf, MESSAGE_KNOWN_LTV_LEN);
+	bt_addr_le_t addrs[DEVICE_STORE_SIZE];
+	struct device_store_source source;
+	size_t count;
+	int rc;
+
+	rc = broadcast_assistant_connect_known(addrs, &count);
+
+	/* The sinks being connected, SINK_CONNECTED follows for each */
+	for (size_t i = 0; i < count; i++) {
+		net_buf_simple_add_u8(known_buf, MESSAGE_EVT_FIELD_SINK_STATUS - 1);
+		net_buf_simple_add_u8(known_buf, BT_DATA_SINK_STATUS);
+		net_buf_simple_add_u8(known_buf, addrs[i].type);
+		net_buf_simple_add_mem(known_buf, &addrs[i].a, sizeof(bt_addr_t));
+		net_buf_simple_add_le32(known_buf, 0);
+	}
+
+	/* So the host can add the last used source again */
+	if (rc == 0 && device_store_get_last_source(&source)) {
+		net_buf_simple_add_u8(known_buf, 1 + BT_ADDR_LE_SIZE);
+		net_buf_simple_add_u8(known_buf, bt_addr_le_is_identity(&source.addr) ?
+							 BT_DATA_IDENTITY : BT_DATA_RPA);
+		net_buf_simple_add_u8(known_buf, source.addr.type);
+		net_buf_simple_add_mem(known_buf, &source.addr.a, sizeof(bt_addr_t));
+		net_buf_simple_add_u8(known_buf, 1 + sizeof(uint8_t));
+		net_buf_simple_add_u8(known_buf, BT_DATA_SID);
+		net_buf_simple_add_u8(known_buf, source.sid);
+		net_buf_simple_add_u8(known_buf, 1 + sizeof(uint16_t));
+		net_buf_simple_add_u8(known_buf, BT_DATA_PA_INTERVAL);
+		net_buf_simple_add_le16(known_buf, source.pa_interval);
+		net_buf_simple_add_u8(known_buf, 1 + sizeof(uint32_t));
+		net_buf_simple_add_u8(known_buf, BT_DATA_BROADCAST_ID);
+		net_buf_simple_add_le32(known_buf, source.broadcast_id);
+	}
+
+	message_send_return_code_ltv(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_CONNECT_KNOWN, seq_no, rc,
+				     known_buf->data, known_buf->len);
+}
+
+static void message_cmd_timeout_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct message_cmd_pending *pending =
+		CONTAINER_OF(dwork, struct message_cmd_pending, timeout_work);
+	uint8_t sub_type;
+	uint8_t seq_no;
+	bool timed_out;
+
+	k_mutex_lock(&cmd_pending_mutex, K_FOREVER);
+	timed_out = pending->active;
+	pending->active = false;
+	sub_type = pending->sub_type;
+	seq_no = pending->seq_no;
+	k_mutex_unlock(&cmd_pending_mutex);
+
+	if (timed_out) {
+		LOG_WRN("Command 0x%02x (seq_no %u) timed out", sub_type, seq_no);
+		message_send_return_code(MESSAGE_TYPE_RES, sub_type, seq_no, -ETIMEDOUT);
+	}
+}
+
+/* Returns false (and responds busy) if a command of the same sub type is pending */
+static bool message_cmd_pending_begin(enum message_sub_type stype, uint8_t seq_no)
+{
+	struct message_cmd_pending *pending = NULL;
+
+	k_mutex_lock(&cmd_pending_mutex, K_FOREVER);
+	for (int i = 0; i < ARRAY_SIZE(cmd_pending); i++) {
+		if (cmd_pending[i].active && cmd_pending[i].sub_type == stype) {
+			pending = NULL;
+			break;
+		}
+
+		if (pending == NULL && !cmd_pending[i].active) {
+			pending = &cmd_pending[i];
+		}
+	}
+
+	if (pending) {
+		pending->sub_type = stype;
+		pending->seq_no = seq_no;
+		pending->active = true;
+		k_work_reschedule(&pending->timeout_work, K_MSEC(CONFIG_CMD_TIMEOUT_MS));
+	}
+	k_mutex_unlock(&cmd_pending_mutex);
+
+	if (pending == NULL) {
+		LOG_WRN("Command 0x%02x busy", stype);
+		message_send_return_code(MESSAGE_TYPE_RES, stype, seq_no, -EBUSY);
+	}
+
+	return pending != NULL;
+}
+
+void message_cmd_complete(enum message_sub_type stype, int32_t rc)
+{
+	message_cmd_complete_ltv(stype, rc, NULL, 0);
+}
+
+void message_cmd_complete_ltv(enum message_sub_type stype, int32_t rc, const uint8_t *ltv,
+			      uint16_t ltv_len)
+{
+	bool found = false;
+	uint8_t seq_no;
+
+	k_mutex_lock(&cmd_pending_mutex, K_FOREVER);
+	for (int i = 0; i < ARRAY_SIZE(cmd_pending); i++) {
+		if (cmd_pending[i].active && cmd_pending[i].sub_type == stype) {
+			(void)k_work_cancel_delayable(&cmd_pending[i].timeout_work);
+			cmd_pending[i].active = false;
+			seq_no = cmd_pending[i].seq_no;
+			found = true;
+			break;
+		}
 	}
+	k_mutex_unlock(&cmd_pending_mutex);
 
-	// Reserve headroom for the webusb msg header
-	net_buf_reserve(tx_net_buf, sizeof(struct webusb_message));
+	if (!found) {
+		/* Already timed out */
+		LOG_DBG("No pending command 0x%02x", stype);
+		return;
+	}
 
-	return tx_net_buf;
+	message_send_return_code_ltv(MESSAGE_TYPE_RES, stype, seq_no, rc, ltv, ltv_len);
 }
 
-void message_send_no_paylod(enum message_type mtype, enum message_sub_type stype, uint8_t seq_no)
+/* Answers every pending command with rc, results arriving later are dropped */
+static void message_cmd_pending_flush(int32_t rc)
+{
+	for (int i = 0; i < ARRAY_SIZE(cmd_pending); i++) {
+		uint8_t sub_type;
+		uint8_t seq_no;
+		bool flushed;
+
+		k_mutex_lock(&cmd_pending_mutex, K_FOREVER);
+		flushed = cmd_pending[i].active;
+		if (flushed) {
+			(void)k_work_cancel_delayable(&cmd_pending[i].timeout_work);
+			cmd_pending[i].active = false;
+		}
+		sub_type = cmd_pending[i].sub_type;
+		seq_no = cmd_pending[i].seq_no;
+		k_mutex_unlock(&cmd_pending_mutex);
+
+		if (flushed) {
+			LOG_DBG("Command 0x%02x (seq_no %u) flushed", sub_type, seq_no);
+			message_send_return_code(MESSAGE_TYPE_RES, sub_type, seq_no, rc);
+		}
+	}
+}
+
+static struct net_buf *message_alloc_tx_from(const struct message_tx_class *classes,
+					      size_t classes_cnt, size_t len,
+					      enum stats_counter failed_counter)
+{
+	struct net_buf *tx_net_buf;
+
+	for (size_t i = 0; i < classes_cnt; i++) {
+		if (len > classes[i].payload_len) {
+			continue;
+		}
+
+		tx_net_buf = net_buf_alloc_len(classes[i].pool,
+					       MESSAGE_TX_BUF_SIZE(classes[i].payload_len), K_NO_WAIT);
+		if (!tx_net_buf) {
+			/* Class used up, try a larger one */
+			continue;
+		}
+
+		// Reserve headroom for the webusb msg header and in place COBS encoding
+		net_buf_reserve(tx_net_buf, MESSAGE_TX_COBS_HEADROOM(classes[i].payload_len) +
+						    sizeof(struct webusb_message));
+
+		return tx_net_buf;
+	}
+
+	stats_inc(failed_counter);
+
+	return NULL;
+}
+
+struct net_buf *message_alloc_tx(size_t len)
+{
+	return message_alloc_tx_from(tx_classes, ARRAY_SIZE(tx_classes), len,
+				     STATS_TX_ALLOC_FAILED);
+}
+
+struct net_buf *message_alloc_tx_bulk(size_t len)
+{
+	return message_alloc_tx_from(tx_bulk_classes, ARRAY_SIZE(tx_bulk_classes), len,
+				     STATS_TX_BULK_ALLOC_FAILED);
+}
+
+bool message_tx_is_bulk(const struct net_buf *buf)
+{
+	return buf->pool_id == net_buf_pool_id(&command_tx_bulk_medium_pool) ||
+	       buf->pool_id == net_buf_pool_id(&command_tx_bulk_pool);
+}
+
+void message_send_ltv(enum message_type mtype, enum message_sub_type stype, uint8_t seq_no,
+		      const uint8_t *ltv, uint16_t ltv_len)
 {
 	struct net_buf *tx_net_buf;
 	int ret;
 
-	tx_net_buf = message_alloc_tx();
+	tx_net_buf = message_alloc_tx(ltv_len);
 	if (!tx_net_buf) {
 		LOG_ERR("Failed to allocate net_buf");
+		return;
+	}
+
+	if (ltv_len > 0) {
+		net_buf_add_mem(tx_net_buf, ltv, ltv_len);
 	}
 
-	message_prepend_header(tx_net_buf, mtype, stype, seq_no, 0);
-	message_log_ltv(&tx_net_buf->data[0], tx_net_buf->len);
+	message_prepend_header(tx_net_buf, mtype, stype, seq_no, ltv_len);
 
 	ret = webusb_transmit(tx_net_buf);
 	if (ret != 0) {
 		LOG_ERR("Failed to send message (err=%d)", ret);
+		net_buf_unref(tx_net_buf);
 	}
 }
 
 void message_send_return_code(enum message_type mtype, enum message_sub_type stype, uint8_t seq_no,
 			      int32_t rc)
+{
+	message_send_return_code_ltv(mtype, stype, seq_no, rc, NULL, 0);
+}
+
+/* Length of the whole LTV records at the start of ltv that fit max_len */
+static uint16_t message_ltv_fit(const uint8_t *ltv, uint16_t ltv_len, uint16_t max_len)
+{
+	uint16_t len = 0;
+
+	while (len < ltv_len) {
+		uint16_t record_len = 1 + ltv[len];
+
+		if (len + record_len > ltv_len || len + record_len > max_len) {
+			break;
+		}
+		len += record_len;
+	}
+
+	return len;
+}
+
+void message_send_return_code_ltv(enum message_type mtype, enum message_sub_type stype,
+				  uint8_t seq_no, int32_t rc, const uint8_t *ltv, uint16_t ltv_len)
 {
 	struct net_buf *tx_net_buf;
 	uint16_t msg_payload_length;
+	uint16_t fit_len;
 	int ret;
 
 	LOG_INF("send simple message(%d, %d, %u, %d)", mtype, stype, seq_no, rc);
 
-	tx_net_buf = message_alloc_tx();
+	/* Only whole LTVs are sent, the host could not parse a cut one */
+	fit_len = message_ltv_fit(ltv, ltv_len,
+				  CONFIG_TX_MSG_MAX_PAYLOAD_LEN - MESSAGE_EVT_FIELD_ERR);
+	if (fit_len < ltv_len) {
+		LOG_WRN("RES 0x%02x: %u of %u bytes of LTVs do not fit", stype, ltv_len - fit_len,
+			ltv_len);
+		if (rc == 0) {
+			rc = -EMSGSIZE;
+		}
+	}
+
+	tx_net_buf = message_alloc_tx(MESSAGE_EVT_FIELD_ERR + fit_len);
 	if (!tx_net_buf) {
 		LOG_ERR("Failed to allocate net_buf");
+		return;
 	}
 
 	/* Append error code payload */
-	net_buf_add_u8(tx_net_buf, 5);
-	net_buf_add_u8(tx_net_buf, BT_DATA_ERROR_CODE);
-	net_buf_add_le32(tx_net_buf, rc);
+	message_evt_add_err(tx_net_buf, rc);
+	/* Additional LTVs (e.g. per sink status) */
+	if (fit_len > 0) {
+		net_buf_add_mem(tx_net_buf, ltv, fit_len);
+	}
 	msg_payload_length = tx_net_buf->len;
 
 	message_prepend_header(tx_net_buf, mtype, stype, seq_no, msg_payload_length);
-	message_log_ltv(&tx_net_buf->data[0], tx_net_buf->len);
 
 	ret = webusb_transmit(tx_net_buf);
 	if (ret != 0) {
 		LOG_ERR("Failed to send message (err=%d)", ret);
+		net_buf_unref(tx_net_buf);
+	}
+}
+
+/* Called with evt_seq_mutex held */
+static void message_evt_replay_keep(uint8_t seq, enum message_sub_type stype,
+				    const struct net_buf *buf)
+{
+	struct message_evt_replay *entry = &evt_replay[seq % ARRAY_SIZE(evt_replay)];
+
+	if (CONFIG_EVT_REPLAY_EVENTS == 0) {
+		return;
+	}
+
+	entry->seq = seq;
+	entry->sub_type = stype;
+	entry->valid = buf && buf->len <= sizeof(entry->payload);
+	if (entry->valid) {
+		entry->len = buf->len;
+		memcpy(entry->payload, buf->data, buf->len);
+	}
+}
+
+/* Called with evt_seq_mutex held */
+static int message_evt_replay_send(uint8_t seq)
+{
+	struct message_evt_replay *entry = &evt_replay[seq % ARRAY_SIZE(evt_replay)];
+	struct net_buf *tx_net_buf;
+	int err;
+
+	if (!entry->valid || entry->seq != seq) {
+		LOG_WRN("Event %u not kept", seq);
+		return -ENOENT;
+	}
+
+	tx_net_buf = message_alloc_tx(entry->len);
+	if (!tx_net_buf) {
+		return -ENOMEM;
 	}
+
+	net_buf_add_mem(tx_net_buf, entry->payload, entry->len);
+	message_prepend_header(tx_net_buf, MESSAGE_TYPE_EVT, entry->sub_type, seq, entry->len);
+
+	err = webusb_transmit(tx_net_buf);
+	if (err) {
+		net_buf_unref(tx_net_buf);
+	}
+
+	return err;
+}
+
+static void message_resync_from(uint8_t seq_no, uint8_t from)
+{
+	uint8_t info[MESSAGE_EVT_FIELD_U8];
+	uint8_t next;
+	int rc = 0;
+
+	k_mutex_lock(&evt_seq_mutex, K_FOREVER);
+	next = evt_seq[MESSAGE_EVT_STREAM_CONTROL];
+	if ((uint8_t)(next - from) > CONFIG_EVT_REPLAY_EVENTS) {
+		LOG_WRN("Events from %u no longer kept (next %u)", from, next);
+		rc = -ENOENT;
+	}
+
+	/* Sent with their original seq_no, before any newer event */
+	for (uint8_t seq = from; rc == 0 && seq != next; seq++) {
+		rc = message_evt_replay_send(seq);
+	}
+	k_mutex_unlock(&evt_seq_mutex);
+
+	LOG_INF("Resync from %u to %u (rc %d)", from, next, rc);
+
+	/* Where the control stream continues */
+	info[0] = sizeof(info) - 1;
+	info[1] = BT_DATA_EVT_SEQ;
+	info[2] = next;
+	message_send_return_code_ltv(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_RESYNC_FROM, seq_no, rc,
+				     info, sizeof(info));
 }
 
 void message_send_net_buf_event(enum message_sub_type stype, struct net_buf *tx_net_buf)
 {
+	bool bulk = message_tx_is_bulk(tx_net_buf);
+	uint8_t seq_no;
 	int ret;
 
-	message_prepend_header(tx_net_buf, MESSAGE_TYPE_EVT, stype, 0, tx_net_buf->len);
-	message_log_ltv(&tx_net_buf->data[0], tx_net_buf->len);
+	k_mutex_lock(&evt_seq_mutex, K_FOREVER);
+	seq_no = evt_seq[bulk ? MESSAGE_EVT_STREAM_BULK : MESSAGE_EVT_STREAM_CONTROL]++;
+	if (!bulk) {
+		message_evt_replay_keep(seq_no, stype, tx_net_buf);
+	}
+
+	message_prepend_header(tx_net_buf, MESSAGE_TYPE_EVT, stype, seq_no, tx_net_buf->len);
 
-	LOG_DBG("send_net_buf_event(stype: %d, len: %zu)", stype, tx_net_buf->len);
+	LOG_DBG("send_net_buf_event(stype: %d, seq: %u, len: %zu)", stype, seq_no,
+		tx_net_buf->len);
 
 	ret = webusb_transmit(tx_net_buf);
+	k_mutex_unlock(&evt_seq_mutex);
 	if (ret != 0) {
 		LOG_ERR("Failed to send message (err=%d)", ret);
+		net_buf_unref(tx_net_buf);
 	}
 }
 
-void message_handler(struct webusb_message *msg_ptr, uint16_t msg_length)
+void message_evt_skip(bool bulk)
 {
-	if (msg_ptr == NULL) {
-		LOG_ERR("Null msg_ptr");
+	uint8_t seq_no;
+
+	k_mutex_lock(&evt_seq_mutex, K_FOREVER);
+	seq_no = evt_seq[bulk ? MESSAGE_EVT_STREAM_BULK : MESSAGE_EVT_STREAM_CONTROL]++;
+	if (!bulk) {
+		message_evt_replay_keep(seq_no, 0, NULL);
+	}
+	k_mutex_unlock(&evt_seq_mutex);
+}
+
+static void message_process(struct webusb_message *msg_ptr, uint16_t msg_length)
+{
+	if (msg_length < sizeof(struct webusb_message)) {
+		LOG_ERR("Message too short (%u)", msg_length);
 		return;
 	}
 
@@ -238,20 +738,33 @@ void message_handler(struct webusb_message *msg_ptr, uint16_t msg_length)
 	struct net_buf_simple msg_net_buf;
 
 	msg_net_buf.data = msg_ptr->payload;
-	msg_net_buf.len = msg_ptr->length;
-	msg_net_buf.size = CONFIG_TX_MSG_MAX_PAYLOAD_LEN;
+	msg_net_buf.len = MIN(sys_le16_to_cpu(msg_ptr->length),
+			      msg_length - sizeof(struct webusb_message));
+	msg_net_buf.size = msg_net_buf.len;
 	msg_net_buf.__buf = msg_ptr->payload;
 
 	memset(&parsed_ltv_data, 0, sizeof(parsed_ltv_data));
 	bt_data_parse(&msg_net_buf, message_ltv_found, (void *)&parsed_ltv_data);
 
 	switch (msg_sub_type) {
-	case MESSAGE_SUBTYPE_HEARTBEAT:
-		/* Toogle heartbeat mode */
-		heartbeat_toggle();
-		message_send_return_code(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_HEARTBEAT, msg_seq_no,
-					 0);
+	case MESSAGE_SUBTYPE_HEARTBEAT: {
+		uint8_t interval[3];
+
+		if (parsed_ltv_data.has_heartbeat_interval) {
+			heartbeat_set_interval(parsed_ltv_data.heartbeat_interval);
+		} else {
+			/* Toogle heartbeat mode */
+			heartbeat_toggle();
+		}
+
+		/* The interval in effect, 0 if stopped */
+		interval[0] = sizeof(interval) - 1;
+		interval[1] = BT_DATA_HEARTBEAT_INTERVAL;
+		interval[2] = heartbeat_get_interval();
+		message_send_return_code_ltv(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_HEARTBEAT, msg_seq_no,
+					     0, interval, sizeof(interval));
 		break;
+	}
 
 	case MESSAGE_SUBTYPE_START_SINK_SCAN:
 		LOG_DBG("START_SINK_SCAN (len %u)", msg_length);
@@ -310,28 +823,59 @@ void message_handler(struct webusb_message *msg_ptr, uint16_t msg_length)
 
 	case MESSAGE_SUBTYPE_ADD_SOURCE:
 		LOG_DBG("ADD_SOURCE (len %u)", msg_length);
+		if (!message_cmd_pending_begin(MESSAGE_SUBTYPE_ADD_SOURCE, msg_seq_no)) {
+			break;
+		}
+		/* RES is sent when the source has been added to all sinks */
 		msg_rc = broadcast_assistant_add_source(
 			parsed_ltv_data.adv_sid, parsed_ltv_data.pa_interval,
 			parsed_ltv_data.broadcast_id, &parsed_ltv_data.addr,
 			parsed_ltv_data.num_subgroups, parsed_ltv_data.bis_sync);
-		message_send_return_code(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_ADD_SOURCE, msg_seq_no,
-					 msg_rc);
+		if (msg_rc != 0) {
+			message_cmd_complete(MESSAGE_SUBTYPE_ADD_SOURCE, msg_rc);
+		}
+		break;
+
+	case MESSAGE_SUBTYPE_SWITCH_SOURCE:
+		LOG_DBG("SWITCH_SOURCE (len %u)", msg_length);
+		if (!message_cmd_pending_begin(MESSAGE_SUBTYPE_SWITCH_SOURCE, msg_seq_no)) {
+			break;
+		}
+		/* RES is sent when all sinks have been written, SOURCE_SWITCHED when synced */
+		msg_rc = broadcast_assistant_switch_source(
+			parsed_ltv_data.adv_sid, parsed_ltv_data.pa_interval,
+			parsed_ltv_data.broadcast_id, &parsed_ltv_data.addr,
+			parsed_ltv_data.num_subgroups, parsed_ltv_data.bis_sync,
+			parsed_ltv_data.has_broadcast_code ? parsed_ltv_data.broadcast_code : NULL);
+		if (msg_rc != 0) {
+			message_cmd_complete(MESSAGE_SUBTYPE_SWITCH_SOURCE, msg_rc);
+		}
 		break;
 
 	case MESSAGE_SUBTYPE_REMOVE_SOURCE:
 		LOG_DBG("REMOVE_SOURCE (len %u)", msg_length);
+		if (!message_cmd_pending_begin(MESSAGE_SUBTYPE_REMOVE_SOURCE, msg_seq_no)) {
+			break;
+		}
+		/* RES is sent when the source has been removed from all sinks */
 		msg_rc = broadcast_assistant_remove_source(parsed_ltv_data.src_id,
 							   parsed_ltv_data.num_subgroups);
-		message_send_return_code(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_REMOVE_SOURCE,
-					 msg_seq_no, msg_rc);
+		if (msg_rc != 0) {
+			message_cmd_complete(MESSAGE_SUBTYPE_REMOVE_SOURCE, msg_rc);
+		}
 		break;
 
 	case MESSAGE_SUBTYPE_BIG_BCODE:
 		LOG_DBG("BIG_BCODE (len %u)", msg_length);
+		if (!message_cmd_pending_begin(MESSAGE_SUBTYPE_BIG_BCODE, msg_seq_no)) {
+			break;
+		}
+		/* RES is sent when the code has been written to all sinks */
 		msg_rc = broadcast_assistant_add_broadcast_code(parsed_ltv_data.src_id,
 								parsed_ltv_data.broadcast_code);
-		message_send_return_code(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_BIG_BCODE, msg_seq_no,
-					 msg_rc);
+		if (msg_rc != 0) {
+			message_cmd_complete(MESSAGE_SUBTYPE_BIG_BCODE, msg_rc);
+		}
 		break;
 
 	case MESSAGE_SUBTYPE_SET_VOLUME:
@@ -356,17 +900,229 @@ void message_handler(struct webusb_message *msg_ptr, uint16_t msg_length)
 					 msg_rc);
 		break;
 
+	case MESSAGE_SUBTYPE_SET_SET_VOLUME:
+		LOG_DBG("SET_SET_VOLUME (vol %u, len %u)", parsed_ltv_data.volume, msg_length);
+		if (!message_cmd_pending_begin(MESSAGE_SUBTYPE_SET_SET_VOLUME, msg_seq_no)) {
+			break;
+		}
+		/* RES is sent when the volume has been written to all set members */
+		msg_rc = broadcast_assistant_set_set_volume(&parsed_ltv_data.addr,
+							    parsed_ltv_data.volume);
+		if (msg_rc != 0) {
+			message_cmd_complete(MESSAGE_SUBTYPE_SET_SET_VOLUME, msg_rc);
+		}
+		break;
+
+	case MESSAGE_SUBTYPE_SET_SET_MUTE:
+		LOG_DBG("SET_SET_MUTE (mute %u, len %u)", parsed_ltv_data.mute, msg_length);
+		if (!message_cmd_pending_begin(MESSAGE_SUBTYPE_SET_SET_MUTE, msg_seq_no)) {
+			break;
+		}
+		msg_rc = broadcast_assistant_set_set_mute(&parsed_ltv_data.addr,
+							  parsed_ltv_data.mute ? BT_VCP_STATE_MUTED
+									       : BT_VCP_STATE_UNMUTED);
+		if (msg_rc != 0) {
+			message_cmd_complete(MESSAGE_SUBTYPE_SET_SET_MUTE, msg_rc);
+		}
+		break;
+
+	case MESSAGE_SUBTYPE_STEP_SET_VOLUME:
+		LOG_DBG("STEP_SET_VOLUME (step %d, len %u)", parsed_ltv_data.volume_step, msg_length);
+		if (!message_cmd_pending_begin(MESSAGE_SUBTYPE_STEP_SET_VOLUME, msg_seq_no)) {
+			break;
+		}
+		msg_rc = broadcast_assistant_step_set_volume(&parsed_ltv_data.addr,
+							     parsed_ltv_data.volume_step);
+		if (msg_rc != 0) {
+			message_cmd_complete(MESSAGE_SUBTYPE_STEP_SET_VOLUME, msg_rc);
+		}
+		break;
+
 	case MESSAGE_SUBTYPE_RESET:
 		LOG_DBG("RESET (len %u)", msg_length);
 		msg_rc = broadcast_assistant_reset();
+		/* Deferred commands are answered before the RESET */
+		message_cmd_pending_flush(-ECANCELED);
 		message_send_return_code(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_RESET, msg_seq_no,
 					 msg_rc);
 		heartbeat_stop(); // Stop heartbeat if active
+		stats_set_interval(0);
+		heartbeat_update_timer();
+		webusb_bulk_credits_disable();
+		break;
+
+	case MESSAGE_SUBTYPE_GET_STATS: {
+		NET_BUF_SIMPLE_DEFINE(stats_buf, STATS_LTV_LEN);
+
+		LOG_DBG("GET_STATS (len %u)", msg_length);
+		if (parsed_ltv_data.has_stats_interval) {
+			stats_set_interval(parsed_ltv_data.stats_interval);
+			heartbeat_update_timer();
+		}
+
+		stats_encode(stats_buf);
+		message_send_return_code_ltv(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_GET_STATS, msg_seq_no,
+					     0, stats_buf->data, stats_buf->len);
+		break;
+	}
+
+	case MESSAGE_SUBTYPE_CONNECT_KNOWN:
+		LOG_DBG("CONNECT_KNOWN (len %u)", msg_length);
+		message_connect_known(msg_seq_no);
+		break;
+
+	case MESSAGE_SUBTYPE_FORGET_KNOWN:
+		LOG_DBG("FORGET_KNOWN (len %u)", msg_length);
+		msg_rc = broadcast_assistant_disconnect_unpair_all();
+		message_send_return_code(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_FORGET_KNOWN, msg_seq_no,
+					 msg_rc);
+		break;
+
+	case MESSAGE_SUBTYPE_GRANT_CREDITS:
+		LOG_DBG("GRANT_CREDITS (credits %u, len %u)", parsed_ltv_data.credits, msg_length);
+		if (parsed_ltv_data.credits == 0) {
+			webusb_bulk_credits_disable();
+		} else {
+			webusb_bulk_credits_grant(parsed_ltv_data.credits);
+		}
+		message_send_return_code(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_GRANT_CREDITS, msg_seq_no,
+					 0);
 		break;
 
+	case MESSAGE_SUBTYPE_GET_TRACE:
+		LOG_DBG("GET_TRACE (from %u, len %u)", parsed_ltv_data.trace_cursor, msg_length);
+		message_get_trace(msg_seq_no, parsed_ltv_data.trace_cursor);
+		break;
+
+	case MESSAGE_SUBTYPE_SET_SCAN_PARAMS: {
+		NET_BUF_SIMPLE_DEFINE(params_buf, SCAN_SCHED_LTV_LEN);
+
+		LOG_DBG("SET_SCAN_PARAMS (len %u)", msg_length);
+		/* Without parameters the current ones are returned */
+		if (parsed_ltv_data.scan_params_invalid) {
+			/* None are applied */
+			LOG_WRN("Malformed or too many scan params");
+			msg_rc = -EINVAL;
+		}
+
+		for (int i = 0; i < parsed_ltv_data.scan_params_cnt && msg_rc == 0; i++) {
+			msg_rc = scan_sched_set_params_raw(parsed_ltv_data.scan_params[i],
+							   SCAN_SCHED_PARAMS_LEN);
+		}
+
+		scan_sched_encode(params_buf);
+		message_send_return_code_ltv(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_SET_SCAN_PARAMS,
+					     msg_seq_no, msg_rc, params_buf->data, params_buf->len);
+		break;
+	}
+
+	case MESSAGE_SUBTYPE_SET_SCAN_FILTER:
+		LOG_DBG("SET_SCAN_FILTER (%zu rules, len %u)", parsed_ltv_data.scan_filter_cnt,
+			msg_length);
+		/* Without rules the filter is cleared */
+		if (parsed_ltv_data.scan_filter_cnt > ARRAY_SIZE(parsed_ltv_data.scan_filter)) {
+			msg_rc = -ENOMEM;
+		} else {
+			msg_rc = scan_filter_set(parsed_ltv_data.scan_filter,
+						 parsed_ltv_data.scan_filter_cnt);
+		}
+		message_send_return_code(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_SET_SCAN_FILTER,
+					 msg_seq_no, msg_rc);
+		break;
+
+	case MESSAGE_SUBTYPE_START_SOURCE_MONITOR:
+		LOG_DBG("START_SOURCE_MONITOR (len %u)", msg_length);
+		/* BASE and BIGinfo changes follow as SOURCE_BASE_FOUND and SOURCE_BIG_INFO */
+		if (bt_addr_le_eq(&parsed_ltv_data.addr, BT_ADDR_LE_ANY)) {
+			msg_rc = -EINVAL;
+		} else {
+			msg_rc = pa_sync_sched_monitor_start(&parsed_ltv_data.addr,
+							     parsed_ltv_data.adv_sid,
+							     parsed_ltv_data.pa_interval,
+							     PA_MONITOR_HOST);
+		}
+		message_send_return_code(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_START_SOURCE_MONITOR,
+					 msg_seq_no, msg_rc);
+		break;
+
+	case MESSAGE_SUBTYPE_STOP_SOURCE_MONITOR:
+		LOG_DBG("STOP_SOURCE_MONITOR (len %u)", msg_length);
+		/* Without an address all monitors are stopped */
+		msg_rc = pa_sync_sched_monitor_stop(&parsed_ltv_data.addr, PA_MONITOR_HOST);
+		message_send_return_code(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_STOP_SOURCE_MONITOR,
+					 msg_seq_no, msg_rc);
+		break;
+
+	case MESSAGE_SUBTYPE_RESYNC_FROM:
+		LOG_DBG("RESYNC_FROM (from %u, len %u)", parsed_ltv_data.evt_seq, msg_length);
+		message_resync_from(msg_seq_no, parsed_ltv_data.evt_seq);
+		break;
+
+	case MESSAGE_SUBTYPE_GET_STATE: {
+		struct state_snapshot snap;
+		uint8_t info[STATE_SNAPSHOT_FIELD_INFO + MESSAGE_EVT_FIELD_U8];
+
+		LOG_DBG("GET_STATE (len %u)", msg_length);
+		state_snapshot_begin(&snap);
+		broadcast_assistant_get_state(&snap);
+		msg_rc = state_snapshot_end(&snap);
+
+		/* The RES may overtake the last frames, it goes on the control queue */
+		info[0] = STATE_SNAPSHOT_FIELD_INFO - 1;
+		info[1] = BT_DATA_STATE_INFO;
+		info[2] = STATE_SNAPSHOT_VERSION;
+		info[3] = snap.frame; /* Number of frames sent */
+		info[4] = 0;
+		/* Scans are not part of the records, the host restores its controls from this */
+		info[5] = MESSAGE_EVT_FIELD_U8 - 1;
+		info[6] = BT_DATA_SCAN_MODE;
+		info[7] = broadcast_assistant_scan_mode_get();
+		message_send_return_code_ltv(MESSAGE_TYPE_RES, MESSAGE_SUBTYPE_GET_STATE, msg_seq_no,
+					     msg_rc, info, sizeof(info));
+		break;
+	}
+
 	default:
 		// Unrecognized message
 		message_send_return_code(MESSAGE_TYPE_RES, msg_sub_type, msg_seq_no, -1);
 		break;
 	}
 }
+
+static void message_cmd_work_handler(struct k_work *work)
+{
+	struct net_buf *msg_buf;
+
+	/* Commands are executed in order, one work run can drain several */
+	while ((msg_buf = k_fifo_get(&message_cmd_fifo, K_NO_WAIT)) != NULL) {
+		uint32_t start = k_cycle_get_32();
+
+		message_process((struct webusb_message *)msg_buf->data, msg_buf->len);
+		stats_latency_end(STATS_LATENCY_CMD, start);
+		net_buf_unref(msg_buf);
+	}
+}
+
+void message_handler(struct net_buf *msg_buf)
+{
+	k_fifo_put(&message_cmd_fifo, msg_buf);
+	k_work_submit_to_queue(&message_cmd_workqueue, &message_cmd_work);
+}
+
+struct k_work_q *message_cmd_workqueue_get(void)
+{
+	return &message_cmd_workqueue;
+}
+
+void message_init(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(cmd_pending); i++) {
+		k_work_init_delayable(&cmd_pending[i].timeout_work,
+				      message_cmd_timeout_work_handler);
+	}
+
+	k_work_queue_start(&message_cmd_workqueue, message_cmd_workqueue_stack,
+			   K_THREAD_STACK_SIZEOF(message_cmd_workqueue_stack),
+			   MESSAGE_CMD_WORKQUEUE_PRIORITY, NULL);
+	k_thread_name_set(&message_cmd_workqueue.thread, "cmdworker");
+}
@@ -8,6 +8,9 @@
 #define __MESSAGE_H__
 
 #include <zephyr/types.h>
+#include <zephyr/net/buf.h>
+
+#include "cobs.h"
 
 enum message_type {
 	MESSAGE_TYPE_CMD = 1,
@@ -30,6 +33,21 @@ enum message_sub_type {
 	MESSAGE_SUBTYPE_MUTE                    = 0x0B,
 	MESSAGE_SUBTYPE_UNMUTE                  = 0x0C,
 	MESSAGE_SUBTYPE_START_CSIS_SCAN         = 0x0D,
+	MESSAGE_SUBTYPE_GET_STATS               = 0x0E,
+	MESSAGE_SUBTYPE_GRANT_CREDITS           = 0x0F,
+	MESSAGE_SUBTYPE_CONNECT_KNOWN           = 0x10,
+	MESSAGE_SUBTYPE_FORGET_KNOWN            = 0x11,
+	MESSAGE_SUBTYPE_SET_SCAN_PARAMS         = 0x12,
+	MESSAGE_SUBTYPE_GET_TRACE               = 0x13,
+	MESSAGE_SUBTYPE_SET_SET_VOLUME          = 0x14,
+	MESSAGE_SUBTYPE_SET_SET_MUTE            = 0x15,
+	MESSAGE_SUBTYPE_STEP_SET_VOLUME         = 0x16,
+	MESSAGE_SUBTYPE_SET_SCAN_FILTER         = 0x17,
+	MESSAGE_SUBTYPE_START_SOURCE_MONITOR    = 0x18,
+	MESSAGE_SUBTYPE_STOP_SOURCE_MONITOR     = 0x19,
+	MESSAGE_SUBTYPE_GET_STATE               = 0x1A,
+	MESSAGE_SUBTYPE_RESYNC_FROM             = 0x1B,
+	MESSAGE_SUBTYPE_SWITCH_SOURCE           = 0x1C,
 
 	MESSAGE_SUBTYPE_RESET                   = 0x2A,
 
@@ -58,6 +76,10 @@ enum message_sub_type {
 	MESSAGE_SUBTYPE_VOLUME_CONTROL_FOUND    = 0x96,
 	MESSAGE_SUBTYPE_SET_IDENTIFIER_FOUND    = 0x97,
 	MESSAGE_SUBTYPE_SET_MEMBER_FOUND        = 0x98,
+	MESSAGE_SUBTYPE_STATS                   = 0x99,
+	MESSAGE_SUBTYPE_SCAN_REPORT_BATCH       = 0x9A,
+	MESSAGE_SUBTYPE_STATE_SNAPSHOT          = 0x9B,
+	MESSAGE_SUBTYPE_SOURCE_SWITCHED         = 0x9C,
 
 	MESSAGE_SUBTYPE_HEARTBEAT               = 0xFF,
 };
@@ -70,11 +92,79 @@ struct webusb_message {
 	uint8_t payload[];
 } __packed;
 
-struct net_buf* message_alloc_tx(void);
-void message_send_no_paylod(enum message_type mtype, enum message_sub_type stype, uint8_t seq_no);
+/*
+ * TX buffers keep room in front of the header for COBS encoding the frame in
+ * place, with its delimiter (see webusb.c)
+ */
+#define MESSAGE_TX_COBS_HEADROOM(payload_len)                                                      \
+	(COBS_ENCODE_SRC_OFFSET(sizeof(struct webusb_message) + (payload_len)) + 1)
+
+/* Number of TX buffers over all size classes */
+#define MESSAGE_TX_MAX_MESSAGES (CONFIG_TX_MSG_MAX_MESSAGES + CONFIG_TX_MSG_SMALL_MAX_MESSAGES)
+#define MESSAGE_TX_BULK_MAX_MESSAGES                                                               \
+	(CONFIG_TX_BULK_MSG_MAX_MESSAGES + CONFIG_TX_BULK_MSG_MEDIUM_MAX_MESSAGES)
+
+/**
+ * @brief Allocate a TX buffer
+ *
+ * Takes a buffer of the smallest size class that fits the payload, or of a
+ * larger class when no buffer of that one is free.
+ *
+ * @param len  Largest payload that will be added
+ *
+ * @return The buffer with headroom for the header, or NULL if none is free
+ */
+struct net_buf *message_alloc_tx(size_t len);
+
+/**
+ * @brief Allocate a TX buffer for a bulk message, see message_alloc_tx()
+ */
+struct net_buf *message_alloc_tx_bulk(size_t len);
+bool message_tx_is_bulk(const struct net_buf *buf);
+
+/**
+ * @brief Send a message of LTVs with the given seq_no
+ *
+ * Events sent this way are not numbered, see message_send_net_buf_event().
+ *
+ * @param ltv      LTVs, NULL for an empty payload
+ * @param ltv_len  Length of the LTVs
+ */
+void message_send_ltv(enum message_type mtype, enum message_sub_type stype, uint8_t seq_no,
+		      const uint8_t *ltv, uint16_t ltv_len);
 void message_send_return_code(enum message_type mtype, enum message_sub_type stype, uint8_t seq_no,
 			      int32_t rc);
+void message_send_return_code_ltv(enum message_type mtype, enum message_sub_type stype,
+				  uint8_t seq_no, int32_t rc, const uint8_t *ltv, uint16_t ltv_len);
+
+/**
+ * @brief Send an event
+ *
+ * The event gets the next sequence number of its stream (control or bulk),
+ * control events are also kept for RESYNC_FROM. Takes the buffer reference.
+ */
 void message_send_net_buf_event(enum message_sub_type stype, struct net_buf *tx_net_buf);
-void message_handler(struct webusb_message *msg_ptr, uint16_t msg_length);
+
+/**
+ * @brief Use up the sequence number of an event that could not be allocated
+ *
+ * The host then sees the gap, the event can not be replayed.
+ *
+ * @param bulk  The event would have been a bulk event
+ */
+void message_evt_skip(bool bulk);
+void message_cmd_complete(enum message_sub_type stype, int32_t rc);
+void message_cmd_complete_ltv(enum message_sub_type stype, int32_t rc, const uint8_t *ltv,
+			      uint16_t ltv_len);
+void message_handler(struct net_buf *msg_buf);
+
+/**
+ * @brief Work queue the commands are handled on
+ *
+ * Deferred parts of a command are run there too, so that they are ordered
+ * with later commands such as RESET.
+ */
+struct k_work_q *message_cmd_workqueue_get(void);
+void message_init(void);
 
 #endif /* __MESSAGE_H__ */
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/buf.h>
+
+#include "message.h"
+#include "message_evt.h"
+
+LOG_MODULE_REGISTER(message_evt, LOG_LEVEL_INF);
+
+#define MESSAGE_EVT_LAYOUT_CHECK(layout)                                                           \
+	BUILD_ASSERT(MESSAGE_EVT_LEN_##layout <= CONFIG_TX_MSG_MAX_PAYLOAD_LEN,                    \
+		     "TX_MSG_MAX_PAYLOAD_LEN too small for " #layout " event");
+
+MESSAGE_EVT_LAYOUTS(MESSAGE_EVT_LAYOUT_CHECK)
+
+static struct net_buf *message_evt_alloc_from(size_t len, bool bulk)
+{
+	struct net_buf *buf;
+
+	if (len > CONFIG_TX_MSG_MAX_PAYLOAD_LEN) {
+		LOG_ERR("Event too large (%zu)", len);
+		return NULL;
+	}
+
+	buf = bulk ? message_alloc_tx_bulk(len) : message_alloc_tx(len);
+	if (!buf) {
+		LOG_ERR("Failed to allocate %sevent", bulk ? "bulk " : "");
+		message_evt_skip(bulk);
+		return NULL;
+	}
+
+	return buf;
+}
+
+/*
+ * Public functions
+ */
+struct net_buf *message_evt_alloc(size_t len)
+{
+	return message_evt_alloc_from(len, false);
+}
+
+struct net_buf *message_evt_alloc_bulk(size_t len)
+{
+	return message_evt_alloc_from(len, true);
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __MESSAGE_EVT_H__
+#define __MESSAGE_EVT_H__
+
+#include <string.h>
+#include <zephyr/types.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/addr.h>
+#include <zephyr/bluetooth/audio/csip.h>
+
+#include "broadcast_assistant.h"
+#include "message.h"
+#include "stats.h"
+
+/* Longest name reported in SINK_FOUND / SOURCE_FOUND */
+#define MESSAGE_EVT_NAME_MAX_LEN  29
+/* Longest value a single LTV field can carry */
+#define MESSAGE_EVT_VALUE_MAX_LEN (UINT8_MAX - 1)
+
+/* Encoded size of the LTV fields used in events ([len][type][value]) */
+#define MESSAGE_EVT_FIELD_LEN(value_len) (2 + (value_len))
+
+#define MESSAGE_EVT_FIELD_ADDR         MESSAGE_EVT_FIELD_LEN(BT_ADDR_LE_SIZE)
+#define MESSAGE_EVT_FIELD_ERR          MESSAGE_EVT_FIELD_LEN(sizeof(int32_t))
+#define MESSAGE_EVT_FIELD_U8           MESSAGE_EVT_FIELD_LEN(sizeof(uint8_t))
+#define MESSAGE_EVT_FIELD_LE16         MESSAGE_EVT_FIELD_LEN(sizeof(uint16_t))
+#define MESSAGE_EVT_FIELD_LE32         MESSAGE_EVT_FIELD_LEN(sizeof(uint32_t))
+#define MESSAGE_EVT_FIELD_SIRK         MESSAGE_EVT_FIELD_LEN(BT_CSIP_SIRK_SIZE)
+#define MESSAGE_EVT_FIELD_BIG_INFO     MESSAGE_EVT_FIELD_LEN(18)
+#define MESSAGE_EVT_FIELD_NAME         MESSAGE_EVT_FIELD_LEN(MESSAGE_EVT_NAME_MAX_LEN)
+/* BT_DATA_SINK_STATUS, [addr type][addr][int32 err] */
+#define MESSAGE_EVT_FIELD_SINK_STATUS  MESSAGE_EVT_FIELD_LEN(BT_ADDR_LE_SIZE + sizeof(int32_t))
+
+/*
+ * Payload size of each event. Events carrying advertising or periodic
+ * advertising data have the data length added when allocating.
+ */
+#define MESSAGE_EVT_LEN_SINK_FOUND                                                                 \
+	(MESSAGE_EVT_FIELD_U8 /* rssi */ + MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_NAME)
+#define MESSAGE_EVT_LEN_SOURCE_FOUND                                                               \
+	(MESSAGE_EVT_LEN_SINK_FOUND + MESSAGE_EVT_FIELD_U8 /* sid */ +                             \
+	 MESSAGE_EVT_FIELD_LE16 /* pa interval */ + MESSAGE_EVT_FIELD_LE32 /* broadcast id */)
+#define MESSAGE_EVT_LEN_SET_MEMBER_FOUND  (MESSAGE_EVT_FIELD_ADDR)
+#define MESSAGE_EVT_LEN_SINK_CONNECTED    (MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_ERR)
+#define MESSAGE_EVT_LEN_SINK_DISCONNECTED (MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_ERR)
+#define MESSAGE_EVT_LEN_SOURCE_ADDED                                                               \
+	(MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_LE32 /* broadcast id */ + MESSAGE_EVT_FIELD_ERR)
+#define MESSAGE_EVT_LEN_SOURCE_REMOVED                                                             \
+	(MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_U8 /* src id */ + MESSAGE_EVT_FIELD_ERR)
+/* Scan stopped by its timeout */
+#define MESSAGE_EVT_LEN_STOP_SCAN         (MESSAGE_EVT_FIELD_ERR)
+/* NEW_ENC_STATE_* */
+#define MESSAGE_EVT_LEN_ENC_STATE         (MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_U8 /* src id */)
+/* NEW_PA_STATE_* and BIS_(NOT_)SYNCED */
+#define MESSAGE_EVT_LEN_PA_STATE                                                                   \
+	(MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_LE32 /* broadcast id */ +                      \
+	 MESSAGE_EVT_FIELD_U8 /* src id */)
+#define MESSAGE_EVT_LEN_BIS_SYNC          MESSAGE_EVT_LEN_PA_STATE
+#define MESSAGE_EVT_LEN_IDENTITY_RESOLVED (2 * MESSAGE_EVT_FIELD_ADDR)
+#define MESSAGE_EVT_LEN_SOURCE_BASE_FOUND (MESSAGE_EVT_FIELD_LEN(0) /* base */ + MESSAGE_EVT_FIELD_ADDR)
+#define MESSAGE_EVT_LEN_SOURCE_BIG_INFO   (MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_BIG_INFO)
+#define MESSAGE_EVT_LEN_VOLUME_STATE                                                               \
+	(MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_U8 /* volume */ +                              \
+	 MESSAGE_EVT_FIELD_U8 /* mute */ + MESSAGE_EVT_FIELD_ERR)
+#define MESSAGE_EVT_LEN_VOLUME_CONTROL_FOUND (MESSAGE_EVT_FIELD_ADDR)
+#define MESSAGE_EVT_LEN_SET_IDENTIFIER_FOUND                                                       \
+	(MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_U8 /* rank */ +                                \
+	 MESSAGE_EVT_FIELD_U8 /* set size */ + MESSAGE_EVT_FIELD_SIRK)
+#define MESSAGE_EVT_LEN_STATS (STATS_LTV_LEN)
+/* Records of a STATE_SNAPSHOT, see broadcast_assistant_get_state() */
+#define MESSAGE_EVT_LEN_STATE_SOURCE                                                               \
+	(MESSAGE_EVT_FIELD_ADDR + MESSAGE_EVT_FIELD_U8 /* sid */ +                                 \
+	 MESSAGE_EVT_FIELD_LE16 /* pa interval */ + MESSAGE_EVT_FIELD_LE32 /* broadcast id */ +    \
+	 MESSAGE_EVT_FIELD_NAME /* broadcast name */)
+#define MESSAGE_EVT_LEN_STATE_SINK                                                                 \
+	(MESSAGE_EVT_LEN_SINK_CONNECTED + MESSAGE_EVT_FIELD_U8 /* volume */ +                      \
+	 MESSAGE_EVT_FIELD_U8 /* mute */ + MESSAGE_EVT_FIELD_U8 /* rank */ +                       \
+	 MESSAGE_EVT_FIELD_U8 /* set size */ + MESSAGE_EVT_FIELD_SIRK +                            \
+	 MESSAGE_EVT_FIELD_LE32 /* broadcast id */ +                                               \
+	 MESSAGE_EVT_FIELD_U8 /* src id */ +                                                       \
+	 MESSAGE_EVT_FIELD_LEN(CONFIG_BT_BAP_BASS_MAX_SUBGROUPS * sizeof(uint32_t)) /* bis sync */)
+/* BT_DATA_BROADCAST_ID, then BT_DATA_SINK_STATUS and BT_DATA_SOURCE_ID per sink */
+#define MESSAGE_EVT_LEN_SOURCE_SWITCHED                                                            \
+	(MESSAGE_EVT_FIELD_LE32 /* broadcast id */ +                                               \
+	 CONFIG_BT_MAX_CONN * (MESSAGE_EVT_FIELD_SINK_STATUS + MESSAGE_EVT_FIELD_U8 /* src id */))
+
+/* All event layouts, checked against the TX buffer size at compile time */
+#define MESSAGE_EVT_LAYOUTS(fn)                                                                    \
+	fn(SINK_FOUND) fn(SOURCE_FOUND) fn(SET_MEMBER_FOUND) fn(SINK_CONNECTED)                    \
+	fn(SINK_DISCONNECTED) fn(SOURCE_ADDED) fn(SOURCE_REMOVED) fn(STOP_SCAN) fn(ENC_STATE) fn(PA_STATE) fn(BIS_SYNC)             \
+	fn(IDENTITY_RESOLVED) fn(SOURCE_BASE_FOUND) fn(SOURCE_BIG_INFO) fn(VOLUME_STATE)           \
+	fn(VOLUME_CONTROL_FOUND) fn(SET_IDENTIFIER_FOUND) fn(STATS) fn(STATE_SOURCE)               \
+	fn(STATE_SINK) fn(SOURCE_SWITCHED)
+
+/**
+ * @brief Allocate a buffer for an event
+ *
+ * The size is checked once here, so the fields can be added without further
+ * checks.
+ *
+ * @param layout    Event layout (MESSAGE_EVT_LEN_<layout>)
+ * @param data_len  Length of advertising data carried by the event, or 0
+ *
+ * @return The buffer, or NULL if no buffer is available or the event is too large
+ */
+#define MESSAGE_EVT_ALLOC(layout, data_len) message_evt_alloc(MESSAGE_EVT_LEN_##layout + (data_len))
+
+/**
+ * @brief Allocate a buffer for a bulk event
+ *
+ * As MESSAGE_EVT_ALLOC(), but from the bulk pool. Bulk events (scan reports,
+ * BASE, BIGinfo, STATS) are sent after all pending control events and are
+ * subject to the host's bulk credits.
+ */
+#define MESSAGE_EVT_ALLOC_BULK(layout, data_len)                                                   \
+	message_evt_alloc_bulk(MESSAGE_EVT_LEN_##layout + (data_len))
+
+struct net_buf *message_evt_alloc(size_t len);
+struct net_buf *message_evt_alloc_bulk(size_t len);
+
+static inline void message_evt_add_addr_type(struct net_buf *buf, uint8_t type,
+					     const bt_addr_le_t *addr)
+{
+	uint8_t *p = net_buf_add(buf, MESSAGE_EVT_FIELD_ADDR);
+
+	p[0] = 1 + BT_ADDR_LE_SIZE;
+	p[1] = type;
+	p[2] = addr->type;
+	memcpy(&p[3], &addr->a, sizeof(bt_addr_t));
+}
+
+/* Bluetooth LE Device Address (BT_DATA_IDENTITY or BT_DATA_RPA) */
+static inline void message_evt_add_addr(struct net_buf *buf, const bt_addr_le_t *addr)
+{
+	message_evt_add_addr_type(buf, bt_addr_le_is_identity(addr) ? BT_DATA_IDENTITY : BT_DATA_RPA,
+				  addr);
+}
+
+static inline void message_evt_add_u8(struct net_buf *buf, uint8_t type, uint8_t val)
+{
+	uint8_t *p = net_buf_add(buf, MESSAGE_EVT_FIELD_U8);
+
+	p[0] = 1 + sizeof(uint8_t);
+	p[1] = type;
+	p[2] = val;
+}
+
+static inline void message_evt_add_le16(struct net_buf *buf, uint8_t type, uint16_t val)
+{
+	uint8_t *p = net_buf_add(buf, MESSAGE_EVT_FIELD_LE16);
+
+	p[0] = 1 + sizeof(uint16_t);
+	p[1] = type;
+	sys_put_le16(val, &p[2]);
+}
+
+static inline void message_evt_add_le32(struct net_buf *buf, uint8_t type, uint32_t val)
+{
+	uint8_t *p = net_buf_add(buf, MESSAGE_EVT_FIELD_LE32);
+
+	p[0] = 1 + sizeof(uint32_t);
+	p[1] = type;
+	sys_put_le32(val, &p[2]);
+}
+
+static inline void message_evt_add_err(struct net_buf *buf, int32_t err)
+{
+	message_evt_add_le32(buf, BT_DATA_ERROR_CODE, (uint32_t)err);
+}
+
+static inline void message_evt_add_mem(struct net_buf *buf, uint8_t type, const void *data,
+				       uint8_t len)
+{
+	uint8_t *p = net_buf_add(buf, MESSAGE_EVT_FIELD_LEN(len));
+
+	p[0] = 1 + len;
+	p[1] = type;
+	memcpy(&p[2], data, len);
+}
+
+#endif /* __MESSAGE_EVT_H__ */
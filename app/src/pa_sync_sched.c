@@ -0,0 +1,689 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/audio/bap.h>
+
+#include "pa_sync_sched.h"
+#include "stats.h"
+
+LOG_MODULE_REGISTER(pa_sync_sched, LOG_LEVEL_INF);
+
+#define PA_SYNC_SKIP                      5
+#define PA_SYNC_INTERVAL_TO_TIMEOUT_RATIO 20 /* Set the timeout relative to interval */
+#define PA_SYNC_SKIP_TO_TIMEOUT_RATIO     3  /* At least this many times the events skipped */
+
+/*
+ * The host only allows a single pending PA sync create at a time, so syncs are
+ * pipelined: the next create is started as soon as the current one is synced,
+ * while the synced slots wait for their BASE in parallel.
+ */
+#define PA_SYNC_SLOTS CONFIG_BT_PER_ADV_SYNC_MAX
+
+BUILD_ASSERT(CONFIG_PA_MONITOR_MAX < PA_SYNC_SLOTS,
+	     "PA_MONITOR_MAX must leave a PA sync for discovering sources");
+
+enum pa_sync_slot_state {
+	PA_SYNC_SLOT_FREE,
+	PA_SYNC_SLOT_CREATING,
+	PA_SYNC_SLOT_SYNCED,
+	PA_SYNC_SLOT_DELETING,
+};
+
+struct pa_sync_candidate {
+	bt_addr_le_t addr;
+	uint16_t interval;
+	uint8_t sid;
+	int8_t rssi;
+	uint8_t attempts;
+	bool monitor;   /* Kept synced until the monitor is stopped */
+	uint8_t owners; /* PA_MONITOR_* of a monitor, stopped once none is left */
+	bool in_use;
+};
+
+struct pa_sync_slot {
+	struct bt_le_per_adv_sync *sync;
+	struct pa_sync_candidate source;
+	enum pa_sync_slot_state state;
+	bool pending; /* Sync create not completed yet, also while being cancelled */
+	bool failed;  /* Retry the source when the sync is terminated */
+	uint32_t create_start; /* Cycle count when the sync create was started */
+	uint32_t data_hash[PA_SYNC_DATA_COUNT]; /* Of the data last reported */
+	bool has_data[PA_SYNC_DATA_COUNT];
+	struct k_work_delayable timeout_work;
+	struct k_work delete_work;
+};
+
+static struct pa_sync_slot slots[PA_SYNC_SLOTS];
+static struct pa_sync_candidate queue[CONFIG_PA_SYNC_QUEUE_SIZE];
+static struct pa_sync_candidate monitors[CONFIG_PA_MONITOR_MAX];
+/*
+ * Sources that used up their retry budget, not queued again until stopped.
+ * Kept out of the queue so they never take the place of a source that may
+ * still sync, the oldest is forgotten (and retried) when full.
+ */
+static bt_addr_le_t exhausted[CONFIG_PA_SYNC_QUEUE_SIZE];
+static uint8_t exhausted_cnt;
+static uint8_t exhausted_next;
+static K_MUTEX_DEFINE(pa_sync_mutex);
+
+static void pa_sync_dispatch_work_handler(struct k_work *work);
+
+K_WORK_DEFINE(pa_sync_dispatch_work, pa_sync_dispatch_work_handler);
+
+static uint16_t sync_skip(const struct pa_sync_candidate *source)
+{
+	return source->monitor ? CONFIG_PA_MONITOR_SKIP : PA_SYNC_SKIP;
+}
+
+static uint16_t interval_to_sync_timeout(uint16_t pa_interval, uint16_t skip)
+{
+	uint16_t pa_timeout;
+
+	if (pa_interval == BT_BAP_PA_INTERVAL_UNKNOWN) {
+		/* Use maximum value to maximize chance of success */
+		pa_timeout = BT_GAP_PER_ADV_MAX_TIMEOUT;
+	} else {
+		uint32_t interval_ms;
+		uint32_t timeout;
+		uint32_t ratio;
+
+		/* Add retries and convert to unit in 10's of ms */
+		interval_ms = BT_GAP_PER_ADV_INTERVAL_TO_MS(pa_interval);
+		ratio = MAX(PA_SYNC_INTERVAL_TO_TIMEOUT_RATIO,
+			    (skip + 1U) * PA_SYNC_SKIP_TO_TIMEOUT_RATIO);
+		timeout = (interval_ms * ratio) / 10;
+
+		/* Enforce restraints */
+		pa_timeout = CLAMP(timeout, BT_GAP_PER_ADV_MIN_TIMEOUT, BT_GAP_PER_ADV_MAX_TIMEOUT);
+	}
+
+	return pa_timeout;
+}
+
+static struct pa_sync_slot *pa_sync_slot_find_sync(const struct bt_le_per_adv_sync *sync)
+{
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].state != PA_SYNC_SLOT_FREE && slots[i].sync == sync) {
+			return &slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct pa_sync_slot *pa_sync_slot_find_addr(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].state != PA_SYNC_SLOT_FREE &&
+		    bt_addr_le_eq(&slots[i].source.addr, addr)) {
+			return &slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct pa_sync_candidate *pa_sync_queue_find(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < ARRAY_SIZE(queue); i++) {
+		if (queue[i].in_use && bt_addr_le_eq(&queue[i].addr, addr)) {
+			return &queue[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct pa_sync_candidate *pa_sync_monitor_find(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < ARRAY_SIZE(monitors); i++) {
+		if (monitors[i].in_use && bt_addr_le_eq(&monitors[i].addr, addr)) {
+			return &monitors[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* A monitored source without a sync, served before the queue */
+static struct pa_sync_candidate *pa_sync_monitor_next(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(monitors); i++) {
+		if (monitors[i].in_use && pa_sync_slot_find_addr(&monitors[i].addr) == NULL) {
+			return &monitors[i];
+		}
+	}
+
+	return NULL;
+}
+
+static bool pa_sync_exhausted_find(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < exhausted_cnt; i++) {
+		if (bt_addr_le_eq(&exhausted[i], addr)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void pa_sync_exhausted_add(const bt_addr_le_t *addr)
+{
+	bt_addr_le_copy(&exhausted[exhausted_next], addr);
+	exhausted_next = (exhausted_next + 1) % ARRAY_SIZE(exhausted);
+	exhausted_cnt = MIN(exhausted_cnt + 1, ARRAY_SIZE(exhausted));
+}
+
+static void pa_sync_queue_put(const struct pa_sync_candidate *candidate)
+{
+	struct pa_sync_candidate *entry = NULL;
+
+	for (int i = 0; i < ARRAY_SIZE(queue); i++) {
+		if (!queue[i].in_use) {
+			entry = &queue[i];
+			break;
+		}
+
+		/* Full queue, make room by dropping the weakest waiting source */
+		if (entry == NULL || queue[i].rssi < entry->rssi) {
+			entry = &queue[i];
+		}
+	}
+
+	if (entry == NULL || (entry->in_use && entry->rssi >= candidate->rssi)) {
+		/* Dropped, requeued on one of the next advertising reports */
+		return;
+	}
+
+	*entry = *candidate;
+	entry->in_use = true;
+}
+
+/* Highest RSSI first, the queue is small so a linear search is used */
+static struct pa_sync_candidate *pa_sync_queue_best(void)
+{
+	struct pa_sync_candidate *best = NULL;
+
+	for (int i = 0; i < ARRAY_SIZE(queue); i++) {
+		if (queue[i].in_use && (best == NULL || queue[i].rssi > best->rssi)) {
+			best = &queue[i];
+		}
+	}
+
+	return best;
+}
+
+static void pa_sync_monitor_retry(const struct pa_sync_candidate *source)
+{
+	struct pa_sync_candidate *monitor = pa_sync_monitor_find(&source->addr);
+	char addr_str[BT_ADDR_LE_STR_LEN];
+
+	if (monitor == NULL) {
+		/* Stopped meanwhile */
+		return;
+	}
+
+	monitor->attempts++;
+	if (monitor->attempts > CONFIG_PA_SYNC_RETRIES) {
+		bt_addr_le_to_str(&monitor->addr, addr_str, sizeof(addr_str));
+		LOG_WRN("PA monitor retries exhausted, monitor stopped (%s)", addr_str);
+		monitor->in_use = false;
+	}
+}
+
+static void pa_sync_retry(const struct pa_sync_candidate *source)
+{
+	struct pa_sync_candidate retry = *source;
+	char addr_str[BT_ADDR_LE_STR_LEN];
+
+	if (source->monitor) {
+		pa_sync_monitor_retry(source);
+		return;
+	}
+
+	retry.attempts++;
+	if (retry.attempts > CONFIG_PA_SYNC_RETRIES) {
+		bt_addr_le_to_str(&retry.addr, addr_str, sizeof(addr_str));
+		LOG_WRN("PA sync retries exhausted (%s)", addr_str);
+		pa_sync_exhausted_add(&retry.addr);
+		return;
+	}
+
+	pa_sync_queue_put(&retry);
+}
+
+static void pa_sync_slot_delete(struct pa_sync_slot *slot, bool failed)
+{
+	(void)k_work_cancel_delayable(&slot->timeout_work);
+	slot->failed = failed;
+	slot->state = PA_SYNC_SLOT_DELETING;
+	k_work_submit(&slot->delete_work);
+}
+
+static void pa_sync_slot_free(struct pa_sync_slot *slot)
+{
+	(void)k_work_cancel_delayable(&slot->timeout_work);
+	slot->sync = NULL;
+	slot->pending = false;
+	slot->state = PA_SYNC_SLOT_FREE;
+}
+
+static void pa_sync_timeout_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct pa_sync_slot *slot = CONTAINER_OF(dwork, struct pa_sync_slot, timeout_work);
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+	if (slot->state == PA_SYNC_SLOT_CREATING || slot->state == PA_SYNC_SLOT_SYNCED) {
+		LOG_WRN("PA sync %s timeout (%p)",
+			slot->state == PA_SYNC_SLOT_CREATING ? "create" : "data", (void *)slot->sync);
+		stats_inc(STATS_PA_SYNC_TIMEOUT);
+		pa_sync_slot_delete(slot, true);
+	}
+	k_mutex_unlock(&pa_sync_mutex);
+}
+
+static void pa_sync_delete_work_handler(struct k_work *work)
+{
+	struct pa_sync_slot *slot = CONTAINER_OF(work, struct pa_sync_slot, delete_work);
+	struct bt_le_per_adv_sync *sync;
+	int err;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+	sync = slot->state == PA_SYNC_SLOT_DELETING ? slot->sync : NULL;
+	k_mutex_unlock(&pa_sync_mutex);
+
+	if (sync == NULL) {
+		return;
+	}
+
+	LOG_INF("pa_sync_delete %p", (void *)sync);
+
+	/* The slot is freed by the term callback, either from within this call (synced)
+	 * or when the cancelled create completes (pending).
+	 */
+	err = bt_le_per_adv_sync_delete(sync);
+	if (err) {
+		LOG_INF("bt_le_per_adv_sync_delete failed (%d)", err);
+
+		k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+		if (slot->state == PA_SYNC_SLOT_DELETING && slot->sync == sync) {
+			pa_sync_slot_free(slot);
+		}
+		k_mutex_unlock(&pa_sync_mutex);
+
+		k_work_submit(&pa_sync_dispatch_work);
+	}
+}
+
+static void pa_sync_dispatch_work_handler(struct k_work *work)
+{
+	struct bt_le_per_adv_sync_param per_adv_sync_param = {0};
+	struct pa_sync_candidate *candidate;
+	struct pa_sync_slot *slot = NULL;
+	uint32_t create_timeout_duration_ms;
+	int err;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].state != PA_SYNC_SLOT_FREE && slots[i].pending) {
+			/* Only a single pending sync create is allowed */
+			goto unlock;
+		}
+
+		if (slot == NULL && slots[i].state == PA_SYNC_SLOT_FREE) {
+			slot = &slots[i];
+		}
+	}
+
+	candidate = pa_sync_monitor_next();
+	if (candidate == NULL) {
+		candidate = pa_sync_queue_best();
+	}
+
+	if (slot == NULL || candidate == NULL) {
+		goto unlock;
+	}
+
+	slot->source = *candidate;
+	if (!candidate->monitor) {
+		candidate->in_use = false;
+	}
+	memset(slot->has_data, 0, sizeof(slot->has_data));
+
+	bt_addr_le_copy(&per_adv_sync_param.addr, &slot->source.addr);
+	per_adv_sync_param.options = BT_LE_PER_ADV_SYNC_OPT_FILTER_DUPLICATE;
+	per_adv_sync_param.sid = slot->source.sid;
+	per_adv_sync_param.skip = sync_skip(&slot->source);
+	per_adv_sync_param.timeout =
+		interval_to_sync_timeout(slot->source.interval, per_adv_sync_param.skip);
+
+	err = bt_le_per_adv_sync_create(&per_adv_sync_param, &slot->sync);
+	if (err != 0) {
+		LOG_INF("Could not create Broadcast PA sync: %d", err);
+		if (err == -EBUSY) {
+			/* Not the fault of the source, try again later */
+			pa_sync_queue_put(&slot->source);
+		} else {
+			pa_sync_retry(&slot->source);
+		}
+		goto unlock;
+	}
+
+	slot->state = PA_SYNC_SLOT_CREATING;
+	slot->pending = true;
+	slot->failed = false;
+	slot->create_start = k_cycle_get_32();
+	stats_inc(STATS_PA_SYNC_CREATED);
+
+	/* The same duration is used for the create and for receiving data once synced */
+	create_timeout_duration_ms = per_adv_sync_param.timeout * 10U;
+	LOG_INF("PA sync create %p (slot %d, attempt %u, timeout %u ms%s)", (void *)slot->sync,
+		(int)(slot - slots), slot->source.attempts, create_timeout_duration_ms,
+		slot->source.monitor ? ", monitor" : "");
+	k_work_reschedule(&slot->timeout_work, K_MSEC(create_timeout_duration_ms));
+
+unlock:
+	k_mutex_unlock(&pa_sync_mutex);
+}
+
+/*
+ * Public functions
+ */
+void pa_sync_sched_request(const bt_addr_le_t *addr, uint8_t sid, uint16_t interval, int8_t rssi)
+{
+	struct pa_sync_candidate *entry;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+
+	if (pa_sync_slot_find_addr(addr) != NULL || pa_sync_exhausted_find(addr)) {
+		k_mutex_unlock(&pa_sync_mutex);
+		return;
+	}
+
+	entry = pa_sync_queue_find(addr);
+	if (entry) {
+		entry->sid = sid;
+		entry->interval = interval;
+		entry->rssi = rssi;
+	} else {
+		struct pa_sync_candidate candidate = {
+			.interval = interval,
+			.sid = sid,
+			.rssi = rssi,
+		};
+
+		bt_addr_le_copy(&candidate.addr, addr);
+		pa_sync_queue_put(&candidate);
+	}
+
+	k_mutex_unlock(&pa_sync_mutex);
+
+	k_work_submit(&pa_sync_dispatch_work);
+}
+
+struct bt_le_per_adv_sync *pa_sync_sched_get_synced(const bt_addr_le_t *addr, uint8_t sid)
+{
+	struct bt_le_per_adv_sync *sync = NULL;
+	struct pa_sync_slot *slot;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+	slot = pa_sync_slot_find_addr(addr);
+	if (slot && slot->state == PA_SYNC_SLOT_SYNCED && slot->source.sid == sid) {
+		sync = slot->sync;
+	}
+	k_mutex_unlock(&pa_sync_mutex);
+
+	return sync;
+}
+
+bool pa_sync_sched_owns(const struct bt_le_per_adv_sync *sync)
+{
+	bool owns;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+	owns = pa_sync_slot_find_sync(sync) != NULL;
+	k_mutex_unlock(&pa_sync_mutex);
+
+	return owns;
+}
+
+void pa_sync_sched_release(struct bt_le_per_adv_sync *sync)
+{
+	struct pa_sync_slot *slot;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+	slot = pa_sync_slot_find_sync(sync);
+	if (slot && slot->source.monitor) {
+		/* Kept, the controller reports a lost sync through the term callback */
+		(void)k_work_cancel_delayable(&slot->timeout_work);
+	} else if (slot && slot->state != PA_SYNC_SLOT_DELETING) {
+		LOG_INF("Delete PA sync %p", (void *)sync);
+		pa_sync_slot_delete(slot, false);
+	}
+	k_mutex_unlock(&pa_sync_mutex);
+}
+
+void pa_sync_sched_synced(struct bt_le_per_adv_sync *sync)
+{
+	struct pa_sync_slot *slot;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+	slot = pa_sync_slot_find_sync(sync);
+	if (slot) {
+		slot->pending = false;
+	}
+	if (slot && slot->state == PA_SYNC_SLOT_CREATING) {
+		struct pa_sync_candidate *monitor = pa_sync_monitor_find(&slot->source.addr);
+
+		stats_inc(STATS_PA_SYNC_SYNCED);
+		stats_latency_end(STATS_LATENCY_PA_SYNC, slot->create_start);
+		slot->state = PA_SYNC_SLOT_SYNCED;
+		k_work_reschedule(&slot->timeout_work,
+				  K_MSEC(interval_to_sync_timeout(slot->source.interval,
+								  sync_skip(&slot->source)) *
+					 10U));
+
+		if (slot->source.monitor && monitor) {
+			/* A sync lost later gets a new retry budget */
+			monitor->attempts = 0;
+		}
+	}
+	k_mutex_unlock(&pa_sync_mutex);
+
+	/* Start the next create while this slot waits for data */
+	k_work_submit(&pa_sync_dispatch_work);
+}
+
+void pa_sync_sched_terminated(struct bt_le_per_adv_sync *sync)
+{
+	struct pa_sync_slot *slot;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+	slot = pa_sync_slot_find_sync(sync);
+	if (slot) {
+		/* Sync lost before data was received counts as a failed attempt */
+		if (slot->failed || slot->state != PA_SYNC_SLOT_DELETING) {
+			pa_sync_retry(&slot->source);
+		}
+		pa_sync_slot_free(slot);
+	}
+	k_mutex_unlock(&pa_sync_mutex);
+
+	k_work_submit(&pa_sync_dispatch_work);
+}
+
+void pa_sync_sched_stop(void)
+{
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+
+	memset(queue, 0, sizeof(queue));
+	exhausted_cnt = 0;
+	exhausted_next = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].source.monitor && slots[i].state != PA_SYNC_SLOT_FREE) {
+			/* Monitors are only stopped by pa_sync_sched_monitor_stop() */
+			continue;
+		}
+
+		if (slots[i].state == PA_SYNC_SLOT_CREATING || slots[i].state == PA_SYNC_SLOT_SYNCED) {
+			pa_sync_slot_delete(&slots[i], false);
+		} else if (slots[i].state == PA_SYNC_SLOT_DELETING) {
+			slots[i].failed = false;
+		}
+	}
+
+	k_mutex_unlock(&pa_sync_mutex);
+}
+
+int pa_sync_sched_monitor_start(const bt_addr_le_t *addr, uint8_t sid, uint16_t interval,
+				uint8_t owner)
+{
+	struct pa_sync_candidate *monitor;
+	struct pa_sync_candidate *queued;
+	struct pa_sync_slot *slot;
+	char addr_str[BT_ADDR_LE_STR_LEN];
+	uint8_t owners = 0;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+
+	monitor = pa_sync_monitor_find(addr);
+	if (monitor) {
+		owners = monitor->owners;
+	}
+	for (int i = 0; monitor == NULL && i < ARRAY_SIZE(monitors); i++) {
+		if (!monitors[i].in_use) {
+			monitor = &monitors[i];
+		}
+	}
+
+	if (monitor == NULL) {
+		k_mutex_unlock(&pa_sync_mutex);
+		return -ENOMEM;
+	}
+
+	memset(monitor, 0, sizeof(*monitor));
+	bt_addr_le_copy(&monitor->addr, addr);
+	monitor->sid = sid;
+	monitor->interval = interval;
+	monitor->monitor = true;
+	monitor->owners = owners | owner;
+	monitor->in_use = true;
+
+	/* The monitor takes over from discovery */
+	queued = pa_sync_queue_find(addr);
+	if (queued) {
+		queued->in_use = false;
+	}
+
+	slot = pa_sync_slot_find_addr(addr);
+	if (slot && !slot->source.monitor && slot->state != PA_SYNC_SLOT_DELETING) {
+		/* Synced again with the monitor skip once deleted */
+		pa_sync_slot_delete(slot, false);
+	}
+
+	k_mutex_unlock(&pa_sync_mutex);
+
+	bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
+	LOG_INF("PA monitor started (%s)", addr_str);
+
+	k_work_submit(&pa_sync_dispatch_work);
+
+	return 0;
+}
+
+int pa_sync_sched_monitor_stop(const bt_addr_le_t *addr, uint8_t owner)
+{
+	bool all = bt_addr_le_eq(addr, BT_ADDR_LE_ANY);
+	struct pa_sync_slot *slot;
+	int err = all ? 0 : -ENOENT;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+
+	for (int i = 0; i < ARRAY_SIZE(monitors); i++) {
+		if (!monitors[i].in_use || (!all && !bt_addr_le_eq(&monitors[i].addr, addr)) ||
+		    !(monitors[i].owners & owner)) {
+			continue;
+		}
+
+		err = 0;
+		monitors[i].owners &= ~owner;
+		if (monitors[i].owners != 0) {
+			/* Still needed by another owner */
+			continue;
+		}
+
+		monitors[i].in_use = false;
+
+		slot = pa_sync_slot_find_addr(&monitors[i].addr);
+		if (slot && slot->source.monitor && slot->state != PA_SYNC_SLOT_DELETING) {
+			pa_sync_slot_delete(slot, false);
+		}
+	}
+
+	k_mutex_unlock(&pa_sync_mutex);
+
+	LOG_INF("PA monitor stopped (err %d)", err);
+
+	return err;
+}
+
+bool pa_sync_sched_data_changed(const struct bt_le_per_adv_sync *sync, enum pa_sync_data kind,
+				const uint8_t *data, size_t len)
+{
+	uint32_t hash = crc32_ieee(data, len);
+	struct pa_sync_slot *slot;
+	bool changed = false;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+	slot = pa_sync_slot_find_sync(sync);
+	if (slot && (!slot->has_data[kind] || slot->data_hash[kind] != hash)) {
+		slot->data_hash[kind] = hash;
+		slot->has_data[kind] = true;
+		changed = true;
+	}
+	k_mutex_unlock(&pa_sync_mutex);
+
+	return changed;
+}
+
+void pa_sync_sched_data_forget(const struct bt_le_per_adv_sync *sync, enum pa_sync_data kind)
+{
+	struct pa_sync_slot *slot;
+
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+	slot = pa_sync_slot_find_sync(sync);
+	if (slot) {
+		slot->has_data[kind] = false;
+	}
+	k_mutex_unlock(&pa_sync_mutex);
+}
+
+void pa_sync_sched_data_forget_all(void)
+{
+	k_mutex_lock(&pa_sync_mutex, K_FOREVER);
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		memset(slots[i].has_data, 0, sizeof(slots[i].has_data));
+	}
+	k_mutex_unlock(&pa_sync_mutex);
+}
+
+void pa_sync_sched_init(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		k_work_init_delayable(&slots[i].timeout_work, pa_sync_timeout_work_handler);
+		k_work_init(&slots[i].delete_work, pa_sync_delete_work_handler);
+		slots[i].state = PA_SYNC_SLOT_FREE;
+	}
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PA_SYNC_SCHED_H__
+#define __PA_SYNC_SCHED_H__
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/addr.h>
+#include <zephyr/bluetooth/bluetooth.h>
+
+/* Data received on a PA sync that is only reported when changed */
+enum pa_sync_data {
+	PA_SYNC_DATA_BASE,
+	PA_SYNC_DATA_BIG_INFO,
+
+	PA_SYNC_DATA_COUNT,
+};
+
+/**
+ * @brief Initialize the PA sync scheduler
+ */
+void pa_sync_sched_init(void);
+
+/**
+ * @brief Request a PA sync to a broadcast source
+ *
+ * The source is queued and synced as soon as a sync slot is available.
+ * Queued sources are served strongest RSSI first. Repeated requests for a
+ * source refresh its queue entry.
+ *
+ * @param addr      Address of the broadcast source
+ * @param sid       Advertising set ID
+ * @param interval  Periodic advertising interval
+ * @param rssi      RSSI of the latest advertising report
+ */
+void pa_sync_sched_request(const bt_addr_le_t *addr, uint8_t sid, uint16_t interval, int8_t rssi);
+
+/**
+ * @brief Get the established PA sync to a broadcast source
+ *
+ * @param addr  Address of the broadcast source
+ * @param sid   Advertising set ID
+ *
+ * @return The PA sync, or NULL if the source is not synced
+ */
+struct bt_le_per_adv_sync *pa_sync_sched_get_synced(const bt_addr_le_t *addr, uint8_t sid);
+
+/**
+ * @brief Check whether a PA sync is owned by the scheduler
+ *
+ * @param sync  The PA sync
+ *
+ * @return true if the sync is one of the scheduler slots
+ */
+bool pa_sync_sched_owns(const struct bt_le_per_adv_sync *sync);
+
+/**
+ * @brief Release a PA sync once the wanted data has been received
+ *
+ * The sync is deleted and its slot is given to the next queued source.
+ * The sync of a monitored source is kept.
+ *
+ * @param sync  The PA sync
+ */
+void pa_sync_sched_release(struct bt_le_per_adv_sync *sync);
+
+/**
+ * @brief Report that a PA sync has been established (synced callback)
+ *
+ * @param sync  The PA sync
+ */
+void pa_sync_sched_synced(struct bt_le_per_adv_sync *sync);
+
+/**
+ * @brief Report that a PA sync has been terminated (term callback)
+ *
+ * @param sync  The PA sync
+ */
+void pa_sync_sched_terminated(struct bt_le_per_adv_sync *sync);
+
+/**
+ * @brief Delete all PA syncs and forget all queued sources
+ *
+ * Monitored sources keep their sync.
+ */
+void pa_sync_sched_stop(void);
+
+/* Users of a monitor, it is kept while any of them needs it */
+enum {
+	PA_MONITOR_HOST = BIT(0), /* START_SOURCE_MONITOR */
+	PA_MONITOR_PAST = BIT(1), /* Sinks may ask for PAST, see broadcast_assistant.c */
+	PA_MONITOR_ALL = PA_MONITOR_HOST | PA_MONITOR_PAST,
+};
+
+/**
+ * @brief Keep a broadcast source synced to follow changes of its BASE and BIGinfo
+ *
+ * The source is synced before any queued source, skipping PA_MONITOR_SKIP
+ * events, and resynced if the sync is lost. Like any PA sync, establishing
+ * it needs a running scan. A discovery sync to the source is replaced.
+ *
+ * @param addr      Address of the broadcast source
+ * @param sid       Advertising set ID
+ * @param interval  Periodic advertising interval
+ * @param owner     PA_MONITOR_* starting it, a started monitor is shared
+ *
+ * @return 0 on success, -ENOMEM if PA_MONITOR_MAX sources are monitored
+ */
+int pa_sync_sched_monitor_start(const bt_addr_le_t *addr, uint8_t sid, uint16_t interval,
+				uint8_t owner);
+
+/**
+ * @brief Stop monitoring a broadcast source for an owner
+ *
+ * The sync is deleted once no owner is left.
+ *
+ * @param addr   Address of the broadcast source, BT_ADDR_LE_ANY for all
+ * @param owner  PA_MONITOR_* stopping it, PA_MONITOR_ALL for any
+ *
+ * @return 0 on success, -ENOENT if the source is not monitored by the owner
+ */
+int pa_sync_sched_monitor_stop(const bt_addr_le_t *addr, uint8_t owner);
+
+/**
+ * @brief Check whether data received on a PA sync differs from the last reported
+ *
+ * Only a hash of the data is kept. It is cleared whenever the sync is created.
+ *
+ * @param sync  The PA sync
+ * @param kind  Kind of data
+ * @param data  The data
+ * @param len   Length of the data
+ *
+ * @return true if the data is new or changed and should be reported
+ */
+bool pa_sync_sched_data_changed(const struct bt_le_per_adv_sync *sync, enum pa_sync_data kind,
+				const uint8_t *data, size_t len);
+
+/**
+ * @brief Forget the data last reported, e.g. when the event could not be sent
+ *
+ * @param sync  The PA sync
+ * @param kind  Kind of data
+ */
+void pa_sync_sched_data_forget(const struct bt_le_per_adv_sync *sync, enum pa_sync_data kind);
+
+/**
+ * @brief Forget the data last reported of all PA syncs
+ *
+ * The BASE and BIGinfo of every synced source are then reported again, e.g.
+ * to a host that has just reattached.
+ */
+void pa_sync_sched_data_forget_all(void);
+
+#endif /* __PA_SYNC_SCHED_H__ */
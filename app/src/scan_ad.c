@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/types.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/bluetooth/audio/audio.h>
+#include <zephyr/bluetooth/audio/csip.h>
+
+#include "broadcast_assistant.h"
+#include "scan_ad.h"
+
+LOG_MODULE_REGISTER(scan_ad, LOG_LEVEL_INF);
+
+/* Fields found so far, used to stop as soon as the active modes are satisfied */
+enum {
+	SCAN_AD_FOUND_NAME = BIT(0),
+	SCAN_AD_FOUND_BROADCAST_NAME = BIT(1),
+	SCAN_AD_FOUND_BROADCAST_ID = BIT(2),
+	SCAN_AD_FOUND_BASS = BIT(3),
+	SCAN_AD_FOUND_RSI = BIT(4),
+	SCAN_AD_FOUND_END = BIT(5), /* Never found, the whole data is walked */
+};
+
+#define SCAN_AD_NEEDS_SOURCE                                                                       \
+	(SCAN_AD_FOUND_NAME | SCAN_AD_FOUND_BROADCAST_NAME | SCAN_AD_FOUND_BROADCAST_ID)
+#define SCAN_AD_NEEDS_SINK (SCAN_AD_FOUND_NAME | SCAN_AD_FOUND_BASS)
+#define SCAN_AD_NEEDS_CSIS (SCAN_AD_FOUND_RSI)
+
+static void scan_ad_copy_name(char *dst, const uint8_t *name, uint8_t name_len)
+{
+	name_len = MIN(name_len, MESSAGE_EVT_NAME_MAX_LEN);
+	memcpy(dst, name, name_len);
+	dst[name_len] = '\0';
+}
+
+static uint8_t scan_ad_uuid16_list(const uint8_t *data, uint8_t data_len,
+				   struct scan_ad_info *info)
+{
+	uint8_t found = 0;
+
+	/* NOTE: According to the BAP 1.0.1 Spec,
+	 * Section 3.9.2. Additional Broadcast Audio Scan Service requirements,
+	 * If the Scan Delegator implements a Broadcast Sink, it should also
+	 * advertise a Service Data field containing the Broadcast Audio
+	 * Scan Service (BASS) UUID.
+	 *
+	 * However, it seems that this is not the case with the sinks available
+	 * while developing this sample application.  Therefore, we instead,
+	 * search for the existence of BASS and PACS in the list of service UUIDs,
+	 * which does seem to exist in the sinks available.
+	 */
+	if (data_len % sizeof(uint16_t) != 0U) {
+		LOG_ERR("UUID16 AD malformed");
+		return 0;
+	}
+
+	for (uint8_t i = 0; i < data_len; i += sizeof(uint16_t)) {
+		switch (sys_get_le16(&data[i])) {
+		case BT_UUID_BASS_VAL:
+			info->has_bass = true;
+			found |= SCAN_AD_FOUND_BASS;
+			break;
+		case BT_UUID_PACS_VAL:
+			info->has_pacs = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return found;
+}
+
+static uint8_t scan_ad_svc_data16(const uint8_t *data, uint8_t data_len,
+				  struct scan_ad_info *info)
+{
+	if (data_len < BT_UUID_SIZE_16) {
+		return 0;
+	}
+
+	switch (sys_get_le16(data)) {
+	case BT_UUID_BASS_VAL:
+		info->has_bass = true;
+		return SCAN_AD_FOUND_BASS;
+	case BT_UUID_BROADCAST_AUDIO_VAL:
+		if (data_len < BT_UUID_SIZE_16 + BT_AUDIO_BROADCAST_ID_SIZE) {
+			return 0;
+		}
+		info->broadcast_id = sys_get_le24(data + BT_UUID_SIZE_16);
+		return SCAN_AD_FOUND_BROADCAST_ID;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Public functions
+ */
+void scan_ad_classify(const struct net_buf_simple *ad, uint8_t modes,
+		      const uint8_t sirk[BT_CSIP_SIRK_SIZE], struct scan_ad_info *info)
+{
+	const uint8_t *data = ad->data;
+	uint16_t len = ad->len;
+	uint8_t needs = 0;
+	uint8_t found = 0;
+
+	memset(info, 0, sizeof(*info));
+	info->broadcast_id = SCAN_AD_INVALID_BROADCAST_ID;
+
+	if (modes & BROADCAST_ASSISTANT_SCAN_SOURCE) {
+		needs |= SCAN_AD_NEEDS_SOURCE;
+	}
+	if (modes & BROADCAST_ASSISTANT_SCAN_SINK) {
+		needs |= SCAN_AD_NEEDS_SINK;
+	}
+	if (modes & BROADCAST_ASSISTANT_SCAN_CSIS) {
+		needs |= SCAN_AD_NEEDS_CSIS;
+	}
+	if (modes & SCAN_AD_ALL_SERVICES) {
+		needs |= SCAN_AD_FOUND_END;
+	}
+
+	/* Same framing as bt_data_parse, [len][type][data] */
+	while (needs != 0 && (found & needs) != needs && len > 1) {
+		const uint8_t field_len = data[0];
+		const uint8_t type = data[1];
+		const uint8_t *value = &data[2];
+		const uint8_t value_len = field_len - 1;
+
+		if (field_len == 0U) {
+			/* Early termination */
+			break;
+		}
+
+		if (field_len > len - 1) {
+			LOG_DBG("Malformed AD (field %u, left %u)", field_len, len);
+			break;
+		}
+
+		switch (type) {
+		case BT_DATA_NAME_COMPLETE:
+			scan_ad_copy_name(info->bt_name, value, value_len);
+			info->bt_name_type = BT_DATA_NAME_COMPLETE;
+			found |= SCAN_AD_FOUND_NAME;
+			break;
+		case BT_DATA_NAME_SHORTENED:
+			/* A complete name takes precedence */
+			if (info->bt_name_type != BT_DATA_NAME_COMPLETE) {
+				scan_ad_copy_name(info->bt_name, value, value_len);
+				info->bt_name_type = BT_DATA_NAME_SHORTENED;
+			}
+			break;
+		case BT_DATA_BROADCAST_NAME:
+			scan_ad_copy_name(info->broadcast_name, value, value_len);
+			found |= SCAN_AD_FOUND_BROADCAST_NAME;
+			break;
+		case BT_DATA_SVC_DATA16:
+			found |= scan_ad_svc_data16(value, value_len, info);
+			break;
+		case BT_DATA_UUID16_SOME:
+		case BT_DATA_UUID16_ALL:
+			found |= scan_ad_uuid16_list(value, value_len, info);
+			break;
+		case BT_DATA_CSIS_RSI:
+			info->has_csis = true;
+			if ((modes & BROADCAST_ASSISTANT_SCAN_CSIS) && !info->set_member) {
+				struct bt_data rsi = {
+					.type = type,
+					.data_len = value_len,
+					.data = value,
+				};
+
+				info->set_member = bt_csip_set_coordinator_is_set_member(sirk, &rsi);
+			}
+			found |= SCAN_AD_FOUND_RSI;
+			break;
+		default:
+			break;
+		}
+
+		data += field_len + 1;
+		len -= field_len + 1;
+	}
+}
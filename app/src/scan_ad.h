@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __SCAN_AD_H__
+#define __SCAN_AD_H__
+
+#include <zephyr/types.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/bluetooth/audio/csip.h>
+
+#include "message_evt.h"
+
+#define SCAN_AD_INVALID_BROADCAST_ID 0xFFFFFFFFU
+
+/* Classify option, walks all of the data so has_pacs and has_csis are complete */
+#define SCAN_AD_ALL_SERVICES BIT(7)
+
+/* What is known about an advertiser after classifying one report */
+struct scan_ad_info {
+	char bt_name[MESSAGE_EVT_NAME_MAX_LEN + 1];
+	uint8_t bt_name_type;
+	char broadcast_name[MESSAGE_EVT_NAME_MAX_LEN + 1];
+	uint32_t broadcast_id;
+	bool has_bass;
+	bool has_pacs;
+	bool has_csis;
+	bool set_member;
+};
+
+/**
+ * @brief Classify an advertising report in a single pass
+ *
+ * Walks the advertising data once, filling in the fields needed by the given
+ * scan modes, and stops as soon as nothing more can be learned for them. The
+ * advertising data is not consumed.
+ *
+ * @param ad     Advertising data
+ * @param modes  BROADCAST_ASSISTANT_SCAN_* bits the report is evaluated for, and
+ *               SCAN_AD_ALL_SERVICES
+ * @param sirk   SIRK to resolve the RSI against (BROADCAST_ASSISTANT_SCAN_CSIS)
+ * @param info   Result, all fields are initialized
+ */
+void scan_ad_classify(const struct net_buf_simple *ad, uint8_t modes,
+		      const uint8_t sirk[BT_CSIP_SIRK_SIZE], struct scan_ad_info *info);
+
+#endif /* __SCAN_AD_H__ */
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/net/buf.h>
+
+#include "message.h"
+#include "message_evt.h"
+#include "scan_batch.h"
+#include "stats.h"
+
+LOG_MODULE_REGISTER(scan_batch, LOG_LEVEL_INF);
+
+/* Scan reports arrive from the BT RX thread, the window expires on the system workqueue */
+static K_MUTEX_DEFINE(batch_mutex);
+static struct net_buf *batch_buf;
+static uint16_t record_offset;
+
+static void scan_batch_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(batch_work, scan_batch_work_handler);
+
+static void scan_batch_send_locked(void)
+{
+	if (!batch_buf) {
+		return;
+	}
+
+	LOG_DBG("Sending batch (%u bytes)", batch_buf->len);
+
+	message_send_net_buf_event(MESSAGE_SUBTYPE_SCAN_REPORT_BATCH, batch_buf);
+	batch_buf = NULL;
+	stats_inc(STATS_SCAN_BATCHES);
+}
+
+static void scan_batch_work_handler(struct k_work *work)
+{
+	k_mutex_lock(&batch_mutex, K_FOREVER);
+	scan_batch_send_locked();
+	k_mutex_unlock(&batch_mutex);
+}
+
+/*
+ * Public functions
+ */
+struct net_buf *scan_batch_alloc(size_t len)
+{
+	if (CONFIG_SCAN_BATCH_WINDOW_MS == 0 ||
+	    SCAN_BATCH_RECORD_HDR_LEN + len > CONFIG_TX_MSG_MAX_PAYLOAD_LEN) {
+		return message_evt_alloc_bulk(len);
+	}
+
+	k_mutex_lock(&batch_mutex, K_FOREVER);
+
+	if (batch_buf && net_buf_tailroom(batch_buf) < SCAN_BATCH_RECORD_HDR_LEN + len) {
+		/* Full, send it before starting a new one */
+		scan_batch_send_locked();
+	}
+
+	if (!batch_buf) {
+		batch_buf = message_evt_alloc_bulk(CONFIG_TX_MSG_MAX_PAYLOAD_LEN);
+		if (!batch_buf) {
+			k_mutex_unlock(&batch_mutex);
+			return NULL;
+		}
+
+		/* The window starts with the first report */
+		k_work_reschedule(&batch_work, K_MSEC(CONFIG_SCAN_BATCH_WINDOW_MS));
+	}
+
+	/* Header is filled in by scan_batch_commit() */
+	record_offset = batch_buf->len;
+	net_buf_add(batch_buf, SCAN_BATCH_RECORD_HDR_LEN);
+
+	/* Kept locked until the record is committed */
+	return batch_buf;
+}
+
+void scan_batch_commit(enum message_sub_type stype, struct net_buf *buf)
+{
+	uint8_t *hdr;
+
+	if (buf != batch_buf) {
+		/* Not batched */
+		message_send_net_buf_event(stype, buf);
+		return;
+	}
+
+	hdr = &buf->data[record_offset];
+	hdr[0] = stype;
+	sys_put_le16(buf->len - record_offset - SCAN_BATCH_RECORD_HDR_LEN, &hdr[1]);
+
+	k_mutex_unlock(&batch_mutex);
+}
+
+void scan_batch_flush(void)
+{
+	k_work_cancel_delayable(&batch_work);
+
+	k_mutex_lock(&batch_mutex, K_FOREVER);
+	scan_batch_send_locked();
+	k_mutex_unlock(&batch_mutex);
+}
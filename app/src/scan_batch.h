@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __SCAN_BATCH_H__
+#define __SCAN_BATCH_H__
+
+#include <zephyr/types.h>
+#include <zephyr/net/buf.h>
+
+#include "message.h"
+#include "message_evt.h"
+
+/*
+ * A SCAN_REPORT_BATCH event carries several scan report events, each as a
+ * record [sub_type][le16 len][payload] with the payload of the regular event.
+ */
+#define SCAN_BATCH_RECORD_HDR_LEN (sizeof(uint8_t) + sizeof(uint16_t))
+
+/**
+ * @brief Allocate room for a scan report in the current batch
+ *
+ * @param layout    Event layout (MESSAGE_EVT_LEN_<layout>)
+ * @param data_len  Length of advertising data carried by the event, or 0
+ */
+#define SCAN_BATCH_ALLOC(layout, data_len) scan_batch_alloc(MESSAGE_EVT_LEN_##layout + (data_len))
+
+/**
+ * @brief Allocate room for a scan report
+ *
+ * The report is added to the returned buffer with the message_evt_add_*()
+ * helpers, and must be completed with scan_batch_commit(). The batch stays
+ * locked in between. The current batch is sent first if the report does not
+ * fit. If batching is disabled (SCAN_BATCH_WINDOW_MS is 0), or the report is
+ * too large for a batch, a buffer for a single event is returned.
+ *
+ * @param len  Maximum payload length of the report
+ *
+ * @return The buffer, or NULL if no buffer is available
+ */
+struct net_buf *scan_batch_alloc(size_t len);
+
+/**
+ * @brief Complete a scan report allocated with scan_batch_alloc()
+ *
+ * @param stype  Event the report would have been sent as (e.g. SINK_FOUND)
+ * @param buf    Buffer returned by scan_batch_alloc()
+ */
+void scan_batch_commit(enum message_sub_type stype, struct net_buf *buf);
+
+/**
+ * @brief Send the pending batch now, e.g. when scanning stops
+ */
+void scan_batch_flush(void);
+
+#endif /* __SCAN_BATCH_H__ */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/addr.h>
+
+#include "scan_cache.h"
+
+LOG_MODULE_REGISTER(scan_cache, LOG_LEVEL_INF);
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_SCAN_CACHE_SIZE), "SCAN_CACHE_SIZE must be a power of two");
+
+/* Number of slots searched from the home slot of an address (linear probing) */
+#define SCAN_CACHE_MAX_PROBE MIN(8, CONFIG_SCAN_CACHE_SIZE)
+
+#define FNV1A_OFFSET_BASIS 2166136261U
+#define FNV1A_PRIME        16777619U
+
+struct scan_cache_entry {
+	bt_addr_le_t addr;
+	uint8_t kind; /* 0 = unused */
+	int8_t rssi;  /* RSSI when last reported */
+	uint32_t ad_hash;
+	uint32_t last_seen;
+};
+
+static struct scan_cache_entry scan_cache[CONFIG_SCAN_CACHE_SIZE];
+static K_MUTEX_DEFINE(scan_cache_mutex);
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t *data, size_t len)
+{
+	while (len-- != 0) {
+		hash ^= *data++;
+		hash *= FNV1A_PRIME;
+	}
+
+	return hash;
+}
+
+static uint32_t scan_cache_home(uint8_t kind, const bt_addr_le_t *addr)
+{
+	uint32_t hash = fnv1a(FNV1A_OFFSET_BASIS, &kind, sizeof(kind));
+
+	hash = fnv1a(hash, (const uint8_t *)addr, sizeof(*addr));
+
+	return hash & (CONFIG_SCAN_CACHE_SIZE - 1);
+}
+
+static bool scan_cache_is_stale(const struct scan_cache_entry *entry, uint32_t now)
+{
+	return (now - entry->last_seen) > CONFIG_SCAN_CACHE_TIMEOUT_MS;
+}
+
+static struct scan_cache_entry *scan_cache_find(uint8_t kind, const bt_addr_le_t *addr)
+{
+	uint32_t idx = scan_cache_home(kind, addr);
+
+	/* Entries can be removed, so always search the whole probe window */
+	for (int i = 0; i < SCAN_CACHE_MAX_PROBE; i++) {
+		struct scan_cache_entry *entry = &scan_cache[(idx + i) & (CONFIG_SCAN_CACHE_SIZE - 1)];
+
+		if (entry->kind == kind && bt_addr_le_eq(&entry->addr, addr)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static struct scan_cache_entry *scan_cache_slot_for_insert(uint8_t kind,
+							   const bt_addr_le_t *addr, uint32_t now)
+{
+	uint32_t idx = scan_cache_home(kind, addr);
+	struct scan_cache_entry *oldest = NULL;
+
+	for (int i = 0; i < SCAN_CACHE_MAX_PROBE; i++) {
+		struct scan_cache_entry *entry = &scan_cache[(idx + i) & (CONFIG_SCAN_CACHE_SIZE - 1)];
+
+		if (entry->kind == 0 || scan_cache_is_stale(entry, now)) {
+			return entry;
+		}
+
+		if (oldest == NULL || (now - entry->last_seen) > (now - oldest->last_seen)) {
+			oldest = entry;
+		}
+	}
+
+	/* Probe window full, evict the least recently seen advertiser */
+	return oldest;
+}
+
+void scan_cache_reset(void)
+{
+	k_mutex_lock(&scan_cache_mutex, K_FOREVER);
+	memset(scan_cache, 0, sizeof(scan_cache));
+	k_mutex_unlock(&scan_cache_mutex);
+}
+
+void scan_cache_remove(uint8_t kind, const bt_addr_le_t *addr)
+{
+	struct scan_cache_entry *entry;
+
+	k_mutex_lock(&scan_cache_mutex, K_FOREVER);
+	entry = scan_cache_find(kind, addr);
+	if (entry) {
+		memset(entry, 0, sizeof(*entry));
+	}
+	k_mutex_unlock(&scan_cache_mutex);
+}
+
+bool scan_cache_contains(uint8_t kind, const bt_addr_le_t *addr)
+{
+	struct scan_cache_entry *entry;
+	bool found;
+
+	k_mutex_lock(&scan_cache_mutex, K_FOREVER);
+	entry = scan_cache_find(kind, addr);
+	found = entry != NULL && !scan_cache_is_stale(entry, k_uptime_get_32());
+	k_mutex_unlock(&scan_cache_mutex);
+
+	return found;
+}
+
+bool scan_cache_should_report(uint8_t kind, const bt_addr_le_t *addr, int8_t rssi,
+			      const uint8_t *ad, uint16_t ad_len)
+{
+	struct scan_cache_entry *entry;
+	uint32_t now = k_uptime_get_32();
+	uint32_t ad_hash = fnv1a(FNV1A_OFFSET_BASIS, ad, ad_len);
+	bool report;
+
+	k_mutex_lock(&scan_cache_mutex, K_FOREVER);
+
+	entry = scan_cache_find(kind, addr);
+	if (entry == NULL || scan_cache_is_stale(entry, now)) {
+		if (entry == NULL) {
+			entry = scan_cache_slot_for_insert(kind, addr, now);
+		}
+		bt_addr_le_copy(&entry->addr, addr);
+		entry->kind = kind;
+		report = true;
+	} else {
+		report = entry->ad_hash != ad_hash ||
+			 abs(entry->rssi - rssi) > CONFIG_SCAN_CACHE_RSSI_DELTA;
+	}
+
+	if (report) {
+		entry->rssi = rssi;
+		entry->ad_hash = ad_hash;
+	}
+	entry->last_seen = now;
+
+	k_mutex_unlock(&scan_cache_mutex);
+
+	return report;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __SCAN_CACHE_H__
+#define __SCAN_CACHE_H__
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/addr.h>
+
+/* Kind under which the scan responses of an advertiser are cached, apart from its advertising */
+#define SCAN_CACHE_SCAN_RSP(kind) ((uint8_t)((kind) | 0x40))
+
+/**
+ * @brief Forget all cached advertisers
+ *
+ * Every advertiser seen after this call is reported again.
+ */
+void scan_cache_reset(void);
+
+/**
+ * @brief Forget a single cached advertiser
+ *
+ * @param kind  Report kind (event sub type) the entry was cached for
+ * @param addr  Address of the advertiser
+ */
+void scan_cache_remove(uint8_t kind, const bt_addr_le_t *addr);
+
+/**
+ * @brief Check whether an advertiser has been reported and not aged out
+ *
+ * @param kind  Report kind (event sub type)
+ * @param addr  Address of the advertiser
+ */
+bool scan_cache_contains(uint8_t kind, const bt_addr_le_t *addr);
+
+/**
+ * @brief Check whether a scan report should be forwarded to the host
+ *
+ * A report is forwarded when the advertiser is new (or aged out), when its
+ * advertising data changed, or when its RSSI moved by more than
+ * CONFIG_SCAN_CACHE_RSSI_DELTA since it was last forwarded.
+ *
+ * @param kind    Report kind (event sub type), cached separately per address
+ * @param addr    Address of the advertiser
+ * @param rssi    RSSI of this report
+ * @param ad      Advertising data of this report
+ * @param ad_len  Length of the advertising data
+ *
+ * @return true if the report should be forwarded
+ */
+bool scan_cache_should_report(uint8_t kind, const bt_addr_le_t *addr, int8_t rssi,
+			      const uint8_t *ad, uint16_t ad_len);
+
+#endif /* __SCAN_CACHE_H__ */
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+
+#include "broadcast_assistant.h"
+#include "scan_ad.h"
+#include "scan_filter.h"
+#include "scan_sched.h"
+
+LOG_MODULE_REGISTER(scan_filter, LOG_LEVEL_INF);
+
+struct scan_filter_name {
+	uint8_t len;
+	char prefix[MESSAGE_EVT_NAME_MAX_LEN];
+};
+
+struct scan_filter_ids {
+	uint8_t cnt;
+	uint32_t ids[CONFIG_SCAN_FILTER_BROADCAST_IDS];
+};
+
+struct scan_filter_addrs {
+	uint8_t cnt;
+	bt_addr_le_t addrs[CONFIG_SCAN_FILTER_ADDRS];
+};
+
+struct scan_filter_rules {
+	bool active; /* Any rule installed */
+	bool has_rssi_min;
+	int8_t rssi_min;
+	uint8_t services;
+	uint8_t names_cnt;
+	struct scan_filter_name names[CONFIG_SCAN_FILTER_NAMES];
+	struct scan_filter_ids id_allow;
+	struct scan_filter_ids id_deny;
+	struct scan_filter_addrs addr_allow;
+	struct scan_filter_addrs addr_deny;
+};
+
+static struct scan_filter_rules scan_filter;
+static K_MUTEX_DEFINE(scan_filter_mutex);
+
+static int scan_filter_add_id(struct scan_filter_ids *list, const uint8_t *data, uint8_t len)
+{
+	if (len != 3) {
+		return -EINVAL;
+	}
+
+	if (list->cnt == ARRAY_SIZE(list->ids)) {
+		return -ENOMEM;
+	}
+
+	list->ids[list->cnt++] = sys_get_le24(data);
+
+	return 0;
+}
+
+static int scan_filter_add_addr(struct scan_filter_addrs *list, const uint8_t *data, uint8_t len)
+{
+	bt_addr_le_t *addr;
+
+	if (len != BT_ADDR_LE_SIZE) {
+		return -EINVAL;
+	}
+
+	if (list->cnt == ARRAY_SIZE(list->addrs)) {
+		return -ENOMEM;
+	}
+
+	addr = &list->addrs[list->cnt++];
+	addr->type = data[0];
+	memcpy(&addr->a, &data[1], sizeof(bt_addr_t));
+
+	return 0;
+}
+
+static int scan_filter_add(struct scan_filter_rules *set, const struct bt_data *rule)
+{
+	const uint8_t *value;
+	uint8_t len;
+
+	if (rule->data_len < 1) {
+		return -EINVAL;
+	}
+
+	value = &rule->data[1];
+	len = rule->data_len - 1;
+
+	switch (rule->data[0]) {
+	case SCAN_FILTER_RSSI_MIN:
+		if (len != 1) {
+			return -EINVAL;
+		}
+		set->has_rssi_min = true;
+		set->rssi_min = (int8_t)value[0];
+		return 0;
+	case SCAN_FILTER_NAME_PREFIX:
+		if (len == 0 || len > MESSAGE_EVT_NAME_MAX_LEN) {
+			return -EINVAL;
+		}
+		if (set->names_cnt == ARRAY_SIZE(set->names)) {
+			return -ENOMEM;
+		}
+		set->names[set->names_cnt].len = len;
+		memcpy(set->names[set->names_cnt].prefix, value, len);
+		set->names_cnt++;
+		return 0;
+	case SCAN_FILTER_BROADCAST_ID_ALLOW:
+		return scan_filter_add_id(&set->id_allow, value, len);
+	case SCAN_FILTER_BROADCAST_ID_DENY:
+		return scan_filter_add_id(&set->id_deny, value, len);
+	case SCAN_FILTER_ADDR_ALLOW:
+		return scan_filter_add_addr(&set->addr_allow, value, len);
+	case SCAN_FILTER_ADDR_DENY:
+		return scan_filter_add_addr(&set->addr_deny, value, len);
+	case SCAN_FILTER_SERVICES:
+		if (len != 1 ||
+		    (value[0] & ~(SCAN_FILTER_HAS_BASS | SCAN_FILTER_HAS_PACS | SCAN_FILTER_HAS_CSIS))) {
+			return -EINVAL;
+		}
+		set->services = value[0];
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static bool scan_filter_has_id(const struct scan_filter_ids *list, uint32_t id)
+{
+	for (int i = 0; i < list->cnt; i++) {
+		if (list->ids[i] == id) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool scan_filter_has_addr(const struct scan_filter_addrs *list, const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < list->cnt; i++) {
+		if (bt_addr_le_eq(&list->addrs[i], addr)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool scan_filter_has_prefix(const struct scan_filter_rules *set, const char *name)
+{
+	if (name[0] == '\0') {
+		return false;
+	}
+
+	for (int i = 0; i < set->names_cnt; i++) {
+		if (strncmp(name, set->names[i].prefix, set->names[i].len) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool scan_filter_names_match(const struct scan_filter_rules *set,
+				    const struct scan_ad_info *ad_info)
+{
+	if (ad_info->bt_name[0] == '\0' && ad_info->broadcast_name[0] == '\0') {
+		/* Not known from this report */
+		return true;
+	}
+
+	return scan_filter_has_prefix(set, ad_info->bt_name) ||
+	       scan_filter_has_prefix(set, ad_info->broadcast_name);
+}
+
+static uint8_t scan_filter_services_of(const struct scan_ad_info *ad_info)
+{
+	return (ad_info->has_bass ? SCAN_FILTER_HAS_BASS : 0) |
+	       (ad_info->has_pacs ? SCAN_FILTER_HAS_PACS : 0) |
+	       (ad_info->has_csis ? SCAN_FILTER_HAS_CSIS : 0);
+}
+
+/* Called with scan_filter_mutex held */
+static bool scan_filter_match_locked(enum scan_filter_target target,
+				     const struct bt_le_scan_recv_info *info,
+				     const struct scan_ad_info *ad_info)
+{
+	const struct scan_filter_rules *set = &scan_filter;
+
+	if (set->has_rssi_min && info->rssi < set->rssi_min) {
+		return false;
+	}
+
+	if (set->addr_allow.cnt > 0 && !scan_filter_has_addr(&set->addr_allow, info->addr)) {
+		return false;
+	}
+
+	if (scan_filter_has_addr(&set->addr_deny, info->addr)) {
+		return false;
+	}
+
+	if (set->names_cnt > 0 && !scan_filter_names_match(set, ad_info)) {
+		return false;
+	}
+
+	if (target == SCAN_FILTER_SOURCE) {
+		if (set->id_allow.cnt > 0 &&
+		    !scan_filter_has_id(&set->id_allow, ad_info->broadcast_id)) {
+			return false;
+		}
+
+		if (scan_filter_has_id(&set->id_deny, ad_info->broadcast_id)) {
+			return false;
+		}
+	} else if (target == SCAN_FILTER_SINK &&
+		   (scan_filter_services_of(ad_info) & set->services) != set->services) {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Public functions
+ */
+int scan_filter_set(const struct bt_data *rules, size_t count)
+{
+	struct scan_filter_rules set;
+	int err;
+
+	memset(&set, 0, sizeof(set));
+
+	for (size_t i = 0; i < count; i++) {
+		err = scan_filter_add(&set, &rules[i]);
+		if (err) {
+			LOG_WRN("Scan filter rule %zu rejected (err %d)", i, err);
+			return err;
+		}
+	}
+
+	set.active = count > 0;
+
+	k_mutex_lock(&scan_filter_mutex, K_FOREVER);
+	scan_filter = set;
+	k_mutex_unlock(&scan_filter_mutex);
+
+	LOG_INF("Scan filter set (%zu rules)", count);
+
+	/* Reports of other advertisers do not even reach the host stack */
+	err = scan_sched_set_accept_list(set.addr_allow.addrs, set.addr_allow.cnt);
+	if (err && err != -ENOTSUP) {
+		LOG_WRN("Filter Accept List not used (err %d)", err);
+	}
+
+	return 0;
+}
+
+bool scan_filter_match(enum scan_filter_target target, const struct bt_le_scan_recv_info *info,
+		       const struct scan_ad_info *ad_info)
+{
+	bool match;
+
+	if (!scan_filter.active) {
+		return true;
+	}
+
+	k_mutex_lock(&scan_filter_mutex, K_FOREVER);
+	match = scan_filter_match_locked(target, info, ad_info);
+	k_mutex_unlock(&scan_filter_mutex);
+
+	return match;
+}
+
+bool scan_filter_needs_services(void)
+{
+	return (scan_filter.services & (SCAN_FILTER_HAS_PACS | SCAN_FILTER_HAS_CSIS)) != 0;
+}
+
+void scan_filter_reset(void)
+{
+	(void)scan_filter_set(NULL, 0);
+}
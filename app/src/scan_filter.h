@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __SCAN_FILTER_H__
+#define __SCAN_FILTER_H__
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/bluetooth.h>
+
+#include "scan_ad.h"
+
+/* Rule kinds of BT_DATA_SCAN_FILTER, [kind][value] */
+enum scan_filter_kind {
+	SCAN_FILTER_RSSI_MIN = 0x01,           /* int8, weaker reports are dropped */
+	SCAN_FILTER_NAME_PREFIX = 0x02,        /* utf8, the name must start with one of them */
+	SCAN_FILTER_BROADCAST_ID_ALLOW = 0x03, /* le24, sources */
+	SCAN_FILTER_BROADCAST_ID_DENY = 0x04,  /* le24, sources */
+	SCAN_FILTER_ADDR_ALLOW = 0x05,         /* [type][addr] */
+	SCAN_FILTER_ADDR_DENY = 0x06,          /* [type][addr] */
+	SCAN_FILTER_SERVICES = 0x07,           /* uint8 SCAN_FILTER_HAS_* all required, sinks */
+};
+
+enum {
+	SCAN_FILTER_HAS_BASS = BIT(0),
+	SCAN_FILTER_HAS_PACS = BIT(1),
+	SCAN_FILTER_HAS_CSIS = BIT(2),
+};
+
+enum scan_filter_target {
+	SCAN_FILTER_SINK,
+	SCAN_FILTER_SINK_SCAN_RSP, /* Scan response of a reported sink, without its services */
+	SCAN_FILTER_SOURCE,
+};
+
+/* Most rules a filter set can hold */
+#define SCAN_FILTER_MAX_RULES                                                                      \
+	(2 + CONFIG_SCAN_FILTER_NAMES + 2 * CONFIG_SCAN_FILTER_BROADCAST_IDS +                     \
+	 2 * CONFIG_SCAN_FILTER_ADDRS)
+
+/**
+ * @brief Install a filter set, replacing the current one
+ *
+ * Reports are forwarded only if they pass every rule kind given. Rules of
+ * the same kind are alternatives (e.g. any name prefix may match). Without
+ * rules all reports are forwarded. An address allowlist is also loaded into
+ * the controller's Filter Accept List, see scan_sched_set_accept_list().
+ *
+ * @param rules  BT_DATA_SCAN_FILTER values
+ * @param count  Number of rules
+ *
+ * @return 0 on success, -EINVAL for a malformed rule, -ENOMEM if a list is full
+ */
+int scan_filter_set(const struct bt_data *rules, size_t count);
+
+/**
+ * @brief Check a classified scan report against the filter set
+ *
+ * A report that carries no name is not dropped by the name prefixes, sinks
+ * may only have it in their scan response.
+ *
+ * @return true if the report should be forwarded
+ */
+bool scan_filter_match(enum scan_filter_target target, const struct bt_le_scan_recv_info *info,
+		       const struct scan_ad_info *ad_info);
+
+/**
+ * @brief Check whether the filter needs has_pacs and has_csis of every report
+ *
+ * @return true if reports are to be classified with SCAN_AD_ALL_SERVICES
+ */
+bool scan_filter_needs_services(void);
+
+void scan_filter_reset(void);
+
+#endif /* __SCAN_FILTER_H__ */
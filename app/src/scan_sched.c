@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gap.h>
+
+#include "broadcast_assistant.h"
+#include "scan_sched.h"
+
+LOG_MODULE_REGISTER(scan_sched, LOG_LEVEL_INF);
+
+#define SCAN_SCHED_INTERVAL_MIN 0x0004
+#define SCAN_SCHED_INTERVAL_MAX 0x4000
+
+/*
+ * Sinks are scanned actively to get their names from scan responses. Sources
+ * must be seen while they are still advertising to be PA synced, so they are
+ * scanned at a higher duty cycle, and passively as their names are in the
+ * extended advertising data.
+ */
+static const struct scan_sched_params scan_sched_defaults[SCAN_SCHED_TARGET_COUNT] = {
+	[SCAN_SCHED_SINK] = {
+		.flags = SCAN_SCHED_ACTIVE,
+		.fast_interval = BT_GAP_SCAN_FAST_INTERVAL,
+		.fast_window = BT_GAP_SCAN_FAST_INTERVAL,
+		.fast_duration_ms = 5000,
+		.interval = 0x0100, /* 160 ms */
+		.window = BT_GAP_SCAN_FAST_WINDOW,
+	},
+	[SCAN_SCHED_SOURCE] = {
+		.flags = 0,
+		.fast_interval = BT_GAP_SCAN_FAST_INTERVAL,
+		.fast_window = BT_GAP_SCAN_FAST_INTERVAL,
+		.fast_duration_ms = 5000,
+		.interval = BT_GAP_SCAN_FAST_INTERVAL,
+		.window = BT_GAP_SCAN_FAST_WINDOW,
+	},
+};
+
+static struct scan_sched_params scan_sched_params[SCAN_SCHED_TARGET_COUNT];
+static uint8_t scan_sched_modes;
+static bool scan_sched_fast;
+static bool scan_sched_paused;
+static bool scan_sched_running;
+static bool scan_sched_accept_list;
+static struct bt_le_scan_param scan_sched_current;
+static K_MUTEX_DEFINE(scan_sched_mutex);
+
+static void scan_sched_phase_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(scan_sched_phase_work, scan_sched_phase_handler);
+
+static uint8_t scan_sched_targets(uint8_t modes)
+{
+	uint8_t targets = 0;
+
+	if (modes & (BROADCAST_ASSISTANT_SCAN_SINK | BROADCAST_ASSISTANT_SCAN_CSIS)) {
+		targets |= BIT(SCAN_SCHED_SINK);
+	}
+	if (modes & BROADCAST_ASSISTANT_SCAN_SOURCE) {
+		targets |= BIT(SCAN_SCHED_SOURCE);
+	}
+
+	return targets;
+}
+
+static void scan_sched_build(struct bt_le_scan_param *param)
+{
+	const uint8_t targets = scan_sched_targets(scan_sched_modes);
+	uint8_t flags = 0;
+	uint16_t interval = SCAN_SCHED_INTERVAL_MAX;
+	uint16_t window = 0;
+
+	for (int i = 0; i < SCAN_SCHED_TARGET_COUNT; i++) {
+		const struct scan_sched_params *p = &scan_sched_params[i];
+
+		if (!(targets & BIT(i))) {
+			continue;
+		}
+
+		flags |= p->flags;
+		interval = MIN(interval, scan_sched_fast ? p->fast_interval : p->interval);
+		window = MAX(window, scan_sched_fast ? p->fast_window : p->window);
+	}
+
+	memset(param, 0, sizeof(*param));
+	param->type = (flags & SCAN_SCHED_ACTIVE) ? BT_LE_SCAN_TYPE_ACTIVE : BT_LE_SCAN_TYPE_PASSIVE;
+	param->options = BT_LE_SCAN_OPT_NONE;
+	param->interval = interval;
+	param->window = MIN(window, interval);
+
+	if (scan_sched_accept_list && !(scan_sched_modes & BROADCAST_ASSISTANT_SCAN_CSIS)) {
+		param->options |= BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST;
+	}
+
+	if (flags & SCAN_SCHED_CODED) {
+		param->options |= BT_LE_SCAN_OPT_CODED;
+		param->interval_coded = param->interval;
+		param->window_coded = param->window;
+	}
+}
+
+/* Called with scan_sched_mutex held */
+static int scan_sched_apply(void)
+{
+	struct bt_le_scan_param param;
+	int err;
+
+	if (scan_sched_modes == BROADCAST_ASSISTANT_SCAN_IDLE || scan_sched_paused) {
+		return 0;
+	}
+
+	scan_sched_build(&param);
+	if (scan_sched_running && memcmp(&param, &scan_sched_current, sizeof(param)) == 0) {
+		return 0;
+	}
+
+	if (scan_sched_running) {
+		err = bt_le_scan_stop();
+		if (err && err != -EALREADY) {
+			LOG_ERR("bt_le_scan_stop failed %d", err);
+			return err;
+		}
+		scan_sched_running = false;
+	}
+
+	err = bt_le_scan_start(&param, NULL);
+	if (err) {
+		LOG_ERR("Scanning failed to start (err %d)", err);
+		return err;
+	}
+
+	LOG_INF("Scanning %s, interval 0x%04x, window 0x%04x%s%s",
+		param.type == BT_LE_SCAN_TYPE_ACTIVE ? "active" : "passive", param.interval,
+		param.window, (param.options & BT_LE_SCAN_OPT_CODED) ? ", coded" : "",
+		(param.options & BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST) ? ", accept list" : "");
+
+	scan_sched_current = param;
+	scan_sched_running = true;
+
+	return 0;
+}
+
+static void scan_sched_phase_handler(struct k_work *work)
+{
+	k_mutex_lock(&scan_sched_mutex, K_FOREVER);
+
+	if (scan_sched_fast) {
+		scan_sched_fast = false;
+		(void)scan_sched_apply();
+	}
+
+	k_mutex_unlock(&scan_sched_mutex);
+}
+
+static void scan_sched_count_conn(struct bt_conn *conn, void *data)
+{
+	(*(size_t *)data)++;
+}
+
+static bool scan_sched_params_valid(uint16_t interval, uint16_t window)
+{
+	return interval >= SCAN_SCHED_INTERVAL_MIN && interval <= SCAN_SCHED_INTERVAL_MAX &&
+	       window >= SCAN_SCHED_INTERVAL_MIN && window <= interval;
+}
+
+/*
+ * Public functions
+ */
+int scan_sched_set_modes(uint8_t modes)
+{
+	uint8_t started;
+	int err = 0;
+
+	k_mutex_lock(&scan_sched_mutex, K_FOREVER);
+
+	started = scan_sched_targets(modes) & ~scan_sched_targets(scan_sched_modes);
+	scan_sched_modes = modes;
+	/* A scan asked for by the host is not held back by an earlier pause */
+	scan_sched_paused = false;
+
+	if (modes == BROADCAST_ASSISTANT_SCAN_IDLE) {
+		k_work_cancel_delayable(&scan_sched_phase_work);
+		scan_sched_fast = false;
+
+		if (scan_sched_running) {
+			err = bt_le_scan_stop();
+			if (err && err != -EALREADY) {
+				LOG_ERR("bt_le_scan_stop failed %d", err);
+			} else {
+				err = 0;
+				scan_sched_running = false;
+			}
+		}
+	} else {
+		if (started) {
+			uint16_t duration = 0;
+
+			for (int i = 0; i < SCAN_SCHED_TARGET_COUNT; i++) {
+				if (started & BIT(i)) {
+					duration = MAX(duration, scan_sched_params[i].fast_duration_ms);
+				}
+			}
+
+			if (duration > 0) {
+				scan_sched_fast = true;
+				k_work_reschedule(&scan_sched_phase_work, K_MSEC(duration));
+			}
+		}
+
+		err = scan_sched_apply();
+	}
+
+	k_mutex_unlock(&scan_sched_mutex);
+
+	return err;
+}
+
+int scan_sched_pause(void)
+{
+	int err = 0;
+
+	if (IS_ENABLED(CONFIG_BT_SCAN_AND_INITIATE_IN_PARALLEL)) {
+		/* Scanning continues while the connection is created */
+		return 0;
+	}
+
+	k_mutex_lock(&scan_sched_mutex, K_FOREVER);
+
+	/* Only a scan that was stopped is resumed, without one there is nothing to pause */
+	if (scan_sched_running) {
+		LOG_INF("Pause scanning");
+		err = bt_le_scan_stop();
+		if (err && err != -EALREADY) {
+			LOG_ERR("bt_le_scan_stop failed %d", err);
+		} else {
+			err = 0;
+			scan_sched_running = false;
+			scan_sched_paused = true;
+		}
+	}
+
+	k_mutex_unlock(&scan_sched_mutex);
+
+	return err;
+}
+
+int scan_sched_resume(void)
+{
+	size_t conn_count = 0;
+	int err;
+
+	k_mutex_lock(&scan_sched_mutex, K_FOREVER);
+
+	scan_sched_paused = false;
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, scan_sched_count_conn, &conn_count);
+	if (conn_count > 0 && scan_sched_fast) {
+		/* Leave airtime for the connections */
+		k_work_cancel_delayable(&scan_sched_phase_work);
+		scan_sched_fast = false;
+	}
+
+	err = scan_sched_apply();
+
+	k_mutex_unlock(&scan_sched_mutex);
+
+	return err;
+}
+
+int scan_sched_set_params(enum scan_sched_target target, const struct scan_sched_params *params)
+{
+	int err;
+
+	if (target >= SCAN_SCHED_TARGET_COUNT ||
+	    (params->flags & ~(SCAN_SCHED_ACTIVE | SCAN_SCHED_CODED)) ||
+	    !scan_sched_params_valid(params->fast_interval, params->fast_window) ||
+	    !scan_sched_params_valid(params->interval, params->window)) {
+		return -EINVAL;
+	}
+
+	if ((params->flags & SCAN_SCHED_CODED) && !IS_ENABLED(CONFIG_BT_EXT_ADV)) {
+		return -ENOTSUP;
+	}
+
+	k_mutex_lock(&scan_sched_mutex, K_FOREVER);
+
+	scan_sched_params[target] = *params;
+	err = scan_sched_apply();
+
+	k_mutex_unlock(&scan_sched_mutex);
+
+	LOG_INF("Scan params of target %u set (err %d)", target, err);
+
+	return err;
+}
+
+int scan_sched_set_params_raw(const uint8_t *data, uint8_t len)
+{
+	struct scan_sched_params params;
+
+	if (len != SCAN_SCHED_PARAMS_LEN) {
+		return -EINVAL;
+	}
+
+	params.flags = data[1];
+	params.fast_interval = sys_get_le16(&data[2]);
+	params.fast_window = sys_get_le16(&data[4]);
+	params.fast_duration_ms = sys_get_le16(&data[6]);
+	params.interval = sys_get_le16(&data[8]);
+	params.window = sys_get_le16(&data[10]);
+
+	return scan_sched_set_params(data[0], &params);
+}
+
+void scan_sched_encode(struct net_buf_simple *buf)
+{
+	k_mutex_lock(&scan_sched_mutex, K_FOREVER);
+
+	for (int i = 0; i < SCAN_SCHED_TARGET_COUNT; i++) {
+		const struct scan_sched_params *p = &scan_sched_params[i];
+
+		net_buf_simple_add_u8(buf, SCAN_SCHED_PARAMS_LEN + 1);
+		net_buf_simple_add_u8(buf, BT_DATA_SCAN_PARAMS);
+		net_buf_simple_add_u8(buf, i);
+		net_buf_simple_add_u8(buf, p->flags);
+		net_buf_simple_add_le16(buf, p->fast_interval);
+		net_buf_simple_add_le16(buf, p->fast_window);
+		net_buf_simple_add_le16(buf, p->fast_duration_ms);
+		net_buf_simple_add_le16(buf, p->interval);
+		net_buf_simple_add_le16(buf, p->window);
+	}
+
+	k_mutex_unlock(&scan_sched_mutex);
+}
+
+int scan_sched_set_accept_list(const bt_addr_le_t *addrs, size_t count)
+{
+	int err = 0;
+
+	if (!IS_ENABLED(CONFIG_BT_FILTER_ACCEPT_LIST)) {
+		return count > 0 ? -ENOTSUP : 0;
+	}
+
+	k_mutex_lock(&scan_sched_mutex, K_FOREVER);
+
+	if (!scan_sched_accept_list && count == 0) {
+		k_mutex_unlock(&scan_sched_mutex);
+		return 0;
+	}
+
+	/* The controller does not take changes to the list while it is used */
+	if (scan_sched_running) {
+		err = bt_le_scan_stop();
+		if (err && err != -EALREADY) {
+			LOG_ERR("bt_le_scan_stop failed %d", err);
+			k_mutex_unlock(&scan_sched_mutex);
+			return err;
+		}
+		scan_sched_running = false;
+	}
+
+	scan_sched_accept_list = false;
+
+	err = bt_le_filter_accept_list_clear();
+	for (size_t i = 0; i < count && !err; i++) {
+		err = bt_le_filter_accept_list_add(&addrs[i]);
+	}
+
+	if (err) {
+		/* Scan for all, the reports are still filtered by the host */
+		LOG_ERR("Failed to load Filter Accept List (err %d)", err);
+		(void)bt_le_filter_accept_list_clear();
+	} else {
+		scan_sched_accept_list = count > 0;
+	}
+
+	(void)scan_sched_apply();
+
+	k_mutex_unlock(&scan_sched_mutex);
+
+	return err;
+}
+
+void scan_sched_reset_params(void)
+{
+	k_mutex_lock(&scan_sched_mutex, K_FOREVER);
+
+	memcpy(scan_sched_params, scan_sched_defaults, sizeof(scan_sched_params));
+	scan_sched_paused = false;
+	(void)scan_sched_apply();
+
+	k_mutex_unlock(&scan_sched_mutex);
+}
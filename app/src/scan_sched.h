@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __SCAN_SCHED_H__
+#define __SCAN_SCHED_H__
+
+#include <zephyr/types.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/bluetooth/addr.h>
+
+/* Scan parameters are kept apart for sinks (and set members) and sources */
+enum scan_sched_target {
+	SCAN_SCHED_SINK = 0x00,
+	SCAN_SCHED_SOURCE = 0x01,
+
+	SCAN_SCHED_TARGET_COUNT,
+};
+
+enum {
+	SCAN_SCHED_ACTIVE = BIT(0), /* Request scan responses */
+	SCAN_SCHED_CODED = BIT(1),  /* Scan on the coded PHY as well as 1M */
+};
+
+/* Intervals and windows in 0.625 ms units */
+struct scan_sched_params {
+	uint8_t flags;
+	uint16_t fast_interval;
+	uint16_t fast_window;
+	uint16_t fast_duration_ms; /* Burst at the fast duty cycle when a scan mode starts */
+	uint16_t interval;
+	uint16_t window;
+};
+
+/* [target][flags][le16 fast_interval][le16 fast_window][le16 fast_duration_ms]
+ * [le16 interval][le16 window]
+ */
+#define SCAN_SCHED_PARAMS_LEN 12
+/* [len][type][params] per target */
+#define SCAN_SCHED_LTV_LEN (SCAN_SCHED_TARGET_COUNT * (2 + SCAN_SCHED_PARAMS_LEN))
+
+/**
+ * @brief Set the scan modes being scanned for
+ *
+ * Each BROADCAST_ASSISTANT_SCAN_* mode uses the parameters of its target, a
+ * mix of modes scans with the highest duty cycle of them and actively if any
+ * of them is active. A mode not scanned for before starts a fast burst. The
+ * scan is only restarted when the resulting parameters change.
+ *
+ * @param modes  BROADCAST_ASSISTANT_SCAN_* bits, 0 stops scanning
+ *
+ * @return 0 on success, or the error of bt_le_scan_start()
+ */
+int scan_sched_set_modes(uint8_t modes);
+
+/**
+ * @brief Suspend scanning while a connection is created
+ *
+ * The scan modes are kept. Does nothing if the controller can scan and
+ * initiate at the same time.
+ */
+int scan_sched_pause(void);
+
+/**
+ * @brief Resume scanning after scan_sched_pause()
+ *
+ * While sinks are connected the scan resumes at the low duty cycle, leaving
+ * airtime for the connections.
+ *
+ * @return 0 on success, or the error of bt_le_scan_start()
+ */
+int scan_sched_resume(void);
+
+/**
+ * @brief Set the parameters of a target, applied at once if scanning
+ *
+ * @return 0 on success, -EINVAL for invalid parameters, -ENOTSUP for coded
+ *         PHY without extended advertising support
+ */
+int scan_sched_set_params(enum scan_sched_target target, const struct scan_sched_params *params);
+
+/**
+ * @brief Decode and set parameters in the BT_DATA_SCAN_PARAMS format
+ */
+int scan_sched_set_params_raw(const uint8_t *data, uint8_t len);
+
+/**
+ * @brief Append the parameters of all targets as BT_DATA_SCAN_PARAMS LTVs
+ *
+ * @param buf  Buffer with at least SCAN_SCHED_LTV_LEN bytes tailroom
+ */
+void scan_sched_encode(struct net_buf_simple *buf);
+
+/**
+ * @brief Only scan for the given advertisers, using the Filter Accept List
+ *
+ * The scan is restarted to load the list into the controller. The list is
+ * not used while scanning for set members, as they advertise with RPAs.
+ *
+ * @param addrs  Advertisers to scan for
+ * @param count  Number of advertisers, 0 scans for all
+ *
+ * @return 0 on success, -ENOTSUP without CONFIG_BT_FILTER_ACCEPT_LIST, or the
+ *         error of the controller
+ */
+int scan_sched_set_accept_list(const bt_addr_le_t *addrs, size_t count);
+
+/**
+ * @brief Restore the default parameters, for RESET
+ *
+ * Also clears a pause left by scan_sched_pause().
+ */
+void scan_sched_reset_params(void);
+
+#endif /* __SCAN_SCHED_H__ */
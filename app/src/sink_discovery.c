@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include "sink_discovery.h"
+
+LOG_MODULE_REGISTER(sink_discovery, LOG_LEVEL_INF);
+
+/* Retry of busy steps when no other step is pending to trigger it */
+#define SINK_DISCOVERY_RETRY_MS 100
+
+struct sink_discovery_sink {
+	struct bt_conn *conn;
+	uint8_t queued;  /* Steps not issued yet (or the stack was busy) */
+	uint8_t pending; /* Steps issued, waiting for their callback */
+	uint32_t start;
+};
+
+static const struct sink_discovery_cb *discovery_cb;
+static struct sink_discovery_sink sinks[CONFIG_BT_MAX_CONN];
+static K_MUTEX_DEFINE(sink_discovery_mutex);
+
+static void sink_discovery_retry_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(sink_discovery_retry_work, sink_discovery_retry_handler);
+
+static void sink_discovery_set_param(struct bt_conn *conn, const struct bt_le_conn_param *param)
+{
+	int err;
+
+	err = bt_conn_le_param_update(conn, param);
+	if (err && err != -EALREADY) {
+		LOG_WRN("Failed to update conn params of %p (err %d)", (void *)conn, err);
+	}
+}
+
+static void sink_discovery_release(struct sink_discovery_sink *sink)
+{
+	bt_conn_unref(sink->conn);
+	memset(sink, 0, sizeof(*sink));
+}
+
+static void sink_discovery_finish_if_done(struct sink_discovery_sink *sink)
+{
+	if (sink->queued || sink->pending) {
+		return;
+	}
+
+	LOG_INF("Discovery of %p done in %u ms", (void *)sink->conn,
+		k_cyc_to_ms_floor32(k_cycle_get_32() - sink->start));
+
+	sink_discovery_set_param(sink->conn, SINK_CONN_PARAM);
+	sink_discovery_release(sink);
+}
+
+static void sink_discovery_issue_queued(void)
+{
+	bool pending = false;
+	bool busy = false;
+
+	for (int i = 0; i < ARRAY_SIZE(sinks); i++) {
+		struct sink_discovery_sink *sink = &sinks[i];
+
+		if (!sink->conn) {
+			continue;
+		}
+
+		for (int step = 0; step < SINK_DISCOVERY_STEP_COUNT; step++) {
+			int err;
+
+			if (!(sink->queued & BIT(step))) {
+				continue;
+			}
+
+			err = discovery_cb->issue(sink->conn, step);
+			if (err == -EBUSY || err == -ENOMEM) {
+				/* Retried when another step completes */
+				busy = true;
+				continue;
+			}
+
+			sink->queued &= ~BIT(step);
+			if (err) {
+				LOG_ERR("Failed to issue step %d to %p (err %d)", step,
+					(void *)sink->conn, err);
+			} else {
+				sink->pending |= BIT(step);
+			}
+		}
+
+		if (sink->pending) {
+			pending = true;
+		}
+
+		sink_discovery_finish_if_done(sink);
+	}
+
+	if (busy && !pending) {
+		k_work_reschedule(&sink_discovery_retry_work, K_MSEC(SINK_DISCOVERY_RETRY_MS));
+	}
+}
+
+static void sink_discovery_retry_handler(struct k_work *work)
+{
+	k_mutex_lock(&sink_discovery_mutex, K_FOREVER);
+	sink_discovery_issue_queued();
+	k_mutex_unlock(&sink_discovery_mutex);
+}
+
+static struct sink_discovery_sink *sink_discovery_find(struct bt_conn *conn)
+{
+	struct sink_discovery_sink *sink = &sinks[bt_conn_index(conn)];
+
+	return sink->conn == conn ? sink : NULL;
+}
+
+/*
+ * Public functions
+ */
+void sink_discovery_register_cb(const struct sink_discovery_cb *cb)
+{
+	discovery_cb = cb;
+}
+
+void sink_discovery_start(struct bt_conn *conn, uint8_t steps)
+{
+	struct sink_discovery_sink *sink = &sinks[bt_conn_index(conn)];
+
+	k_mutex_lock(&sink_discovery_mutex, K_FOREVER);
+
+	if (sink->conn) {
+		/* Security changed again (e.g. re-encryption), start over */
+		sink_discovery_release(sink);
+	}
+
+	sink->conn = bt_conn_ref(conn);
+	sink->queued = steps;
+	sink->start = k_cycle_get_32();
+
+	LOG_INF("Discover %p (steps 0x%02x)", (void *)conn, steps);
+	sink_discovery_set_param(conn, SINK_DISCOVERY_CONN_PARAM);
+	sink_discovery_issue_queued();
+
+	k_mutex_unlock(&sink_discovery_mutex);
+}
+
+void sink_discovery_done(struct bt_conn *conn, enum sink_discovery_step step)
+{
+	struct sink_discovery_sink *sink;
+
+	k_mutex_lock(&sink_discovery_mutex, K_FOREVER);
+
+	sink = sink_discovery_find(conn);
+	if (sink) {
+		sink->pending &= ~BIT(step);
+		sink_discovery_finish_if_done(sink);
+	}
+
+	/* The stack may have been busy with this step */
+	sink_discovery_issue_queued();
+
+	k_mutex_unlock(&sink_discovery_mutex);
+}
+
+void sink_discovery_stop(struct bt_conn *conn)
+{
+	struct sink_discovery_sink *sink;
+
+	k_mutex_lock(&sink_discovery_mutex, K_FOREVER);
+
+	sink = sink_discovery_find(conn);
+	if (sink) {
+		sink_discovery_release(sink);
+	}
+
+	k_mutex_unlock(&sink_discovery_mutex);
+}
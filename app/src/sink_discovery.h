@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __SINK_DISCOVERY_H__
+#define __SINK_DISCOVERY_H__
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
+
+enum sink_discovery_step {
+	SINK_DISCOVERY_BASS,
+	SINK_DISCOVERY_VCS,
+	SINK_DISCOVERY_CSIS,
+
+	SINK_DISCOVERY_STEP_COUNT,
+};
+
+/* Short interval while discovering, until all steps have completed */
+#define SINK_DISCOVERY_CONN_PARAM                                                                  \
+	BT_LE_CONN_PARAM(CONFIG_DISCOVERY_CONN_INTERVAL, CONFIG_DISCOVERY_CONN_INTERVAL, 0, 800)
+#define SINK_CONN_PARAM BT_LE_CONN_PARAM(CONFIG_SINK_CONN_INTERVAL, CONFIG_SINK_CONN_INTERVAL, 0, 800)
+
+struct sink_discovery_cb {
+	/*
+	 * Starts discovering a service. -EBUSY or -ENOMEM retries the step when
+	 * another step completes, any other error abandons it and the caller is
+	 * expected to have handled it.
+	 */
+	int (*issue)(struct bt_conn *conn, enum sink_discovery_step step);
+};
+
+void sink_discovery_register_cb(const struct sink_discovery_cb *cb);
+
+/**
+ * @brief Start discovering a connected sink
+ *
+ * All steps are issued at once, and run in parallel on the sink as far as its
+ * ATT bearer allows. Sinks are discovered independently of each other. The
+ * connection is kept at SINK_DISCOVERY_CONN_PARAM until the last step has
+ * completed, and then relaxed to SINK_CONN_PARAM.
+ *
+ * @param conn   Connection of the sink
+ * @param steps  BIT(SINK_DISCOVERY_*) mask of the steps to run
+ */
+void sink_discovery_start(struct bt_conn *conn, uint8_t steps);
+
+/**
+ * @brief Report that a step has completed, successfully or not
+ *
+ * @param conn  Connection of the sink
+ * @param step  The step
+ */
+void sink_discovery_done(struct bt_conn *conn, enum sink_discovery_step step);
+
+/**
+ * @brief Abandon the discovery of a sink that disconnected
+ *
+ * @param conn  Connection of the sink
+ */
+void sink_discovery_stop(struct bt_conn *conn);
+
+#endif /* __SINK_DISCOVERY_H__ */
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include "broadcast_assistant.h"
+#include "message.h"
+#include "message_evt.h"
+#include "sink_op.h"
+
+LOG_MODULE_REGISTER(sink_op, LOG_LEVEL_INF);
+
+static K_MUTEX_DEFINE(sink_op_mutex);
+
+/* The RES carries the status of every sink, whatever TX class it takes */
+BUILD_ASSERT(MESSAGE_EVT_FIELD_ERR + CONFIG_BT_MAX_CONN * MESSAGE_EVT_FIELD_SINK_STATUS <=
+		     CONFIG_TX_MSG_MAX_PAYLOAD_LEN,
+	     "Sink status LTVs do not fit a full size TX buffer");
+
+static void sink_op_release(struct sink_op *op)
+{
+	for (int i = 0; i < ARRAY_SIZE(op->sinks); i++) {
+		if (op->sinks[i].conn) {
+			bt_conn_unref(op->sinks[i].conn);
+		}
+	}
+
+	memset(op->sinks, 0, sizeof(op->sinks));
+	op->active = false;
+}
+
+static struct sink_op_sink *sink_op_find(struct sink_op *op, struct bt_conn *conn)
+{
+	for (int i = 0; i < ARRAY_SIZE(op->sinks); i++) {
+		if (op->sinks[i].conn == conn) {
+			return &op->sinks[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Called with sink_op_mutex held. issue() writes to the sink, so it is called
+ * unlocked, the responses of other sinks are not held up behind it.
+ */
+static void sink_op_issue_queued(struct sink_op *op)
+{
+	bool tried[CONFIG_BT_MAX_CONN] = {0};
+	bool in_flight = false;
+
+	for (;;) {
+		struct sink_op_sink *sink = NULL;
+		struct bt_conn *conn;
+		uint8_t gen = op->gen;
+		int err;
+
+		for (int i = 0; i < ARRAY_SIZE(op->sinks); i++) {
+			if (op->sinks[i].state == SINK_OP_QUEUED && !tried[i]) {
+				tried[i] = true;
+				sink = &op->sinks[i];
+				break;
+			}
+		}
+
+		if (sink == NULL) {
+			break;
+		}
+
+		/* The operation may be restarted meanwhile, releasing its references */
+		conn = bt_conn_ref(sink->conn);
+		sink->state = SINK_OP_ISSUING;
+
+		k_mutex_unlock(&sink_op_mutex);
+		err = op->issue(conn);
+		k_mutex_lock(&sink_op_mutex, K_FOREVER);
+
+		if (op->gen != gen) {
+			/* Restarted, the new run issues its own sinks */
+			bt_conn_unref(conn);
+			return;
+		}
+
+		if (sink->state != SINK_OP_ISSUING) {
+			/* Responded or disconnected already */
+		} else if (err == -EBUSY) {
+			/* Stack busy with another sink, retried when that one completes */
+			sink->state = SINK_OP_QUEUED;
+		} else if (err) {
+			LOG_ERR("Failed to issue 0x%02x to %p (err %d)", op->sub_type, (void *)conn,
+				err);
+			sink->state = SINK_OP_DONE;
+			sink->err = err;
+		} else {
+			sink->state = SINK_OP_PENDING;
+		}
+
+		bt_conn_unref(conn);
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(op->sinks); i++) {
+		if (op->sinks[i].state == SINK_OP_PENDING || op->sinks[i].state == SINK_OP_ISSUING) {
+			in_flight = true;
+		}
+	}
+
+	if (in_flight) {
+		return;
+	}
+
+	/* Nothing in flight that could unblock the remaining sinks */
+	for (int i = 0; i < ARRAY_SIZE(op->sinks); i++) {
+		if (op->sinks[i].state == SINK_OP_QUEUED) {
+			op->sinks[i].state = SINK_OP_DONE;
+			op->sinks[i].err = -EBUSY;
+		}
+	}
+}
+
+/* Returns the length of the status LTVs if the operation completed, otherwise -EAGAIN */
+static int sink_op_check_complete(struct sink_op *op, uint8_t *ltv, int32_t *rc)
+{
+	int len = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(op->sinks); i++) {
+		if (op->sinks[i].state == SINK_OP_QUEUED || op->sinks[i].state == SINK_OP_ISSUING ||
+		    op->sinks[i].state == SINK_OP_PENDING) {
+			return -EAGAIN;
+		}
+	}
+
+	*rc = 0;
+	for (int i = 0; i < ARRAY_SIZE(op->sinks); i++) {
+		const struct sink_op_sink *sink = &op->sinks[i];
+		const bt_addr_le_t *addr;
+
+		if (sink->state != SINK_OP_DONE) {
+			continue;
+		}
+
+		if (*rc == 0) {
+			*rc = sink->err;
+		}
+
+		addr = bt_conn_get_dst(sink->conn);
+		ltv[len++] = MESSAGE_EVT_FIELD_SINK_STATUS - 1;
+		ltv[len++] = BT_DATA_SINK_STATUS;
+		ltv[len++] = addr->type;
+		memcpy(&ltv[len], &addr->a, sizeof(bt_addr_t));
+		len += sizeof(bt_addr_t);
+		sys_put_le32(sink->err, &ltv[len]);
+		len += sizeof(int32_t);
+	}
+
+	sink_op_release(op);
+
+	return len;
+}
+
+static void sink_op_update_and_unlock(struct sink_op *op)
+{
+	uint8_t ltv[CONFIG_BT_MAX_CONN * MESSAGE_EVT_FIELD_SINK_STATUS];
+	int32_t rc;
+	int len;
+	uint8_t gen = op->gen;
+
+	sink_op_issue_queued(op);
+	if (op->gen != gen) {
+		k_mutex_unlock(&sink_op_mutex);
+		return;
+	}
+	len = sink_op_check_complete(op, ltv, &rc);
+
+	k_mutex_unlock(&sink_op_mutex);
+
+	if (len < 0) {
+		return;
+	}
+
+	LOG_INF("0x%02x completed on all sinks (rc %d)", op->sub_type, rc);
+	if (op->complete) {
+		op->complete(op, rc, ltv, len);
+	} else {
+		message_cmd_complete_ltv(op->sub_type, rc, ltv, len);
+	}
+}
+
+static void sink_op_add_connected(struct bt_conn *conn, void *data)
+{
+	struct sink_op *op = data;
+	struct bt_conn_info info;
+	int err;
+
+	err = bt_conn_get_info(conn, &info);
+	if (err || info.state != BT_CONN_STATE_CONNECTED) {
+		LOG_WRN("Skip conn %p (not connected)", (void *)conn);
+		return;
+	}
+
+	if (op->filter && !op->filter(conn)) {
+		return;
+	}
+
+	op->sinks[bt_conn_index(conn)].conn = bt_conn_ref(conn);
+	op->sinks[bt_conn_index(conn)].state = SINK_OP_QUEUED;
+}
+
+/*
+ * Public functions
+ */
+void sink_op_start(struct sink_op *op)
+{
+	k_mutex_lock(&sink_op_mutex, K_FOREVER);
+
+	if (op->active) {
+		LOG_WRN("Abandoning unfinished 0x%02x", op->sub_type);
+	}
+	sink_op_release(op);
+	op->active = true;
+	op->gen++;
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, sink_op_add_connected, op);
+
+	sink_op_update_and_unlock(op);
+}
+
+void sink_op_done(struct sink_op *op, struct bt_conn *conn, int err)
+{
+	struct sink_op_sink *sink;
+
+	k_mutex_lock(&sink_op_mutex, K_FOREVER);
+
+	sink = op->active ? sink_op_find(op, conn) : NULL;
+	if (sink == NULL || (sink->state != SINK_OP_PENDING && sink->state != SINK_OP_ISSUING)) {
+		/* Late response to an abandoned operation */
+		k_mutex_unlock(&sink_op_mutex);
+		return;
+	}
+
+	sink->state = SINK_OP_DONE;
+	sink->err = err;
+
+	sink_op_update_and_unlock(op);
+}
+
+void sink_op_disconnected(struct sink_op *op, struct bt_conn *conn)
+{
+	struct sink_op_sink *sink;
+
+	k_mutex_lock(&sink_op_mutex, K_FOREVER);
+
+	sink = op->active ? sink_op_find(op, conn) : NULL;
+	if (sink == NULL || sink->state == SINK_OP_DONE) {
+		k_mutex_unlock(&sink_op_mutex);
+		return;
+	}
+
+	sink->state = SINK_OP_DONE;
+	sink->err = -ENOTCONN;
+
+	sink_op_update_and_unlock(op);
+}
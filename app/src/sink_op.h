@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __SINK_OP_H__
+#define __SINK_OP_H__
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include "message.h"
+
+enum sink_op_state {
+	SINK_OP_IDLE,
+	SINK_OP_QUEUED,  /* Not issued yet (or the stack was busy) */
+	SINK_OP_ISSUING, /* issue() running, without sink_op_mutex held */
+	SINK_OP_PENDING, /* Issued, waiting for the sink to respond */
+	SINK_OP_DONE,
+};
+
+struct sink_op_sink {
+	struct bt_conn *conn;
+	enum sink_op_state state;
+	int32_t err;
+};
+
+/*
+ * A command written to all connected sinks at once. The RES is sent when every
+ * sink has responded, carrying a BT_DATA_SINK_STATUS LTV per sink.
+ */
+struct sink_op {
+	enum message_sub_type sub_type;
+	/* Starts the operation on a sink, -EBUSY retries when another sink completes */
+	int (*issue)(struct bt_conn *conn);
+	/* Selects the sinks taking part, all connected sinks when NULL */
+	bool (*filter)(struct bt_conn *conn);
+	/* Called instead of sending the RES when set, e.g. to release a lock first */
+	void (*complete)(struct sink_op *op, int32_t rc, const uint8_t *ltv, uint16_t ltv_len);
+	bool active;
+	uint8_t gen; /* Bumped by sink_op_start(), so an unlocked issue() sees a restart */
+	struct sink_op_sink sinks[CONFIG_BT_MAX_CONN];
+};
+
+/**
+ * @brief Start an operation on all connected sinks
+ *
+ * The operation is issued to every connected sink (that the filter accepts)
+ * without waiting for the others. A previous unfinished run of the same
+ * operation is abandoned.
+ *
+ * @param op  The operation
+ */
+void sink_op_start(struct sink_op *op);
+
+/**
+ * @brief Report that a sink has responded
+ *
+ * @param op    The operation
+ * @param conn  Connection of the sink
+ * @param err   Result reported by the sink
+ */
+void sink_op_done(struct sink_op *op, struct bt_conn *conn, int err);
+
+/**
+ * @brief Abandon a sink that disconnected
+ *
+ * @param op    The operation
+ * @param conn  Connection of the sink
+ */
+void sink_op_disconnected(struct sink_op *op, struct bt_conn *conn);
+
+#endif /* __SINK_OP_H__ */
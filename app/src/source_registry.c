@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/addr.h>
+
+#include "source_registry.h"
+
+LOG_MODULE_REGISTER(source_registry, LOG_LEVEL_INF);
+
+/* Records are kept sorted by address so lookups are a binary search */
+static struct source_record sources[CONFIG_SOURCE_REGISTRY_SIZE];
+static size_t sources_num;
+static K_MUTEX_DEFINE(sources_mutex);
+
+/* Returns the index of addr, or the insertion point encoded as -(index + 1) */
+static int source_registry_search(const bt_addr_le_t *addr)
+{
+	int lo = 0;
+	int hi = (int)sources_num - 1;
+
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+		int cmp = bt_addr_le_cmp(&sources[mid].addr, addr);
+
+		if (cmp == 0) {
+			return mid;
+		} else if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	return -(lo + 1);
+}
+
+static void source_registry_remove_at(size_t idx)
+{
+	memmove(&sources[idx], &sources[idx + 1], (sources_num - idx - 1) * sizeof(sources[0]));
+	sources_num--;
+}
+
+static size_t source_registry_lru_index(uint32_t now)
+{
+	size_t lru = 0;
+
+	for (size_t i = 1; i < sources_num; i++) {
+		if ((now - sources[i].last_seen) > (now - sources[lru].last_seen)) {
+			lru = i;
+		}
+	}
+
+	return lru;
+}
+
+void source_registry_reset(void)
+{
+	k_mutex_lock(&sources_mutex, K_FOREVER);
+	memset(sources, 0, sizeof(sources));
+	sources_num = 0;
+	k_mutex_unlock(&sources_mutex);
+}
+
+void source_registry_update(const bt_addr_le_t *addr, uint8_t sid, uint16_t pa_interval,
+			    uint32_t broadcast_id, const char *broadcast_name,
+			    struct source_record *record)
+{
+	uint32_t now = k_uptime_get_32();
+	struct source_record *entry;
+	int idx;
+
+	k_mutex_lock(&sources_mutex, K_FOREVER);
+
+	idx = source_registry_search(addr);
+	if (idx < 0) {
+		char addr_str[BT_ADDR_LE_STR_LEN];
+
+		if (sources_num == ARRAY_SIZE(sources)) {
+			size_t lru = source_registry_lru_index(now);
+
+			bt_addr_le_to_str(&sources[lru].addr, addr_str, sizeof(addr_str));
+			LOG_INF("Source evicted (%s)", addr_str);
+			source_registry_remove_at(lru);
+			/* Insertion point may have moved */
+			idx = source_registry_search(addr);
+		}
+
+		idx = -idx - 1;
+		memmove(&sources[idx + 1], &sources[idx], (sources_num - idx) * sizeof(sources[0]));
+		sources_num++;
+
+		entry = &sources[idx];
+		bt_addr_le_copy(&entry->addr, addr);
+		entry->broadcast_name[0] = '\0';
+		entry->pa_recv = false;
+
+		bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
+		LOG_INF("Source added (%s), (%zu)", addr_str, sources_num);
+	} else {
+		entry = &sources[idx];
+	}
+
+	entry->sid = sid;
+	entry->pa_interval = pa_interval;
+	entry->broadcast_id = broadcast_id;
+	entry->last_seen = now;
+	if (broadcast_name[0] != '\0') {
+		strncpy(entry->broadcast_name, broadcast_name, sizeof(entry->broadcast_name) - 1);
+	}
+
+	if (record) {
+		*record = *entry;
+	}
+
+	k_mutex_unlock(&sources_mutex);
+}
+
+bool source_registry_get(const bt_addr_le_t *addr, struct source_record *record)
+{
+	int idx;
+
+	k_mutex_lock(&sources_mutex, K_FOREVER);
+	idx = source_registry_search(addr);
+	if (idx >= 0) {
+		*record = sources[idx];
+	}
+	k_mutex_unlock(&sources_mutex);
+
+	return idx >= 0;
+}
+
+bool source_registry_get_at(size_t idx, struct source_record *record)
+{
+	bool found;
+
+	k_mutex_lock(&sources_mutex, K_FOREVER);
+	found = idx < sources_num;
+	if (found) {
+		*record = sources[idx];
+	}
+	k_mutex_unlock(&sources_mutex);
+
+	return found;
+}
+
+void source_registry_set_pa_recv(const bt_addr_le_t *addr, bool pa_recv)
+{
+	int idx;
+
+	k_mutex_lock(&sources_mutex, K_FOREVER);
+	idx = source_registry_search(addr);
+	if (idx >= 0) {
+		sources[idx].pa_recv = pa_recv;
+	}
+	k_mutex_unlock(&sources_mutex);
+}
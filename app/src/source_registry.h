@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __SOURCE_REGISTRY_H__
+#define __SOURCE_REGISTRY_H__
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/addr.h>
+
+#include "message_evt.h"
+
+struct source_record {
+	bt_addr_le_t addr;
+	uint8_t sid;
+	uint16_t pa_interval;
+	uint32_t broadcast_id;
+	char broadcast_name[MESSAGE_EVT_NAME_MAX_LEN + 1]; /* Empty until advertised */
+	bool pa_recv;       /* BASE received from the periodic advertising train */
+	uint32_t last_seen; /* k_uptime_get_32() of the last advertising report */
+};
+
+/**
+ * @brief Remove all sources from the registry
+ */
+void source_registry_reset(void);
+
+/**
+ * @brief Add or refresh a broadcast source
+ *
+ * Looks up the source by address under a single lock, adding it if unknown
+ * (evicting the least recently seen source if the registry is full) and
+ * refreshing its advertising parameters and last seen time.
+ *
+ * @param addr          Address of the broadcast source
+ * @param sid           Advertising set ID
+ * @param pa_interval   Periodic advertising interval
+ * @param broadcast_id  Broadcast ID
+ * @param broadcast_name  Broadcast name, kept from earlier reports if empty
+ * @param[out] record   Copy of the resulting record (may be NULL)
+ */
+void source_registry_update(const bt_addr_le_t *addr, uint8_t sid, uint16_t pa_interval,
+			    uint32_t broadcast_id, const char *broadcast_name,
+			    struct source_record *record);
+
+/**
+ * @brief Get a copy of a source record
+ *
+ * @param addr          Address of the broadcast source
+ * @param[out] record   Copy of the record
+ *
+ * @return true if the source is known
+ */
+bool source_registry_get(const bt_addr_le_t *addr, struct source_record *record);
+
+/**
+ * @brief Get a copy of a source record by position
+ *
+ * Records are in address order, so iterating idx from 0 until false is
+ * returned visits every source once unless the registry changes meanwhile.
+ *
+ * @param idx           Position in the registry
+ * @param[out] record   Copy of the record
+ *
+ * @return true if idx is within the registry
+ */
+bool source_registry_get_at(size_t idx, struct source_record *record);
+
+/**
+ * @brief Set whether the BASE has been received for a source
+ *
+ * @param addr     Address of the broadcast source
+ * @param pa_recv  BASE received
+ */
+void source_registry_set_pa_recv(const bt_addr_le_t *addr, bool pa_recv);
+
+#endif /* __SOURCE_REGISTRY_H__ */
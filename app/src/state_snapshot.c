@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/net/buf.h>
+
+#include "broadcast_assistant.h"
+#include "message.h"
+#include "message_evt.h"
+#include "state_snapshot.h"
+
+LOG_MODULE_REGISTER(state_snapshot, LOG_LEVEL_INF);
+
+/* Frames are sent back to back, buffers are freed as the host reads them */
+#define STATE_SNAPSHOT_ALLOC_RETRY_MS 5
+#define STATE_SNAPSHOT_ALLOC_TIMEOUT_MS 500
+
+BUILD_ASSERT(STATE_SNAPSHOT_FIELD_INFO + SCAN_BATCH_RECORD_HDR_LEN +
+		     MAX(MESSAGE_EVT_LEN_STATE_SOURCE, MESSAGE_EVT_LEN_STATE_SINK) <=
+		     CONFIG_TX_MSG_MAX_PAYLOAD_LEN,
+	     "TX_MSG_MAX_PAYLOAD_LEN too small for STATE_SNAPSHOT records");
+
+static struct net_buf *state_snapshot_frame_alloc(void)
+{
+	struct net_buf *buf;
+
+	for (int waited = 0; waited < STATE_SNAPSHOT_ALLOC_TIMEOUT_MS;
+	     waited += STATE_SNAPSHOT_ALLOC_RETRY_MS) {
+		buf = message_alloc_tx_bulk(CONFIG_TX_MSG_MAX_PAYLOAD_LEN);
+		if (buf) {
+			return buf;
+		}
+
+		k_sleep(K_MSEC(STATE_SNAPSHOT_ALLOC_RETRY_MS));
+	}
+
+	return NULL;
+}
+
+static void state_snapshot_send(struct state_snapshot *snap, bool last)
+{
+	uint8_t *info = snap->buf->data;
+
+	info[0] = STATE_SNAPSHOT_FIELD_INFO - 1;
+	info[1] = BT_DATA_STATE_INFO;
+	info[2] = STATE_SNAPSHOT_VERSION;
+	info[3] = snap->frame++;
+	info[4] = last ? STATE_SNAPSHOT_LAST : 0;
+
+	LOG_DBG("Sending frame %u (%u bytes)", info[3], snap->buf->len);
+
+	message_send_net_buf_event(MESSAGE_SUBTYPE_STATE_SNAPSHOT, snap->buf);
+	snap->buf = NULL;
+}
+
+static bool state_snapshot_open(struct state_snapshot *snap)
+{
+	snap->buf = state_snapshot_frame_alloc();
+	if (!snap->buf) {
+		LOG_ERR("No buffer for frame %u", snap->frame);
+		snap->err = -ENOMEM;
+		return false;
+	}
+
+	/* Filled in when the frame is sent */
+	net_buf_add(snap->buf, STATE_SNAPSHOT_FIELD_INFO);
+
+	return true;
+}
+
+/*
+ * Public functions
+ */
+void state_snapshot_begin(struct state_snapshot *snap)
+{
+	memset(snap, 0, sizeof(*snap));
+}
+
+struct net_buf *state_snapshot_alloc(struct state_snapshot *snap, size_t len)
+{
+	if (snap->err) {
+		return NULL;
+	}
+
+	if (snap->buf && net_buf_tailroom(snap->buf) < SCAN_BATCH_RECORD_HDR_LEN + len) {
+		state_snapshot_send(snap, false);
+	}
+
+	if (!snap->buf && !state_snapshot_open(snap)) {
+		return NULL;
+	}
+
+	if (net_buf_tailroom(snap->buf) < SCAN_BATCH_RECORD_HDR_LEN + len) {
+		LOG_ERR("Record too large (%zu)", len);
+		return NULL;
+	}
+
+	/* Header is filled in by state_snapshot_commit() */
+	snap->record_offset = snap->buf->len;
+	net_buf_add(snap->buf, SCAN_BATCH_RECORD_HDR_LEN);
+
+	return snap->buf;
+}
+
+void state_snapshot_commit(struct state_snapshot *snap, enum message_sub_type stype)
+{
+	uint8_t *hdr = &snap->buf->data[snap->record_offset];
+
+	hdr[0] = stype;
+	sys_put_le16(snap->buf->len - snap->record_offset - SCAN_BATCH_RECORD_HDR_LEN, &hdr[1]);
+}
+
+int state_snapshot_end(struct state_snapshot *snap)
+{
+	if (!snap->buf && !snap->err) {
+		(void)state_snapshot_open(snap);
+	}
+
+	if (snap->buf) {
+		state_snapshot_send(snap, snap->err == 0);
+	}
+
+	LOG_INF("State snapshot sent (%u frames, err %d)", snap->frame, snap->err);
+
+	return snap->err;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __STATE_SNAPSHOT_H__
+#define __STATE_SNAPSHOT_H__
+
+#include <zephyr/types.h>
+#include <zephyr/net/buf.h>
+
+#include "message.h"
+#include "message_evt.h"
+#include "scan_batch.h"
+
+/* Increased whenever the content of the records changes incompatibly */
+#define STATE_SNAPSHOT_VERSION 1
+
+/* BT_DATA_STATE_INFO, [version][frame index][flags] */
+#define STATE_SNAPSHOT_FIELD_INFO MESSAGE_EVT_FIELD_LEN(3)
+#define STATE_SNAPSHOT_LAST       BIT(0) /* Last frame of the snapshot */
+
+/*
+ * A STATE_SNAPSHOT event starts with BT_DATA_STATE_INFO, followed by records
+ * laid out as in SCAN_REPORT_BATCH ([sub_type][le16 len][payload]).
+ */
+struct state_snapshot {
+	struct net_buf *buf; /* Frame being filled */
+	uint16_t record_offset;
+	uint8_t frame;
+	int err;
+};
+
+/**
+ * @brief Start a snapshot, no frame is allocated until the first record
+ */
+void state_snapshot_begin(struct state_snapshot *snap);
+
+/**
+ * @brief Allocate room for a record in the current frame
+ *
+ * The record is added with the message_evt_add_*() helpers and completed
+ * with state_snapshot_commit(). A full frame is sent first. Waits for a
+ * free bulk buffer, so it must not be called from the Bluetooth callbacks.
+ *
+ * @param len  Maximum payload length of the record
+ *
+ * @return The frame buffer, or NULL if none became available (the snapshot
+ *         then fails with -ENOMEM)
+ */
+struct net_buf *state_snapshot_alloc(struct state_snapshot *snap, size_t len);
+
+/**
+ * @brief Complete a record allocated with state_snapshot_alloc()
+ *
+ * @param stype  Kind of record (e.g. SINK_CONNECTED)
+ */
+void state_snapshot_commit(struct state_snapshot *snap, enum message_sub_type stype);
+
+/**
+ * @brief Send the last frame
+ *
+ * A snapshot without records is sent as a single empty frame.
+ *
+ * @return 0 if all records were sent, -ENOMEM otherwise
+ */
+int state_snapshot_end(struct state_snapshot *snap);
+
+#endif /* __STATE_SNAPSHOT_H__ */
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/net/buf.h>
+
+#include "broadcast_assistant.h"
+#include "message.h"
+#include "message_evt.h"
+#include "stats.h"
+
+LOG_MODULE_REGISTER(stats, LOG_LEVEL_INF);
+
+struct stats_latency_data {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+};
+
+static atomic_t counters[STATS_COUNTER_COUNT];
+static struct stats_latency_data latencies[STATS_LATENCY_COUNT];
+static struct k_spinlock latency_lock;
+
+static uint8_t stats_interval;
+static uint8_t stats_countdown;
+
+static void stats_send(void)
+{
+	struct net_buf *evt_msg;
+
+	evt_msg = MESSAGE_EVT_ALLOC_BULK(STATS, 0);
+	if (!evt_msg) {
+		return;
+	}
+
+	stats_encode(&evt_msg->b);
+	message_send_net_buf_event(MESSAGE_SUBTYPE_STATS, evt_msg);
+}
+
+/*
+ * Public functions
+ */
+void stats_inc(enum stats_counter counter)
+{
+	atomic_inc(&counters[counter]);
+}
+
+uint32_t stats_get(enum stats_counter counter)
+{
+	return (uint32_t)atomic_get(&counters[counter]);
+}
+
+void stats_max(enum stats_counter counter, uint32_t value)
+{
+	atomic_val_t old;
+
+	do {
+		old = atomic_get(&counters[counter]);
+		if ((uint32_t)old >= value) {
+			return;
+		}
+	} while (!atomic_cas(&counters[counter], old, value));
+}
+
+void stats_latency_end(enum stats_latency latency, uint32_t start)
+{
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+	struct stats_latency_data *data = &latencies[latency];
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&latency_lock);
+	if (data->count == 0 || us < data->min) {
+		data->min = us;
+	}
+	if (us > data->max) {
+		data->max = us;
+	}
+	data->sum += us;
+	data->count++;
+	k_spin_unlock(&latency_lock, key);
+}
+
+void stats_latency_get(enum stats_latency latency, struct stats_latency_value *value)
+{
+	struct stats_latency_data data;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&latency_lock);
+	data = latencies[latency];
+	k_spin_unlock(&latency_lock, key);
+
+	value->count = data.count;
+	value->min = data.min;
+	value->max = data.max;
+	value->avg = data.count ? data.sum / data.count : 0;
+}
+
+void stats_encode(struct net_buf_simple *buf)
+{
+	struct stats_latency_data snapshot[STATS_LATENCY_COUNT];
+	k_spinlock_key_t key;
+
+	for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+		net_buf_simple_add_u8(buf, STATS_COUNTER_LTV_LEN - 1);
+		net_buf_simple_add_u8(buf, BT_DATA_STATS_COUNTER);
+		net_buf_simple_add_u8(buf, i);
+		net_buf_simple_add_le32(buf, (uint32_t)atomic_get(&counters[i]));
+	}
+
+	key = k_spin_lock(&latency_lock);
+	memcpy(snapshot, latencies, sizeof(snapshot));
+	k_spin_unlock(&latency_lock, key);
+
+	for (int i = 0; i < STATS_LATENCY_COUNT; i++) {
+		net_buf_simple_add_u8(buf, STATS_LATENCY_LTV_LEN - 1);
+		net_buf_simple_add_u8(buf, BT_DATA_STATS_LATENCY);
+		net_buf_simple_add_u8(buf, i);
+		net_buf_simple_add_le32(buf, snapshot[i].count);
+		net_buf_simple_add_le32(buf, snapshot[i].min);
+		net_buf_simple_add_le32(buf, snapshot[i].max);
+		net_buf_simple_add_le32(buf, snapshot[i].count ? snapshot[i].sum / snapshot[i].count : 0);
+	}
+}
+
+void stats_reset(void)
+{
+	k_spinlock_key_t key;
+
+	for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+		atomic_clear(&counters[i]);
+	}
+
+	key = k_spin_lock(&latency_lock);
+	memset(latencies, 0, sizeof(latencies));
+	k_spin_unlock(&latency_lock, key);
+}
+
+void stats_tick(void)
+{
+	if (stats_interval == 0) {
+		return;
+	}
+
+	if (--stats_countdown == 0) {
+		stats_countdown = stats_interval;
+		stats_send();
+	}
+}
+
+void stats_set_interval(uint8_t seconds)
+{
+	LOG_INF("STATS event interval %u s", seconds);
+
+	stats_countdown = seconds;
+	stats_interval = seconds;
+}
+
+uint8_t stats_get_interval(void)
+{
+	return stats_interval;
+}
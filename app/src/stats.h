@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <zephyr/types.h>
+#include <zephyr/net/buf.h>
+
+/* Event counters and gauges, the IDs are part of the STATS message format */
+enum stats_counter {
+	STATS_TX_ALLOC_FAILED = 0x00, /* message_alloc_tx() found no free buffer large enough */
+	STATS_TX_QUEUE_FULL = 0x01,   /* Frames dropped by webusb_transmit() */
+	STATS_TX_QUEUE_PEAK = 0x02,   /* Highest TX queue fill level (gauge) */
+	STATS_TX_FRAMES = 0x03,
+	STATS_TX_TRANSFERS = 0x04,
+	STATS_TX_ERRORS = 0x05,
+	STATS_RX_FRAMES = 0x06,
+	STATS_RX_ERRORS = 0x07,
+	STATS_RX_PAUSED = 0x08, /* Reception paused, RX pool empty */
+	STATS_SCAN_REPORTS = 0x09,
+	STATS_SCAN_FORWARDED = 0x0A,
+	STATS_PA_SYNC_CREATED = 0x0B,
+	STATS_PA_SYNC_SYNCED = 0x0C,
+	STATS_PA_SYNC_TIMEOUT = 0x0D,
+	STATS_SCAN_BATCHES = 0x0E, /* SCAN_REPORT_BATCH events sent */
+	STATS_TX_BULK_ALLOC_FAILED = 0x0F, /* message_alloc_tx_bulk() found no free buffer large enough */
+	STATS_SCAN_FILTERED = 0x10,        /* Reports dropped by the host's scan filter */
+	STATS_IO_ARENA_PEAK = 0x11,        /* Most bytes of the LOW_RAM buffer arena used (gauge) */
+
+	STATS_COUNTER_COUNT,
+};
+
+/* Latencies in microseconds */
+enum stats_latency {
+	STATS_LATENCY_USB_TX = 0x00,    /* Bulk IN transfer submit to completion */
+	STATS_LATENCY_PA_SYNC = 0x01,   /* PA sync create to synced */
+	STATS_LATENCY_CMD = 0x02,       /* CMD processing on the command workqueue */
+	STATS_LATENCY_SCAN_RECV = 0x03, /* Handling of one injected scan report (LOADGEN) */
+	STATS_LATENCY_ADD_SOURCE = 0x04, /* ADD_SOURCE to BIS synced, per sink */
+
+	STATS_LATENCY_COUNT,
+};
+
+/* [len][type][id][u32 value] */
+#define STATS_COUNTER_LTV_LEN (3 + sizeof(uint32_t))
+/* [len][type][id][u32 count][u32 min][u32 max][u32 avg] */
+#define STATS_LATENCY_LTV_LEN (3 + 4 * sizeof(uint32_t))
+#define STATS_LTV_LEN                                                                              \
+	(STATS_COUNTER_COUNT * STATS_COUNTER_LTV_LEN + STATS_LATENCY_COUNT * STATS_LATENCY_LTV_LEN)
+
+struct stats_latency_value {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint32_t avg;
+};
+
+void stats_inc(enum stats_counter counter);
+uint32_t stats_get(enum stats_counter counter);
+
+/**
+ * @brief Raise a gauge to a new value if it is higher than the current one
+ */
+void stats_max(enum stats_counter counter, uint32_t value);
+
+/**
+ * @brief Record a latency sample
+ *
+ * @param latency  Latency being measured
+ * @param start    k_cycle_get_32() when the measured operation started
+ */
+void stats_latency_end(enum stats_latency latency, uint32_t start);
+void stats_latency_get(enum stats_latency latency, struct stats_latency_value *value);
+
+/**
+ * @brief Append all counters and latencies as LTVs
+ *
+ * @param buf  Buffer with at least STATS_LTV_LEN bytes tailroom
+ */
+void stats_encode(struct net_buf_simple *buf);
+
+void stats_reset(void);
+
+/**
+ * @brief Send a STATS event, called every second from the heartbeat work
+ *
+ * Does nothing unless a STATS interval has been set.
+ */
+void stats_tick(void);
+
+/**
+ * @brief Set the interval of the periodic STATS event
+ *
+ * @param seconds  Interval in seconds, 0 to disable the event
+ */
+void stats_set_interval(uint8_t seconds);
+uint8_t stats_get_interval(void);
+
+#endif /* __STATS_H__ */
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/net/buf.h>
+
+#include "broadcast_assistant.h"
+#include "message.h"
+#include "trace.h"
+
+#if CONFIG_TRACE_RECORDS > 0
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_TRACE_RECORDS), "TRACE_RECORDS must be a power of two");
+
+struct trace_record {
+	atomic_t seq; /* Sequence number + 1 when complete, 0 while being written */
+	uint32_t timestamp;
+	uint8_t event;
+	uint8_t type;
+	uint8_t sub_type;
+	uint8_t seq_no;
+	uint16_t length;
+	uint8_t captured;
+	uint8_t payload[CONFIG_TRACE_PAYLOAD_LEN];
+};
+
+static struct trace_record trace_ring[CONFIG_TRACE_RECORDS];
+static atomic_t trace_next;
+
+/*
+ * Public functions
+ */
+void trace_frame(enum trace_event event, const uint8_t *frame, uint16_t len)
+{
+	const struct webusb_message *msg = (const struct webusb_message *)frame;
+	struct trace_record *rec;
+	uint32_t seq;
+
+	if (len < sizeof(struct webusb_message)) {
+		return;
+	}
+
+	if (event == TRACE_TX && msg->sub_type == MESSAGE_SUBTYPE_GET_TRACE) {
+		/* Dumping the trace would push out what is being dumped */
+		return;
+	}
+
+	/* Each writer claims its own record, concurrent writers never share one */
+	seq = (uint32_t)atomic_inc(&trace_next);
+	rec = &trace_ring[seq & (CONFIG_TRACE_RECORDS - 1)];
+
+	atomic_set(&rec->seq, 0);
+	rec->timestamp = k_ticks_to_us_floor32(k_uptime_ticks());
+	rec->event = event;
+	rec->type = msg->type;
+	rec->sub_type = msg->sub_type;
+	rec->seq_no = msg->seq_no;
+	rec->length = len - sizeof(struct webusb_message);
+	rec->captured = MIN(rec->length, CONFIG_TRACE_PAYLOAD_LEN);
+	memcpy(rec->payload, msg->payload, rec->captured);
+	atomic_set(&rec->seq, seq + 1);
+}
+
+uint32_t trace_encode(struct net_buf_simple *buf, uint32_t from)
+{
+	const uint32_t next = (uint32_t)atomic_get(&trace_next);
+
+	if (next - from > CONFIG_TRACE_RECORDS) {
+		/* Overwritten, start at the oldest record left */
+		from = next - CONFIG_TRACE_RECORDS;
+	}
+
+	for (; from != next && net_buf_simple_tailroom(buf) >= TRACE_RECORD_LTV_LEN; from++) {
+		const struct trace_record *rec = &trace_ring[from & (CONFIG_TRACE_RECORDS - 1)];
+		struct trace_record copy;
+
+		if ((uint32_t)atomic_get(&rec->seq) != from + 1) {
+			continue;
+		}
+
+		memcpy(&copy, rec, sizeof(copy));
+		if ((uint32_t)atomic_get(&rec->seq) != from + 1) {
+			/* Overwritten while copying */
+			continue;
+		}
+
+		net_buf_simple_add_u8(buf, 1 + TRACE_RECORD_HDR_LEN + copy.captured);
+		net_buf_simple_add_u8(buf, BT_DATA_TRACE);
+		net_buf_simple_add_le32(buf, from);
+		net_buf_simple_add_le32(buf, copy.timestamp);
+		net_buf_simple_add_u8(buf, copy.event);
+		net_buf_simple_add_u8(buf, copy.type);
+		net_buf_simple_add_u8(buf, copy.sub_type);
+		net_buf_simple_add_u8(buf, copy.seq_no);
+		net_buf_simple_add_le16(buf, copy.length);
+		net_buf_simple_add_mem(buf, copy.payload, copy.captured);
+	}
+
+	return from;
+}
+#else
+void trace_frame(enum trace_event event, const uint8_t *frame, uint16_t len)
+{
+}
+
+uint32_t trace_encode(struct net_buf_simple *buf, uint32_t from)
+{
+	return from;
+}
+#endif /* CONFIG_TRACE_RECORDS > 0 */
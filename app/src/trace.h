@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024 Demant A/S
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <zephyr/types.h>
+#include <zephyr/net/buf.h>
+
+/* Part of the GET_TRACE record format */
+enum trace_event {
+	TRACE_TX = 0x00,
+	TRACE_TX_DROPPED = 0x01, /* Follows the TX record of a frame the full TX queue dropped */
+	TRACE_RX = 0x02,
+	TRACE_RX_ERROR = 0x03, /* COBS decoding failed, the raw bytes are captured */
+};
+
+/* [le32 seq][le32 timestamp_us][event][type][sub_type][seq_no][le16 length][payload] */
+#define TRACE_RECORD_HDR_LEN 14
+/* [len][type][record] */
+#define TRACE_RECORD_LTV_LEN (2 + TRACE_RECORD_HDR_LEN + CONFIG_TRACE_PAYLOAD_LEN)
+
+/**
+ * @brief Record a frame in the trace ring
+ *
+ * Lock-free, can be called from any context including ISRs. The oldest record
+ * is overwritten when the ring is full.
+ *
+ * @param event  What happened to the frame
+ * @param frame  Message, starting with the struct webusb_message header
+ * @param len    Length of the message
+ */
+void trace_frame(enum trace_event event, const uint8_t *frame, uint16_t len);
+
+/**
+ * @brief Append trace records as BT_DATA_TRACE LTVs, oldest first
+ *
+ * Records that are being written or have been overwritten while encoding are
+ * skipped.
+ *
+ * @param buf   Buffer the records are appended to, as many as fit
+ * @param from  Sequence number of the first record, older ones are gone
+ *
+ * @return Sequence number of the record to continue from
+ */
+uint32_t trace_encode(struct net_buf_simple *buf, uint32_t from);
+
+#endif /* __TRACE_H__ */
@@ -22,11 +22,15 @@ LOG_MODULE_REGISTER(webusb, LOG_LEVEL_ERR);
 #include <zephyr/sys/ring_buffer.h>
 #include <zephyr/usb/usb_device.h>
 #include <usb_descriptor.h>
+#include <zephyr/drivers/console/uart_pipe.h>
 
 #include "message.h"
 #include "webusb.h"
 #include "cobs.h"
 #include "msosv2.h"
+#include "stats.h"
+#include "trace.h"
+#include "io_arena.h"
 
 /* Max packet size for Bulk endpoints */
 #if defined(CONFIG_USB_DC_HAS_HS_SUPPORT)
@@ -43,15 +47,44 @@ LOG_MODULE_REGISTER(webusb, LOG_LEVEL_ERR);
 #define WEBUSB_IN_EP_IDX		0
 #define WEBUSB_OUT_EP_IDX		1
 
-#define WEBUSB_WORKQUEUE_STACK_SIZE 2048
 #define WEBUSB_WORKQUEUE_PRIORITY K_PRIO_PREEMPT(1)
 
-void (*webusb_msg_handler)(struct webusb_message *msg_ptr, uint16_t msg_length);
+void (*webusb_msg_handler)(struct net_buf *msg_buf);
 
 #define MAX_COBS_MESSAGE_SIZE COBS_ENCODE_DST_BUF_LEN_MAX(CONFIG_TX_MSG_MAX_PAYLOAD_LEN)
+#define MAX_COBS_RX_MESSAGE_SIZE                                                                   \
+	COBS_ENCODE_DST_BUF_LEN_MAX(sizeof(struct webusb_message) + CONFIG_RX_MSG_MAX_PAYLOAD_LEN)
 
-uint8_t rx_buf[MAX_COBS_MESSAGE_SIZE];
+/*
+ * Each received frame is read and COBS decoded in place in its own buffer
+ * (decoding never writes ahead of the read position), then handed to the
+ * message handler. The OUT endpoint is only re-armed when a buffer is free,
+ * which NAKs the host instead of dropping commands.
+ */
+static void webusb_rx_buf_destroy(struct net_buf *buf);
+static void webusb_rx_resume(void);
+
+#if defined(CONFIG_LOW_RAM)
+IO_ARENA_POOL_DEFINE(webusb_rx_pool, CONFIG_RX_MSG_MAX_MESSAGES, webusb_rx_buf_destroy);
+#else
+NET_BUF_POOL_DEFINE(webusb_rx_pool, CONFIG_RX_MSG_MAX_MESSAGES, MAX_COBS_RX_MESSAGE_SIZE, 0,
+		    webusb_rx_buf_destroy);
+#endif /* CONFIG_LOW_RAM */
+
+static struct net_buf *rx_net_buf;
+static struct usb_cfg_data *rx_cfg;
+static uint8_t rx_ep;
+static atomic_t rx_paused;
 
+#if defined(CONFIG_HOST_PIPE)
+/*
+ * Simulated boards exchange the same COBS frames over the zephyr,uart-pipe
+ * UART instead of the bulk endpoints. A pipe can not NAK, bytes received
+ * while reception is paused go to the scratch buffer and are dropped.
+ */
+static uint8_t rx_pipe_scratch[MAX_COBS_RX_MESSAGE_SIZE];
+static size_t rx_pipe_scanned;
+#else
 #define INITIALIZER_IF(num_ep, iface_class)				\
 	{								\
 		.bLength = sizeof(struct usb_if_descriptor),		\
@@ -98,19 +131,39 @@ static struct usb_ep_cfg_data webusb_ep_data[] = {
 		.ep_addr = AUTO_EP_OUT
 	}
 };
+#endif /* CONFIG_HOST_PIPE */
 
 struct k_work_q webusb_workqueue;
-K_THREAD_STACK_DEFINE(webusb_workqueue_stack, WEBUSB_WORKQUEUE_STACK_SIZE);
+K_THREAD_STACK_DEFINE(webusb_workqueue_stack, CONFIG_WEBUSB_WORKQUEUE_STACK_SIZE);
 
-static void webusb_rx_work_handler(struct k_work *work_p);
-K_WORK_DEFINE(webusb_rx_work, webusb_rx_work_handler);
 static void webusb_tx_work_handler(struct k_work *work_p);
 K_WORK_DEFINE(webusb_tx_work, webusb_tx_work_handler);
-K_MSGQ_DEFINE(webusb_tx_msg_queue, sizeof(struct net_buf*), CONFIG_TX_MSG_MAX_MESSAGES, 4);
+K_MSGQ_DEFINE(webusb_tx_msg_queue, sizeof(struct net_buf*), MESSAGE_TX_MAX_MESSAGES, 4);
+K_MSGQ_DEFINE(webusb_tx_bulk_msg_queue, sizeof(struct net_buf *), MESSAGE_TX_BULK_MAX_MESSAGES, 4);
 
-uint8_t cobs_decoded_stream[MAX_COBS_MESSAGE_SIZE];
-uint16_t cobs_decoded_length;
-uint8_t cobs_encoded_stream[MAX_COBS_MESSAGE_SIZE];
+/*
+ * Bulk frames the host has granted. Negative until the first grant, which
+ * means no flow control.
+ */
+static atomic_t tx_bulk_credits = ATOMIC_INIT(-1);
+
+/*
+ * Frames are COBS encoded into one buffer while the other one is being
+ * transferred. Small frames are coalesced into a single bulk transfer of up
+ * to CONFIG_TX_TRANSFER_MAX_LEN bytes. A frame too large for that is encoded
+ * in place, in the headroom of its own buffer, and sent from there. With
+ * CONFIG_TX_TRANSFER_MAX_LEN 0 every frame is.
+ */
+struct webusb_tx_stream {
+	uint8_t buf[MAX(CONFIG_TX_TRANSFER_MAX_LEN, 1)];
+	size_t len;
+	struct net_buf *frame; /* Sent instead of buf when set */
+	uint32_t start;        /* Cycle count when the transfer was submitted */
+};
+
+static struct webusb_tx_stream tx_streams[2];
+static uint8_t tx_fill_idx;
+static atomic_t tx_busy;
 
 /*#define WEBUSB_DEBUG*/
 
@@ -124,9 +177,76 @@ static void print_hex(const uint8_t *ptr, size_t len)
 }
 #endif /* WEBUSB_DEBUG */
 
+static void webusb_read_cb(uint8_t ep, int size, void *priv);
+static void webusb_write_cb(uint8_t ep, int size, void *priv);
+
+#if defined(CONFIG_HOST_PIPE)
+static uint8_t *webusb_pipe_recv_cb(uint8_t *buf, size_t *off)
+{
+	uint8_t *frame_end;
+
+	/* Hand over each complete frame, the bytes after it start the next one */
+	while ((frame_end = memchr(buf + rx_pipe_scanned, 0, *off - rx_pipe_scanned)) != NULL) {
+		size_t left = *off - (frame_end + 1 - buf);
+		uint8_t *next;
+
+		if (buf != rx_pipe_scratch) {
+			webusb_read_cb(0, frame_end + 1 - buf, NULL);
+		}
+
+		next = rx_net_buf != NULL ? rx_net_buf->data : rx_pipe_scratch;
+		memmove(next, frame_end + 1, left);
+		buf = next;
+		*off = left;
+		rx_pipe_scanned = 0;
+	}
+
+	if (*off == sizeof(rx_pipe_scratch)) {
+		LOG_ERR("RX frame too long");
+		stats_inc(STATS_RX_ERRORS);
+		*off = 0;
+	}
+	rx_pipe_scanned = *off;
+
+	if (buf == rx_pipe_scratch && rx_net_buf != NULL) {
+		/* Resumed, the partial frame was dropped */
+		buf = rx_net_buf->data;
+		*off = 0;
+		rx_pipe_scanned = 0;
+	}
+
+	return buf;
+}
+
+static void webusb_ep_read(struct net_buf *buf)
+{
+	/* Picked up by webusb_pipe_recv_cb() */
+	ARG_UNUSED(buf);
+}
+
+static int webusb_ep_write(const uint8_t *data, size_t len, void *priv)
+{
+	uart_pipe_send(data, len);
+	webusb_write_cb(0, len, priv);
+
+	return 0;
+}
+#else
+static void webusb_ep_read(struct net_buf *buf)
+{
+	usb_transfer(rx_ep, buf->data, net_buf_tailroom(buf), USB_TRANS_READ, webusb_read_cb,
+		     rx_cfg);
+}
+
+static int webusb_ep_write(const uint8_t *data, size_t len, void *priv)
+{
+	return usb_transfer(webusb_ep_data[WEBUSB_IN_EP_IDX].ep_addr, (uint8_t *)data, len,
+			    USB_TRANS_WRITE, webusb_write_cb, priv);
+}
+#endif /* CONFIG_HOST_PIPE */
+
 void webusb_init(void)
 {
-	k_work_init(&webusb_rx_work, webusb_rx_work_handler);
 	k_work_init(&webusb_tx_work, webusb_tx_work_handler);
 
 	k_work_queue_start(&webusb_workqueue,
@@ -135,10 +255,23 @@ void webusb_init(void)
 	                   WEBUSB_WORKQUEUE_PRIORITY,
 	                   NULL);
 	k_thread_name_set(&webusb_workqueue.thread, "webusbworker");
+
+#if defined(CONFIG_LOW_RAM)
+	/* Reception also pauses when TX buffers hold the arena, retry as they are freed */
+	io_arena_register_free_cb(webusb_rx_resume);
+#endif /* CONFIG_LOW_RAM */
+
+#if defined(CONFIG_HOST_PIPE)
+	/* The pipe is always up, there is no configured event to wait for */
+	webusb_read_cb(0, 0, NULL);
+	uart_pipe_register(rx_net_buf != NULL ? rx_net_buf->data : rx_pipe_scratch,
+			   sizeof(rx_pipe_scratch), webusb_pipe_recv_cb);
+#endif /* CONFIG_HOST_PIPE */
 }
 
 int webusb_transmit(struct net_buf *tx_net_buf)
 {
+	struct k_msgq *queue;
 	int ret;
 
 	LOG_DBG("Preparing to send message (size=%d)", tx_net_buf->len);
@@ -151,52 +284,238 @@ int webusb_transmit(struct net_buf *tx_net_buf)
 
 	LOG_DBG("Trying to put message on queue");
 
-	ret = k_msgq_put(&webusb_tx_msg_queue, &tx_net_buf, K_NO_WAIT);
+	queue = message_tx_is_bulk(tx_net_buf) ? &webusb_tx_bulk_msg_queue : &webusb_tx_msg_queue;
+	/* Once queued the buffer may already be sent and freed */
+	trace_frame(TRACE_TX, tx_net_buf->data, tx_net_buf->len);
+	ret = k_msgq_put(queue, &tx_net_buf, K_NO_WAIT);
 
 	if (ret != 0) {
 		LOG_ERR("Failed to put message on queue");
+		stats_inc(STATS_TX_QUEUE_FULL);
+		trace_frame(TRACE_TX_DROPPED, tx_net_buf->data, tx_net_buf->len);
 		return ret;
 	}
+	stats_max(STATS_TX_QUEUE_PEAK, k_msgq_num_used_get(queue));
+
 	ret = k_work_submit_to_queue(&webusb_workqueue, &webusb_tx_work);
 	if (ret < 0) {
+		/* Queued already, sent with the next frame */
 		LOG_ERR("Failed to submit work qo workqueue");
-		return ret;
 	}
 	return 0;
 }
 
-static void webusb_rx_work_handler(struct k_work *work_p)
+static void webusb_read_start(struct net_buf *buf)
 {
-	ARG_UNUSED(work_p);
+	if (buf == NULL) {
+		buf = net_buf_alloc_len(&webusb_rx_pool, MAX_COBS_RX_MESSAGE_SIZE, K_NO_WAIT);
+	}
 
-	if (webusb_msg_handler) {
-		webusb_msg_handler((struct webusb_message *)&cobs_decoded_stream, cobs_decoded_length);
+	if (buf == NULL) {
+		atomic_set(&rx_paused, 1);
+
+		/* A buffer may have been freed before the flag was seen */
+		buf = net_buf_alloc_len(&webusb_rx_pool, MAX_COBS_RX_MESSAGE_SIZE, K_NO_WAIT);
+		if (buf == NULL) {
+			LOG_WRN("RX pool empty, pausing reception");
+			stats_inc(STATS_RX_PAUSED);
+			return;
+		}
+
+		if (!atomic_cas(&rx_paused, 1, 0)) {
+			/* Already resumed when a buffer was freed */
+			net_buf_unref(buf);
+			return;
+		}
 	}
+
+	net_buf_reset(buf);
+	rx_net_buf = buf;
+	webusb_ep_read(buf);
 }
 
-static void webusb_tx_work_handler(struct k_work *work_p)
+static void webusb_rx_resume(void)
 {
-	ARG_UNUSED(work_p);
+	if (atomic_cas(&rx_paused, 1, 0)) {
+		LOG_DBG("Resuming reception");
+		webusb_read_start(NULL);
+	}
+}
+
+static void webusb_rx_buf_destroy(struct net_buf *buf)
+{
+	net_buf_destroy(buf);
+	webusb_rx_resume();
+}
+
+/* Strict priority, bulk frames are only taken when no other frame waits */
+static struct k_msgq *webusb_tx_next_queue(void)
+{
+	if (k_msgq_num_used_get(&webusb_tx_msg_queue) != 0) {
+		return &webusb_tx_msg_queue;
+	}
+
+	if (atomic_get(&tx_bulk_credits) != 0 &&
+	    k_msgq_num_used_get(&webusb_tx_bulk_msg_queue) != 0) {
+		return &webusb_tx_bulk_msg_queue;
+	}
 
+	return NULL;
+}
+
+static void webusb_tx_encode_in_place(struct webusb_tx_stream *stream, struct net_buf *tx_net_buf)
+{
+	/* The encoded frame and its delimiter end where the message did */
+	const size_t offset = COBS_ENCODE_SRC_OFFSET(tx_net_buf->len) + 1;
+	cobs_encode_result result;
+	uint8_t *dst;
+
+	if (net_buf_headroom(tx_net_buf) < offset) {
+		LOG_ERR("No headroom to encode in place (%zu)", net_buf_headroom(tx_net_buf));
+		net_buf_unref(tx_net_buf);
+		return;
+	}
+
+	dst = tx_net_buf->data - offset;
+	result = cobs_encode(dst, tx_net_buf->len + offset, tx_net_buf->data, tx_net_buf->len);
+	if (result.status != COBS_ENCODE_OK) {
+		LOG_ERR("COBS Encoding failed: %d", result.status);
+		net_buf_unref(tx_net_buf);
+		return;
+	}
+
+	dst[result.out_len] = '\0';
+	tx_net_buf->data = dst;
+	tx_net_buf->len = result.out_len + 1;
+
+	stream->frame = tx_net_buf;
+	stream->len = tx_net_buf->len;
+	stats_inc(STATS_TX_FRAMES);
+}
+
+/* Encode queued frames into the stream as long as they fit */
+static void webusb_tx_fill(struct webusb_tx_stream *stream)
+{
 	struct net_buf *tx_net_buf = NULL;
+	struct k_msgq *queue;
 
-	while (k_msgq_get(&webusb_tx_msg_queue, &tx_net_buf, K_NO_WAIT) == 0) {
+	while (stream->frame == NULL && (queue = webusb_tx_next_queue()) != NULL &&
+	       k_msgq_peek(queue, &tx_net_buf) == 0) {
+		size_t frame_max_len = COBS_ENCODE_DST_BUF_LEN_MAX(tx_net_buf->len) + 1;
+		bool in_place = frame_max_len > CONFIG_TX_TRANSFER_MAX_LEN;
 		cobs_encode_result result;
 
+		if (stream->len != 0 && (in_place || stream->len + frame_max_len > sizeof(stream->buf))) {
+			break;
+		}
+
+		(void)k_msgq_get(queue, &tx_net_buf, K_NO_WAIT);
+		if (queue == &webusb_tx_bulk_msg_queue && atomic_get(&tx_bulk_credits) > 0) {
+			/* Only this work consumes credits, grants are only added */
+			atomic_dec(&tx_bulk_credits);
+		}
+
+		if (in_place) {
+			webusb_tx_encode_in_place(stream, tx_net_buf);
+			break;
+		}
+
 		// Leave room for a terminating zero byte.
-		result = cobs_encode(&cobs_encoded_stream, sizeof(cobs_encoded_stream)-1, tx_net_buf->data, tx_net_buf->len);
+		result = cobs_encode(&stream->buf[stream->len], sizeof(stream->buf) - stream->len - 1,
+				     tx_net_buf->data, tx_net_buf->len);
+		net_buf_unref(tx_net_buf);
+
 		if (result.status != COBS_ENCODE_OK) {
 			LOG_ERR("COBS Encoding failed: %d", result.status);
+			continue;
 		}
-		cobs_encoded_stream[result.out_len++] = '\0';
 
-		net_buf_unref(tx_net_buf);
+		stream->len += result.out_len;
+		stream->buf[stream->len++] = '\0';
+		stats_inc(STATS_TX_FRAMES);
+	}
+}
 
-		// We will never send more than WEBUSB_BULK_EP_MPS so we should
-		// be able to do it as a sync transfer and not handle callbacks.
-		usb_transfer_sync(webusb_ep_data[WEBUSB_IN_EP_IDX].ep_addr, cobs_encoded_stream,
-		                  result.out_len, USB_TRANS_WRITE);
+static void webusb_tx_stream_done(struct webusb_tx_stream *stream)
+{
+	if (stream->frame != NULL) {
+		net_buf_unref(stream->frame);
+		stream->frame = NULL;
 	}
+
+	stream->len = 0;
+	atomic_clear(&tx_busy);
+}
+
+static void webusb_write_cb(uint8_t ep, int size, void *priv)
+{
+	struct webusb_tx_stream *stream = priv;
+
+	if (size < 0) {
+		LOG_ERR("TX transfer failed (%d)", size);
+		stats_inc(STATS_TX_ERRORS);
+	} else {
+		stats_latency_end(STATS_LATENCY_USB_TX, stream->start);
+	}
+
+	webusb_tx_stream_done(stream);
+
+	/* Send whatever was encoded meanwhile */
+	k_work_submit_to_queue(&webusb_workqueue, &webusb_tx_work);
+}
+
+static void webusb_tx_work_handler(struct k_work *work_p)
+{
+	ARG_UNUSED(work_p);
+
+	struct webusb_tx_stream *stream = &tx_streams[tx_fill_idx];
+	int ret;
+
+	webusb_tx_fill(stream);
+
+	if (stream->len == 0 || !atomic_cas(&tx_busy, 0, 1)) {
+		/* Nothing to send, or sent when the ongoing transfer completes */
+		return;
+	}
+
+	tx_fill_idx ^= 1;
+
+	stats_inc(STATS_TX_TRANSFERS);
+	stream->start = k_cycle_get_32();
+	ret = webusb_ep_write(stream->frame != NULL ? stream->frame->data : stream->buf,
+			      stream->len, stream);
+	if (ret < 0) {
+		LOG_ERR("Failed to start TX transfer (%d)", ret);
+		stats_inc(STATS_TX_ERRORS);
+		webusb_tx_stream_done(stream);
+		return;
+	}
+
+	/* Encode the next frames while this transfer is ongoing */
+	webusb_tx_fill(&tx_streams[tx_fill_idx]);
+}
+
+size_t webusb_tx_queued(bool bulk)
+{
+	return k_msgq_num_used_get(bulk ? &webusb_tx_bulk_msg_queue : &webusb_tx_msg_queue);
+}
+
+void webusb_bulk_credits_grant(uint16_t credits)
+{
+	atomic_val_t old;
+
+	do {
+		old = atomic_get(&tx_bulk_credits);
+	} while (!atomic_cas(&tx_bulk_credits, old, MAX(old, 0) + credits));
+
+	k_work_submit_to_queue(&webusb_workqueue, &webusb_tx_work);
+}
+
+void webusb_bulk_credits_disable(void)
+{
+	atomic_set(&tx_bulk_credits, -1);
+
+	k_work_submit_to_queue(&webusb_workqueue, &webusb_tx_work);
 }
 
 /**
@@ -207,8 +526,7 @@ static void webusb_tx_work_handler(struct k_work *work_p)
  *
  * @param [in] handlers Pointer to WebUSB command handler structure
  */
-void webusb_register_message_handler(void (*cb)(struct webusb_message *msg_ptr,
-						uint16_t msg_length))
+void webusb_register_message_handler(void (*cb)(struct net_buf *msg_buf))
 {
 	webusb_msg_handler = cb;
 }
@@ -216,31 +534,53 @@ void webusb_register_message_handler(void (*cb)(struct webusb_message *msg_ptr,
 static void webusb_read_cb(uint8_t ep, int size, void *priv)
 {
 	struct usb_cfg_data *cfg = priv;
+	struct net_buf *rx_buf = rx_net_buf;
 	cobs_decode_result result;
+	uint8_t *frame_end;
 
 	LOG_DBG("cfg %p ep %x size %u", cfg, ep, size);
 
-	if ((size <= 0)) {
+	rx_net_buf = NULL;
+	rx_cfg = cfg;
+	rx_ep = ep;
+
+	if ((size <= 0) || rx_buf == NULL) {
 		// Skip empty packages
 		goto done;
 	}
 
-	result = cobs_decode(&cobs_decoded_stream, sizeof(cobs_decoded_stream), rx_buf, strlen(rx_buf));
+	frame_end = memchr(rx_buf->data, 0, size);
+	if (frame_end != NULL) {
+		size = frame_end - rx_buf->data;
+	}
+
+	/* Decode in place, the output never overtakes the input */
+	result = cobs_decode(rx_buf->data, net_buf_tailroom(rx_buf), rx_buf->data, size);
 	if (result.status == COBS_DECODE_OK) {
-		cobs_decoded_length = result.out_len;
+		net_buf_add(rx_buf, result.out_len);
 		LOG_DBG("Decoded COBS to Message, len=%d", result.out_len);
+		stats_inc(STATS_RX_FRAMES);
+		trace_frame(TRACE_RX, rx_buf->data, rx_buf->len);
 #ifdef WEBUSB_DEBUG
-		print_hex(cobs_decoded_stream, result.out_len);
+		print_hex(rx_buf->data, rx_buf->len);
 #endif /* WEBUSB_DEBUG */
-		k_work_submit_to_queue(&webusb_workqueue, &webusb_rx_work);
+		if (webusb_msg_handler) {
+			/* The handler takes over the buffer */
+			webusb_msg_handler(rx_buf);
+			rx_buf = NULL;
+		}
 	} else {
 		LOG_ERR("Could not decode received COBS encoded data! - err: %d", result.status);
+		stats_inc(STATS_RX_ERRORS);
+		trace_frame(TRACE_RX_ERROR, rx_buf->data, size);
 	}
 
 done:
-	usb_transfer(ep, rx_buf, sizeof(rx_buf), USB_TRANS_READ, webusb_read_cb, cfg);
+	/* Reuse the buffer if it was not queued */
+	webusb_read_start(rx_buf);
 }
 
+#if !defined(CONFIG_HOST_PIPE)
 /**
  * @brief Callback used to know the USB connection status
  *
@@ -271,6 +611,8 @@ static void webusb_dev_status_cb(struct usb_cfg_data *cfg,
 		break;
 	case USB_DC_DISCONNECTED:
 		LOG_DBG("USB device disconnected");
+		/* A new host session starts without flow control */
+		webusb_bulk_credits_disable();
 		break;
 	case USB_DC_SUSPEND:
 		LOG_DBG("USB device suspended");
@@ -297,3 +639,4 @@ USBD_DEFINE_CFG_DATA(webusb_config) = {
 	.num_endpoints = ARRAY_SIZE(webusb_ep_data),
 	.endpoint = webusb_ep_data
 };
+#endif /* !CONFIG_HOST_PIPE */
@@ -27,17 +27,45 @@ void webusb_init(void);
 /**
  * @brief Transmits a USB package
  *
+ * Takes the buffer reference on success only, the caller unrefs the buffer
+ * if an error is returned.
+ *
+ * @return 0 if queued, -EINVAL if too long, or the error of k_msgq_put()
  */
 int webusb_transmit(struct net_buf *tx_net_buf);
 
+/**
+ * @brief Get the number of messages waiting to be sent
+ *
+ * @param bulk  Count the bulk queue instead of the control queue
+ */
+size_t webusb_tx_queued(bool bulk);
+
+/**
+ * @brief Grant the host's credits for bulk messages
+ *
+ * The first grant enables flow control, after which each bulk message sent
+ * (scan reports, BASE, BIGinfo, STATS) uses one credit. Bulk messages are
+ * held back while no credits are left.
+ *
+ * @param credits Number of bulk messages the host is ready to receive
+ */
+void webusb_bulk_credits_grant(uint16_t credits);
+
+/**
+ * @brief Disable bulk flow control, bulk messages are sent without credits
+ */
+void webusb_bulk_credits_disable(void);
+
 /**
  * @brief Register message handler callback
  *
- * Function to register message handler callback for handling device messages
+ * Function to register message handler callback for handling device messages.
+ * The handler takes over the received buffer (holding a struct webusb_message)
+ * and must unref it when done.
  *
- * @param [in] handlers Pointer to WebUSB message handler structure
+ * @param [in] cb Message handler callback
  */
-void webusb_register_message_handler(void (*cb)(struct webusb_message *msg_ptr,
-						uint16_t msg_length));
+void webusb_register_message_handler(void (*cb)(struct net_buf *msg_buf));
 
 #endif /* __WEBUSB_SERIAL_H__ */
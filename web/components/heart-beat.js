@@ -64,8 +64,8 @@ export class HeartBeat extends HTMLElement {
 		this.#model = AssistantModel.getInstance();
 
 		this.#model.addEventListener('heartbeat-received', (event) => {
-			const heartbeat_count = event.detail;
-			//console.log("Heartbeat: " + heartbeat_count);
+			const { count, health } = event.detail;
+			//console.log("Heartbeat: " + count, health);
 			// Heartbeat tick received, begin animation
 			this.heartbeatImage.classList.add('animation')
 		});
@@ -112,10 +112,17 @@ export class SourceDeviceList extends HTMLElement {
 
 		console.log('Source clicked:', sourceEl.getModel());
 
+		// Only the selected source is monitored, so its BASE and encryption changes show up
+		this.#model.stopSourceMonitor();
 		if (source.state === "selected") {
 			this.#model.removeSource(source);
+		} else if (this.#model.getSyncedSource()) {
+			// Another source is playing, the sinks are moved over in one go
+			this.#model.switchSource(source);
+			this.#model.startSourceMonitor(source);
 		} else {
 			this.#model.addSource(source);
+			this.#model.startSourceMonitor(source);
 		}
 	}
 
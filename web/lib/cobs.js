@@ -4,39 +4,48 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+// Blocks are split at each zero and after 254 non-zero bytes, copied with
+// indexOf()/set() rather than byte by byte
 export const cobsEncode = (data, zeropad) => {
 	if (!(data instanceof Uint8Array)) {
 		throw new Error("Input data must be a Uint8Array");
 	}
 
-	const res = [0];
-	let res_ptr = 0;
-	let count = 1;
+	const len = data.length;
+	// One code byte per 254 bytes of data plus the last one, and the padding
+	const res = new Uint8Array(len + Math.floor(len / 254) + 1 + (zeropad ? 1 : 0));
+	let ptr = 0;
+	let out = 0;
+	let zero = -1;
 
-
-	const blockDone = last => {
-		res[res_ptr] = count;
-		res_ptr = res.length;
-		if (!last || zeropad) {
-			res.push(0);
+	for (;;) {
+		if (zero < ptr) {
+			zero = data.indexOf(0, ptr);
+			if (zero < 0) {
+				zero = len;
+			}
 		}
-		count = 1;
-	}
 
-	for (const byte of data) {
-		if (byte === 0) {
-			blockDone(false);
+		const end = Math.min(zero, ptr + 254);
+		const count = end - ptr + 1;
+
+		res[out] = count;
+		res.set(data.subarray(ptr, end), out + 1);
+		out += count;
+
+		if (count === 255) {
+			// A new block follows, even at the end of the data
+			ptr = end;
+		} else if (end === len) {
+			break;
 		} else {
-			res.push(byte);
-			count++;
-			if (count === 255) {
-				blockDone(false);
-			}
+			// Skip the zero
+			ptr = end + 1;
 		}
 	}
-	blockDone(true);
 
-	return new Uint8Array(res);
+	// The padding byte is already zero
+	return res.subarray(0, zeropad ? out + 1 : out);
 }
 
 export const cobsDecode = (data, zeropad) => {
@@ -44,25 +53,135 @@ export const cobsDecode = (data, zeropad) => {
 		throw new Error("Input data must be a Uint8Array");
 	}
 
-	const res = [];
+	const src = zeropad ? data.subarray(0, -1) : data;
+	const res = new Uint8Array(src.length);
+	let ptr = 0;
+	let out = 0;
 	let count = 255;
 
-	let tmpVal = 0;
+	while (ptr < src.length) {
+		// Blocks are separated by a zero, except after a block of 254 bytes
+		if (count !== 255) {
+			res[out++] = 0;
+		}
 
-	for (const byte of zeropad ? data.subarray(0, -1) : data) {
-		if (tmpVal !== 0) {
-			res.push(byte);
-		} else {
-			if (count !== 255) {
-				res.push(0);
+		count = src[ptr];
+		if (count === 0) {
+			break;
+		}
+
+		const block = src.subarray(ptr + 1, ptr + count);
+		res.set(block, out);
+		out += block.length;
+		ptr += count;
+	}
+
+	return res.subarray(0, out);
+}
+
+/**
+* Incremental decoder of zero delimited COBS frames
+*
+* Data is pushed as it is received, frames may be split across (or several
+* be held in) a single push. Frames are decoded into a ring buffer and handed
+* to onFrame as views, valid until onFrame returns: whatever is kept has to be
+* copied. A frame larger than the ring is dropped.
+*/
+export class CobsFrameDecoder {
+	#ring
+	#onFrame
+	#start = 0	// Start of the frame being decoded in the ring
+	#out = 0	// End of the decoded data
+	#remaining = 0	// Bytes left of the current block
+	#code = 0	// Code byte of the current block, 0 before the first one
+	#dropping = false
+
+	constructor(onFrame, ringSize = 65536) {
+		this.#ring = new Uint8Array(ringSize);
+		this.#onFrame = onFrame;
+	}
+
+	reset() {
+		this.#start = this.#out = 0;
+		this.#remaining = this.#code = 0;
+		this.#dropping = false;
+	}
+
+	push(data) {
+		let ptr = 0;
+
+		while (ptr < data.length) {
+			if (this.#remaining === 0) {
+				const code = data[ptr++];
+
+				if (code === 0) {
+					this.#frameDone();
+					continue;
+				}
+
+				// Blocks are separated by a zero, except after a block of 254 bytes
+				if (this.#code !== 0 && this.#code !== 255 && this.#reserve(1)) {
+					this.#ring[this.#out++] = 0;
+				}
+				this.#code = code;
+				this.#remaining = code - 1;
+				continue;
+			}
+
+			const block = data.subarray(ptr, ptr + Math.min(this.#remaining, data.length - ptr));
+			const zero = block.indexOf(0);
+
+			if (zero !== -1) {
+				// Delimiter within a block, the frame is broken
+				console.warn('COBS frame truncated');
+				this.#dropping = true;
+				ptr += zero;
+				this.#remaining = 0;
+				continue;
 			}
-			count = tmpVal = byte;
-			if (count === 0) {
-				break;
+
+			if (this.#reserve(block.length)) {
+				this.#ring.set(block, this.#out);
+				this.#out += block.length;
 			}
+			this.#remaining -= block.length;
+			ptr += block.length;
 		}
-		tmpVal--;
 	}
 
-	return new Uint8Array(res);
+	#reserve(len) {
+		if (this.#dropping) {
+			return false;
+		}
+
+		if (this.#out + len > this.#ring.length) {
+			// Continue the frame from the start of the ring
+			const partial = this.#out - this.#start;
+
+			if (partial + len > this.#ring.length) {
+				console.warn('COBS frame too large for the ring');
+				this.#dropping = true;
+				return false;
+			}
+
+			this.#ring.copyWithin(0, this.#start, this.#out);
+			this.#start = 0;
+			this.#out = partial;
+		}
+
+		return true;
+	}
+
+	#frameDone() {
+		const frame = this.#ring.subarray(this.#start, this.#out);
+		const complete = !this.#dropping && this.#code !== 0;
+
+		this.#start = this.#out;
+		this.#code = 0;
+		this.#dropping = false;
+
+		if (complete && frame.length) {
+			this.#onFrame(frame);
+		}
+	}
 }
@@ -43,6 +43,21 @@ export const MessageSubType = Object.freeze({
 	MUTE:				0x0B,
 	UNMUTE:				0x0C,
 	START_SET_MEMBER_SCAN:		0x0D,
+	GET_STATS:			0x0E,
+	GRANT_CREDITS:			0x0F,
+	CONNECT_KNOWN:			0x10,
+	FORGET_KNOWN:			0x11,
+	SET_SCAN_PARAMS:		0x12,
+	GET_TRACE:			0x13,
+	SET_SET_VOLUME:			0x14,
+	SET_SET_MUTE:			0x15,
+	STEP_SET_VOLUME:		0x16,
+	SET_SCAN_FILTER:		0x17,
+	START_SOURCE_MONITOR:		0x18,
+	STOP_SOURCE_MONITOR:		0x19,
+	GET_STATE:			0x1A,
+	RESYNC_FROM:			0x1B,
+	SWITCH_SOURCE:			0x1C,
 
 	RESET:				0x2A,
 
@@ -71,6 +86,10 @@ export const MessageSubType = Object.freeze({
 	SINK_VOLUME_CONTROL_FOUND:	0x96,
 	SINK_SET_IDENTIFIER_FOUND:	0x97,
 	SET_MEMBER_FOUND:		0x98,
+	STATS:				0x99,
+	SCAN_REPORT_BATCH:		0x9A,
+	STATE_SNAPSHOT:			0x9B,
+	SOURCE_SWITCHED:		0x9C,
 
 	HEARTBEAT:			0xFF,
 });
@@ -91,6 +110,21 @@ export const BT_DataType = Object.freeze({
 	BT_DATA_BROADCAST_NAME:		0x30,	// utf8 (variable len)
 
 	// The following types are created for this app (not standard)
+	BT_DATA_SCAN_MODE:		0xe1,	// uint8 (ScanMode mask)
+	BT_DATA_HEALTH:			0xe2,	// uint32[3] (uptime s, tx dropped, rx errors) + uint8[2] (tx queued)
+	BT_DATA_HEARTBEAT_INTERVAL:	0xe3,	// uint8 (s)
+	BT_DATA_EVT_SEQ:		0xe4,	// uint8
+	BT_DATA_STATE_INFO:		0xe5,	// uint8 (version) + uint8 (frame) + uint8 (flags)
+	BT_DATA_SCAN_FILTER:		0xe6,	// uint8 (kind) + uint8[] (see ScanFilterKind)
+	BT_DATA_VOLUME_STEP:		0xe7,	// int8
+	BT_DATA_TRACE_CURSOR:		0xe8,	// uint32
+	BT_DATA_TRACE:			0xe9,	// uint32 (seq) + uint32 (us) + uint8[4] + uint16 (len) + uint8[]
+	BT_DATA_SCAN_PARAMS:		0xea,	// uint8 (target) + uint8 (flags) + uint16[5]
+	BT_DATA_CREDITS:		0xeb,	// uint16
+	BT_DATA_STATS_INTERVAL:		0xec,	// uint8
+	BT_DATA_STATS_LATENCY:		0xed,	// uint8 (id) + uint32[4] (count, min, max, avg)
+	BT_DATA_STATS_COUNTER:		0xee,	// uint8 (id) + uint32
+	BT_DATA_SINK_STATUS:		0xef,	// uint8 (type) + uint8[6] (addr) + int32
 	BT_DATA_SET_RANK:		0xf0,	// uint8
 	BT_DATA_SET_SIZE:		0xf1,	// uint8
 	BT_DATA_SIRK:			0xf2,	// uint8[6]
@@ -108,6 +142,95 @@ export const BT_DataType = Object.freeze({
 	BT_DATA_RSSI:			0xfe,	// int8
 });
 
+// IDs of BT_DATA_STATS_COUNTER and BT_DATA_STATS_LATENCY (see app/src/stats.h)
+export const StatsCounter = Object.freeze({
+	TX_ALLOC_FAILED:		0x00,
+	TX_QUEUE_FULL:			0x01,
+	TX_QUEUE_PEAK:			0x02,
+	TX_FRAMES:			0x03,
+	TX_TRANSFERS:			0x04,
+	TX_ERRORS:			0x05,
+	RX_FRAMES:			0x06,
+	RX_ERRORS:			0x07,
+	RX_PAUSED:			0x08,
+	SCAN_REPORTS:			0x09,
+	SCAN_FORWARDED:			0x0A,
+	PA_SYNC_CREATED:		0x0B,
+	PA_SYNC_SYNCED:			0x0C,
+	PA_SYNC_TIMEOUT:		0x0D,
+	SCAN_BATCHES:			0x0E,
+	TX_BULK_ALLOC_FAILED:		0x0F,
+	SCAN_FILTERED:			0x10,
+	IO_ARENA_PEAK:			0x11,
+});
+
+export const StatsLatency = Object.freeze({
+	USB_TX:				0x00,
+	PA_SYNC:			0x01,
+	CMD:				0x02,
+	SCAN_RECV:			0x03,
+	ADD_SOURCE:			0x04,
+});
+
+// Targets and flags of BT_DATA_SCAN_PARAMS (see app/src/scan_sched.h)
+export const ScanTarget = Object.freeze({
+	SINK:				0x00,
+	SOURCE:				0x01,
+});
+
+export const ScanFlags = Object.freeze({
+	ACTIVE:				0x01,
+	CODED:				0x02,
+});
+
+// Bits of BT_DATA_SCAN_MODE (see app/src/broadcast_assistant.h)
+export const ScanMode = Object.freeze({
+	SOURCE:				0x01,
+	SINK:				0x02,
+	CSIS:				0x04,
+});
+
+// Rule kinds and service bits of BT_DATA_SCAN_FILTER (see app/src/scan_filter.h)
+export const ScanFilterKind = Object.freeze({
+	RSSI_MIN:			0x01,	// int8
+	NAME_PREFIX:			0x02,	// string
+	BROADCAST_ID_ALLOW:		0x03,	// uint24
+	BROADCAST_ID_DENY:		0x04,	// uint24
+	ADDR_ALLOW:			0x05,	// {type, addr}
+	ADDR_DENY:			0x06,	// {type, addr}
+	SERVICES:			0x07,	// ScanFilterServices mask
+});
+
+export const ScanFilterServices = Object.freeze({
+	BASS:				0x01,
+	PACS:				0x02,
+	CSIS:				0x04,
+});
+
+// Events of BT_DATA_TRACE records (see app/src/trace.h)
+export const TraceEvent = Object.freeze({
+	TX:				0x00,
+	TX_DROPPED:			0x01,
+	RX:				0x02,
+	RX_ERROR:			0x03,
+});
+
+// EVT subTypes sent as bulk messages, each uses one credit when flow control is enabled
+export const BulkSubTypes = Object.freeze([
+	MessageSubType.SINK_FOUND,
+	MessageSubType.SOURCE_FOUND,
+	MessageSubType.SET_MEMBER_FOUND,
+	MessageSubType.SOURCE_BASE_FOUND,
+	MessageSubType.SOURCE_BIG_INFO,
+	MessageSubType.STATS,
+	MessageSubType.SCAN_REPORT_BATCH,
+	MessageSubType.STATE_SNAPSHOT,
+]);
+
+// Format of the STATE_SNAPSHOT records (see app/src/state_snapshot.h)
+export const STATE_SNAPSHOT_VERSION = 1;
+export const STATE_SNAPSHOT_LAST = 0x01;
+
 export const BT_UUID = Object.freeze({
 	BT_UUID_BROADCAST_AUDIO:	0x1852,
 });
@@ -194,7 +317,95 @@ export const arrayToMsg = data => {
 	}
 }
 
+/**
+* As arrayToMsg(), for a frame decoded into the receive ring
+*
+* The header is checked against the frame length only, and the payload is a
+* view into the frame: valid while the message is handled, copy what is kept.
+*
+* @param data	Decoded frame (Uint8Array)
+* @returns	Message {type, subType, seqNo, payloadSize, payload}, or undefined if malformed
+*/
+export const frameToMsg = data => {
+	if (data.length < 5) {
+		return;
+	}
+
+	const payloadSize = data[3] | (data[4] << 8);
+	if (data.length !== payloadSize + 5) {
+		return;
+	}
+
+	return {
+		type: data[0],
+		subType: data[1],
+		seqNo: data[2],
+		payloadSize,
+		payload: data.subarray(5)
+	}
+}
+
+/**
+* Unpacks the scan reports of a SCAN_REPORT_BATCH event
+*
+* Each record is [subType][uint16 length][payload], the payload being that of
+* the event the report would otherwise have been sent as.
+*
+* @param message	SCAN_REPORT_BATCH EVT message
+* @returns		Array of EVT messages [{type, subType, seqNo, payloadSize, payload}, ...]
+*/
+export const batchToMessages = message => recordsToMessages(message, 0);
+
+/**
+* Unpacks a STATE_SNAPSHOT event
+*
+* The leading BT_DATA_STATE_INFO is followed by records as in SCAN_REPORT_BATCH,
+* SOURCE_FOUND for each known source and SINK_CONNECTED for each connected sink.
+*
+* @param message	STATE_SNAPSHOT EVT message
+* @returns		{ info: {version, frame, last}, messages: [...] }, info undefined if malformed
+*/
+export const snapshotToMessages = message => {
+	const { payload } = message;
+
+	if (payload.length < 2 || payload[1] !== BT_DataType.BT_DATA_STATE_INFO) {
+		return { info: undefined, messages: [] };
+	}
+
+	const info = parseLTVItem(payload[1], payload[0] - 1, payload.subarray(2, payload[0] + 1))?.value;
+
+	return { info, messages: recordsToMessages(message, payload[0] + 1) };
+}
+
+const recordsToMessages = (message, ptr) => {
+	const { payload } = message;
+	const messages = [];
+
+	while (ptr + 3 <= payload.length) {
+		const subType = payload[ptr];
+		const payloadSize = payload[ptr + 1] + (payload[ptr + 2] << 8);
+		ptr += 3;
+
+		if (ptr + payloadSize > payload.length) {
+			console.warn(`Truncated batch record (${payloadSize} > ${payload.length - ptr})`);
+			break;
+		}
+
+		messages.push({
+			type: message.type,
+			subType,
+			seqNo: message.seqNo,
+			payloadSize,
+			payload: payload.subarray(ptr, ptr + payloadSize)
+		});
+		ptr += payloadSize;
+	}
+
+	return messages;
+}
+
 const utf8decoder = new TextDecoder();
+const utf8encoder = new TextEncoder();
 
 const addressStringToArray = (str) => {
 	return str.split(':').reverse().map(v => Number.parseInt(v, 16));
@@ -214,6 +425,22 @@ const uintToArray = (num, length) => {
 	return outArr;
 }
 
+// value: {kind, value} with the value as listed in ScanFilterKind
+const scanFilterToArray = ({ kind, value }) => {
+	switch (kind) {
+		case ScanFilterKind.NAME_PREFIX:
+			return [kind, ...utf8encoder.encode(value)];
+		case ScanFilterKind.BROADCAST_ID_ALLOW:
+		case ScanFilterKind.BROADCAST_ID_DENY:
+			return [kind, ...uintToArray(value, 3)];
+		case ScanFilterKind.ADDR_ALLOW:
+		case ScanFilterKind.ADDR_DENY:
+			return [kind, value.type, ...Array.from(value.addr)];
+		default:
+			return [kind, ...uintToArray(value, 1)];
+	}
+}
+
 const bufToInt = (data, signed) => {
 	if (!(data instanceof Uint8Array)) {
 		throw new Error("Input data must be a Uint8Array");
@@ -270,6 +497,16 @@ const bufToValueArray = (data, itemsize) => {
 	return res;
 }
 
+// Received messages share the buffer of the receive ring, so one view serves all
+let dataViewCache;
+const dataView = value => {
+	if (dataViewCache?.buffer !== value.buffer) {
+		dataViewCache = new DataView(value.buffer);
+	}
+
+	return dataViewCache;
+}
+
 const parseLTVItem = (type, len, value) => {
 	// type: uint8 (AD type)
 	// len: utin8
@@ -279,6 +516,9 @@ const parseLTVItem = (type, len, value) => {
 		return;
 	}
 
+	// The value is a view into the received message, what is kept must be copied
+	const dv = dataView(value);
+	const o = value.byteOffset;
 	const item = { type };
 	// For now, just parse the ones we know
 	switch (type) {
@@ -288,7 +528,7 @@ const parseLTVItem = (type, len, value) => {
 			item.value = utf8decoder.decode(value);
 			break;
 		case BT_DataType.BT_DATA_SIRK:
-			item.value = value;
+			item.value = value.slice();
 			break;
 		case BT_DataType.BT_DATA_UUID16_SOME:
 		case BT_DataType.BT_DATA_UUID16_ALL:
@@ -301,6 +541,7 @@ const parseLTVItem = (type, len, value) => {
 		case BT_DataType.BT_DATA_RSSI:
 		case BT_DataType.BT_DATA_ERROR_CODE:
 		case BT_DataType.BT_DATA_SOURCE_ID:
+		case BT_DataType.BT_DATA_VOLUME_STEP:
 			item.value = bufToInt(value, true);
 			break;
 		case BT_DataType.BT_DATA_BROADCAST_ID:
@@ -310,6 +551,9 @@ const parseLTVItem = (type, len, value) => {
 		case BT_DataType.BT_DATA_MUTE:
 		case BT_DataType.BT_DATA_SET_RANK:
 		case BT_DataType.BT_DATA_SET_SIZE:
+		case BT_DataType.BT_DATA_EVT_SEQ:
+		case BT_DataType.BT_DATA_HEARTBEAT_INTERVAL:
+		case BT_DataType.BT_DATA_SCAN_MODE:
 			item.value = bufToInt(value, false);
 			break;
 		case BT_DataType.BT_DATA_RPA:
@@ -319,15 +563,87 @@ const parseLTVItem = (type, len, value) => {
 				addr: value.slice(1)
 			}
 			item.value.addrStr = bufToAddressString(item.value.addr);
-			const subTypeName = keyName(MessageSubType, type);
-			console.log(subTypeName, item.value, bufToAddressString(item.value.addr));
+			break;
+		case BT_DataType.BT_DATA_SINK_STATUS:
+			item.value = {
+				type: value[0],
+				addr: value.slice(1, 7),
+				err: dv.getInt32(o + 7, true)
+			}
+			item.value.addrStr = bufToAddressString(item.value.addr);
+			break;
+		case BT_DataType.BT_DATA_STATS_COUNTER:
+			item.value = {
+				id: value[0],
+				name: keyName(StatsCounter, value[0]),
+				value: dv.getUint32(o + 1, true)
+			}
+			break;
+		case BT_DataType.BT_DATA_STATS_LATENCY:
+			item.value = {
+				id: value[0],
+				name: keyName(StatsLatency, value[0]),
+				count: dv.getUint32(o + 1, true),
+				min: dv.getUint32(o + 5, true),
+				max: dv.getUint32(o + 9, true),
+				avg: dv.getUint32(o + 13, true)
+			}
+			break;
+		case BT_DataType.BT_DATA_SCAN_PARAMS:
+			// Intervals and windows in 0.625 ms units
+			item.value = {
+				target: value[0],
+				flags: value[1],
+				fastInterval: dv.getUint16(o + 2, true),
+				fastWindow: dv.getUint16(o + 4, true),
+				fastDuration: dv.getUint16(o + 6, true),
+				interval: dv.getUint16(o + 8, true),
+				window: dv.getUint16(o + 10, true)
+			}
+			break;
+		case BT_DataType.BT_DATA_TRACE_CURSOR:
+			item.value = bufToInt(value, false) >>> 0;
+			break;
+		case BT_DataType.BT_DATA_TRACE:
+			// Header of a traced frame and the first bytes of its payload
+			item.value = {
+				seq: dv.getUint32(o, true),
+				timestamp: dv.getUint32(o + 4, true),
+				event: value[8],
+				eventName: keyName(TraceEvent, value[8]),
+				type: value[9],
+				subType: value[10],
+				seqNo: value[11],
+				length: dv.getUint16(o + 12, true),
+				payload: value.slice(14)
+			}
+			break;
+		case BT_DataType.BT_DATA_BIS_SYNC:
+			item.value = bufToValueArray(value, 4).map(v => v >>> 0);
+			break;
+		case BT_DataType.BT_DATA_HEALTH:
+			item.value = {
+				uptime: dv.getUint32(o, true),
+				txDropped: dv.getUint32(o + 4, true),
+				rxErrors: dv.getUint32(o + 8, true),
+				txQueued: value[12],
+				txBulkQueued: value[13]
+			}
+			break;
+		case BT_DataType.BT_DATA_STATE_INFO:
+			item.value = {
+				version: value[0],
+				frame: value[1],
+				last: (value[2] & STATE_SNAPSHOT_LAST) !== 0
+			}
 			break;
 		case BT_DataType.BT_DATA_BIG_INFO:
 			item.value = parse_big_info(value);
 			console.log('BIG Info received', value, JSON.stringify(item.value, null, 2));
 			break;
 		case BT_DataType.BT_DATA_BASE:
-			item.value = parse_base(value);
+			// Kept by the model, the parsed BASE refers to the buffer
+			item.value = parse_base(value.slice());
 			console.log('BASE received', value, JSON.stringify(item.value, null, 2));
 			break;
 		default:
@@ -409,18 +725,41 @@ export const tvArrayToLtv = arr => {
 				outArr = uintToArray(value, 3);	//uint24
 				break;
 			case BT_DataType.BT_DATA_PA_INTERVAL:
+			case BT_DataType.BT_DATA_CREDITS:
 				outArr = uintToArray(value, 2); //uint16
 				break;
 			case BT_DataType.BT_DATA_SID:
 			case BT_DataType.BT_DATA_SOURCE_ID:
 			case BT_DataType.BT_DATA_VOLUME:
+			case BT_DataType.BT_DATA_MUTE:
+			case BT_DataType.BT_DATA_VOLUME_STEP:
 			case BT_DataType.BT_DATA_SET_SIZE:
-				outArr = uintToArray(value, 1);	//uint8
+			case BT_DataType.BT_DATA_STATS_INTERVAL:
+			case BT_DataType.BT_DATA_EVT_SEQ:
+			case BT_DataType.BT_DATA_HEARTBEAT_INTERVAL:
+				outArr = uintToArray(value, 1);	//uint8 (int8 as two's complement)
 				break;
 			case BT_DataType.BT_DATA_BROADCAST_CODE:
 			case BT_DataType.BT_DATA_SIRK:
 				outArr = Array.from(value);	//uint8 array
 				break;
+			case BT_DataType.BT_DATA_SCAN_PARAMS:
+				outArr = [
+					value.target,
+					value.flags,
+					...uintToArray(value.fastInterval, 2),
+					...uintToArray(value.fastWindow, 2),
+					...uintToArray(value.fastDuration, 2),
+					...uintToArray(value.interval, 2),
+					...uintToArray(value.window, 2)
+				];
+				break;
+			case BT_DataType.BT_DATA_SCAN_FILTER:
+				outArr = scanFilterToArray(value);
+				break;
+			case BT_DataType.BT_DATA_TRACE_CURSOR:
+				outArr = uintToArray(value, 4); //uint32
+				break;
 			case BT_DataType.BT_DATA_BIS_SYNC:
 				outArr = [];
 				value.forEach(v => {
@@ -229,6 +229,7 @@ button:disabled {
 			<button id="sink_scan">Search for<br>Devices</button>
 			<button id='stop_scan'>Stop<br>Scanning</button>
 			<button id="source_scan">Search for<br>Auracasts</button>
+			<button id="connect_known">Reconnect<br>Known</button>
 			</div>
 
 			<!-- broadcast sink components... -->
@@ -318,10 +319,13 @@ export class MainApp extends HTMLElement {
 		const shadowRoot = this.attachShadow({mode: 'open'});
 
 		this.sendReset = this.sendReset.bind(this);
+		this.sendGetState = this.sendGetState.bind(this);
+		this.stateRestored = this.stateRestored.bind(this);
 		this.scanStopped = this.scanStopped.bind(this);
 		this.sinkScanStarted = this.sinkScanStarted.bind(this);
 		this.sourceScanStarted = this.sourceScanStarted.bind(this);
 		this.sendStopScan = this.sendStopScan.bind(this);
+		this.sendConnectKnown = this.sendConnectKnown.bind(this);
 		this.sendStartSinkScan = this.sendStartSinkScan.bind(this);
 		this.sendStartSourceScan = this.sendStartSourceScan.bind(this);
 		this.doQrScan = this.doQrScan.bind(this);
@@ -352,14 +356,20 @@ export class MainApp extends HTMLElement {
 		const filterLog = message => {
 			// Filter frequent messages to avoid flooding activity log
 			if ((message.type === MessageType.EVT) &&
-			    (message.subType === MessageSubType.HEARTBEAT)) {
+			    [MessageSubType.HEARTBEAT, MessageSubType.STATS].includes(message.subType)) {
+				return true;
+			}
+
+			if ((message.type === MessageType.RES) &&
+			    [MessageSubType.GRANT_CREDITS, MessageSubType.GET_TRACE].includes(message.subType)) {
 				return true;
 			}
 
 			if (lastLogMsg) {
 				if (message.type === MessageType.EVT && lastLogMsg.type === MessageType.EVT) {
 					if (message.subType === lastLogMsg.subType &&
-					    [MessageSubType.SINK_FOUND, MessageSubType.SOURCE_FOUND].includes(message.subType)) {
+					    [MessageSubType.SINK_FOUND, MessageSubType.SOURCE_FOUND,
+					     MessageSubType.SCAN_REPORT_BATCH].includes(message.subType)) {
 						return true;
 					    }
 				}
@@ -378,7 +388,8 @@ export class MainApp extends HTMLElement {
 			}
 
 			let extraInfo;
-			if ([MessageSubType.SINK_FOUND, MessageSubType.SOURCE_FOUND].includes(message.subType)) {
+			if ([MessageSubType.SINK_FOUND, MessageSubType.SOURCE_FOUND,
+			     MessageSubType.SCAN_REPORT_BATCH].includes(message.subType)) {
 				extraInfo = " (silencing similar...)";
 			}
 
@@ -415,7 +426,9 @@ export class MainApp extends HTMLElement {
 		WebUSBDeviceService.addEventListener('connected', () => { splashbox?.classList.add('hidden') });
 		WebUSBDeviceService.addEventListener('disconnected', () => { splashbox?.classList.remove('hidden') });
 
-		WebUSBDeviceService.addEventListener('connected', this.sendReset);
+		// Reattach to the state kept by the firmware, unless e.g. ?reattach=n
+		WebUSBDeviceService.addEventListener('connected',
+			this.#pageState.get('reattach') === 'n' ? this.sendReset : this.sendGetState);
 
 		this.#stopScanButton = this.shadowRoot?.querySelector('#stop_scan');
 		this.#stopScanButton.addEventListener('click', this.sendStopScan);
@@ -429,6 +442,9 @@ export class MainApp extends HTMLElement {
 		this.#scanSourceButton.addEventListener('click', this.sendStartSourceScan);
 		// this.#scanSourceButton.disabled = true;
 
+		this.shadowRoot?.querySelector('#connect_known')?.
+			addEventListener('click', this.sendConnectKnown);
+
 		this.#qrScanButton = this.shadowRoot?.querySelector('#qr_scan');
 		this.#qrScanButton.addEventListener('click', this.doQrScan);
 		this.#qrScanner = this.shadowRoot?.querySelector('qr-scanner');
@@ -444,6 +460,7 @@ export class MainApp extends HTMLElement {
 		this.#model.addEventListener('source-scan-started', this.sourceScanStarted);
 		this.#model.addEventListener('sirk-found', this.sirkFound);
 		this.#model.addEventListener('csis-pairing-complete', this.closeCSISPair);
+		this.#model.addEventListener('state-restored', this.stateRestored);
 
 		const activityLog = this.shadowRoot?.querySelector('#activity');
 		if (this.#pageState.get('log') === 'y') {
@@ -479,6 +496,28 @@ export class MainApp extends HTMLElement {
 
 	sendReset() {
 		this.#model.resetBA();
+		this.enableBulkCredits();
+	}
+
+	sendGetState() {
+		// The snapshot frames are bulk messages
+		this.enableBulkCredits();
+		this.#model.getState();
+	}
+
+	stateRestored(evt) {
+		if (!evt.detail.complete) {
+			console.log("State not restored, resetting");
+			this.sendReset();
+		}
+	}
+
+	enableBulkCredits() {
+		// Optional flow control of bulk messages, e.g. ?credits=8
+		const credits = Number.parseInt(this.#pageState.get('credits'));
+		if (credits > 0) {
+			this.#model.enableBulkCredits(credits);
+		}
 	}
 
 	scanStopped() {
@@ -505,6 +544,12 @@ export class MainApp extends HTMLElement {
 		this.#scanSourceButton.disabled = true;
 	}
 
+	sendConnectKnown() {
+		console.log("Clicked Reconnect Known");
+
+		this.#model.connectKnownSinks();
+	}
+
 	sendStopScan() {
 		console.log("Clicked Stop Scan");
 
@@ -8,8 +8,13 @@ import {
 	MessageType,
 	MessageSubType,
 	BT_DataType,
+	BulkSubTypes,
 	ltvToTvArray,
 	tvArrayToLtv,
+	batchToMessages,
+	snapshotToMessages,
+	STATE_SNAPSHOT_VERSION,
+	ScanMode,
 	tvArrayFindItem
 } from '../lib/message.js';
 import { compareTypedArray } from '../lib/helpers.js';
@@ -49,6 +54,14 @@ class AssistantModel extends EventTarget {
 	#service
 	#sinks
 	#sources
+	#bulkCreditWindow
+	#bulkCreditsUsed
+	#traceRecords
+	#traceFrom
+	#snapshotFrame
+	#evtSeq
+	#resyncFrom
+	#heldEvents
 
 	constructor(service) {
 		super();
@@ -56,6 +69,13 @@ class AssistantModel extends EventTarget {
 		this.#service = service;
 		this.#sinks = [];
 		this.#sources = [];
+		this.#bulkCreditWindow = 0;
+		this.#bulkCreditsUsed = 0;
+		this.#traceRecords = null;
+		this.#snapshotFrame = null;
+		this.#evtSeq = {};
+		this.#resyncFrom = null;
+		this.#heldEvents = [];
 
 		this.serviceMessageHandler = this.serviceMessageHandler.bind(this);
 
@@ -66,6 +86,10 @@ class AssistantModel extends EventTarget {
 		this.#service.addEventListener('connected', evt => {
 			console.log('AssistantModel registered Service as connected');
 			this.serviceIsConnected = true;
+			// Numbering continues from wherever the firmware is
+			this.#evtSeq = {};
+			this.#resyncFrom = null;
+			this.#heldEvents = [];
 		});
 		this.#service.addEventListener('disconnected', evt => {
 			console.log('AssistantModel registered Service as disconnected');
@@ -79,9 +103,11 @@ class AssistantModel extends EventTarget {
 		const payloadArray = ltvToTvArray(message.payload);
 		console.log('Payload', payloadArray);
 
-		const heartbeat_cnt = message.seqNo;
+		const count = message.seqNo;
+		// Only sent when the link was idle, any other frame also means alive
+		const health = tvArrayFindItem(payloadArray, [BT_DataType.BT_DATA_HEALTH])?.value;
 
-		this.dispatchEvent(new CustomEvent('heartbeat-received', {detail: heartbeat_cnt}));
+		this.dispatchEvent(new CustomEvent('heartbeat-received', {detail: { count, health }}));
 	}
 
 	addSourceFromBroadcastAudioURI(parsedCode) {
@@ -284,6 +310,10 @@ class AssistantModel extends EventTarget {
 			return;
 		}
 
+		this.setSinkSynced(sink, source, source_id, isSynced);
+	}
+
+	setSinkSynced(sink, source, source_id, isSynced) {
 		let syncState = isSynced ? "selected" : undefined;
 
 		this.#sources.forEach( s => {
@@ -303,6 +333,43 @@ class AssistantModel extends EventTarget {
 		this.dispatchEvent(new CustomEvent('sink-updated', {detail: { sink }}));
 	}
 
+	handleSourceSwitched(message) {
+		console.log(`Handle Source Switched`);
+
+		const payloadArray = ltvToTvArray(message.payload);
+
+		const broadcast_id = tvArrayFindItem(payloadArray, [
+			BT_DataType.BT_DATA_BROADCAST_ID
+		])?.value
+
+		const source = this.#sources.find(i => i.broadcast_id === broadcast_id);
+		if (!source) {
+			console.warn("Unknown source with broadcast ID:", broadcast_id?.toString(16).padStart(6, '0'));
+			return;
+		}
+
+		// Each BT_DATA_SINK_STATUS is followed by the source ID the sink assigned, if any
+		const results = [];
+		payloadArray.forEach(item => {
+			if (item.type === BT_DataType.BT_DATA_SINK_STATUS) {
+				results.push({ ...item.value });
+			} else if (item.type === BT_DataType.BT_DATA_SOURCE_ID && results.length) {
+				results[results.length - 1].source_id = item.value;
+			}
+		});
+
+		results.forEach(({ addr, addrStr, err, source_id }) => {
+			console.log(`Sink ${addrStr} switched: ${err}`);
+
+			const sink = this.#sinks.find(i => compareTypedArray(i.addr.value.addr, addr));
+			if (sink) {
+				this.setSinkSynced(sink, source, source_id, err === 0);
+			}
+		});
+
+		this.dispatchEvent(new CustomEvent('source-switched', {detail: { source, results }}));
+	}
+
 	handleSinkFound(message) {
 		console.log(`Handle found Sink`);
 
@@ -343,6 +410,11 @@ class AssistantModel extends EventTarget {
 			this.dispatchEvent(new CustomEvent('sink-found', {detail: { sink }}));
 		} else {
 			sink.rssi = rssi;
+			// The name may only be in the scan response, reported separately
+			sink.name = sink.name || tvArrayFindItem(payloadArray, [
+				BT_DataType.BT_DATA_NAME_SHORTENED,
+				BT_DataType.BT_DATA_NAME_COMPLETE
+			])?.value;
 			this.dispatchEvent(new CustomEvent('sink-updated', {detail: { sink }}));
 		}
 	}
@@ -589,6 +661,289 @@ class AssistantModel extends EventTarget {
 		}
 	}
 
+	logSinkStatus(message) {
+		const payloadArray = ltvToTvArray(message.payload);
+
+		payloadArray.filter(item => item.type === BT_DataType.BT_DATA_SINK_STATUS)
+		.forEach(item => {
+			const { addrStr, err } = item.value;
+			console.log(`Sink ${addrStr} status: ${err}`);
+		});
+	}
+
+	handleStats(message) {
+		const payloadArray = ltvToTvArray(message.payload);
+
+		const counters = payloadArray.filter(item => item.type === BT_DataType.BT_DATA_STATS_COUNTER)
+		.map(item => item.value);
+		const latencies = payloadArray.filter(item => item.type === BT_DataType.BT_DATA_STATS_LATENCY)
+		.map(item => item.value);
+
+		console.log('Stats', counters, latencies);
+
+		this.dispatchEvent(new CustomEvent('stats', {detail: { counters, latencies }}));
+	}
+
+	handleScanParamsRes(message) {
+		const payloadArray = ltvToTvArray(message.payload);
+
+		const err = tvArrayFindItem(payloadArray, [
+			BT_DataType.BT_DATA_ERROR_CODE
+		])?.value;
+
+		const params = payloadArray.filter(item => item.type === BT_DataType.BT_DATA_SCAN_PARAMS)
+		.map(item => item.value);
+
+		console.log('Scan params', err, params);
+
+		this.dispatchEvent(new CustomEvent('scan-params', {detail: { err, params }}));
+	}
+
+	handleScanFilterRes(message) {
+		const payloadArray = ltvToTvArray(message.payload);
+
+		const err = tvArrayFindItem(payloadArray, [
+			BT_DataType.BT_DATA_ERROR_CODE
+		])?.value;
+
+		console.log('Scan filter', err);
+
+		this.dispatchEvent(new CustomEvent('scan-filter', {detail: { err }}));
+	}
+
+	handleTraceRes(message) {
+		const payloadArray = ltvToTvArray(message.payload);
+
+		const cursor = tvArrayFindItem(payloadArray, [
+			BT_DataType.BT_DATA_TRACE_CURSOR
+		])?.value;
+
+		const records = payloadArray.filter(item => item.type === BT_DataType.BT_DATA_TRACE)
+		.map(item => item.value);
+
+		if (!this.#traceRecords) {
+			// Not started by getTrace(), just pass the records on
+			this.dispatchEvent(new CustomEvent('trace', {detail: { records }}));
+			return;
+		}
+		this.#traceRecords.push(...records);
+
+		// Keep reading until the cursor stops moving, the ring is then drained
+		if (cursor !== undefined && cursor !== this.#traceFrom) {
+			this.#traceFrom = cursor;
+			this.sendGetTrace(cursor);
+			return;
+		}
+
+		console.log('Trace', this.#traceRecords.length, 'records');
+
+		this.dispatchEvent(new CustomEvent('trace', {detail: { records: this.#traceRecords }}));
+		this.#traceRecords = null;
+	}
+
+	handleConnectKnownRes(message) {
+		console.log("Handle Connect Known Res");
+
+		const payloadArray = ltvToTvArray(message.payload);
+
+		const err = tvArrayFindItem(payloadArray, [
+			BT_DataType.BT_DATA_ERROR_CODE
+		])?.value;
+
+		if (err !== 0) {
+			console.log("Error code", err);
+			return;
+		}
+
+		// Known sinks being connected, SINK_CONNECTED follows for each
+		payloadArray.filter(item => item.type === BT_DataType.BT_DATA_SINK_STATUS)
+		.forEach(item => {
+			const { type, addr } = item.value;
+			let sink = this.#sinks.find(i => compareTypedArray(i.addr.value.addr, addr));
+			if (!sink) {
+				sink = {
+					addr: { type: BT_DataType.BT_DATA_IDENTITY, value: { type, addr } },
+					name: "Known device",
+					uuid16s: []
+				}
+				this.#sinks.push(sink);
+				this.dispatchEvent(new CustomEvent('sink-found', {detail: { sink }}));
+			}
+
+			sink.state = "connecting";
+			this.dispatchEvent(new CustomEvent('sink-updated', {detail: { sink }}));
+		});
+
+		// The source last added, if any
+		const broadcast_id = tvArrayFindItem(payloadArray, [
+			BT_DataType.BT_DATA_BROADCAST_ID
+		])?.value;
+		if (broadcast_id !== undefined) {
+			const source = {
+				addr: tvArrayFindItem(payloadArray, [
+					BT_DataType.BT_DATA_IDENTITY,
+					BT_DataType.BT_DATA_RPA
+				]),
+				sid: tvArrayFindItem(payloadArray, [BT_DataType.BT_DATA_SID])?.value,
+				pa_interval: tvArrayFindItem(payloadArray, [BT_DataType.BT_DATA_PA_INTERVAL])?.value,
+				broadcast_id
+			}
+
+			this.dispatchEvent(new CustomEvent('known-source', {detail: { source }}));
+		}
+	}
+
+	hydrateSource(message) {
+		const payloadArray = ltvToTvArray(message.payload);
+
+		const addr = tvArrayFindItem(payloadArray, [
+			BT_DataType.BT_DATA_IDENTITY,
+			BT_DataType.BT_DATA_RPA
+		]);
+
+		if (!addr) {
+			return;
+		}
+
+		const source = {
+			addr,
+			broadcast_name: tvArrayFindItem(payloadArray, [
+				BT_DataType.BT_DATA_BROADCAST_NAME
+			])?.value,
+			broadcast_id: tvArrayFindItem(payloadArray, [
+				BT_DataType.BT_DATA_BROADCAST_ID
+			])?.value,
+			pa_interval: tvArrayFindItem(payloadArray, [
+				BT_DataType.BT_DATA_PA_INTERVAL
+			])?.value,
+			sid: tvArrayFindItem(payloadArray, [
+				BT_DataType.BT_DATA_SID
+			])?.value
+		}
+
+		this.#sources.push(source);
+		this.dispatchEvent(new CustomEvent('source-found', {detail: { source }}));
+	}
+
+	hydrateSink(message) {
+		const payloadArray = ltvToTvArray(message.payload);
+
+		const addr = tvArrayFindItem(payloadArray, [
+			BT_DataType.BT_DATA_IDENTITY,
+			BT_DataType.BT_DATA_RPA
+		]);
+
+		if (!addr) {
+			return;
+		}
+
+		// Names are not kept by the firmware, a later SINK_FOUND does not replace it either
+		const sink = {
+			addr,
+			name: "Known device",
+			uuid16s: [],
+			state: "connected",
+			volume: tvArrayFindItem(payloadArray, [BT_DataType.BT_DATA_VOLUME])?.value,
+			mute: tvArrayFindItem(payloadArray, [BT_DataType.BT_DATA_MUTE])?.value
+		}
+
+		const set_size = tvArrayFindItem(payloadArray, [BT_DataType.BT_DATA_SET_SIZE])?.value;
+		if (set_size !== undefined) {
+			sink.csis = {
+				sirk: tvArrayFindItem(payloadArray, [BT_DataType.BT_DATA_SIRK])?.value,
+				rank: tvArrayFindItem(payloadArray, [BT_DataType.BT_DATA_SET_RANK])?.value,
+				set_size
+			};
+		}
+
+		this.#sinks.push(sink);
+		this.dispatchEvent(new CustomEvent('sink-found', {detail: { sink }}));
+
+		// As after BIS_SYNCED, the sources come first in the snapshot
+		const broadcast_id = tvArrayFindItem(payloadArray, [
+			BT_DataType.BT_DATA_BROADCAST_ID
+		])?.value;
+		const bis_sync = tvArrayFindItem(payloadArray, [
+			BT_DataType.BT_DATA_BIS_SYNC
+		])?.value || [];
+		const source = this.#sources.find(i => i.broadcast_id === broadcast_id);
+
+		if (source && bis_sync.some(bis => bis !== 0 && bis !== 0xFFFFFFFF)) {
+			source.state = "selected";
+			sink.source_added = source;
+			sink.synced_source_id = tvArrayFindItem(payloadArray, [
+				BT_DataType.BT_DATA_SOURCE_ID
+			])?.value;
+			this.dispatchEvent(new CustomEvent('source-updated', {detail: { source }}));
+		}
+
+		this.dispatchEvent(new CustomEvent('sink-updated', {detail: { sink }}));
+	}
+
+	stateRestored(complete) {
+		console.log(`State snapshot ${complete ? 'complete' : 'incomplete'}`,
+			    this.#sinks.length, 'sinks', this.#sources.length, 'sources');
+
+		this.#snapshotFrame = null;
+		this.dispatchEvent(new CustomEvent('state-restored', {detail: { complete }}));
+	}
+
+	handleStateSnapshot(message) {
+		const { info, messages } = snapshotToMessages(message);
+
+		if (this.#snapshotFrame === null) {
+			console.warn("STATE_SNAPSHOT not requested by getState()");
+			return;
+		}
+
+		// Frames are sent in order, a gap means a lost frame
+		if (info?.version !== STATE_SNAPSHOT_VERSION || info.frame !== this.#snapshotFrame) {
+			console.warn('Unexpected snapshot frame', info, this.#snapshotFrame);
+			this.stateRestored(false);
+			return;
+		}
+		this.#snapshotFrame++;
+
+		messages.forEach(m => {
+			switch (m.subType) {
+				case MessageSubType.SOURCE_FOUND:
+				this.hydrateSource(m);
+				break;
+				case MessageSubType.SINK_CONNECTED:
+				this.hydrateSink(m);
+				break;
+				default:
+				console.log(`Unknown snapshot record 0x${m.subType.toString(16)}`);
+			}
+		});
+
+		if (info.last) {
+			this.stateRestored(true);
+		}
+	}
+
+	handleGetStateRes(message) {
+		const payloadArray = ltvToTvArray(message.payload);
+		const err = tvArrayFindItem(payloadArray, [BT_DataType.BT_DATA_ERROR_CODE])?.value;
+		const scanMode = tvArrayFindItem(payloadArray, [BT_DataType.BT_DATA_SCAN_MODE])?.value;
+
+		// The RES may arrive before the last frames, those complete the snapshot
+		if (err !== 0 && this.#snapshotFrame !== null) {
+			console.log("Error code", err);
+			this.stateRestored(false);
+			return;
+		}
+
+		// Scan buttons follow the scan still running on the device
+		if (scanMode & ScanMode.SINK) {
+			this.dispatchEvent(new CustomEvent('sink-scan-started'));
+		} else if (scanMode & ScanMode.SOURCE) {
+			this.dispatchEvent(new CustomEvent('source-scan-started'));
+		} else if (scanMode !== undefined) {
+			this.dispatchEvent(new CustomEvent('scan-stopped'));
+		}
+	}
+
 	handleRES(message) {
 		console.log(`Response message with subType 0x${message.subType.toString(16)}`);
 
@@ -611,10 +966,15 @@ class AssistantModel extends EventTarget {
 			break;
 			case MessageSubType.ADD_SOURCE:
 			console.log('ADD_SOURCE response received');
-			// NOOP/TODO
+			this.logSinkStatus(message);
+			break;
+			case MessageSubType.SWITCH_SOURCE:
+			console.log('SWITCH_SOURCE response received');
+			this.logSinkStatus(message);
 			break;
 			case MessageSubType.BIG_BCODE:
 			console.log('BIG_BCODE response received');
+			this.logSinkStatus(message);
 			this.dispatchEvent(new CustomEvent('scan-stopped'));
 			break;
 			case MessageSubType.RESET:
@@ -625,6 +985,53 @@ class AssistantModel extends EventTarget {
 			console.log('START_SET_MEMBER_SCAN response received');
 			this.handleStartSetMemberScanRes(message);
 			break;
+			case MessageSubType.GRANT_CREDITS:
+			break;
+			case MessageSubType.HEARTBEAT:
+			console.log('HEARTBEAT response received, interval', tvArrayFindItem(
+				ltvToTvArray(message.payload), [BT_DataType.BT_DATA_HEARTBEAT_INTERVAL])?.value);
+			break;
+			case MessageSubType.CONNECT_KNOWN:
+			console.log('CONNECT_KNOWN response received');
+			this.handleConnectKnownRes(message);
+			break;
+			case MessageSubType.FORGET_KNOWN:
+			console.log('FORGET_KNOWN response received');
+			break;
+			case MessageSubType.GET_STATS:
+			console.log('GET_STATS response received');
+			this.handleStats(message);
+			break;
+			case MessageSubType.SET_SCAN_PARAMS:
+			console.log('SET_SCAN_PARAMS response received');
+			this.handleScanParamsRes(message);
+			break;
+			case MessageSubType.SET_SCAN_FILTER:
+			console.log('SET_SCAN_FILTER response received');
+			this.handleScanFilterRes(message);
+			break;
+			case MessageSubType.START_SOURCE_MONITOR:
+			case MessageSubType.STOP_SOURCE_MONITOR:
+			console.log('SOURCE_MONITOR response received', tvArrayFindItem(
+				ltvToTvArray(message.payload), [BT_DataType.BT_DATA_ERROR_CODE])?.value);
+			break;
+			case MessageSubType.GET_TRACE:
+			this.handleTraceRes(message);
+			break;
+			case MessageSubType.GET_STATE:
+			console.log('GET_STATE response received');
+			this.handleGetStateRes(message);
+			break;
+			case MessageSubType.RESYNC_FROM:
+			console.log('RESYNC_FROM response received');
+			this.handleResyncRes(message);
+			break;
+			case MessageSubType.SET_SET_VOLUME:
+			case MessageSubType.SET_SET_MUTE:
+			case MessageSubType.STEP_SET_VOLUME:
+			console.log('Set volume response received');
+			this.logSinkStatus(message);
+			break;
 			default:
 			console.log(`Missing handler for RES subType 0x${message.subType.toString(16)}`);
 		}
@@ -709,6 +1116,19 @@ class AssistantModel extends EventTarget {
 			case MessageSubType.SET_MEMBER_FOUND:
 			console.log('Set member found');
 			this.handleSetMemberFound(message);
+			break;
+			case MessageSubType.STATS:
+			this.handleStats(message);
+			break;
+			case MessageSubType.SCAN_REPORT_BATCH:
+			batchToMessages(message).forEach(m => this.handleEVT(m));
+			break;
+			case MessageSubType.STATE_SNAPSHOT:
+			this.handleStateSnapshot(message);
+			break;
+			case MessageSubType.SOURCE_SWITCHED:
+			this.handleSourceSwitched(message);
+			break;
 			default:
 			console.log(`Missing handler for EVT subType 0x${message.subType.toString(16)}`);
 		}
@@ -732,13 +1152,123 @@ class AssistantModel extends EventTarget {
 			this.handleRES(message);
 			break;
 			case MessageType.EVT:
-			this.handleEVT(message);
+			this.countBulkCredit(message);
+			if (this.sequenceEvent(message)) {
+				this.handleEVT(message);
+			}
 			break;
 			default:
 			console.log(`Could not interpret message with type ${message.type}`);
 		}
 	}
 
+	sequenceEvent(message) {
+		// Heartbeats carry their own count
+		if (message.subType === MessageSubType.HEARTBEAT) {
+			return true;
+		}
+
+		const stream = BulkSubTypes.includes(message.subType) ? 'bulk' : 'control';
+		const expected = this.#evtSeq[stream];
+		const gap = expected === undefined ? 0 : (message.seqNo - expected) & 0xff;
+
+		if (stream === 'bulk') {
+			// Scan reports are repeated anyway, lost ones are only counted
+			if (gap !== 0) {
+				console.warn(`${gap} bulk events lost`);
+				this.dispatchEvent(new CustomEvent('events-lost', {detail: { stream, count: gap }}));
+			}
+			this.#evtSeq.bulk = (message.seqNo + 1) & 0xff;
+			return true;
+		}
+
+		if (this.#resyncFrom !== null) {
+			// Handled in order once the missed events are replayed
+			this.#heldEvents.push({ ...message, payload: message.payload.slice() });
+			return false;
+		}
+
+		if (gap >= 0x80) {
+			console.log(`Event ${message.seqNo} already handled`);
+			return false;
+		}
+
+		if (gap !== 0) {
+			console.warn(`${gap} events lost, resyncing from ${expected}`);
+			this.#resyncFrom = expected;
+			this.#heldEvents.push({ ...message, payload: message.payload.slice() });
+			this.sendResyncFrom(expected);
+			// Not held forever if the RES is lost as well
+			setTimeout(() => {
+				if (this.#resyncFrom === expected) {
+					this.resyncFailed('timeout');
+				}
+			}, 2000);
+			return false;
+		}
+
+		this.#evtSeq.control = (message.seqNo + 1) & 0xff;
+		return true;
+	}
+
+	resyncFailed(reason) {
+		// The missed events are gone, rebuild from the full state instead
+		console.warn(`Resync failed (${reason}), getting state`);
+		this.#resyncFrom = null;
+		this.#heldEvents = [];
+		this.#evtSeq.control = undefined;
+		this.getState();
+	}
+
+	handleResyncRes(message) {
+		const err = tvArrayFindItem(ltvToTvArray(message.payload), [
+			BT_DataType.BT_DATA_ERROR_CODE
+		])?.value;
+
+		const from = this.#resyncFrom;
+		const held = this.#heldEvents;
+
+		this.#resyncFrom = null;
+		this.#heldEvents = [];
+
+		if (from === null) {
+			return;
+		}
+
+		if (err !== 0) {
+			this.resyncFailed(err);
+			return;
+		}
+
+		// Replayed and newer events, in stream order
+		const distance = m => (m.seqNo - from) & 0xff;
+		this.#evtSeq.control = from;
+		held.sort((a, b) => distance(a) - distance(b)).forEach(m => {
+			const gap = (m.seqNo - this.#evtSeq.control) & 0xff;
+			if (gap >= 0x80) {
+				return;
+			}
+			if (gap !== 0) {
+				console.warn(`${gap} events still missing`);
+			}
+			this.#evtSeq.control = (m.seqNo + 1) & 0xff;
+			this.handleEVT(m);
+		});
+	}
+
+	countBulkCredit(message) {
+		if (!this.#bulkCreditWindow || !BulkSubTypes.includes(message.subType)) {
+			return;
+		}
+
+		// Hand the used credits back once half of the window is used
+		this.#bulkCreditsUsed++;
+		if (this.#bulkCreditsUsed >= Math.ceil(this.#bulkCreditWindow / 2)) {
+			this.grantCredits(this.#bulkCreditsUsed);
+			this.#bulkCreditsUsed = 0;
+		}
+	}
+
 	resetBA() {
 		console.log("Sending Reset CMD")
 
@@ -757,14 +1287,49 @@ class AssistantModel extends EventTarget {
 		this.#sources = [];
 	}
 
-	startHeartbeat() {
+	getState() {
+		console.log("Sending Get State CMD")
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.GET_STATE,
+			seqNo: 123,
+			payload: new Uint8Array([])
+		};
+
+		// Rebuilt from the snapshot, see handleStateSnapshot()
+		this.dispatchEvent(new Event('reset'));
+		this.#sinks = [];
+		this.#sources = [];
+		this.#snapshotFrame = 0;
+
+		this.#service.sendCMD(message)
+	}
+
+	sendResyncFrom(seq) {
+		console.log("Sending Resync From CMD", seq);
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.RESYNC_FROM,
+			seqNo: 123,
+			payload: tvArrayToLtv([{ type: BT_DataType.BT_DATA_EVT_SEQ, value: seq }])
+		};
+
+		this.#service.sendCMD(message)
+	}
+
+	// Toggles the heartbeat, or sets its interval in seconds (0 stops it)
+	startHeartbeat(interval) {
 		console.log("Sending Heartbeat CMD")
 
 		const message = {
 			type: Number(MessageType.CMD),
 			subType: MessageSubType.HEARTBEAT,
 			seqNo: 123,
-			payload: new Uint8Array([])
+			payload: interval === undefined ? new Uint8Array([]) : tvArrayToLtv([
+				{ type: BT_DataType.BT_DATA_HEARTBEAT_INTERVAL, value: interval }
+			])
 		};
 
 		this.#service.sendCMD(message)
@@ -811,6 +1376,49 @@ class AssistantModel extends EventTarget {
 	addSource(source) {
 		console.log("Sending Add Source CMD");
 
+		const payload = tvArrayToLtv(this.sourceToTvArr(source));
+
+		console.log('Add Source payload', payload)
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.ADD_SOURCE,
+			seqNo: 123,
+			payload
+		};
+
+		this.#service.sendCMD(message);
+	}
+
+	switchSource(source, broadcastCode) {
+		// The firmware moves all sinks over, and sends SOURCE_SWITCHED once they have settled
+		console.log("Sending Switch Source CMD");
+
+		const tvArr = this.sourceToTvArr(source);
+
+		if (broadcastCode) {
+			tvArr.push({ type: BT_DataType.BT_DATA_BROADCAST_CODE, value: broadcastCode });
+		}
+
+		const payload = tvArrayToLtv(tvArr);
+
+		console.log('Switch Source payload', payload)
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.SWITCH_SOURCE,
+			seqNo: 123,
+			payload
+		};
+
+		this.#service.sendCMD(message);
+	}
+
+	getSyncedSource() {
+		return this.#sinks.find(i => i.source_added)?.source_added;
+	}
+
+	sourceToTvArr(source) {
 		const { addr } = source;
 
 		if (!addr) {
@@ -858,18 +1466,7 @@ class AssistantModel extends EventTarget {
 			console.log("BIS SYNC TO", value);
 		}
 
-		const payload = tvArrayToLtv(tvArr);
-
-		console.log('Add Source payload', payload)
-
-		const message = {
-			type: Number(MessageType.CMD),
-			subType: MessageSubType.ADD_SOURCE,
-			seqNo: 123,
-			payload
-		};
-
-		this.#service.sendCMD(message);
+		return tvArr;
 	}
 
 	getBroadcastCode(message) {
@@ -972,6 +1569,48 @@ class AssistantModel extends EventTarget {
 		this.#service.sendCMD(message);
 	}
 
+	// Keep the source PA synced, BASE and BIGinfo events then follow its changes
+	startSourceMonitor(source) {
+		console.log("Sending Start Source Monitor CMD");
+
+		const { addr } = source;
+
+		if (!addr) {
+			throw Error("Address not found in source object!");
+		}
+
+		const payload = tvArrayToLtv([
+			{ type: BT_DataType.BT_DATA_SID, value: source.sid },
+			{ type: BT_DataType.BT_DATA_PA_INTERVAL, value: source.pa_interval },
+			addr,
+		]);
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.START_SOURCE_MONITOR,
+			seqNo: 123,
+			payload
+		};
+
+		this.#service.sendCMD(message);
+	}
+
+	// Without a source, all monitors are stopped
+	stopSourceMonitor(source) {
+		console.log("Sending Stop Source Monitor CMD");
+
+		const payload = tvArrayToLtv(source?.addr ? [source.addr] : []);
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.STOP_SOURCE_MONITOR,
+			seqNo: 123,
+			payload
+		};
+
+		this.#service.sendCMD(message);
+	}
+
 	connectSink(sink) {
 		console.log("Sending Connect Sink CMD");
 
@@ -1068,6 +1707,47 @@ class AssistantModel extends EventTarget {
 		this.#service.sendCMD(message);
 	}
 
+	sendSetVolumeCMD(sink, subType, tvArr) {
+		const { addr } = sink;
+
+		if (!addr) {
+			throw Error("Address not found in sink object!");
+		}
+
+		// Any member addresses the whole set
+		const payload = tvArrayToLtv([...tvArr, addr]);
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType,
+			seqNo: 123,
+			payload
+		};
+
+		this.#service.sendCMD(message);
+	}
+
+	setSetVolume(sink, volume) {
+		console.log("Set Volume on Set CMD");
+
+		this.sendSetVolumeCMD(sink, MessageSubType.SET_SET_VOLUME,
+			[{ type: BT_DataType.BT_DATA_VOLUME, value: volume }]);
+	}
+
+	setSetMute(sink, state) {
+		console.log("Set Mute/Unmute on Set CMD");
+
+		this.sendSetVolumeCMD(sink, MessageSubType.SET_SET_MUTE,
+			[{ type: BT_DataType.BT_DATA_MUTE, value: state ? 1 : 0 }]);
+	}
+
+	stepSetVolume(sink, step) {
+		console.log("Step Volume on Set CMD");
+
+		this.sendSetVolumeCMD(sink, MessageSubType.STEP_SET_VOLUME,
+			[{ type: BT_DataType.BT_DATA_VOLUME_STEP, value: step }]);
+	}
+
 	handlePrefoundSetMembers(set_size, sirk) {
 		console.log("Connect to already found CSIS set members");
 
@@ -1106,6 +1786,138 @@ class AssistantModel extends EventTarget {
 
 		this.#service.sendCMD(message);
 	}
+
+	connectKnownSinks() {
+		console.log("Sending Connect Known CMD");
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.CONNECT_KNOWN,
+			seqNo: 123,
+			payload: new Uint8Array([])
+		};
+
+		this.#service.sendCMD(message);
+	}
+
+	forgetKnownSinks() {
+		console.log("Sending Forget Known CMD");
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.FORGET_KNOWN,
+			seqNo: 123,
+			payload: new Uint8Array([])
+		};
+
+		// Connected sinks are disconnected as well, SINK_DISCONNECTED follows
+		this.#service.sendCMD(message);
+	}
+
+	grantCredits(credits) {
+		console.log(`Sending Grant Credits CMD (${credits})`);
+
+		const payload = tvArrayToLtv([{ type: BT_DataType.BT_DATA_CREDITS, value: credits }]);
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.GRANT_CREDITS,
+			seqNo: 123,
+			payload
+		};
+
+		this.#service.sendCMD(message);
+	}
+
+	// Flow control of bulk messages (scan reports etc.), window 0 disables it
+	enableBulkCredits(window) {
+		this.#bulkCreditWindow = window;
+		this.#bulkCreditsUsed = 0;
+		this.grantCredits(window);
+	}
+
+	getStats(interval) {
+		console.log("Sending Get Stats CMD");
+
+		// Optional interval (s) of the periodic STATS event, 0 stops it
+		const tvArr = [];
+		if (Number.isInteger(interval)) {
+			tvArr.push({ type: BT_DataType.BT_DATA_STATS_INTERVAL, value: interval });
+		}
+
+		const payload = tvArrayToLtv(tvArr);
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.GET_STATS,
+			seqNo: 123,
+			payload
+		};
+
+		this.#service.sendCMD(message);
+	}
+
+	// params: [{target, flags, fastInterval, fastWindow, fastDuration, interval, window}]
+	// (intervals and windows in 0.625 ms units), none to read the current ones
+	setScanParams(params = []) {
+		console.log("Sending Set Scan Params CMD");
+
+		const payload = tvArrayToLtv(params.map(value => ({
+			type: BT_DataType.BT_DATA_SCAN_PARAMS,
+			value
+		})));
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.SET_SCAN_PARAMS,
+			seqNo: 123,
+			payload
+		};
+
+		this.#service.sendCMD(message);
+	}
+
+	// rules: [{kind, value}] (see ScanFilterKind), none to forward all reports.
+	// Applied in the firmware, before reports are sent over USB
+	setScanFilter(rules = []) {
+		console.log("Sending Set Scan Filter CMD");
+
+		const payload = tvArrayToLtv(rules.map(value => ({
+			type: BT_DataType.BT_DATA_SCAN_FILTER,
+			value
+		})));
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.SET_SCAN_FILTER,
+			seqNo: 123,
+			payload
+		};
+
+		this.#service.sendCMD(message);
+	}
+
+	sendGetTrace(from) {
+		const payload = tvArrayToLtv([{ type: BT_DataType.BT_DATA_TRACE_CURSOR, value: from }]);
+
+		const message = {
+			type: Number(MessageType.CMD),
+			subType: MessageSubType.GET_TRACE,
+			seqNo: 123,
+			payload
+		};
+
+		this.#service.sendCMD(message);
+	}
+
+	// Dump the trace ring of the device, emits 'trace' with all records read
+	getTrace() {
+		console.log("Sending Get Trace CMD");
+
+		this.#traceRecords = [];
+		this.#traceFrom = 0;
+		this.sendGetTrace(0);
+	}
 }
 
 let _instance = null;
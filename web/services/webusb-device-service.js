@@ -4,8 +4,8 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-import { arrayToMsg, msgToArray, MessageType, MessageSubType } from '../lib/message.js';
-import { cobsEncode, cobsDecode } from '../lib/cobs.js';
+import { frameToMsg, msgToArray, MessageType, MessageSubType } from '../lib/message.js';
+import { cobsEncode, CobsFrameDecoder } from '../lib/cobs.js';
 
 /**
 * WebUSB Device Service
@@ -19,9 +19,12 @@ import { cobsEncode, cobsDecode } from '../lib/cobs.js';
 const deviceFilter = { 'vendorId': 0x2fe3, 'productId': 0x00a };
 
 const MAX_BYTES_READ = 4096;
+// IN transfers kept queued, so the endpoint is read while frames are handled
+const RX_TRANSFERS = 4;
 
 export const WebUSBDeviceService = new class extends EventTarget {
 	#device
+	#rxDecoder
 
 	constructor() {
 		super();
@@ -29,6 +32,9 @@ export const WebUSBDeviceService = new class extends EventTarget {
 		this.scan = this.scan.bind(this);
 		this.sendCMD = this.sendCMD.bind(this);
 		this.sendData = this.sendData.bind(this);
+		this.frameReceived = this.frameReceived.bind(this);
+
+		this.#rxDecoder = new CobsFrameDecoder(this.frameReceived);
 
 		navigator.usb.addEventListener("disconnect", (event) => {
 			const { device } = event;
@@ -58,29 +64,58 @@ export const WebUSBDeviceService = new class extends EventTarget {
 		.catch(error => { console.log(error); });
 	}
 
-	readLoop() {
+	frameReceived(frame) {
+		const message = frameToMsg(frame);
+
+		if (!message) {
+			console.warn(`Malformed frame (${frame.length} bytes)`);
+			return;
+		}
+
+		// The payload is a view into the decoder ring, valid while handled
+		this.dispatchEvent(new CustomEvent('message', {detail: { message }}));
+	}
+
+	async readLoop() {
+		const device = this.#device;
 		const {
 			endpointNumber
-		} = this.#device.configuration.interfaces[0].alternate.endpoints[0]
-		this.#device.transferIn(endpointNumber, MAX_BYTES_READ).then(result => {
-			const buf = new Uint8Array(result.data.buffer);
+		} = device.configuration.interfaces[0].alternate.endpoints[0]
+		const transfers = [];
+
+		// Completed in the order queued
+		for (let i = 0; i < RX_TRANSFERS; i++) {
+			transfers.push(device.transferIn(endpointNumber, MAX_BYTES_READ));
+		}
+
+		for (;;) {
+			let result;
+
+			try {
+				result = await transfers.shift();
+			} catch (error) {
+				console.log('error', error);
+				break;
+			}
+			transfers.push(device.transferIn(endpointNumber, MAX_BYTES_READ));
+
+			const buf = new Uint8Array(result.data.buffer, result.data.byteOffset,
+						   result.data.byteLength);
 
 			if (buf.length === 0) {
 				console.log("Probably rebooted. Disconnecting!");
-				this.#device.close();
+				device.close();
+				break;
 			}
 
 			this.dispatchEvent(new CustomEvent('raw-data-received', {detail: { buf }}));
 
-			// decode to message
-			let decoded = cobsDecode(buf, true);
-			const message = arrayToMsg(decoded);
-			this.dispatchEvent(new CustomEvent('message', {detail: { message }}));
+			// Frames may span transfers, and one transfer hold several
+			this.#rxDecoder.push(buf);
+		}
 
-			this.readLoop();
-		}, error => {
-			console.log('error', error);
-		});
+		// The transfers still queued fail as the device goes away
+		transfers.forEach(t => t.catch(() => {}));
 	}
 
 	sendData(data) {
@@ -116,6 +151,7 @@ export const WebUSBDeviceService = new class extends EventTarget {
 		await device.claimInterface(0);
 
 		this.#device = device;
+		this.#rxDecoder.reset();
 
 		this.dispatchEvent(new CustomEvent('connected', { detail: { device }}));
 